@@ -40,7 +40,8 @@ TAddrIA::TAddrIA(const std::string& ifacename, int ifindex, TIAType type, SPtr<T
                  SPtr<TDUID> duid, unsigned long t1, unsigned long t2,unsigned long id)
     :IAID(id),T1(t1),T2(t2), State(STATE_NOTCONFIGURED), 
      Tentative(ADDRSTATUS_UNKNOWN), Timestamp((unsigned long)time(NULL)),
-     Unicast(false), Iface_(ifacename), Ifindex_(ifindex), Type(type)
+     Unicast(false), Iface_(ifacename), Ifindex_(ifindex), fqdnState(FQDNSTATE_NONE),
+     Type(type)
 {
     this->setDUID(duid);
     if (addr)
@@ -541,6 +542,26 @@ SPtr<TFQDN> TAddrIA::getFQDN()
     return this->fqdn;
 }
 
+/** 
+ * stores state of the DNS Update (updates are performed asynchronously)
+ * 
+ * @param state new state
+ */
+void TAddrIA::setFQDNState(enum EFQDNState state)
+{
+    this->fqdnState = state;
+}
+
+/** 
+ * returns state of the DNS Update
+ * 
+ * @return state of the DNS Update
+ */
+enum EFQDNState TAddrIA::getFQDNState()
+{
+    return this->fqdnState;
+}
+
 // --------------------------------------------------------------------
 // --- operators ------------------------------------------------------
 // --------------------------------------------------------------------
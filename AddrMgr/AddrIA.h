@@ -99,6 +99,8 @@ class TAddrIA
     SPtr<TIPv6Addr> getFQDNDnsServer();
     void setFQDN(SPtr<TFQDN> fqdn);
     SPtr<TFQDN> getFQDN();
+    void setFQDNState(enum EFQDNState state);
+    enum EFQDNState getFQDNState();
 
 private:
     List(TAddrAddr) AddrLst;
@@ -124,6 +126,7 @@ private:
 
     SPtr<TIPv6Addr> fqdnDnsServer; // DNS Updates was performed to that server
     SPtr<TFQDN> fqdn;              // this FQDN object was used to perform update
+    enum EFQDNState fqdnState;     // result of that update
 
     TIAType Type; // type of this IA (IA, TA or PD)
 };
@@ -17,9 +17,21 @@
 #include <sstream>
 #include "Portable.h"
 #include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef WIN32
+#include <vector>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "AddrMgr.h"
 #include "AddrClient.h"
 #include "DHCPDefaults.h"
+#include "LeaseJournal.h"
 #include "Logger.h"
 #include "hex.h"
 
@@ -63,6 +75,17 @@ TAddrMgr::TAddrMgr(const std::string& xmlFile, bool loadfile)
  */
 void TAddrMgr::dbLoad(const char * xmlFile)
 {
+    // binary snapshot is much faster to load, use it if it's up to date
+    std::string snapshot = snapshotName(xmlFile);
+    if (snapshotIsCurrent(snapshot, xmlFile)) {
+        Log(Info) << "Loading old address database (" << snapshot
+                  << "), binary snapshot." << LogEnd;
+        if (binaryLoad(snapshot.c_str()))
+            return;
+        Log(Warning) << "Failed to load binary snapshot, trying " << xmlFile
+                     << " instead." << LogEnd;
+    }
+
     Log(Info) << "Loading old address database (" << xmlFile
               << "), using built-in routines." << LogEnd;
 
@@ -71,6 +94,84 @@ void TAddrMgr::dbLoad(const char * xmlFile)
     xmlLoadBuiltIn(xmlFile);
 }
 
+/**
+ * @brief applies lease journal on top of the loaded database
+ *
+ * Journal contains complete state of a client (<AddrClient> block,
+ * the same as in the database file) each time it was changed,
+ * <DelClient> records for removed clients and replay detection
+ * updates. Records are applied in order, so the last state of each
+ * client wins. Truncated last record (e.g. after a crash) is ignored,
+ * previous state of that client is kept.
+ *
+ * @param journalFile filename of the journal
+ *
+ * @return number of applied records
+ */
+int TAddrMgr::journalReplay(const char * journalFile)
+{
+    FILE * f = fopen(journalFile, "r");
+    if (!f)
+        return 0; // no journal, nothing to replay
+
+    int records = 0;
+    char buf[256];
+    while (fgets(buf, 255, f)) {
+        if (strstr(buf, "<AddrClient")) {
+            // Old state of the client is set aside while the new one is
+            // parsed, so its own prefixes are not reported as overlapping.
+            // It is put back if the record is truncated or corrupted.
+            SPtr<TAddrClient> old;
+            long pos = ftell(f);
+            if (fgets(buf, 255, f) && strstr(buf, "<duid") && strstr(buf, "</duid>")) {
+                char * x = strstr(buf, ">") + 1;
+                *strstr(x, "</duid>") = 0;
+                SPtr<TDUID> duid = new TDUID(x);
+                if (old = getClient(duid))
+                    delClient(duid);
+            }
+            fseek(f, pos, SEEK_SET);
+
+            TPrefixTrie prefixes;
+            SPtr<TAddrClient> clnt = parseAddrClient(journalFile, f, prefixes);
+            if (!clnt || !clnt->getDUID()) {
+                if (old)
+                    addClient(old);
+                continue;
+            }
+            if (getClient(clnt->getDUID()))
+                delClient(clnt->getDUID());
+            if (clnt->countIA() + clnt->countTA() + clnt->countPD() > 0)
+                addClient(clnt);
+            records++;
+            continue;
+        }
+        if (strstr(buf, "<DelClient>")) {
+            char * x = strstr(buf, "<DelClient>") + 11;
+            char * end = strstr(x, "</DelClient>");
+            if (!end)
+                continue;
+            *end = 0;
+            SPtr<TDUID> duid = new TDUID(x);
+            if (getClient(duid))
+                delClient(duid);
+            records++;
+            continue;
+        }
+        if (strstr(buf, "<replayDetection>")) {
+            stringstream tmp(strstr(buf, "<replayDetection>") + 17);
+            tmp >> ReplayDetectionValue_;
+            records++;
+            continue;
+        }
+    }
+    fclose(f);
+
+    Log(Info) << "Journal " << journalFile << ": " << records
+              << " record(s) replayed." << LogEnd;
+    return records;
+}
+
 /**
  * @brief stores content of the AddrMgr database to a file
  *
@@ -85,9 +186,543 @@ void TAddrMgr::dump()
     xmlDump.close();
 }
 
+/* ******************************************************************************** */
+/* *** BINARY SNAPSHOT ************************************************************ */
+/* ******************************************************************************** */
+
+/// binary snapshot starts with these 8 bytes
+static const char SNAPSHOT_MAGIC[] = "DIBLEASE";
+
+/// binary snapshot format version, must be increased when layout changes
+#define SNAPSHOT_VERSION 2
+
+// IA flags in binary snapshot
+#define SNAPSHOT_IA_UNICAST   0x01
+#define SNAPSHOT_IA_DNSSERVER 0x02
+#define SNAPSHOT_IA_FQDN      0x04
+#define SNAPSHOT_IA_FQDN_DUID 0x08
+#define SNAPSHOT_IA_FQDN_ADDR 0x10
+#define SNAPSHOT_IA_FQDN_USED 0x20
+
+/// @brief FNV-1a hash of the XML database, identifies it in snapshot header
+static uint64_t hashSource(const char * data, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void putUint8(std::string& buf, uint8_t x) {
+    buf.push_back((char)x);
+}
+
+static void putUint16(std::string& buf, uint16_t x) {
+    char tmp[2];
+    writeUint16(tmp, x);
+    buf.append(tmp, 2);
+}
+
+static void putUint32(std::string& buf, uint32_t x) {
+    char tmp[4];
+    writeUint32(tmp, x);
+    buf.append(tmp, 4);
+}
+
+static void putUint64(std::string& buf, uint64_t x) {
+    char tmp[8];
+    writeUint64(tmp, x);
+    buf.append(tmp, 8);
+}
+
+/// stores up to 64k of data, preceded by its length
+static void putBlob(std::string& buf, const char * data, size_t len) {
+    if (len > 0xffff)
+        len = 0xffff;
+    putUint16(buf, (uint16_t)len);
+    if (len)
+        buf.append(data, len);
+}
+
+static void putDuid(std::string& buf, SPtr<TDUID> duid) {
+    if (duid)
+        putBlob(buf, duid->get(), duid->getLen());
+    else
+        putBlob(buf, NULL, 0);
+}
+
+/// stores IA, TA or PD with all its addresses or prefixes
+static void putIA(std::string& buf, SPtr<TAddrIA> ia, TIAType type) {
+    putUint8(buf, (uint8_t)type);
+    putUint32(buf, ia->getIAID());
+    putUint32(buf, ia->getT1());
+    putUint32(buf, ia->getT2());
+    putUint32(buf, (uint32_t)ia->getIfindex());
+    putUint8(buf, (uint8_t)ia->getState());
+    putBlob(buf, ia->getIfacename().c_str(), ia->getIfacename().size());
+    putDuid(buf, ia->getDUID());
+
+    SPtr<TIPv6Addr> unicast = ia->getSrvAddr();
+    SPtr<TIPv6Addr> dnsSrv = ia->getFQDNDnsServer();
+    SPtr<TFQDN> fqdn = ia->getFQDN();
+    uint8_t flags = 0;
+    if (unicast)
+        flags |= SNAPSHOT_IA_UNICAST;
+    if (dnsSrv)
+        flags |= SNAPSHOT_IA_DNSSERVER;
+    if (fqdn) {
+        flags |= SNAPSHOT_IA_FQDN;
+        if (fqdn->getDuid())
+            flags |= SNAPSHOT_IA_FQDN_DUID;
+        else if (fqdn->getAddr())
+            flags |= SNAPSHOT_IA_FQDN_ADDR;
+        if (fqdn->isUsed())
+            flags |= SNAPSHOT_IA_FQDN_USED;
+    }
+    putUint8(buf, flags);
+    if (unicast)
+        buf.append(unicast->getAddr(), 16);
+    if (dnsSrv)
+        buf.append(dnsSrv->getAddr(), 16);
+    if (fqdn) {
+        if (flags & SNAPSHOT_IA_FQDN_DUID)
+            putDuid(buf, fqdn->getDuid());
+        if (flags & SNAPSHOT_IA_FQDN_ADDR)
+            buf.append(fqdn->getAddr()->getAddr(), 16);
+        std::string name = fqdn->getName();
+        putBlob(buf, name.c_str(), name.size());
+    }
+
+    if (type == IATYPE_PD) {
+        putUint32(buf, ia->countPrefix());
+        SPtr<TAddrPrefix> prefix;
+        ia->firstPrefix();
+        while (prefix = ia->getPrefix()) {
+            buf.append(prefix->get()->getAddr(), 16);
+            putUint32(buf, (uint32_t)prefix->getTimestamp());
+            putUint32(buf, prefix->getPref());
+            putUint32(buf, prefix->getValid());
+            putUint8(buf, (uint8_t)prefix->getLength());
+        }
+    } else {
+        putUint32(buf, ia->countAddr());
+        SPtr<TAddrAddr> addr;
+        ia->firstAddr();
+        while (addr = ia->getAddr()) {
+            buf.append(addr->get()->getAddr(), 16);
+            putUint32(buf, (uint32_t)addr->getTimestamp());
+            putUint32(buf, addr->getPref());
+            putUint32(buf, addr->getValid());
+            putUint8(buf, (uint8_t)addr->getPrefix());
+        }
+    }
+}
+
+/// @brief bounds checked reader of the binary snapshot
+///
+/// Once any read goes past the end of data, reader is marked as failed
+/// and all subsequent reads return zeros.
+class TSnapshotReader {
+public:
+    TSnapshotReader(const char * data, size_t len)
+        :Pos_(data), End_(data + len), Ok_(data != NULL) {
+    }
+    bool ok() const { return Ok_; }
+    bool atEnd() const { return Pos_ == End_; }
+    const char * raw(size_t len) {
+        if (!Ok_ || (size_t)(End_ - Pos_) < len) {
+            Ok_ = false;
+            return NULL;
+        }
+        const char * x = Pos_;
+        Pos_ += len;
+        return x;
+    }
+    uint8_t u8() {
+        const char * x = raw(1);
+        return x ? readUint8(x) : 0;
+    }
+    uint16_t u16() {
+        const char * x = raw(2);
+        return x ? readUint16(x) : 0;
+    }
+    uint32_t u32() {
+        const char * x = raw(4);
+        return x ? readUint32(x) : 0;
+    }
+    uint64_t u64() {
+        const char * x = raw(8);
+        return x ? readUint64(x) : 0;
+    }
+    std::string blob() {
+        uint16_t len = u16();
+        const char * x = raw(len);
+        return x ? std::string(x, len) : std::string();
+    }
+    SPtr<TDUID> duid() {
+        std::string x = blob();
+        if (x.empty())
+            return 0;
+        return new TDUID(x.c_str(), (int)x.size());
+    }
+    SPtr<TIPv6Addr> addr() {
+        const char * x = raw(16);
+        if (!x)
+            return 0;
+        return new TIPv6Addr(x, false);
+    }
+private:
+    const char * Pos_;
+    const char * End_;
+    bool Ok_;
+};
+
+/// @brief read-only content of the whole file (memory mapped, if possible)
+class TMappedFile {
+public:
+    TMappedFile(const char * file)
+        :Data_(NULL), Len_(0) {
+#ifdef WIN32
+        FILE * f = fopen(file, "rb");
+        if (!f)
+            return;
+        char tmp[4096];
+        size_t len;
+        while ((len = fread(tmp, 1, sizeof(tmp), f)) > 0)
+            Buf_.insert(Buf_.end(), tmp, tmp + len);
+        fclose(f);
+        if (!Buf_.empty()) {
+            Data_ = &Buf_[0];
+            Len_ = Buf_.size();
+        }
+#else
+        int fd = open(file, O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (!fstat(fd, &st) && st.st_size > 0) {
+            void * map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                Data_ = (const char*)map;
+                Len_ = (size_t)st.st_size;
+            }
+        }
+        ::close(fd);
+#endif
+    }
+    ~TMappedFile() {
+#ifndef WIN32
+        if (Data_)
+            munmap((void*)Data_, Len_);
+#endif
+    }
+    const char * data() const { return Data_; }
+    size_t size() const { return Len_; }
+private:
+    const char * Data_;
+    size_t Len_;
+#ifdef WIN32
+    std::vector<char> Buf_;
+#endif
+};
+
+/**
+ * @brief returns name of the binary snapshot that accompanies XML database
+ *
+ * @param xmlFile filename of the XML database
+ *
+ * @return filename of the binary snapshot (.xml extension replaced with .bin)
+ */
+std::string TAddrMgr::snapshotName(const std::string& xmlFile)
+{
+    std::string name(xmlFile);
+    if (name.size() > 4 && name.substr(name.size() - 4) == ".xml")
+        name.erase(name.size() - 4);
+    return name + ".bin";
+}
+
+/**
+ * @brief checks if binary snapshot should be loaded instead of XML database
+ *
+ * Snapshot header contains size and hash of the XML file written together
+ * with it. If XML file is different, it was modified by someone else (e.g.
+ * restored from a backup or edited by hand) and has to be loaded instead.
+ * File timestamps are not used, as they are not reliable (copied files,
+ * coarse resolution, clock changes).
+ *
+ * @param snapshot filename of the binary snapshot
+ * @param xmlFile filename of the XML database
+ *
+ * @return true if snapshot exists and XML file is missing or the same
+ */
+bool TAddrMgr::snapshotIsCurrent(const std::string& snapshot, const std::string& xmlFile)
+{
+    TMappedFile bin(snapshot.c_str());
+    TSnapshotReader r(bin.data(), bin.size());
+    const char * magic = r.raw(8);
+    if (!magic || memcmp(magic, SNAPSHOT_MAGIC, 8) || r.u32() != SNAPSHOT_VERSION)
+        return false;
+    uint64_t size = r.u64();
+    uint64_t hash = r.u64();
+    if (!r.ok())
+        return false;
+
+    struct stat xml;
+    if (stat(xmlFile.c_str(), &xml))
+        return true;
+    if ((uint64_t)xml.st_size != size)
+        return false;
+    TMappedFile src(xmlFile.c_str());
+    return hashSource(src.data(), src.size()) == hash;
+}
+
+/**
+ * @brief stores content of the AddrMgr database in binary format
+ *
+ * Snapshot consists of a header (magic, version, size and hash of the
+ * XML database, timestamp, replay detection value and number of clients)
+ * followed by clients. Each
+ * client is its DUID, reconfigure key and list of IAs, TAs and PDs
+ * with their leases. All integers are in network byte order, variable
+ * length fields are preceded by 16-bit length.
+ *
+ * @param file filename of the snapshot
+ * @param xml content of the XML database written with the snapshot (see
+ *        snapshotIsCurrent())
+ *
+ * @return true if snapshot was written
+ */
+bool TAddrMgr::binaryDump(const char * file, const std::string& xml)
+{
+    std::string buf;
+    buf.append(SNAPSHOT_MAGIC, 8);
+    putUint32(buf, SNAPSHOT_VERSION);
+    putUint64(buf, xml.size());
+    putUint64(buf, hashSource(xml.data(), xml.size()));
+    putUint32(buf, (uint32_t)time(NULL));
+    putUint64(buf, ReplayDetectionValue_);
+    putUint32(buf, (uint32_t)ClntsLst.count());
+
+    for (std::list< SPtr<TAddrClient> >::const_iterator cli = ClntsLst.getSTL().begin();
+         cli != ClntsLst.getSTL().end(); ++cli) {
+        SPtr<TAddrClient> client = *cli;
+        putDuid(buf, client->getDUID());
+        if (client->ReconfKey_.empty())
+            putBlob(buf, NULL, 0);
+        else
+            putBlob(buf, (const char*)&client->ReconfKey_[0], client->ReconfKey_.size());
+        putUint16(buf, (uint16_t)(client->countIA() + client->countTA() + client->countPD()));
+
+        SPtr<TAddrIA> ia;
+        client->firstIA();
+        while (ia = client->getIA())
+            putIA(buf, ia, IATYPE_IA);
+        client->firstTA();
+        while (ia = client->getTA())
+            putIA(buf, ia, IATYPE_TA);
+        client->firstPD();
+        while (ia = client->getPD())
+            putIA(buf, ia, IATYPE_PD);
+    }
+
+    return TLeaseJournal::writeFile(file, buf);
+}
+
+/**
+ * @brief loads database from binary snapshot (see binaryDump())
+ *
+ * Snapshot is memory mapped and decoded in place. Leases that no longer
+ * match current configuration are dropped, as in XML loading. Database is
+ * not modified unless whole snapshot is decoded successfully.
+ *
+ * @param file filename of the snapshot
+ *
+ * @return true if snapshot was loaded
+ */
+bool TAddrMgr::binaryLoad(const char * file)
+{
+    TMappedFile map(file);
+    if (!map.data()) {
+        Log(Warning) << "Unable to open " << file << "." << LogEnd;
+        return false;
+    }
+
+    TSnapshotReader r(map.data(), map.size());
+    const char * magic = r.raw(8);
+    if (!magic || memcmp(magic, SNAPSHOT_MAGIC, 8)) {
+        Log(Error) << "File " << file << " is not a lease snapshot." << LogEnd;
+        return false;
+    }
+    uint32_t version = r.u32();
+    if (version != SNAPSHOT_VERSION) {
+        Log(Error) << "Lease snapshot " << file << " has unsupported version "
+                   << version << " (expected " << SNAPSHOT_VERSION << ")." << LogEnd;
+        return false;
+    }
+    r.u64(); // XML database size and hash, see snapshotIsCurrent()
+    r.u64();
+    uint32_t ts = r.u32();
+    uint64_t replayDetection = r.u64();
+    uint32_t clients = r.u32();
+
+    uint32_t now = (uint32_t)time(NULL);
+    Log(Info) << "DB timestamp:" << ts << ", now()=" << now << ", db is " << (now-ts)
+              << " second(s) old." << LogEnd;
+
+    std::vector< SPtr<TAddrClient> > loaded;
+    TPrefixTrie prefixes;
+    unsigned int dropped = 0;
+    for (uint32_t i = 0; i < clients && r.ok(); i++) {
+        SPtr<TDUID> duid = r.duid();
+        std::string reconfKey = r.blob();
+        uint16_t iaCnt = r.u16();
+        if (!duid)
+            break;
+
+        SPtr<TAddrClient> clnt = new TAddrClient(duid);
+        clnt->ReconfKey_.assign(reconfKey.begin(), reconfKey.end());
+
+        for (uint16_t j = 0; j < iaCnt && r.ok(); j++) {
+            TIAType type = static_cast<TIAType>(r.u8());
+            uint32_t iaid = r.u32();
+            uint32_t t1 = r.u32();
+            uint32_t t2 = r.u32();
+            int ifindex = (int)r.u32();
+            uint8_t state = r.u8();
+            std::string ifacename = r.blob();
+            SPtr<TDUID> iaDuid = r.duid();
+            uint8_t flags = r.u8();
+
+            SPtr<TIPv6Addr> unicast;
+            SPtr<TIPv6Addr> dnsSrv;
+            SPtr<TFQDN> fqdn;
+            if (flags & SNAPSHOT_IA_UNICAST)
+                unicast = r.addr();
+            if (flags & SNAPSHOT_IA_DNSSERVER)
+                dnsSrv = r.addr();
+            if (flags & SNAPSHOT_IA_FQDN) {
+                SPtr<TDUID> fqdnDuid;
+                SPtr<TIPv6Addr> fqdnAddr;
+                if (flags & SNAPSHOT_IA_FQDN_DUID)
+                    fqdnDuid = r.duid();
+                if (flags & SNAPSHOT_IA_FQDN_ADDR)
+                    fqdnAddr = r.addr();
+                std::string name = r.blob();
+                bool used = (flags & SNAPSHOT_IA_FQDN_USED) != 0;
+                if (fqdnDuid)
+                    fqdn = new TFQDN(fqdnDuid, name, used);
+                else if (fqdnAddr)
+                    fqdn = new TFQDN(fqdnAddr, name, used);
+                else
+                    fqdn = new TFQDN(name, used);
+            }
+
+            SPtr<TAddrIA> ia = new TAddrIA(ifacename, ifindex, type, unicast, iaDuid,
+                                           t1, t2, iaid);
+            ia->setState(static_cast<EState>(state));
+            if (dnsSrv)
+                ia->setFQDNDnsServer(dnsSrv);
+            if (fqdn)
+                ia->setFQDN(fqdn);
+
+            uint32_t leases = r.u32();
+            for (uint32_t k = 0; k < leases && r.ok(); k++) {
+                SPtr<TIPv6Addr> addr = r.addr();
+                uint32_t timestamp = r.u32();
+                uint32_t pref = r.u32();
+                uint32_t valid = r.u32();
+                int len = r.u8();
+                if (!addr)
+                    break;
+
+                if (type == IATYPE_PD) {
+                    if (prefixes.overlaps(addr, len) || !verifyPrefix(addr)) {
+                        dropped++;
+                        continue;
+                    }
+                    SPtr<TAddrPrefix> prefix = new TAddrPrefix(addr, pref, valid, len);
+                    prefix->setTimestamp(timestamp);
+                    prefix->setTentative(ADDRSTATUS_NO);
+                    ia->addPrefix(prefix);
+                    prefixes.insert(addr, len);
+                } else {
+                    if (!verifyAddr(addr)) {
+                        dropped++;
+                        continue;
+                    }
+                    SPtr<TAddrAddr> lease = new TAddrAddr(addr, pref, valid, len);
+                    lease->setTimestamp(timestamp);
+                    lease->setTentative(ADDRSTATUS_NO);
+                    ia->addAddr(lease);
+                }
+            }
+            ia->setTentative();
+
+            switch (type) {
+            case IATYPE_IA:
+                if (ia->countAddr())
+                    clnt->addIA(ia);
+                break;
+            case IATYPE_TA:
+                if (ia->countAddr())
+                    clnt->addTA(ia);
+                break;
+            case IATYPE_PD:
+                if (ia->countPrefix())
+                    clnt->addPD(ia);
+                break;
+            default:
+                break;
+            }
+        }
+        loaded.push_back(clnt);
+    }
+
+    if (!r.ok() || !r.atEnd() || loaded.size() != clients) {
+        Log(Error) << "Lease snapshot " << file << " is truncated or corrupted." << LogEnd;
+        return false;
+    }
+
+    for (std::vector< SPtr<TAddrClient> >::const_iterator cli = loaded.begin();
+         cli != loaded.end(); ++cli) {
+        if ((*cli)->countIA() + (*cli)->countTA() + (*cli)->countPD() > 0)
+            addClient(*cli);
+    }
+    ReplayDetectionValue_ = replayDetection;
+
+    Log(Info) << "Loaded " << countClient() << " client(s) from " << file;
+    if (dropped)
+        Log(Cont) << ", " << dropped << " lease(s) no longer match configuration and were dropped";
+    Log(Cont) << "." << LogEnd;
+    return true;
+}
+
+/// @brief returns key used in the DUID index
+///
+/// @param duid client DUID
+///
+/// @return DUID in packed form
+std::string TAddrMgr::duidKey(SPtr<TDUID> duid)
+{
+    if (!duid || !duid->getLen())
+        return std::string();
+    return std::string(duid->get(), duid->getLen());
+}
+
 void TAddrMgr::addClient(SPtr<TAddrClient> x)
 {
     ClntsLst.append(x);
+    indexPrefixes(x, true);
+
+    std::string key = duidKey(x->getDUID());
+    if (ClntsIdx_.find(key) != ClntsIdx_.end()) {
+        // lookups by DUID will keep returning the first client added
+        Log(Warning) << "Client with DUID=" << x->getDUID()->getPlain()
+                     << " is already present in addrDB." << LogEnd;
+        return;
+    }
+    ClntsIdx_[key] = --ClntsLst.getSTL().end();
 }
 
 void TAddrMgr::firstClient()
@@ -111,14 +746,10 @@ SPtr<TAddrClient> TAddrMgr::getClient()
  */
 SPtr<TAddrClient> TAddrMgr::getClient(SPtr<TDUID> duid)
 {
-    SPtr<TAddrClient> ptr;
-    ClntsLst.first();
-    while (ptr = ClntsLst.get() )
-    {
-        if ( *(ptr->getDUID()) == (*duid) )
-            return ptr;
-    }
-    return 0;
+    DuidToClientIndex::const_iterator i = ClntsIdx_.find(duidKey(duid));
+    if (i == ClntsIdx_.end())
+        return 0;
+    return *(i->second);
 }
 
 /**
@@ -175,18 +806,17 @@ int TAddrMgr::countClient()
 
 bool TAddrMgr::delClient(SPtr<TDUID> duid)
 {
-    SPtr<TAddrClient> ptr;
-    ClntsLst.first();
+    DuidToClientIndex::iterator i = ClntsIdx_.find(duidKey(duid));
+    if (i == ClntsIdx_.end())
+        return false;
 
-    while ( ptr = ClntsLst.get() )
-    {
-        if  ((*ptr->getDUID())==(*duid))
-        {
-            ClntsLst.del();
-            return true;
-        }
-    }
-    return false;
+    indexPrefixes(*(i->second), false);
+    ClntsLst.getSTL().erase(i->second);
+    ClntsIdx_.erase(i);
+
+    // erase() may have invalidated the list iterator, rewind it (as del() does)
+    ClntsLst.first();
+    return true;
 }
 
 
@@ -343,12 +973,7 @@ bool TAddrMgr::addPrefix(SPtr<TDUID> clntDuid , SPtr<TIPv6Addr> clntAddr, const
                          SPtr<TIPv6Addr> prefix, unsigned long pref, unsigned long valid,
                          int length, bool quiet) {
     // find this client
-    SPtr <TAddrClient> ptrClient;
-    this->firstClient();
-    while ( ptrClient = this->getClient() ) {
-        if ( (*ptrClient->getDUID()) == (*clntDuid) )
-            break;
-    }
+    SPtr <TAddrClient> ptrClient = getClient(clntDuid);
 
     // have we found this client?
     if (!ptrClient) {
@@ -414,6 +1039,7 @@ bool TAddrMgr::addPrefix(SPtr<TAddrClient> client, SPtr<TDUID> duid , SPtr<TIPv6
 
     // add address
     ptrPD->addPrefix(prefix, pref, valid, length);
+    PrefixIdx_.insert(prefix, length);
     if (!quiet)
         Log(Debug) << "PD: Adding " << prefix->getPlain()
                    << " prefix to PD (iaid=" << IAID
@@ -428,12 +1054,7 @@ bool TAddrMgr::updatePrefix(SPtr<TDUID> duid , SPtr<TIPv6Addr> addr, const std::
                             int length, bool quiet)
 {
     // find client...
-    SPtr <TAddrClient> client;
-    this->firstClient();
-    while ( client = this->getClient() ) {
-        if ( (*client->getDUID()) == (*duid) )
-            break;
-    }
+    SPtr <TAddrClient> client = getClient(duid);
     if (!client) {
         Log(Error) << "Unable to update prefix " << prefix->getPlain() << "/" << (int)length << ": DUID=" << duid->getPlain() << " not found." << LogEnd;
         return false;
@@ -501,12 +1122,7 @@ bool TAddrMgr::delPrefix(SPtr<TDUID> clntDuid,
 
     Log(Debug) << "PD: Deleting prefix " << prefix->getPlain() << ", DUID=" << clntDuid->getPlain() << ", iaid=" << IAID << LogEnd;
     // find this client
-    SPtr <TAddrClient> ptrClient;
-    this->firstClient();
-    while ( ptrClient = this->getClient() ) {
-        if ( (*ptrClient->getDUID()) == (*clntDuid) )
-            break;
-    }
+    SPtr <TAddrClient> ptrClient = getClient(clntDuid);
 
     // have we found this client?
     if (!ptrClient) {
@@ -543,6 +1159,7 @@ bool TAddrMgr::delPrefix(SPtr<TDUID> clntDuid,
         return false;
     }
 
+    PrefixIdx_.remove(prefix, ptrPrefix->getLength());
     ptrPD->delPrefix(prefix);
 
     /// @todo: Cache for prefixes this->addCachedAddr(clntDuid, clntAddr);
@@ -567,7 +1184,7 @@ bool TAddrMgr::delPrefix(SPtr<TDUID> clntDuid,
 
 
 /**
- * checks if a specific prefix is used
+ * checks if a specific address is not covered by any delegated prefix
  *
  * @param x
  *
@@ -575,24 +1192,55 @@ bool TAddrMgr::delPrefix(SPtr<TDUID> clntDuid,
  */
 bool TAddrMgr::prefixIsFree(SPtr<TIPv6Addr> x)
 {
-    SPtr<TAddrClient> client;
+    return prefixIsFree(x, 128);
+}
+
+/**
+ * checks if a specific prefix is free, i.e. it does not overlap with
+ * any delegated prefix
+ *
+ * @param x prefix
+ * @param length prefix length
+ *
+ * @return true if prefix is free, false if it is (partially) used
+ */
+bool TAddrMgr::prefixIsFree(SPtr<TIPv6Addr> x, int length)
+{
+    return !PrefixIdx_.overlaps(x, length);
+}
+
+/**
+ * adds (or removes) prefixes held by the client to (from) the prefix index
+ *
+ * @param client client which prefixes should be (un)indexed
+ * @param add true to add prefixes, false to remove them
+ */
+void TAddrMgr::indexPrefixes(SPtr<TAddrClient> client, bool add)
+{
     SPtr<TAddrIA> pd;
+
+    client->firstPD();
+    while (pd = client->getPD())
+        indexPD(pd, add);
+}
+
+/**
+ * adds (or removes) prefixes of a single PD to (from) the prefix index
+ *
+ * @param pd PD which prefixes should be (un)indexed
+ * @param add true to add prefixes, false to remove them
+ */
+void TAddrMgr::indexPD(SPtr<TAddrIA> pd, bool add)
+{
     SPtr<TAddrPrefix> prefix;
 
-    firstClient();
-    while (client = getClient()) {
-              client->firstPD();
-              while (pd = client->getPD()) {
-                  pd->firstPrefix();
-                  while (prefix = pd->getPrefix()) {
-                            if (*prefix->get()==*x)
-                                return false;
-                  }
-              }
-    }
-
-    /* prefix not found, so it's free */
-    return true;
+    pd->firstPrefix();
+    while (prefix = pd->getPrefix()) {
+        if (add)
+            PrefixIdx_.insert(prefix->get(), prefix->getLength());
+        else
+            PrefixIdx_.remove(prefix->get(), prefix->getLength());
+    }
 }
 
 // --------------------------------------------------------------------
@@ -612,6 +1260,7 @@ bool TAddrMgr::xmlLoadBuiltIn(const char * xmlFile)
 {
     SPtr<TAddrClient> clnt;
     bool AddrMgrTag = false;
+    TPrefixTrie prefixes; // loaded so far, including clients not added yet
 
     char buf[256];
 
@@ -647,10 +1296,10 @@ bool TAddrMgr::xmlLoadBuiltIn(const char * xmlFile)
             continue;
         }
         if (AddrMgrTag && strstr(buf,"<AddrClient")) {
-	    clnt = parseAddrClient(xmlFile, f);
+	    clnt = parseAddrClient(xmlFile, f, prefixes);
 	    if (clnt) {
 		if (clnt->countIA() + clnt->countTA() + clnt->countPD() > 0) {
-		    ClntsLst.append(clnt);
+		    addClient(clnt);
 		    Log(Debug) << "Client " << clnt->getDUID()->getPlain()
 			       << " loaded from disk successfuly (" << clnt->countIA()
 			       << "/" << clnt->countPD() << "/" << clnt->countTA()
@@ -684,10 +1333,13 @@ bool TAddrMgr::xmlLoadBuiltIn(const char * xmlFile)
  *
  * @param xmlFile name of the file being currently read
  * @param f file handle
+ * @param prefixes prefixes loaded so far (accepted ones are added)
  *
- * @return pointer to a newly created TAddrClient object
+ * @return pointer to a newly created TAddrClient object (or 0 if the
+ *         section is truncated)
  */
-SPtr<TAddrClient> TAddrMgr::parseAddrClient(const char * xmlFile, FILE *f)
+SPtr<TAddrClient> TAddrMgr::parseAddrClient(const char * xmlFile, FILE *f,
+                                            TPrefixTrie& prefixes)
 {
     char buf[256];
     char * x = 0;
@@ -701,6 +1353,7 @@ SPtr<TAddrClient> TAddrMgr::parseAddrClient(const char * xmlFile, FILE *f)
     SPtr<TIPv6Addr> unicast;
     string ifacename;
     std::vector<uint8_t> reconfKey;
+    bool complete = false;
 
     while (!feof(f)) {
         if (!fgets(buf,255,f)) {
@@ -816,7 +1469,8 @@ SPtr<TAddrClient> TAddrMgr::parseAddrClient(const char * xmlFile, FILE *f)
                     ifacename = string(x + 11, end);
                 }
             }
-            if (ptrpd = parseAddrPD(xmlFile, f, t1, t2, pdid, ifacename, ifindex, unicast)) {
+            if (ptrpd = parseAddrPD(xmlFile, f, t1, t2, pdid, ifacename, ifindex,
+                                     prefixes, unicast)) {
                 if (!ptrpd || !clnt)
                     continue;
 
@@ -832,8 +1486,15 @@ SPtr<TAddrClient> TAddrMgr::parseAddrClient(const char * xmlFile, FILE *f)
                 }
             }
         }
-        if (strstr(buf,"</AddrClient>"))
+        if (strstr(buf,"</AddrClient>")) {
+            complete = true;
             break;
+        }
+    }
+
+    if (!complete) {
+        Log(Error) << "Truncated " << xmlFile << " file: AddrClient is not complete." << LogEnd;
+        return 0;
     }
 
     if (clnt) {
@@ -878,11 +1539,13 @@ SPtr<TAddrIA> TAddrMgr::parseAddrTA(const char * xmlFile, FILE *f) {
  * @param t2 T2 value
  * @param iaid IAID
  * @param iface interface index
+ * @param prefixes prefixes loaded so far (accepted ones are added)
  *
  * @return pointer to newly created TAddrIA object
  */
 SPtr<TAddrIA> TAddrMgr::parseAddrPD(const char * xmlFile, FILE * f, int t1,int t2,
                                     int iaid, const string& ifacename, int ifindex,
+                                    TPrefixTrie& prefixes,
                                     SPtr<TIPv6Addr> unicast /* =0 */) {
     // IA paramteres
     char buf[256];
@@ -919,8 +1582,13 @@ SPtr<TAddrIA> TAddrMgr::parseAddrPD(const char * xmlFile, FILE * f, int t1,int t
         if (strstr(buf,"<AddrPrefix")) {
             pr = parseAddrPrefix(xmlFile, buf, true);
             if (ptrpd && pr) {
-                if (verifyPrefix(pr->get())) {
+                if (prefixes.overlaps(pr->get(), pr->getLength()) ||
+                    !prefixIsFree(pr->get(), pr->getLength())) {
+                    Log(Warning) << "Prefix " << pr->get()->getPlain() << "/" << pr->getLength()
+                                 << " overlaps with already loaded prefix. Lease dropped." << LogEnd;
+                } else if (verifyPrefix(pr->get())) {
                     ptrpd->addPrefix(pr);
+                    prefixes.insert(pr->get(), pr->getLength());
                     pr->setTentative(ADDRSTATUS_NO);
                     //Log(Debug) << "Parsed prefix " << pr->getPlain() << LogEnd;
                 } else {
@@ -14,10 +14,12 @@ class TAddrMgr;
 
 #include <string>
 #include <map>
+#include <list>
 #include "SmartPtr.h"
 #include "Container.h"
 #include "AddrClient.h"
 #include "AddrIA.h"
+#include "PrefixTrie.h"
 
 ///
 /// @brief Address Manager that holds address and prefix information.
@@ -62,7 +64,7 @@ class TAddrMgr
     SPtr<TAddrClient> getClient();
     SPtr<TAddrClient> getClient(SPtr<TDUID> duid);
     SPtr<TAddrClient> getClient(uint32_t SPI);
-    SPtr<TAddrClient> getClient(SPtr<TIPv6Addr> leasedAddr);
+    virtual SPtr<TAddrClient> getClient(SPtr<TIPv6Addr> leasedAddr);
     int countClient();
     bool delClient(SPtr<TDUID> duid);
 
@@ -85,15 +87,23 @@ class TAddrMgr
     virtual bool delPrefix(SPtr<TDUID> clntDuid, unsigned long IAID,
                            SPtr<TIPv6Addr> prefix, bool quiet);
     bool prefixIsFree(SPtr<TIPv6Addr> prefix);
+    bool prefixIsFree(SPtr<TIPv6Addr> prefix, int length);
 
     //--- Time related methods ---
     unsigned long getT1Timeout();
     unsigned long getT2Timeout();
     unsigned long getPrefTimeout();
-    unsigned long getValidTimeout();
+    virtual unsigned long getValidTimeout();
 
     // --- backup/restore ---
     void dbLoad(const char * xmlFile);
+    int journalReplay(const char * journalFile);
+
+    // --- binary snapshot ---
+    bool binaryDump(const char * file, const std::string& xml);
+    bool binaryLoad(const char * file);
+    static std::string snapshotName(const std::string& xmlFile);
+    static bool snapshotIsCurrent(const std::string& snapshot, const std::string& xmlFile);
     virtual void dump();
     bool isDone();
 
@@ -107,13 +117,13 @@ class TAddrMgr
 #else
     // database loading methods that use internal loading routines
     bool xmlLoadBuiltIn(const char * xmlFile);
-    SPtr<TAddrClient> parseAddrClient(const char * xmlFile, FILE *f);
+    SPtr<TAddrClient> parseAddrClient(const char * xmlFile, FILE *f, TPrefixTrie& prefixes);
     SPtr<TAddrIA> parseAddrIA(const char * xmlFile, FILE * f, int t1,int t2,
                               int iaid, const std::string& ifname, int ifindex,
                               SPtr<TIPv6Addr> unicast = 0);
     SPtr<TAddrIA> parseAddrPD(const char * xmlFile, FILE * f, int t1,int t2,
                               int iaid, const std::string& ifname, int ifindex,
-                              SPtr<TIPv6Addr> unicast = 0);
+                              TPrefixTrie& prefixes, SPtr<TIPv6Addr> unicast = 0);
     SPtr<TAddrAddr> parseAddrAddr(const char * xmlFile, char * buf,bool pd);
     SPtr<TAddrPrefix> parseAddrPrefix(const char * xmlFile, char * buf,bool pd);
     SPtr<TAddrIA> parseAddrTA(const char * xmlFile, FILE *f);
@@ -122,6 +132,16 @@ class TAddrMgr
     uint64_t getNextReplayDetectionValue();
 
 protected:
+    /// position of a client within ClntsLst
+    typedef std::list< SPtr<TAddrClient> >::iterator ClientIterator;
+
+    /// holds DUID (packed form) to client mapping, see ClntsIdx_
+    typedef std::map<std::string, ClientIterator> DuidToClientIndex;
+
+    static std::string duidKey(SPtr<TDUID> duid);
+    void indexPrefixes(SPtr<TAddrClient> client, bool add);
+    void indexPD(SPtr<TAddrIA> pd, bool add);
+
     virtual void print(std::ostream & out) = 0;
     bool addPrefix(SPtr<TAddrClient> client, SPtr<TDUID> duid , SPtr<TIPv6Addr> clntAddr,
                    const std::string& ifname, int ifindex, unsigned long IAID,
@@ -136,6 +156,18 @@ protected:
     List(TAddrClient) ClntsLst;
     std::string XmlFile;
 
+    /// @brief index of ClntsLst entries by client DUID
+    ///
+    /// Kept in sync by addClient() and delClient(). Every path that modifies
+    /// the client list must go through those methods.
+    DuidToClientIndex ClntsIdx_;
+
+    /// @brief all delegated prefixes
+    ///
+    /// Updated by addPrefix()/delPrefix() and by addClient()/delClient()
+    /// (for prefixes that client already had).
+    TPrefixTrie PrefixIdx_;
+
     /// should the client without any IA, TA or PDs be deleted? (srv = yes, client = no)
     bool DeleteEmptyClient;
 
@@ -0,0 +1,75 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <limits.h>
+#include "ExpiryQueue.h"
+
+TExpiryQueue::TExpiryQueue() {
+}
+
+/// @brief adds an entry or moves existing one to a new expiration time
+///
+/// @param key entry identifier
+/// @param expires absolute expiration time
+void TExpiryQueue::schedule(const std::string& key, unsigned long expires) {
+    KeyToTime::iterator it = Expires_.find(key);
+    if (it != Expires_.end()) {
+        if (it->second == expires)
+            return;
+        Queue_.erase(std::make_pair(it->second, key));
+        it->second = expires;
+    } else {
+        Expires_.insert(std::make_pair(key, expires));
+    }
+    Queue_.insert(std::make_pair(expires, key));
+}
+
+/// @brief removes an entry
+///
+/// @param key entry identifier
+///
+/// @return true if entry was queued
+bool TExpiryQueue::cancel(const std::string& key) {
+    KeyToTime::iterator it = Expires_.find(key);
+    if (it == Expires_.end())
+        return false;
+    Queue_.erase(std::make_pair(it->second, key));
+    Expires_.erase(it);
+    return true;
+}
+
+/// @brief returns earliest expiration time (or ULONG_MAX if queue is empty)
+unsigned long TExpiryQueue::getNext() const {
+    if (Queue_.empty())
+        return ULONG_MAX;
+    return Queue_.begin()->first;
+}
+
+/// @brief removes all entries that expired at or before specified time
+///
+/// @param now current time
+/// @param keys removed entries are appended here (earliest first)
+void TExpiryQueue::popExpired(unsigned long now, std::vector<std::string>& keys) {
+    while (!Queue_.empty() && Queue_.begin()->first <= now) {
+        keys.push_back(Queue_.begin()->second);
+        Expires_.erase(Queue_.begin()->second);
+        Queue_.erase(Queue_.begin());
+    }
+}
+
+/// @brief returns number of queued entries
+size_t TExpiryQueue::count() const {
+    return Expires_.size();
+}
+
+/// @brief removes all entries
+void TExpiryQueue::clear() {
+    Queue_.clear();
+    Expires_.clear();
+}
@@ -0,0 +1,47 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TExpiryQueue;
+#ifndef EXPIRYQUEUE_H
+#define EXPIRYQUEUE_H
+
+#include <stddef.h>
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+
+/// @brief Priority queue of lease expiration times
+///
+/// Each entry is identified by an opaque key (e.g. packed address) and
+/// holds an absolute expiration time (seconds since epoch). Earliest
+/// expiration is available in constant time and only entries that
+/// actually expired are visited by popExpired(). Scheduling a key that
+/// is already in the queue moves it to the new expiration time.
+class TExpiryQueue
+{
+  public:
+    TExpiryQueue();
+
+    void schedule(const std::string& key, unsigned long expires);
+    bool cancel(const std::string& key);
+    unsigned long getNext() const;
+    void popExpired(unsigned long now, std::vector<std::string>& keys);
+    size_t count() const;
+    void clear();
+
+  private:
+    typedef std::set< std::pair<unsigned long, std::string> > TimeOrder;
+    typedef std::map<std::string, unsigned long> KeyToTime;
+
+    TimeOrder Queue_;   ///< entries sorted by expiration time
+    KeyToTime Expires_; ///< expiration time of every queued key
+};
+
+#endif
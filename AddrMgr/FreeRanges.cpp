@@ -0,0 +1,148 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include "FreeRanges.h"
+
+/// @brief creates set with all leases free
+///
+/// @param size number of leases
+TFreeRanges::TFreeRanges(uint64_t size)
+    :Size_(size), FreeCount_(size) {
+    if (size)
+        Free_[0] = size - 1;
+}
+
+/// @brief returns number of leases
+uint64_t TFreeRanges::size() const {
+    return Size_;
+}
+
+/// @brief returns number of free leases
+uint64_t TFreeRanges::freeCount() const {
+    return FreeCount_;
+}
+
+/// @brief returns number of free extents
+size_t TFreeRanges::countRanges() const {
+    return Free_.size();
+}
+
+/// @brief returns extent that contains specified lease (or end())
+TFreeRanges::Ranges::const_iterator TFreeRanges::find(uint64_t index) const {
+    Ranges::const_iterator it = Free_.upper_bound(index);
+    if (it == Free_.begin())
+        return Free_.end();
+    --it;
+    if (it->second < index)
+        return Free_.end();
+    return it;
+}
+
+/// @brief checks if lease is free
+bool TFreeRanges::isFree(uint64_t index) const {
+    return find(index) != Free_.end();
+}
+
+/// @brief marks lease as used
+///
+/// @param index lease index
+///
+/// @return true if lease was free
+bool TFreeRanges::take(uint64_t index) {
+    Ranges::const_iterator it = find(index);
+    if (it == Free_.end())
+        return false;
+    uint64_t first = it->first;
+    uint64_t last = it->second;
+    Free_.erase(first);
+    if (first < index)
+        Free_[first] = index - 1;
+    if (index < last)
+        Free_[index + 1] = last;
+    FreeCount_--;
+    return true;
+}
+
+/// @brief marks lease as free (merging it with neighbouring extents)
+///
+/// @param index lease index
+///
+/// @return true if lease was used
+bool TFreeRanges::release(uint64_t index) {
+    if (index >= Size_ || isFree(index))
+        return false;
+
+    uint64_t first = index;
+    uint64_t last = index;
+    Ranges::iterator next = Free_.upper_bound(index);
+    if (next != Free_.end() && next->first == index + 1) {
+        last = next->second;
+        Free_.erase(next++);
+    }
+    if (next != Free_.begin()) {
+        Ranges::iterator prev = next;
+        --prev;
+        if (prev->second + 1 == index) {
+            first = prev->first;
+            Free_.erase(prev);
+        }
+    }
+    Free_[first] = last;
+    FreeCount_++;
+    return true;
+}
+
+/// @brief marks all leases in the range as used (e.g. reserved ones)
+///
+/// @param first first lease index
+/// @param last last lease index (inclusive)
+///
+/// @return number of leases that were free
+uint64_t TFreeRanges::takeRange(uint64_t first, uint64_t last) {
+    uint64_t taken = 0;
+    if (first > last)
+        return 0;
+
+    Ranges::iterator it = Free_.upper_bound(first);
+    if (it != Free_.begin()) {
+        --it;
+        if (it->second < first)
+            ++it;
+    }
+    while (it != Free_.end() && it->first <= last) {
+        uint64_t a = it->first;
+        uint64_t b = it->second;
+        Free_.erase(it++);
+        taken += (b < last ? b : last) - (a > first ? a : first) + 1;
+        if (a < first)
+            Free_[a] = first - 1;
+        if (b > last)
+            Free_[last + 1] = b;
+    }
+    FreeCount_ -= taken;
+    return taken;
+}
+
+/// @brief returns first free lease at or after start (wrapping around)
+///
+/// @param start index to start search from
+///
+/// @return index of a free lease, or size() if there are no free leases
+uint64_t TFreeRanges::findFree(uint64_t start) const {
+    if (!FreeCount_)
+        return Size_;
+    if (start >= Size_)
+        start = 0;
+    if (isFree(start))
+        return start;
+    Ranges::const_iterator it = Free_.upper_bound(start);
+    if (it == Free_.end())
+        it = Free_.begin();
+    return it->first;
+}
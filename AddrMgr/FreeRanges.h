@@ -0,0 +1,48 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TFreeRanges;
+#ifndef FREERANGES_H
+#define FREERANGES_H
+
+#include <map>
+#include "Portable.h"
+
+/// @brief Set of free leases, kept as sorted list of free extents
+///
+/// Leases are identified by their index (0..size()-1). Only free extents
+/// are stored, so memory depends on fragmentation, not on the number of
+/// leases. That makes it usable for huge spaces (e.g. all /64 prefixes
+/// in a /32 pool). Every operation takes O(log n), where n is the number
+/// of extents.
+class TFreeRanges
+{
+  public:
+    TFreeRanges(uint64_t size);
+
+    uint64_t size() const;
+    uint64_t freeCount() const;
+    size_t countRanges() const;
+    bool isFree(uint64_t index) const;
+    bool take(uint64_t index);
+    bool release(uint64_t index);
+    uint64_t takeRange(uint64_t first, uint64_t last);
+    uint64_t findFree(uint64_t start) const;
+
+  private:
+    typedef std::map<uint64_t, uint64_t> Ranges; ///< first -> last (inclusive)
+
+    Ranges::const_iterator find(uint64_t index) const;
+
+    Ranges Free_;
+    uint64_t Size_;
+    uint64_t FreeCount_;
+};
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include "LeaseBitmap.h"
+
+/// @brief returns index of the lowest set bit (x must not be 0)
+static unsigned int lowestBit(uint64_t x) {
+#ifdef __GNUC__
+    return __builtin_ctzll(x);
+#else
+    unsigned int bit = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/// @brief creates bitmap with all leases free
+///
+/// @param size number of leases in the pool
+TLeaseBitmap::TLeaseBitmap(size_t size)
+    :Size_(size), Free_(size) {
+    size_t bits = size;
+    do {
+        size_t words = bits ? (bits + 63) / 64 : 1;
+        Level level(words, ~(uint64_t)0);
+        if (bits % 64)
+            level[words - 1] = ((uint64_t)1 << (bits % 64)) - 1;
+        if (!bits)
+            level[0] = 0;
+        Levels_.push_back(level);
+        bits = words;
+    } while (bits > 1);
+}
+
+/// @brief returns number of leases in the pool
+size_t TLeaseBitmap::size() const {
+    return Size_;
+}
+
+/// @brief returns number of free leases
+size_t TLeaseBitmap::freeCount() const {
+    return Free_;
+}
+
+/// @brief checks if lease is free
+///
+/// @param offset lease offset
+bool TLeaseBitmap::isFree(size_t offset) const {
+    if (offset >= Size_)
+        return false;
+    return (Levels_[0][offset / 64] >> (offset % 64)) & 1;
+}
+
+/// @brief marks lease as used
+///
+/// @param offset lease offset
+///
+/// @return true if lease was free
+bool TLeaseBitmap::take(size_t offset) {
+    if (!isFree(offset))
+        return false;
+    set(offset, false);
+    Free_--;
+    return true;
+}
+
+/// @brief marks lease as free
+///
+/// @param offset lease offset
+///
+/// @return true if lease was used
+bool TLeaseBitmap::release(size_t offset) {
+    if (offset >= Size_ || isFree(offset))
+        return false;
+    set(offset, true);
+    Free_++;
+    return true;
+}
+
+/// @brief returns first free lease at or after start (wrapping around)
+///
+/// @param start offset to start search from
+///
+/// @return offset of a free lease, or size() if there are no free leases
+size_t TLeaseBitmap::findFree(size_t start) const {
+    if (!Free_)
+        return Size_;
+    size_t offset = findNext(start < Size_ ? start : 0);
+    if (offset < Size_)
+        return offset;
+    return findNext(0);
+}
+
+void TLeaseBitmap::set(size_t offset, bool free) {
+    for (size_t l = 0; l < Levels_.size(); l++) {
+        uint64_t& word = Levels_[l][offset / 64];
+        uint64_t mask = (uint64_t)1 << (offset % 64);
+        bool wasEmpty = !word;
+        if (free)
+            word |= mask;
+        else
+            word &= ~mask;
+
+        // upper level changes only if this word became (non-)empty
+        if (free ? !wasEmpty : word != 0)
+            return;
+        offset /= 64;
+    }
+}
+
+/// @brief returns first free lease at or after offset (without wrapping)
+size_t TLeaseBitmap::findNext(size_t offset) const {
+    size_t l = 0;
+    size_t idx = offset;
+
+    // go up until a word with a set bit at or after idx is found
+    for (;;) {
+        const Level& level = Levels_[l];
+        size_t word = idx / 64;
+        if (word >= level.size())
+            return Size_;
+        uint64_t bits = level[word] & (~(uint64_t)0 << (idx % 64));
+        if (bits) {
+            idx = word * 64 + lowestBit(bits);
+            break;
+        }
+        if (l + 1 == Levels_.size())
+            return Size_;
+        idx = word + 1;
+        l++;
+    }
+
+    // go down to the first free lease in that subtree
+    while (l > 0) {
+        l--;
+        idx = idx * 64 + lowestBit(Levels_[l][idx]);
+    }
+    return idx;
+}
@@ -0,0 +1,48 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TLeaseBitmap;
+#ifndef LEASEBITMAP_H
+#define LEASEBITMAP_H
+
+#include <stddef.h>
+#include <vector>
+#include "Portable.h"
+
+/// @brief Set of free leases in a pool
+///
+/// Leases are identified by their offset within the pool (0..size()-1).
+/// Bitmap is hierarchical: every bit on a higher level says whether the
+/// corresponding 64-bit word on the level below has any free lease. Finding
+/// a free lease takes O(log64 n), no matter how full the pool is, so
+/// allocation never has to retry.
+class TLeaseBitmap
+{
+  public:
+    TLeaseBitmap(size_t size);
+
+    size_t size() const;
+    size_t freeCount() const;
+    bool isFree(size_t offset) const;
+    bool take(size_t offset);
+    bool release(size_t offset);
+    size_t findFree(size_t start) const;
+
+  private:
+    typedef std::vector<uint64_t> Level;
+
+    void set(size_t offset, bool free);
+    size_t findNext(size_t offset) const;
+
+    std::vector<Level> Levels_; ///< Levels_[0] holds one bit per lease (1 = free)
+    size_t Size_;
+    size_t Free_;
+};
+
+#endif
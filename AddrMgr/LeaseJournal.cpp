@@ -0,0 +1,196 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <limits.h>
+#include <time.h>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "LeaseJournal.h"
+#include "Logger.h"
+
+/// @brief writes all buffered data and syncs the file to disk
+static bool syncFile(FILE * f) {
+    if (fflush(f))
+        return false;
+#ifdef WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+TLeaseJournal::TLeaseJournal()
+    :File_(NULL), Size_(0), Unsynced_(0), FirstUnsynced_(0),
+     SyncRecords_(LEASEJOURNAL_DEFAULT_SYNC_RECORDS),
+     SyncInterval_(LEASEJOURNAL_DEFAULT_SYNC_INTERVAL) {
+}
+
+TLeaseJournal::~TLeaseJournal() {
+    close();
+}
+
+/// @brief opens journal file for appending
+///
+/// @param file journal filename
+/// @param truncate should existing records be discarded?
+///
+/// @return true if journal was opened
+bool TLeaseJournal::open(const std::string& file, bool truncate) {
+    close();
+
+    Name_ = file;
+    File_ = fopen(file.c_str(), truncate ? "wb" : "ab");
+    if (!File_) {
+        Log(Error) << "Journal: Unable to open " << file << " file." << LogEnd;
+        return false;
+    }
+    fseek(File_, 0, SEEK_END);
+    long len = ftell(File_);
+    Size_ = len > 0 ? (size_t)len : 0;
+    Unsynced_ = 0;
+    return true;
+}
+
+/// @brief syncs pending records and closes journal
+void TLeaseJournal::close() {
+    if (!File_)
+        return;
+    if (Unsynced_)
+        syncFile(File_);
+    fclose(File_);
+    File_ = NULL;
+    Unsynced_ = 0;
+}
+
+bool TLeaseJournal::isOpen() const {
+    return File_ != NULL;
+}
+
+const std::string& TLeaseJournal::getFile() const {
+    return Name_;
+}
+
+/// @brief appends a record
+///
+/// Record is buffered. It is written out on next flush() or sync().
+///
+/// @param record record to be appended
+///
+/// @return true if record was accepted
+bool TLeaseJournal::append(const std::string& record) {
+    if (!File_)
+        return false;
+    if (fwrite(record.c_str(), 1, record.size(), File_) != record.size()) {
+        Log(Error) << "Journal: Failed to write to " << Name_ << " file." << LogEnd;
+        return false;
+    }
+    if (!Unsynced_)
+        FirstUnsynced_ = (unsigned long)time(NULL);
+    Unsynced_++;
+    Size_ += record.size();
+    return true;
+}
+
+/// @brief writes out appended records, syncs them if sync is due
+///
+/// @return false if writing failed
+bool TLeaseJournal::flush() {
+    if (!File_)
+        return false;
+    if (!Unsynced_)
+        return true;
+    if (Unsynced_ >= SyncRecords_ || !getSyncTimeout())
+        return sync();
+    return fflush(File_) == 0;
+}
+
+/// @brief writes out appended records and syncs them to disk
+///
+/// @return false if writing failed
+bool TLeaseJournal::sync() {
+    if (!File_)
+        return false;
+    if (!syncFile(File_)) {
+        Log(Error) << "Journal: Failed to sync " << Name_ << " file." << LogEnd;
+        return false;
+    }
+    Unsynced_ = 0;
+    return true;
+}
+
+/// @brief removes all records
+///
+/// @return true if journal was truncated
+bool TLeaseJournal::truncate() {
+    if (!File_)
+        return false;
+    return open(Name_, true);
+}
+
+/// @brief returns journal length (in bytes)
+size_t TLeaseJournal::size() const {
+    return Size_;
+}
+
+/// @brief returns number of seconds until pending records must be synced
+///
+/// @return 0 if sync is due, UINT_MAX if there's nothing to sync
+unsigned long TLeaseJournal::getSyncTimeout() const {
+    if (!File_ || !Unsynced_)
+        return UINT_MAX;
+    unsigned long now = (unsigned long)time(NULL);
+    unsigned long deadline = FirstUnsynced_ + SyncInterval_;
+    return deadline > now ? deadline - now : 0;
+}
+
+/// @brief sets group commit parameters
+///
+/// @param records number of pending records that triggers sync
+/// @param interval maximum time (in seconds) a record may wait for sync
+void TLeaseJournal::setSyncPolicy(unsigned int records, unsigned int interval) {
+    SyncRecords_ = records ? records : 1;
+    SyncInterval_ = interval;
+}
+
+/// @brief atomically replaces file content
+///
+/// Content is written to a temporary file, synced and then renamed,
+/// so the file contains either old or new content, even after a crash.
+///
+/// @param file filename
+/// @param content new file content
+///
+/// @return true if file was written
+bool TLeaseJournal::writeFile(const std::string& file, const std::string& content) {
+    std::string tmp = file + ".tmp";
+    FILE * f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        Log(Error) << "Unable to create " << tmp << " file." << LogEnd;
+        return false;
+    }
+    bool ok = fwrite(content.c_str(), 1, content.size(), f) == content.size();
+    ok = syncFile(f) && ok;
+    fclose(f);
+    if (!ok) {
+        Log(Error) << "Failed to write " << tmp << " file." << LogEnd;
+        remove(tmp.c_str());
+        return false;
+    }
+#ifdef WIN32
+    remove(file.c_str()); // rename does not replace existing files
+#endif
+    if (rename(tmp.c_str(), file.c_str())) {
+        Log(Error) << "Unable to rename " << tmp << " to " << file << "." << LogEnd;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TLeaseJournal;
+#ifndef LEASEJOURNAL_H
+#define LEASEJOURNAL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string>
+
+/// default number of records that forces journal to be synced to disk
+#define LEASEJOURNAL_DEFAULT_SYNC_RECORDS 64
+
+/// default maximum time (in seconds) that a record may stay not synced
+#define LEASEJOURNAL_DEFAULT_SYNC_INTERVAL 1
+
+/// @brief Append-only log of lease database changes
+///
+/// Records are appended to the end of the file and written out (but
+/// not necessarily synced) on every flush(). Calls to fsync() are batched
+/// (group commit): journal is synced when certain number of records is
+/// waiting or when the oldest of them waits for too long. Journal is
+/// expected to be truncated after database snapshot is written.
+///
+/// Journal does not interpret the records. It is up to the user to
+/// make them self-delimiting and to replay them.
+class TLeaseJournal
+{
+  public:
+    TLeaseJournal();
+    ~TLeaseJournal();
+
+    bool open(const std::string& file, bool truncate);
+    void close();
+    bool isOpen() const;
+    const std::string& getFile() const;
+
+    bool append(const std::string& record);
+    bool flush();
+    bool sync();
+    bool truncate();
+
+    size_t size() const;
+    unsigned long getSyncTimeout() const;
+    void setSyncPolicy(unsigned int records, unsigned int interval);
+
+    static bool writeFile(const std::string& file, const std::string& content);
+
+  private:
+    // not copyable
+    TLeaseJournal(const TLeaseJournal&);
+    TLeaseJournal& operator=(const TLeaseJournal&);
+
+    FILE * File_;
+    std::string Name_;
+    size_t Size_;                  ///< journal length (in bytes)
+    unsigned int Unsynced_;        ///< records written since last sync
+    unsigned long FirstUnsynced_;  ///< when the oldest of them was written
+    unsigned int SyncRecords_;
+    unsigned int SyncInterval_;
+};
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <string.h>
+#include "PrefixTrie.h"
+
+/// returns specified bit of the 128 bit key (bit 0 is the most significant one)
+static inline int getBit(const uint8_t * key, int bit) {
+    return (key[bit/8] >> (7 - bit%8)) & 1;
+}
+
+/// returns number of leading bits (up to max) that are the same in both keys
+static int commonBits(const uint8_t * a, const uint8_t * b, int max) {
+    int bits = 0;
+    int i = 0;
+    while (bits < max && a[i] == b[i]) {
+        bits += 8;
+        i++;
+    }
+    if (bits >= max)
+        return max;
+
+    uint8_t diff = a[i] ^ b[i];
+    while (!(diff & 0x80)) {
+        diff <<= 1;
+        bits++;
+    }
+    return bits < max ? bits : max;
+}
+
+TPrefixTrie::TPrefixTrie()
+    :Root_(NULL), Count_(0) {
+}
+
+TPrefixTrie::~TPrefixTrie() {
+    clear();
+}
+
+TPrefixTrie::TNode * TPrefixTrie::newNode(const uint8_t * key, int len, unsigned int refs) {
+    TNode * node = new TNode;
+    memcpy(node->Key, key, 16);
+    node->Len = len;
+    node->Refs = refs;
+    node->Child[0] = node->Child[1] = NULL;
+    return node;
+}
+
+void TPrefixTrie::freeNode(TNode * node) {
+    if (!node)
+        return;
+    freeNode(node->Child[0]);
+    freeNode(node->Child[1]);
+    delete node;
+}
+
+/// @brief converts prefix to a trie key (prefix with host bits cleared)
+///
+/// @param prefix prefix to be converted
+/// @param length prefix length
+/// @param key 16 bytes long buffer for the key
+///
+/// @return false if prefix or its length are invalid
+bool TPrefixTrie::toKey(SPtr<TIPv6Addr> prefix, int length, uint8_t * key) {
+    if (!prefix || length < 0 || length > 128)
+        return false;
+
+    memcpy(key, prefix->getAddr(), 16);
+    if (length % 8)
+        key[length/8] &= (uint8_t)(0xff << (8 - length%8));
+    for (int i = (length + 7)/8; i < 16; i++)
+        key[i] = 0;
+    return true;
+}
+
+/// @brief adds a prefix to the trie
+///
+/// @param prefix prefix to be added
+/// @param length prefix length
+void TPrefixTrie::insert(SPtr<TIPv6Addr> prefix, int length) {
+    uint8_t key[16];
+    if (!toKey(prefix, length, key))
+        return;
+
+    TNode ** link = &Root_;
+    while (*link) {
+        TNode * node = *link;
+        int common = commonBits(node->Key, key, node->Len < length ? node->Len : length);
+
+        if (common == node->Len) {
+            if (node->Len == length) {
+                // the same prefix is already there
+                node->Refs++;
+                Count_++;
+                return;
+            }
+            // node is a less specific prefix, go deeper
+            link = &node->Child[getBit(key, node->Len)];
+            continue;
+        }
+
+        if (common == length) {
+            // new prefix is less specific than node, put it above
+            TNode * added = newNode(key, length, 1);
+            added->Child[getBit(node->Key, length)] = node;
+            *link = added;
+        } else {
+            // prefixes diverge, add a branching node
+            TNode * branch = newNode(key, common, 0);
+            if (common % 8)
+                branch->Key[common/8] &= (uint8_t)(0xff << (8 - common%8));
+            for (int i = (common + 7)/8; i < 16; i++)
+                branch->Key[i] = 0;
+
+            branch->Child[getBit(key, common)] = newNode(key, length, 1);
+            branch->Child[getBit(node->Key, common)] = node;
+            *link = branch;
+        }
+        Count_++;
+        return;
+    }
+
+    *link = newNode(key, length, 1);
+    Count_++;
+}
+
+/// @brief removes a prefix from the trie
+///
+/// @param prefix prefix to be removed
+/// @param length prefix length
+///
+/// @return true if prefix was present
+bool TPrefixTrie::remove(SPtr<TIPv6Addr> prefix, int length) {
+    uint8_t key[16];
+    if (!toKey(prefix, length, key))
+        return false;
+
+    TNode ** parentLink = NULL;
+    TNode ** link = &Root_;
+    while (*link) {
+        TNode * node = *link;
+        if (node->Len > length || commonBits(node->Key, key, node->Len) != node->Len)
+            return false;
+        if (node->Len == length)
+            break;
+        parentLink = link;
+        link = &node->Child[getBit(key, node->Len)];
+    }
+
+    TNode * node = *link;
+    if (!node || !node->Refs)
+        return false;
+
+    Count_--;
+    if (--node->Refs)
+        return true;
+
+    // still needed as a branching node
+    if (node->Child[0] && node->Child[1])
+        return true;
+
+    *link = node->Child[0] ? node->Child[0] : node->Child[1];
+    bool leaf = (*link == NULL);
+    delete node;
+
+    // parent could have been a branching node that now has only one child
+    if (leaf && parentLink) {
+        TNode * parent = *parentLink;
+        if (!parent->Refs) {
+            *parentLink = parent->Child[0] ? parent->Child[0] : parent->Child[1];
+            delete parent;
+        }
+    }
+    return true;
+}
+
+/// @brief checks if exactly this prefix is stored in the trie
+///
+/// @param prefix prefix to be checked
+/// @param length prefix length
+///
+/// @return true if prefix is present
+bool TPrefixTrie::find(SPtr<TIPv6Addr> prefix, int length) const {
+    uint8_t key[16];
+    if (!toKey(prefix, length, key))
+        return false;
+
+    const TNode * node = Root_;
+    while (node) {
+        if (node->Len > length || commonBits(node->Key, key, node->Len) != node->Len)
+            return false;
+        if (node->Len == length)
+            return node->Refs > 0;
+        node = node->Child[getBit(key, node->Len)];
+    }
+    return false;
+}
+
+/// @brief checks if any stored prefix overlaps with specified prefix
+///
+/// Prefixes overlap if one of them contains the other one (this
+/// includes the case of both being the same).
+///
+/// @param prefix prefix to be checked
+/// @param length prefix length
+///
+/// @return true if there is at least one overlapping prefix
+bool TPrefixTrie::overlaps(SPtr<TIPv6Addr> prefix, int length) const {
+    uint8_t key[16];
+    if (!toKey(prefix, length, key))
+        return false;
+
+    const TNode * node = Root_;
+    while (node) {
+        if (node->Len >= length) {
+            // whole subtree is either within the prefix or disjoint with it.
+            // Every node has a prefix below it (branching nodes have 2 children).
+            return commonBits(node->Key, key, length) == length;
+        }
+        if (commonBits(node->Key, key, node->Len) != node->Len)
+            return false;
+        if (node->Refs)
+            return true; // stored prefix contains the checked one
+        node = node->Child[getBit(key, node->Len)];
+    }
+    return false;
+}
+
+/// @brief returns number of stored prefixes (including duplicates)
+size_t TPrefixTrie::count() const {
+    return Count_;
+}
+
+/// @brief removes all prefixes
+void TPrefixTrie::clear() {
+    freeNode(Root_);
+    Root_ = NULL;
+    Count_ = 0;
+}
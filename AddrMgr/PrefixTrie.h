@@ -0,0 +1,61 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TPrefixTrie;
+#ifndef PREFIXTRIE_H
+#define PREFIXTRIE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SmartPtr.h"
+#include "IPv6Addr.h"
+
+/// @brief Path-compressed binary (Patricia) trie of IPv6 prefixes
+///
+/// Stores prefix/length pairs, so it can answer both exact match
+/// ("is 2001:db8:1::/48 delegated?") and overlap ("is any part of
+/// 2001:db8::/32 delegated?") queries in O(128) steps, regardless of
+/// the number of stored prefixes. The same prefix may be inserted more
+/// than once; it is then removed after the same number of remove() calls.
+///
+/// Bits beyond the prefix length are ignored.
+class TPrefixTrie
+{
+  public:
+    TPrefixTrie();
+    ~TPrefixTrie();
+
+    void insert(SPtr<TIPv6Addr> prefix, int length);
+    bool remove(SPtr<TIPv6Addr> prefix, int length);
+    bool find(SPtr<TIPv6Addr> prefix, int length) const;
+    bool overlaps(SPtr<TIPv6Addr> prefix, int length) const;
+    size_t count() const;
+    void clear();
+
+  private:
+    struct TNode {
+        uint8_t Key[16];     ///< prefix (bits beyond Len are zero)
+        int Len;             ///< prefix length
+        unsigned int Refs;   ///< 0 for internal (branching only) nodes
+        TNode * Child[2];
+    };
+
+    // not copyable
+    TPrefixTrie(const TPrefixTrie&);
+    TPrefixTrie& operator=(const TPrefixTrie&);
+
+    static TNode * newNode(const uint8_t * key, int len, unsigned int refs);
+    static void freeNode(TNode * node);
+    static bool toKey(SPtr<TIPv6Addr> prefix, int length, uint8_t * key);
+
+    TNode * Root_;
+    size_t Count_;
+};
+
+#endif
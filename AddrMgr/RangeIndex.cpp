@@ -0,0 +1,171 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include "RangeIndex.h"
+
+const size_t TRangeIndex::NONE;
+
+/// @brief adds one to packed address
+///
+/// @return false if address was ffff:...:ffff (and wrapped to ::)
+static bool incKey(std::string& key) {
+    for (int i = (int)key.size() - 1; i >= 0; i--) {
+        key[i] = (char)((unsigned char)key[i] + 1);
+        if (key[i])
+            return true;
+    }
+    return false;
+}
+
+/// @brief subtracts one from packed address (which must not be ::)
+static void decKey(std::string& key) {
+    for (int i = (int)key.size() - 1; i >= 0; i--) {
+        key[i] = (char)((unsigned char)key[i] - 1);
+        if ((unsigned char)key[i] != 0xff)
+            return;
+    }
+}
+
+TRangeIndex::TRangeIndex()
+    :Dirty_(false) {
+}
+
+/// @brief adds a range
+///
+/// Ranges added earlier take precedence over ranges added later.
+///
+/// @param first first address in range
+/// @param last last address in range
+/// @param owner value returned by find() for addresses in this range
+void TRangeIndex::add(SPtr<TIPv6Addr> first, SPtr<TIPv6Addr> last, size_t owner) {
+    if (!first || !last)
+        return;
+    TRange range;
+    range.First = toKey(first);
+    range.Last = toKey(last);
+    range.Owner = owner;
+    if (range.Last < range.First)
+        return;
+    Ranges_.push_back(range);
+    Dirty_ = true;
+}
+
+/// @brief finds the range that address belongs to
+///
+/// @param addr address to look for
+///
+/// @return owner of the first added range containing address (or NONE)
+size_t TRangeIndex::find(SPtr<TIPv6Addr> addr) {
+    if (!addr)
+        return NONE;
+    if (Dirty_)
+        build();
+
+    TSegment probe;
+    probe.First = toKey(addr);
+    std::vector<TSegment>::const_iterator it =
+        std::upper_bound(Segments_.begin(), Segments_.end(), probe);
+    if (it == Segments_.begin())
+        return NONE;
+    --it;
+    if (it->Last < probe.First)
+        return NONE;
+    return it->Owner;
+}
+
+/// @brief returns number of added ranges
+size_t TRangeIndex::count() const {
+    return Ranges_.size();
+}
+
+/// @brief returns number of disjoint segments that ranges were cut into
+size_t TRangeIndex::countSegments() {
+    if (Dirty_)
+        build();
+    return Segments_.size();
+}
+
+/// @brief removes all ranges
+void TRangeIndex::clear() {
+    Ranges_.clear();
+    Segments_.clear();
+    Dirty_ = false;
+}
+
+/// @brief cuts ranges into disjoint segments
+///
+/// Every segment starts at the first address of some range or just
+/// after the last address of some range. Boundaries are swept in
+/// ascending order, keeping the set of ranges that cover current
+/// segment, so the whole table is built in O(n log n).
+void TRangeIndex::build() {
+    Segments_.clear();
+    Dirty_ = false;
+
+    std::vector<std::string> bounds;
+    std::multimap<std::string, size_t> starts;
+    for (size_t i = 0; i < Ranges_.size(); i++) {
+        bounds.push_back(Ranges_[i].First);
+        std::string next = Ranges_[i].Last;
+        if (incKey(next))
+            bounds.push_back(next);
+        starts.insert(std::make_pair(Ranges_[i].First, i));
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    std::set<size_t> active;                  // covering ranges, by priority
+    std::multimap<std::string, size_t> ends;  // last address -> range
+    std::multimap<std::string, size_t>::iterator start = starts.begin();
+    bool adjacent = false;
+
+    for (size_t i = 0; i < bounds.size(); i++) {
+        const std::string& first = bounds[i];
+        for (; start != starts.end() && start->first <= first; ++start) {
+            active.insert(start->second);
+            ends.insert(std::make_pair(Ranges_[start->second].Last, start->second));
+        }
+        while (!ends.empty() && ends.begin()->first < first) {
+            active.erase(ends.begin()->second);
+            ends.erase(ends.begin());
+        }
+        if (active.empty()) {
+            adjacent = false;
+            continue;
+        }
+
+        std::string last;
+        if (i + 1 < bounds.size()) {
+            last = bounds[i + 1];
+            decKey(last);
+        } else {
+            last = std::string(16, (char)0xff);
+        }
+
+        size_t owner = Ranges_[*active.begin()].Owner;
+        if (adjacent && Segments_.back().Owner == owner) {
+            Segments_.back().Last = last;
+        } else {
+            TSegment seg;
+            seg.First = first;
+            seg.Last = last;
+            seg.Owner = owner;
+            Segments_.push_back(seg);
+        }
+        adjacent = true;
+    }
+}
+
+/// @brief packs address, so string comparison matches address order
+std::string TRangeIndex::toKey(SPtr<TIPv6Addr> addr) {
+    return std::string(addr->getAddr(), 16);
+}
@@ -0,0 +1,65 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TRangeIndex;
+#ifndef RANGEINDEX_H
+#define RANGEINDEX_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "SmartPtr.h"
+#include "IPv6Addr.h"
+
+/// @brief Sorted table of (possibly overlapping) address ranges
+///
+/// Maps 128-bit address ranges to owner identifiers (e.g. position of
+/// a pool on the interface class list). Ranges are cut into disjoint
+/// segments, each of them owned by the first added range that covers
+/// it, so lookup is a binary search that returns the same owner as
+/// checking all ranges in order of their addition would.
+///
+/// Segment table is rebuilt on the first lookup after a range was added.
+class TRangeIndex
+{
+  public:
+    /// returned by find() if address is not in any range
+    static const size_t NONE = (size_t)-1;
+
+    TRangeIndex();
+
+    void add(SPtr<TIPv6Addr> first, SPtr<TIPv6Addr> last, size_t owner);
+    size_t find(SPtr<TIPv6Addr> addr);
+    size_t count() const;
+    size_t countSegments();
+    void clear();
+
+  private:
+    struct TRange {
+        std::string First;   ///< packed first address
+        std::string Last;    ///< packed last address (inclusive)
+        size_t Owner;
+    };
+
+    struct TSegment {
+        std::string First;
+        std::string Last;
+        size_t Owner;
+        bool operator<(const TSegment& other) const { return First < other.First; }
+    };
+
+    void build();
+    static std::string toKey(SPtr<TIPv6Addr> addr);
+
+    std::vector<TRange> Ranges_;      ///< in order of addition (priority)
+    std::vector<TSegment> Segments_;  ///< disjoint, sorted by first address
+    bool Dirty_;
+};
+
+#endif
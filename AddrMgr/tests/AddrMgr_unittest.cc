@@ -2,6 +2,8 @@
 #include <AddrMgr.h>
 #include <gtest/gtest.h>
 #include <DUID.h>
+#include <sstream>
+#include <stdio.h>
 
 namespace test {
 
@@ -16,6 +18,7 @@ namespace test {
             TAddrMgr(addrdb, loadfile) {
 
         }
+        using TAddrMgr::ReplayDetectionValue_;
         virtual void print(std::ostream& s) {
 
         }
@@ -36,6 +39,81 @@ TEST_F(AddrMgrTest, constructor) {
     delete mgr;
 }
 
+// This test checks that clients can be found and deleted by DUID
+TEST_F(AddrMgrTest, getClientByDuid) {
+    NakedAddrMgr * mgr = new NakedAddrMgr("non-existing.xml", false);
+
+    SPtr<TDUID> duid1 = new TDUID("00:01:00:01:17:6c:b5:cf:f4:6d:04:fa:ce:ba:be");
+    SPtr<TDUID> duid2 = new TDUID("00:01:00:01:17:6c:b5:cf:f4:6d:04:fa:ce:ba:bf");
+    SPtr<TDUID> duid3 = new TDUID("00:03:00:01:01:02:03:04:05:06");
+    SPtr<TDUID> unknown = new TDUID("00:03:00:01:ff:ff:ff:ff:ff:ff");
+
+    SPtr<TAddrClient> client1 = new TAddrClient(duid1);
+    SPtr<TAddrClient> client2 = new TAddrClient(duid2);
+    SPtr<TAddrClient> client3 = new TAddrClient(duid3);
+    mgr->addClient(client1);
+    mgr->addClient(client2);
+    mgr->addClient(client3);
+    EXPECT_EQ(3, mgr->countClient());
+
+    // lookup uses DUID content, not the pointer
+    SPtr<TDUID> copy2 = new TDUID(*duid2);
+    EXPECT_TRUE(mgr->getClient(duid1) == client1);
+    EXPECT_TRUE(mgr->getClient(copy2) == client2);
+    EXPECT_TRUE(mgr->getClient(duid3) == client3);
+    EXPECT_FALSE(mgr->getClient(unknown));
+
+    EXPECT_TRUE(mgr->delClient(copy2));
+    EXPECT_FALSE(mgr->delClient(duid2));
+    EXPECT_FALSE(mgr->delClient(unknown));
+    EXPECT_EQ(2, mgr->countClient());
+    EXPECT_FALSE(mgr->getClient(duid2));
+    EXPECT_TRUE(mgr->getClient(duid1) == client1);
+    EXPECT_TRUE(mgr->getClient(duid3) == client3);
+
+    // remaining clients are still listed in the original order
+    mgr->firstClient();
+    EXPECT_TRUE(mgr->getClient() == client1);
+    EXPECT_TRUE(mgr->getClient() == client3);
+    EXPECT_FALSE(mgr->getClient());
+
+    // deleted client can be added again
+    mgr->addClient(client2);
+    EXPECT_TRUE(mgr->getClient(duid2) == client2);
+    EXPECT_EQ(3, mgr->countClient());
+
+    delete mgr;
+}
+
+// This test checks that delegated prefixes are tracked by prefixIsFree()
+TEST_F(AddrMgrTest, prefixIsFree) {
+    NakedAddrMgr * mgr = new NakedAddrMgr("non-existing.xml", false);
+
+    SPtr<TDUID> duid = new TDUID("00:01:00:01:17:6c:b5:cf:f4:6d:04:fa:ce:ba:be");
+    SPtr<TIPv6Addr> clntAddr = new TIPv6Addr("fe80::1", true);
+    SPtr<TIPv6Addr> prefix = new TIPv6Addr("2001:db8:1:100::", true);
+    SPtr<TIPv6Addr> other = new TIPv6Addr("2001:db8:1:200::", true);
+    SPtr<TIPv6Addr> outer = new TIPv6Addr("2001:db8:1::", true);
+
+    EXPECT_TRUE(mgr->prefixIsFree(prefix, 56));
+
+    EXPECT_TRUE(mgr->addPrefix(duid, clntAddr, "eth0", 1, 1, 100, 200, prefix,
+                               300, 400, 56, true));
+    EXPECT_FALSE(mgr->prefixIsFree(prefix, 56));
+    EXPECT_FALSE(mgr->prefixIsFree(prefix));
+    EXPECT_FALSE(mgr->prefixIsFree(outer, 48)); // contains delegated prefix
+    EXPECT_FALSE(mgr->prefixIsFree(prefix, 64)); // within delegated prefix
+    EXPECT_TRUE(mgr->prefixIsFree(other, 56));
+
+    // the last prefix removes the client and its PD
+    EXPECT_TRUE(mgr->delPrefix(duid, 1, prefix, true));
+    EXPECT_EQ(0, mgr->countClient());
+    EXPECT_TRUE(mgr->prefixIsFree(prefix, 56));
+    EXPECT_TRUE(mgr->prefixIsFree(outer, 48));
+
+    delete mgr;
+}
+
 TEST_F(AddrMgrTest, XmlLoadValidDB) {
     TAddrMgr* mgr = new NakedAddrMgr("server-AddrMgr-0.8.3.xml", true);
 
@@ -99,4 +177,164 @@ TEST_F(AddrMgrTest, XmlLoadValidDB) {
     delete mgr;
 }
 
+// checks that overlapping prefixes of the same client are not both loaded
+TEST_F(AddrMgrTest, XmlLoadOverlappingPrefixes) {
+    FILE* f = fopen("addrmgr-overlap.xml", "w");
+    ASSERT_TRUE(f);
+    fprintf(f, "<AddrMgr>\n"
+            "  <AddrClient>\n"
+            "    <duid length=\"15\">00:01:00:01:17:6c:b5:cf:f4:6d:04:fa:ce:ba:be</duid>\n"
+            "    <AddrPD unicast=\"\" T1=\"2000\" T2=\"3000\" IAID=\"1\" state=\"CONFIGURED\" iface=\"2\">\n"
+            "      <duid length=\"15\">00:01:00:01:17:6c:b5:cf:f4:6d:04:fa:ce:ba:be</duid>\n"
+            "      <AddrPrefix timestamp=\"1370685799\" pref=\"8000000\" valid=\"9000000\" "
+            "length=\"48\">2001:db8:1::</AddrPrefix>\n"
+            "    </AddrPD>\n"
+            "    <AddrPD unicast=\"\" T1=\"2000\" T2=\"3000\" IAID=\"2\" state=\"CONFIGURED\" iface=\"2\">\n"
+            "      <duid length=\"15\">00:01:00:01:17:6c:b5:cf:f4:6d:04:fa:ce:ba:be</duid>\n"
+            "      <AddrPrefix timestamp=\"1370685799\" pref=\"8000000\" valid=\"9000000\" "
+            "length=\"56\">2001:db8:1:100::</AddrPrefix>\n"
+            "      <AddrPrefix timestamp=\"1370685799\" pref=\"8000000\" valid=\"9000000\" "
+            "length=\"48\">2001:db8:2::</AddrPrefix>\n"
+            "    </AddrPD>\n"
+            "  </AddrClient>\n"
+            "</AddrMgr>\n");
+    fclose(f);
+    remove("addrmgr-overlap.bin");
+
+    NakedAddrMgr* mgr = new NakedAddrMgr("addrmgr-overlap.xml", true);
+    ASSERT_EQ(1, mgr->countClient());
+    mgr->firstClient();
+    SPtr<TAddrClient> client = mgr->getClient();
+    ASSERT_TRUE(client);
+
+    // 2001:db8:1:100::/56 is within 2001:db8:1::/48 loaded before
+    int prefixes = 0;
+    SPtr<TAddrIA> pd;
+    client->firstPD();
+    while (pd = client->getPD())
+        prefixes += pd->countPrefix();
+    EXPECT_EQ(2, prefixes);
+    EXPECT_FALSE(mgr->prefixIsFree(new TIPv6Addr("2001:db8:1::", true), 48));
+    EXPECT_FALSE(mgr->prefixIsFree(new TIPv6Addr("2001:db8:2::", true), 48));
+
+    delete mgr;
+    remove("addrmgr-overlap.xml");
+    remove("addrmgr-overlap.bin");
+}
+
+// checks that database stored in binary snapshot is the same after loading
+TEST_F(AddrMgrTest, binarySnapshot) {
+    EXPECT_EQ("addrmgr.bin", TAddrMgr::snapshotName("addrmgr.xml"));
+    EXPECT_EQ("addrmgr.db.bin", TAddrMgr::snapshotName("addrmgr.db"));
+
+    NakedAddrMgr* mgr = new NakedAddrMgr("server-AddrMgr-0.8.3.xml", true);
+    ASSERT_EQ(3, mgr->countClient());
+    mgr->ReplayDetectionValue_ = 1234;
+
+    remove("addrmgr-snapshot.bin");
+    ASSERT_TRUE(mgr->binaryDump("addrmgr-snapshot.bin", ""));
+
+    // there is no XML file, so binary snapshot should be used
+    EXPECT_TRUE(TAddrMgr::snapshotIsCurrent("addrmgr-snapshot.bin", "addrmgr-snapshot.xml"));
+    NakedAddrMgr* loaded = new NakedAddrMgr("addrmgr-snapshot.xml", true);
+    EXPECT_EQ(1234u, loaded->ReplayDetectionValue_);
+    ASSERT_EQ(mgr->countClient(), loaded->countClient());
+
+    SPtr<TAddrClient> client;
+    mgr->firstClient();
+    while (client = mgr->getClient()) {
+        SPtr<TAddrClient> other = loaded->getClient(client->getDUID());
+        ASSERT_TRUE(other);
+        std::ostringstream exp, got;
+        exp << *client;
+        got << *other;
+        EXPECT_EQ(exp.str(), got.str());
+    }
+
+    delete loaded;
+    delete mgr;
+    remove("addrmgr-snapshot.bin");
+}
+
+// checks that snapshot is used only with the XML file it was written with
+TEST_F(AddrMgrTest, snapshotIsCurrent) {
+    std::string xml = "<AddrMgr>\n</AddrMgr>\n";
+    NakedAddrMgr* mgr = new NakedAddrMgr("non-existing.xml", false);
+    remove("addrmgr-snapshot.bin");
+    EXPECT_FALSE(TAddrMgr::snapshotIsCurrent("addrmgr-snapshot.bin", "addrmgr-snapshot.xml"));
+    ASSERT_TRUE(mgr->binaryDump("addrmgr-snapshot.bin", xml));
+    delete mgr;
+
+    FILE* f = fopen("addrmgr-snapshot.xml", "w");
+    ASSERT_TRUE(f);
+    fputs(xml.c_str(), f);
+    fclose(f);
+    EXPECT_TRUE(TAddrMgr::snapshotIsCurrent("addrmgr-snapshot.bin", "addrmgr-snapshot.xml"));
+
+    // the same size, different content (timestamps don't matter)
+    f = fopen("addrmgr-snapshot.xml", "w");
+    ASSERT_TRUE(f);
+    fputs("<AddrMgr>\n</AddrMgX>\n", f);
+    fclose(f);
+    EXPECT_FALSE(TAddrMgr::snapshotIsCurrent("addrmgr-snapshot.bin", "addrmgr-snapshot.xml"));
+
+    // different size
+    f = fopen("addrmgr-snapshot.xml", "w");
+    ASSERT_TRUE(f);
+    fputs("<AddrMgr>\n</AddrMgr>\n\n", f);
+    fclose(f);
+    EXPECT_FALSE(TAddrMgr::snapshotIsCurrent("addrmgr-snapshot.bin", "addrmgr-snapshot.xml"));
+
+    // no XML file, snapshot is the only database
+    remove("addrmgr-snapshot.xml");
+    EXPECT_TRUE(TAddrMgr::snapshotIsCurrent("addrmgr-snapshot.bin", "addrmgr-snapshot.xml"));
+
+    // not a snapshot
+    f = fopen("addrmgr-snapshot.bin", "w");
+    ASSERT_TRUE(f);
+    fputs(xml.c_str(), f);
+    fclose(f);
+    EXPECT_FALSE(TAddrMgr::snapshotIsCurrent("addrmgr-snapshot.bin", "addrmgr-snapshot.xml"));
+    remove("addrmgr-snapshot.bin");
+}
+
+// checks that corrupted snapshots are rejected and database is not modified
+TEST_F(AddrMgrTest, binarySnapshotCorrupted) {
+    NakedAddrMgr* mgr = new NakedAddrMgr("server-AddrMgr-0.8.3.xml", true);
+    ASSERT_TRUE(mgr->binaryDump("addrmgr-snapshot.bin", ""));
+    delete mgr;
+
+    FILE* f = fopen("addrmgr-snapshot.bin", "rb");
+    ASSERT_TRUE(f);
+    char buf[4096];
+    size_t len = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    ASSERT_GT(len, 100u);
+
+    // truncated file
+    f = fopen("addrmgr-snapshot.bin", "wb");
+    ASSERT_TRUE(f);
+    fwrite(buf, 1, len - 10, f);
+    fclose(f);
+
+    mgr = new NakedAddrMgr("non-existing.xml", false);
+    EXPECT_FALSE(mgr->binaryLoad("addrmgr-snapshot.bin"));
+    EXPECT_EQ(0, mgr->countClient());
+
+    // not a snapshot at all
+    buf[0] = 'X';
+    f = fopen("addrmgr-snapshot.bin", "wb");
+    ASSERT_TRUE(f);
+    fwrite(buf, 1, len, f);
+    fclose(f);
+    EXPECT_FALSE(mgr->binaryLoad("addrmgr-snapshot.bin"));
+    EXPECT_EQ(0, mgr->countClient());
+
+    // missing file
+    remove("addrmgr-snapshot.bin");
+    EXPECT_FALSE(mgr->binaryLoad("addrmgr-snapshot.bin"));
+
+    delete mgr;
+}
+
 } // end of anonymous namespace
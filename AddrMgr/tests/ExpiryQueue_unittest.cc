@@ -0,0 +1,56 @@
+#include <ExpiryQueue.h>
+#include <gtest/gtest.h>
+#include <limits.h>
+
+namespace test {
+
+TEST(ExpiryQueueTest, order) {
+    TExpiryQueue q;
+    EXPECT_EQ(0u, q.count());
+    EXPECT_EQ(ULONG_MAX, q.getNext());
+
+    q.schedule("c", 300);
+    q.schedule("a", 100);
+    q.schedule("b", 200);
+    q.schedule("b2", 200);
+    EXPECT_EQ(4u, q.count());
+    EXPECT_EQ(100u, q.getNext());
+
+    std::vector<std::string> keys;
+    q.popExpired(99, keys);
+    EXPECT_TRUE(keys.empty());
+
+    q.popExpired(200, keys);
+    ASSERT_EQ(3u, keys.size());
+    EXPECT_EQ("a", keys[0]);
+    EXPECT_EQ(1u, q.count());
+    EXPECT_EQ(300u, q.getNext());
+}
+
+TEST(ExpiryQueueTest, reschedule) {
+    TExpiryQueue q;
+
+    q.schedule("a", 100);
+    q.schedule("b", 200);
+
+    // renewal moves entry, it does not duplicate it
+    q.schedule("a", 500);
+    EXPECT_EQ(2u, q.count());
+    EXPECT_EQ(200u, q.getNext());
+
+    std::vector<std::string> keys;
+    q.popExpired(499, keys);
+    ASSERT_EQ(1u, keys.size());
+    EXPECT_EQ("b", keys[0]);
+
+    EXPECT_TRUE(q.cancel("a"));
+    EXPECT_FALSE(q.cancel("a"));
+    EXPECT_EQ(0u, q.count());
+    EXPECT_EQ(ULONG_MAX, q.getNext());
+
+    q.schedule("x", 1);
+    q.clear();
+    EXPECT_EQ(0u, q.count());
+}
+
+} // end of anonymous namespace
@@ -0,0 +1,85 @@
+#include <FreeRanges.h>
+#include <gtest/gtest.h>
+
+namespace test {
+
+TEST(FreeRangesTest, takeRelease) {
+    TFreeRanges ranges(16);
+    EXPECT_EQ(16u, ranges.size());
+    EXPECT_EQ(16u, ranges.freeCount());
+    EXPECT_EQ(1u, ranges.countRanges());
+
+    EXPECT_TRUE(ranges.take(5));
+    EXPECT_FALSE(ranges.take(5));
+    EXPECT_FALSE(ranges.isFree(5));
+    EXPECT_TRUE(ranges.isFree(4));
+    EXPECT_TRUE(ranges.isFree(6));
+    EXPECT_EQ(2u, ranges.countRanges());
+    EXPECT_EQ(6u, ranges.findFree(5));
+
+    EXPECT_TRUE(ranges.take(0));
+    EXPECT_TRUE(ranges.take(15));
+    EXPECT_EQ(13u, ranges.freeCount());
+    EXPECT_EQ(2u, ranges.countRanges());
+    EXPECT_FALSE(ranges.take(16));
+
+    // released leases are merged with neighbours
+    EXPECT_TRUE(ranges.release(5));
+    EXPECT_FALSE(ranges.release(5));
+    EXPECT_EQ(1u, ranges.countRanges());
+    EXPECT_TRUE(ranges.release(0));
+    EXPECT_TRUE(ranges.release(15));
+    EXPECT_FALSE(ranges.release(16));
+    EXPECT_EQ(1u, ranges.countRanges());
+    EXPECT_EQ(16u, ranges.freeCount());
+}
+
+TEST(FreeRangesTest, takeRange) {
+    TFreeRanges ranges(100);
+    ranges.take(10);
+    ranges.take(20);
+
+    // 10 and 20 are already used
+    EXPECT_EQ(19u, ranges.takeRange(5, 25));
+    EXPECT_EQ(79u, ranges.freeCount());
+    EXPECT_TRUE(ranges.isFree(4));
+    EXPECT_FALSE(ranges.isFree(5));
+    EXPECT_FALSE(ranges.isFree(25));
+    EXPECT_TRUE(ranges.isFree(26));
+    EXPECT_EQ(2u, ranges.countRanges());
+    EXPECT_EQ(0u, ranges.takeRange(5, 25));
+    EXPECT_EQ(26u, ranges.findFree(7));
+
+    EXPECT_EQ(79u, ranges.takeRange(0, 1000));
+    EXPECT_EQ(0u, ranges.freeCount());
+    EXPECT_EQ(100u, ranges.findFree(0));
+}
+
+TEST(FreeRangesTest, findFree) {
+    TFreeRanges ranges(1000);
+    EXPECT_EQ(0u, ranges.takeRange(1000, 2000));
+    EXPECT_EQ(999u, ranges.takeRange(1, 999));
+    EXPECT_EQ(0u, ranges.findFree(500)); // wraps around
+    EXPECT_EQ(0u, ranges.findFree(5000));
+    EXPECT_TRUE(ranges.take(0));
+    EXPECT_EQ(1000u, ranges.findFree(0));
+
+    EXPECT_TRUE(ranges.release(700));
+    EXPECT_EQ(700u, ranges.findFree(0));
+    EXPECT_EQ(700u, ranges.findFree(701));
+}
+
+// all /64 prefixes in a /8 pool
+TEST(FreeRangesTest, huge) {
+    const uint64_t size = (uint64_t)1 << 56;
+    TFreeRanges ranges(size);
+    EXPECT_TRUE(ranges.take(size - 1));
+    EXPECT_TRUE(ranges.take(12345678901ull));
+    EXPECT_EQ(size - 2, ranges.freeCount());
+    EXPECT_EQ(12345678902ull, ranges.findFree(12345678901ull));
+    EXPECT_EQ(0u, ranges.findFree(size - 1));
+    EXPECT_TRUE(ranges.release(size - 1));
+    EXPECT_EQ(size - 1, ranges.findFree(size - 1));
+}
+
+} // end of anonymous namespace
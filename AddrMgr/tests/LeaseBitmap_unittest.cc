@@ -0,0 +1,79 @@
+#include <LeaseBitmap.h>
+#include <gtest/gtest.h>
+
+namespace test {
+
+TEST(LeaseBitmapTest, basic) {
+    TLeaseBitmap bitmap(100);
+    EXPECT_EQ(100u, bitmap.size());
+    EXPECT_EQ(100u, bitmap.freeCount());
+    EXPECT_TRUE(bitmap.isFree(0));
+    EXPECT_TRUE(bitmap.isFree(99));
+    EXPECT_FALSE(bitmap.isFree(100));
+
+    EXPECT_EQ(10u, bitmap.findFree(10));
+    EXPECT_TRUE(bitmap.take(10));
+    EXPECT_FALSE(bitmap.take(10));
+    EXPECT_FALSE(bitmap.isFree(10));
+    EXPECT_EQ(99u, bitmap.freeCount());
+    EXPECT_EQ(11u, bitmap.findFree(10));
+
+    EXPECT_TRUE(bitmap.release(10));
+    EXPECT_FALSE(bitmap.release(10));
+    EXPECT_FALSE(bitmap.release(100));
+    EXPECT_EQ(100u, bitmap.freeCount());
+    EXPECT_EQ(10u, bitmap.findFree(10));
+}
+
+TEST(LeaseBitmapTest, wrapAround) {
+    TLeaseBitmap bitmap(200);
+    for (size_t i = 0; i < 200; i++) {
+        if (i != 5) {
+            EXPECT_TRUE(bitmap.take(i));
+        }
+    }
+    EXPECT_EQ(1u, bitmap.freeCount());
+
+    // search continues from the beginning of the pool
+    EXPECT_EQ(5u, bitmap.findFree(150));
+    EXPECT_EQ(5u, bitmap.findFree(5));
+    EXPECT_EQ(5u, bitmap.findFree(1000));
+
+    EXPECT_TRUE(bitmap.take(5));
+    EXPECT_EQ(200u, bitmap.findFree(0));
+    EXPECT_EQ(200u, bitmap.findFree(150));
+}
+
+TEST(LeaseBitmapTest, empty) {
+    TLeaseBitmap bitmap(0);
+    EXPECT_EQ(0u, bitmap.freeCount());
+    EXPECT_EQ(0u, bitmap.findFree(0));
+    EXPECT_FALSE(bitmap.take(0));
+    EXPECT_FALSE(bitmap.release(0));
+}
+
+// fills large bitmap up to the last lease, checking every allocation
+TEST(LeaseBitmapTest, exhaust) {
+    const size_t size = 300000;
+    TLeaseBitmap bitmap(size);
+
+    size_t start = 12345;
+    for (size_t i = 0; i < size; i++) {
+        size_t offset = bitmap.findFree(start);
+        ASSERT_LT(offset, size);
+        ASSERT_TRUE(bitmap.take(offset));
+        start = (start * 7919 + 17) % size;
+    }
+    EXPECT_EQ(0u, bitmap.freeCount());
+    EXPECT_EQ(size, bitmap.findFree(0));
+
+    // a single released lease is found from anywhere
+    EXPECT_TRUE(bitmap.release(size - 1));
+    EXPECT_EQ(size - 1, bitmap.findFree(0));
+    EXPECT_EQ(size - 1, bitmap.findFree(size - 1));
+    EXPECT_TRUE(bitmap.release(64 * 64));
+    EXPECT_EQ(64u * 64u, bitmap.findFree(0));
+    EXPECT_EQ(size - 1, bitmap.findFree(64 * 64 + 1));
+}
+
+} // end of anonymous namespace
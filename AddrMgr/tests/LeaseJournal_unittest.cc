@@ -0,0 +1,62 @@
+#include <LeaseJournal.h>
+#include <gtest/gtest.h>
+#include <limits.h>
+#include <fstream>
+#include <sstream>
+
+namespace test {
+
+    std::string readFile(const char* file) {
+        std::ifstream f(file);
+        std::stringstream content;
+        content << f.rdbuf();
+        return content.str();
+    }
+
+TEST(LeaseJournalTest, append) {
+    TLeaseJournal journal;
+    EXPECT_FALSE(journal.isOpen());
+    EXPECT_FALSE(journal.append("x"));
+
+    ASSERT_TRUE(journal.open("journal-test.log", true));
+    EXPECT_EQ(0u, journal.size());
+    EXPECT_EQ(UINT_MAX, journal.getSyncTimeout());
+
+    journal.setSyncPolicy(3, 60);
+    EXPECT_TRUE(journal.append("first\n"));
+    EXPECT_TRUE(journal.append("second\n"));
+    EXPECT_EQ(13u, journal.size());
+
+    // not enough records to force sync, but data is written out
+    EXPECT_TRUE(journal.flush());
+    EXPECT_NE(UINT_MAX, journal.getSyncTimeout());
+    EXPECT_EQ("first\nsecond\n", readFile("journal-test.log"));
+
+    EXPECT_TRUE(journal.append("third\n"));
+    EXPECT_TRUE(journal.flush());
+    EXPECT_EQ(UINT_MAX, journal.getSyncTimeout());
+
+    // reopening keeps existing records
+    journal.close();
+    ASSERT_TRUE(journal.open("journal-test.log", false));
+    EXPECT_EQ(19u, journal.size());
+    EXPECT_TRUE(journal.append("fourth\n"));
+    EXPECT_TRUE(journal.sync());
+    EXPECT_EQ("first\nsecond\nthird\nfourth\n", readFile("journal-test.log"));
+
+    EXPECT_TRUE(journal.truncate());
+    EXPECT_EQ(0u, journal.size());
+    EXPECT_EQ("", readFile("journal-test.log"));
+    journal.close();
+    unlink("journal-test.log");
+}
+
+TEST(LeaseJournalTest, writeFile) {
+    EXPECT_TRUE(TLeaseJournal::writeFile("journal-test.xml", "<old/>\n"));
+    EXPECT_TRUE(TLeaseJournal::writeFile("journal-test.xml", "<new/>\n"));
+    EXPECT_EQ("<new/>\n", readFile("journal-test.xml"));
+    EXPECT_EQ("", readFile("journal-test.xml.tmp"));
+    unlink("journal-test.xml");
+}
+
+} // end of anonymous namespace
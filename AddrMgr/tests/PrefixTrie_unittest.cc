@@ -0,0 +1,136 @@
+#include <IPv6Addr.h>
+#include <PrefixTrie.h>
+#include <SmartPtr.h>
+#include <gtest/gtest.h>
+
+namespace test {
+
+    class PrefixTrieTest : public ::testing::Test {
+    public:
+        PrefixTrieTest() { }
+
+        SPtr<TIPv6Addr> addr(const char* txt) {
+            return new TIPv6Addr(txt, true);
+        }
+    };
+
+TEST_F(PrefixTrieTest, exactMatch) {
+    TPrefixTrie trie;
+    EXPECT_EQ(0u, trie.count());
+    EXPECT_FALSE(trie.find(addr("2001:db8::"), 32));
+
+    trie.insert(addr("2001:db8:1::"), 48);
+    trie.insert(addr("2001:db8:2::"), 48);
+    trie.insert(addr("2001:db8:2:100::"), 56);
+    EXPECT_EQ(3u, trie.count());
+
+    EXPECT_TRUE(trie.find(addr("2001:db8:1::"), 48));
+    EXPECT_TRUE(trie.find(addr("2001:db8:2::"), 48));
+    EXPECT_TRUE(trie.find(addr("2001:db8:2:100::"), 56));
+
+    // host bits are ignored
+    EXPECT_TRUE(trie.find(addr("2001:db8:1::1"), 48));
+
+    // different length is not an exact match
+    EXPECT_FALSE(trie.find(addr("2001:db8:1::"), 56));
+    EXPECT_FALSE(trie.find(addr("2001:db8::"), 32));
+    EXPECT_FALSE(trie.find(addr("2001:db8:3::"), 48));
+}
+
+TEST_F(PrefixTrieTest, overlaps) {
+    TPrefixTrie trie;
+    EXPECT_FALSE(trie.overlaps(addr("::"), 0));
+
+    trie.insert(addr("2001:db8:1::"), 48);
+    trie.insert(addr("2001:db8:2:100::"), 56);
+
+    // the same prefix
+    EXPECT_TRUE(trie.overlaps(addr("2001:db8:1::"), 48));
+
+    // less specific prefix containing stored prefixes
+    EXPECT_TRUE(trie.overlaps(addr("2001:db8::"), 32));
+    EXPECT_TRUE(trie.overlaps(addr("2001:db8:2::"), 48));
+    EXPECT_TRUE(trie.overlaps(addr("::"), 0));
+
+    // more specific prefix within stored prefix
+    EXPECT_TRUE(trie.overlaps(addr("2001:db8:1:ff00::"), 56));
+    EXPECT_TRUE(trie.overlaps(addr("2001:db8:1::1"), 128));
+    EXPECT_TRUE(trie.overlaps(addr("2001:db8:2:1ff::"), 64));
+
+    // disjoint prefixes
+    EXPECT_FALSE(trie.overlaps(addr("2001:db8:3::"), 48));
+    EXPECT_FALSE(trie.overlaps(addr("2001:db8:2:200::"), 56));
+    EXPECT_FALSE(trie.overlaps(addr("2001:db9::"), 32));
+    EXPECT_FALSE(trie.overlaps(addr("2001:db8:2::"), 56));
+}
+
+TEST_F(PrefixTrieTest, remove) {
+    TPrefixTrie trie;
+
+    trie.insert(addr("2001:db8:1::"), 48);
+    trie.insert(addr("2001:db8:1::"), 48); // duplicate
+    trie.insert(addr("2001:db8:1:100::"), 56);
+    trie.insert(addr("2001:db8:1:200::"), 56);
+    trie.insert(addr("2001:db8:8000::"), 48);
+    EXPECT_EQ(5u, trie.count());
+
+    // not present
+    EXPECT_FALSE(trie.remove(addr("2001:db8:1::"), 56));
+    EXPECT_FALSE(trie.remove(addr("2001:db8::"), 32));
+    EXPECT_EQ(5u, trie.count());
+
+    // duplicate is removed once
+    EXPECT_TRUE(trie.remove(addr("2001:db8:1::"), 48));
+    EXPECT_TRUE(trie.find(addr("2001:db8:1::"), 48));
+    EXPECT_TRUE(trie.remove(addr("2001:db8:1::"), 48));
+    EXPECT_FALSE(trie.find(addr("2001:db8:1::"), 48));
+    EXPECT_FALSE(trie.remove(addr("2001:db8:1::"), 48));
+
+    // more specific prefixes are still there
+    EXPECT_TRUE(trie.find(addr("2001:db8:1:100::"), 56));
+    EXPECT_TRUE(trie.find(addr("2001:db8:1:200::"), 56));
+    EXPECT_FALSE(trie.overlaps(addr("2001:db8:1:300::"), 56));
+    EXPECT_TRUE(trie.overlaps(addr("2001:db8:1::"), 48));
+
+    EXPECT_TRUE(trie.remove(addr("2001:db8:1:100::"), 56));
+    EXPECT_TRUE(trie.remove(addr("2001:db8:1:200::"), 56));
+    EXPECT_FALSE(trie.overlaps(addr("2001:db8:1::"), 48));
+    EXPECT_TRUE(trie.find(addr("2001:db8:8000::"), 48));
+    EXPECT_EQ(1u, trie.count());
+
+    EXPECT_TRUE(trie.remove(addr("2001:db8:8000::"), 48));
+    EXPECT_EQ(0u, trie.count());
+    EXPECT_FALSE(trie.overlaps(addr("::"), 0));
+}
+
+TEST_F(PrefixTrieTest, many) {
+    TPrefixTrie trie;
+    char buf[64];
+
+    // 2001:db8:0:0::/64 ... 2001:db8:0:3e7::/64
+    for (int i = 0; i < 1000; i++) {
+        sprintf(buf, "2001:db8:0:%x::", i);
+        trie.insert(addr(buf), 64);
+    }
+    EXPECT_EQ(1000u, trie.count());
+
+    for (int i = 0; i < 1000; i += 2) {
+        sprintf(buf, "2001:db8:0:%x::", i);
+        EXPECT_TRUE(trie.remove(addr(buf), 64));
+    }
+    EXPECT_EQ(500u, trie.count());
+
+    for (int i = 0; i < 1000; i++) {
+        sprintf(buf, "2001:db8:0:%x::", i);
+        EXPECT_EQ(i % 2 == 1, trie.find(addr(buf), 64));
+        EXPECT_EQ(i % 2 == 1, trie.overlaps(addr(buf), 64));
+    }
+    EXPECT_FALSE(trie.overlaps(addr("2001:db8:0:3e8::"), 62));
+    EXPECT_TRUE(trie.overlaps(addr("2001:db8::"), 48));
+
+    trie.clear();
+    EXPECT_EQ(0u, trie.count());
+    EXPECT_FALSE(trie.overlaps(addr("2001:db8::"), 48));
+}
+
+} // end of anonymous namespace
@@ -0,0 +1,114 @@
+#include <IPv6Addr.h>
+#include <RangeIndex.h>
+#include <SmartPtr.h>
+#include <gtest/gtest.h>
+
+namespace test {
+
+    class RangeIndexTest : public ::testing::Test {
+    public:
+        RangeIndexTest() { }
+
+        SPtr<TIPv6Addr> addr(const char* txt) {
+            return new TIPv6Addr(txt, true);
+        }
+    };
+
+TEST_F(RangeIndexTest, disjoint) {
+    TRangeIndex idx;
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("2001:db8::1")));
+
+    idx.add(addr("2001:db8::100"), addr("2001:db8::1ff"), 0);
+    idx.add(addr("2001:db8::1"), addr("2001:db8::ff"), 1);
+    idx.add(addr("2001:db8:1::"), addr("2001:db8:1::"), 2);
+    EXPECT_EQ(3u, idx.count());
+    EXPECT_EQ(3u, idx.countSegments());
+
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("2001:db8::")));
+    EXPECT_EQ(1u, idx.find(addr("2001:db8::1")));
+    EXPECT_EQ(1u, idx.find(addr("2001:db8::ff")));
+    EXPECT_EQ(0u, idx.find(addr("2001:db8::100")));
+    EXPECT_EQ(0u, idx.find(addr("2001:db8::1ff")));
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("2001:db8::200")));
+    EXPECT_EQ(2u, idx.find(addr("2001:db8:1::")));
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("2001:db8:1::1")));
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("::")));
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff")));
+
+    // invalid range is ignored
+    idx.add(addr("2001:db8::2ff"), addr("2001:db8::200"), 3);
+    EXPECT_EQ(3u, idx.count());
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("2001:db8::250")));
+}
+
+TEST_F(RangeIndexTest, overlapping) {
+    TRangeIndex idx;
+
+    // ranges added first take precedence
+    idx.add(addr("2001:db8::100"), addr("2001:db8::1ff"), 0);
+    idx.add(addr("2001:db8::"), addr("2001:db8::ffff"), 1);
+    idx.add(addr("2001:db8::180"), addr("2001:db8::2ff"), 2);
+
+    EXPECT_EQ(1u, idx.find(addr("2001:db8::")));
+    EXPECT_EQ(1u, idx.find(addr("2001:db8::ff")));
+    EXPECT_EQ(0u, idx.find(addr("2001:db8::100")));
+    EXPECT_EQ(0u, idx.find(addr("2001:db8::180")));
+    EXPECT_EQ(0u, idx.find(addr("2001:db8::1ff")));
+    EXPECT_EQ(1u, idx.find(addr("2001:db8::200")));
+    EXPECT_EQ(1u, idx.find(addr("2001:db8::2ff")));
+    EXPECT_EQ(1u, idx.find(addr("2001:db8::ffff")));
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("2001:db8::1:0")));
+    EXPECT_EQ(3u, idx.countSegments());
+
+    // adding a range rebuilds the table
+    idx.add(addr("2001:db8::1:0"), addr("2001:db8::1:ff"), 1);
+    EXPECT_EQ(1u, idx.find(addr("2001:db8::1:0")));
+    EXPECT_EQ(3u, idx.countSegments());
+
+    idx.clear();
+    EXPECT_EQ(0u, idx.count());
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("2001:db8::")));
+}
+
+TEST_F(RangeIndexTest, edges) {
+    TRangeIndex idx;
+
+    idx.add(addr("::"), addr("::ff"), 0);
+    idx.add(addr("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ff00"),
+            addr("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"), 1);
+    EXPECT_EQ(0u, idx.find(addr("::")));
+    EXPECT_EQ(0u, idx.find(addr("::ff")));
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("::100")));
+    EXPECT_EQ(1u, idx.find(addr("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ff00")));
+    EXPECT_EQ(1u, idx.find(addr("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff")));
+
+    // whole address space
+    idx.add(addr("::"), addr("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"), 2);
+    EXPECT_EQ(0u, idx.find(addr("::ff")));
+    EXPECT_EQ(2u, idx.find(addr("::100")));
+    EXPECT_EQ(2u, idx.find(addr("2001:db8::")));
+    EXPECT_EQ(1u, idx.find(addr("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff")));
+    EXPECT_EQ(3u, idx.countSegments());
+}
+
+TEST_F(RangeIndexTest, many) {
+    TRangeIndex idx;
+    char first[64];
+    char last[64];
+
+    // 2001:db8:0:N::/64 for N = 0..999, owners added in reverse order
+    for (int i = 999; i >= 0; i--) {
+        sprintf(first, "2001:db8:0:%x::", i);
+        sprintf(last, "2001:db8:0:%x:ffff:ffff:ffff:ffff", i);
+        idx.add(addr(first), addr(last), (size_t)i);
+    }
+    EXPECT_EQ(1000u, idx.countSegments());
+
+    for (int i = 0; i < 1000; i++) {
+        sprintf(first, "2001:db8:0:%x::1", i);
+        EXPECT_EQ((size_t)i, idx.find(addr(first)));
+    }
+    EXPECT_EQ(TRangeIndex::NONE, idx.find(addr("2001:db8:0:3e8::")));
+}
+
+} // end of anonymous namespace
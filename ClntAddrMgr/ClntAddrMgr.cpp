@@ -236,10 +236,15 @@ SPtr<TAddrIA> TClntAddrMgr::getPD() {
 }
 
 bool TClntAddrMgr::delPD(long IAID) {
+    // prefixes that are still there must not stay in the prefix index
+    SPtr<TAddrIA> pd = getPD(IAID);
+    if (pd)
+        indexPD(pd, false);
     return Client->delPD(IAID);
 }
 
 void TClntAddrMgr::addPD(SPtr<TAddrIA> ptr) {
+    indexPD(ptr, true);
     Client->addPD(ptr);
 }
 
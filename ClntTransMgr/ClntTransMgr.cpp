@@ -325,8 +325,10 @@ void TClntTransMgr::removeExpired() {
                 &params);
 
 	    // Note: Technically, removing address here is not needed, as it will
-	    // be removed in AddrMgr::doDuties() anyway
-	    ptrPD->delPrefix(ptrPrefix);
+	    // be removed in AddrMgr::doDuties() anyway (AddrMgr keeps the prefix
+	    // index up to date, so don't remove it from ptrPD directly)
+	    ClntAddrMgr().delPrefix(ClntCfgMgr().getDUID(), ptrPD->getIAID(), ptrPrefix->get(),
+                                    true);
 	    Log(Info) << "Expired prefix " << ptrPrefix->get()->getPlain() << "/" << ptrPrefix->getLength()
 		      << " from IA_PD " << ptrPD->getIAID()
 		      << " has been removed from addrDB." << LogEnd;
@@ -12,9 +12,12 @@
  */
 
 #include "DNSUpdate.h"
+#include "DnsConnPool.h"
 #include "Portable.h"
 #include "Logger.h"
 #include <stdio.h>
+#include <map>
+#include <sstream>
 #include "sha256.h"
 
 using namespace std;
@@ -36,7 +39,7 @@ DNSUpdate::DNSUpdate(const std::string& dns_address, const std::string& zonename
 		     const std::string& hostname, std::string hostip,
 		     DnsUpdateMode updateMode, DnsUpdateProtocol proto /* = DNSUPDATE_TCP */)
     :Message_(NULL), DnsAddr_(dns_address), Hostip_(hostip), UpdateMode_(updateMode), 
-     Proto_(proto), Fudge_(0) {
+     Proto_(proto), Fudge_(0), OldRRChecked_(false), Pool_(NULL) {
 
     if (UpdateMode_ == DNSUPDATE_AAAA || UpdateMode_ == DNSUPDATE_AAAA_CLEANUP) {
 	splitHostDomain(hostname);
@@ -76,7 +79,30 @@ void DNSUpdate::splitHostDomain(std::string fqdnName) {
     }
 }
 
+/// @brief performs DNS Update (prepares and sends the message)
+///
+/// @param timeout timeout (in seconds)
+///
+/// @return result of the update
 DnsUpdateResult DNSUpdate::run(int timeout){
+    DnsUpdateResult result = prepare();
+    if (result != DNSUPDATE_SUCCESS)
+        return result;
+
+    result = send(timeout);
+    showErrors();
+    return result;
+}
+
+/// @brief prepares DNS Update message (does not send it)
+///
+/// @return DNSUPDATE_SUCCESS if message was created
+DnsUpdateResult DNSUpdate::prepare() {
+
+    if (Message_) {
+        delete Message_;
+        Message_ = NULL;
+    }
 
     Log(Info) << "DDNS: Performing DNS Update over " << protoToString() << ", DNS address="
 	       << DnsAddr_;
@@ -85,31 +111,31 @@ DnsUpdateResult DNSUpdate::run(int timeout){
 	case DNSUPDATE_PTR:
 	    Log(Cont) << ": Add PTR record." << LogEnd;
 	    createSOAMsg();
-	    addinMsg_delOldRR();
 	    addinMsg_newPTR();
 	    break;
 	case DNSUPDATE_PTR_CLEANUP:
 	    Log(Cont) << ": Cleanup PTR record." << LogEnd;
 	    createSOAMsg();
-	    addinMsg_delOldRR();
 	    deletePTRRecordFromRRSet();
 	    break;
 	case DNSUPDATE_AAAA:
 	    Log(Cont) << ": Add AAAA record." << LogEnd;
 	    createSOAMsg();
-	    addinMsg_delOldRR();
 	    addinMsg_newAAAA();
 	    break;
 	case DNSUPDATE_AAAA_CLEANUP:
 	    Log(Cont) << ": Cleanup AAAA record." << LogEnd;
 	    createSOAMsg();
-	    addinMsg_delOldRR();
 	    deleteAAAARecordFromRRSet();
 	    break;
 	}
     }
     catch (const PException& p) {
         Log(Warning) << "DNS Update failed: " << p.message << LogEnd;
+        if (Message_) {
+            delete Message_;
+            Message_ = NULL;
+        }
         return DNSUPDATE_ERROR;
     }
 
@@ -119,27 +145,298 @@ DnsUpdateResult DNSUpdate::run(int timeout){
 				       domainname(Algorithm_.c_str()));
 	Message_->sign_key = Key_;
     }
+    OldRRChecked_ = false;
+
+    return DNSUPDATE_SUCCESS;
+}
+
+/// @brief sends prepared DNS Update message and waits for the response
+///
+/// Old record is removed first (it is looked up only once, so the
+/// message may be sent again). Does not log anything, so it may be called
+/// from other thread than the one that prepared the message. Errors are
+/// stored and may be printed later with showErrors().
+///
+/// @param timeout timeout (in ms)
+///
+/// @return result of the update
+DnsUpdateResult DNSUpdate::send(int timeout) {
+    Error_.clear();
+    if (!Message_) {
+        return failed("message not prepared");
+    }
+
+    checkOldRR(timeout);
 
     try {
 	sendMsg(timeout);
     }
     catch (const PException& p) {
-	DnsUpdateResult result = DNSUPDATE_ERROR;
-	if (strstr(p.message,"Could not connect TCP socket") ){
-	    result = DNSUPDATE_CONNFAIL;
-	}
-	if (!strcmp(p.message,"NOTAUTH")){
-	    Log(Error) << "DDNS: Nameserver returned NOTAUTH error." << LogEnd;
-	    result = DNSUPDATE_SRVNOTAUTH;
-	}
-
-	Log(Error) << "DDNS: Update failed. Error: " << p.message << "." << LogEnd;
-	return result;
+	return failed(p.message);
      }// exeption catch
 
     return DNSUPDATE_SUCCESS;
 }
 
+/// @brief sends several prepared updates, coalescing and pipelining them
+///
+/// Updates of the same zone (sent to the same DNS server, over the same
+/// protocol and with the same TSIG key) share a single lookup of old
+/// records and are sent in common messages, as long as they fit in a
+/// single message. Every such message is signed once. If the server
+/// rejects a common message, its updates are sent again one by one, so
+/// that a single bad update does not make the others fail.
+///
+/// Messages sent over TCP using connection pool are grouped by DNS server
+/// and all messages of a group are sent over a single connection before
+/// waiting for answers. Other messages are sent one by one. Like send(),
+/// does not log anything.
+///
+/// @param updates updates to be sent
+/// @param timeout timeout (in ms)
+/// @param results [out] result of every update
+void DNSUpdate::sendAll(const std::vector<DNSUpdate*>& updates, int timeout,
+                        std::vector<DnsUpdateResult>& results) {
+    results.assign(updates.size(), DNSUPDATE_SKIP);
+
+    typedef map<string, vector<size_t> > TZones;
+    TZones zones;
+    for (size_t i = 0; i < updates.size(); i++) {
+        DNSUpdate * update = updates[i];
+        if (!update->Message_) {
+            results[i] = update->send(timeout);
+            continue;
+        }
+        update->Error_.clear();
+        zones[update->coalesceKey()].push_back(i);
+    }
+
+    vector<TBatch> batches;
+    for (TZones::const_iterator zone = zones.begin(); zone != zones.end(); ++zone) {
+        vector<DNSUpdate*> zoneUpdates;
+        for (size_t i = 0; i < zone->second.size(); i++)
+            zoneUpdates.push_back(updates[zone->second[i]]);
+        checkOldRR(zoneUpdates, timeout);
+        coalesce(updates, zone->second, batches);
+    }
+
+    typedef map<pair<TDnsConnPool*, string>, vector<size_t> > TServers;
+    TServers servers;
+    for (size_t i = 0; i < batches.size(); i++) {
+        DNSUpdate * first = updates[batches[i].Updates[0]];
+        if (!first->Pool_ || first->Proto_ != DNSUPDATE_TCP) {
+            string error = first->sendOther(batches[i].Msg, timeout);
+            batchDone(batches[i], error, updates, timeout, results);
+            continue;
+        }
+        servers[make_pair(first->Pool_, first->DnsAddr_)].push_back(i);
+    }
+
+    for (TServers::const_iterator server = servers.begin(); server != servers.end(); ++server) {
+        const vector<size_t>& idx = server->second;
+        vector<DnsMessage*> queries, answers;
+        vector<string> errors;
+        for (size_t i = 0; i < idx.size(); i++)
+            queries.push_back(batches[idx[i]].Msg);
+
+        _addr dnsAddr = ToPoslibAddr(server->first.second);
+        server->first.first->exchange(dnsAddr, queries, answers, errors, timeout);
+
+        for (size_t i = 0; i < idx.size(); i++) {
+            string error = errors[i];
+            if (answers[i] && answers[i]->RCODE != RCODE_NOERROR)
+                error = str_rcode(answers[i]->RCODE);
+            else if (!answers[i] && error.empty())
+                error = "DNS server answer not received";
+            delete answers[i];
+            batchDone(batches[idx[i]], error, updates, timeout, results);
+        }
+    }
+
+    for (size_t i = 0; i < batches.size(); i++) {
+        if (batches[i].Msg != updates[batches[i].Updates[0]]->Message_)
+            delete batches[i].Msg;
+    }
+}
+
+/// @brief sets connection pool (TCP updates will use its connections)
+///
+/// @param pool connection pool (NULL to open a new connection for every message)
+void DNSUpdate::setConnPool(TDnsConnPool * pool) {
+    Pool_ = pool;
+}
+
+/// @brief looks up old record (once) and adds its removal to the message
+///
+/// @param timeout timeout (in ms)
+void DNSUpdate::checkOldRR(unsigned int timeout) {
+    checkOldRR(vector<DNSUpdate*>(1, this), timeout);
+}
+
+/// @brief looks up old records of several updates of the same zone
+///
+/// Zone is transferred only once for all updates that were not checked
+/// yet. Removal of the old record is added to the message of every update.
+///
+/// @param updates updates of the same zone
+/// @param timeout timeout (in ms)
+void DNSUpdate::checkOldRR(const std::vector<DNSUpdate*>& updates, unsigned int timeout) {
+    vector<DNSUpdate*> unchecked;
+    for (size_t i = 0; i < updates.size(); i++) {
+        if (!updates[i]->OldRRChecked_)
+            unchecked.push_back(updates[i]);
+    }
+    if (unchecked.empty())
+        return;
+
+    DnsMessage * zone = NULL;
+    string error;
+    try {
+        zone = unchecked[0]->getZone(timeout);
+    } catch (const PException& p) {
+        error = p.message;
+    }
+
+    for (size_t i = 0; i < unchecked.size(); i++) {
+        unchecked[i]->LookupError_ = error;
+        if (zone)
+            unchecked[i]->addinMsg_delOldRR(zone);
+        unchecked[i]->OldRRChecked_ = true;
+    }
+    delete zone;
+}
+
+/// @brief returns key identifying updates that may be sent in one message
+///
+/// Such updates are sent to the same DNS server, using the same protocol
+/// (and connection pool), update the same zone and are signed with the
+/// same TSIG key.
+std::string DNSUpdate::coalesceKey() const {
+    ostringstream key;
+    key << Proto_ << " " << (void*)Pool_ << " " << DnsAddr_ << " "
+        << Zoneroot_.tostring() << " " << Keyname_ << " " << Key_ << " "
+        << Algorithm_ << " " << Fudge_;
+    return key.str();
+}
+
+/// @brief splits updates of the same zone into messages
+///
+/// Records of consecutive updates are put into one message (with a single
+/// TSIG record), until the message would not fit into a single UDP or TCP
+/// message. Update that is sent alone uses its own message.
+///
+/// @param updates all updates being sent
+/// @param zone indexes of updates of the same zone
+/// @param batches [out] created messages are appended here
+void DNSUpdate::coalesce(const std::vector<DNSUpdate*>& updates,
+                         const std::vector<size_t>& zone, std::vector<TBatch>& batches) {
+    DNSUpdate * first = updates[zone[0]];
+    size_t limit = (first->Proto_ == DNSUPDATE_UDP) ? UDP_MSG_SIZE : TCP_MSG_SIZE - 1;
+    size_t overhead = 16 + first->Zoneroot_.len() + DNSUPDATE_TSIG_SIZE;
+
+    size_t i = 0;
+    while (i < zone.size()) {
+        TBatch batch;
+        size_t size = overhead;
+        do {
+            DnsMessage * msg = updates[zone[i]]->Message_;
+            size_t len = 0;
+            for (stl_list(DnsRR)::iterator rr = msg->authority.begin();
+                 rr != msg->authority.end(); ++rr)
+                len += rr->NAME.len() + 10 + rr->RDLENGTH;
+            if (!batch.Updates.empty() && size + len > limit)
+                break;
+            size += len;
+            batch.Updates.push_back(zone[i++]);
+        } while (i < zone.size());
+
+        DNSUpdate * leader = updates[batch.Updates[0]];
+        if (batch.Updates.size() == 1) {
+            batch.Msg = leader->Message_;
+        } else {
+            batch.Msg = new DnsMessage();
+            batch.Msg->OPCODE = OPCODE_UPDATE;
+            batch.Msg->questions = leader->Message_->questions;
+            for (size_t j = 0; j < batch.Updates.size(); j++) {
+                DnsMessage * msg = updates[batch.Updates[j]]->Message_;
+                batch.Msg->authority.insert(batch.Msg->authority.end(),
+                                            msg->authority.begin(), msg->authority.end());
+            }
+            if (leader->Message_->tsig_rr) {
+                batch.Msg->tsig_rr = tsig_record(domainname(leader->Keyname_.c_str()),
+                                                 leader->Fudge_,
+                                                 domainname(leader->Algorithm_.c_str()));
+                batch.Msg->sign_key = leader->Message_->sign_key;
+            }
+        }
+        batches.push_back(batch);
+    }
+}
+
+/// @brief sets results of updates sent in one message
+///
+/// @param batch sent message
+/// @param error error (empty if the message was accepted)
+/// @param updates all updates being sent
+/// @param timeout timeout (in ms), used if updates are sent again
+/// @param results [out] result of every update
+void DNSUpdate::batchDone(const TBatch& batch, const std::string& error,
+                          const std::vector<DNSUpdate*>& updates, int timeout,
+                          std::vector<DnsUpdateResult>& results) {
+    for (size_t i = 0; i < batch.Updates.size(); i++) {
+        size_t idx = batch.Updates[i];
+        if (error.empty())
+            results[idx] = DNSUPDATE_SUCCESS;
+        else if (batch.Updates.size() > 1 && rejected(error))
+            results[idx] = updates[idx]->send(timeout);
+        else
+            results[idx] = updates[idx]->failed(error);
+    }
+}
+
+/// @brief checks if the error was reported by the server for message content
+///
+/// @param error error description
+///
+/// @return true if the message was answered with error RCODE (other than NOTAUTH)
+bool DNSUpdate::rejected(const std::string& error) {
+    for (int rcode = RCODE_QUERYERR; rcode <= RCODE_NOTZONE; rcode++) {
+        if (rcode != RCODE_NOTAUTH && error == str_rcode(rcode))
+            return true;
+    }
+    return false;
+}
+
+/// @brief stores error and converts it to the update result
+///
+/// @param error error description
+///
+/// @return result of the update
+DnsUpdateResult DNSUpdate::failed(const std::string& error) {
+    Error_ = error;
+    if (strstr(error.c_str(), "Could not connect TCP socket")) {
+        return DNSUPDATE_CONNFAIL;
+    }
+    if (error == "NOTAUTH") {
+        return DNSUPDATE_SRVNOTAUTH;
+    }
+    return DNSUPDATE_ERROR;
+}
+
+/// @brief prints errors reported by the last send()
+void DNSUpdate::showErrors() {
+    if (!LookupError_.empty()) {
+        Log(Error) << "DDNS: Attempt to get old DNS record failed:" << LookupError_ << LogEnd;
+        LookupError_.clear();
+    }
+    if (Error_.empty())
+        return;
+    if (Error_ == "NOTAUTH") {
+        Log(Error) << "DDNS: Nameserver returned NOTAUTH error." << LogEnd;
+    }
+    Log(Error) << "DDNS: Update failed. Error: " << Error_ << "." << LogEnd;
+}
+
 /**
  * create new message for Dns Update
  *
@@ -272,17 +569,16 @@ void DNSUpdate::addinMsg_newPTR(){
 }
 
 /**
- * insert a delete-RR entry in message for deleting old entry
+ * insert a delete-RR entry in front of the message for deleting old entry
  *
+ * @param zone zone transfer (xfr) received from server
  */
-void DNSUpdate::addinMsg_delOldRR(){
-    //get old, available DnsRR from Dns Server
-    DnsRR* oldDnsRR=this->get_oldDnsRR();
-    if (oldDnsRR){
+void DNSUpdate::addinMsg_delOldRR(DnsMessage *zone){
+    DnsRR oldDnsRR;
+    if (DnsRR_avail(zone, oldDnsRR)){
 	//delete message
-	oldDnsRR->CLASS = QCLASS_NONE; oldDnsRR->TTL = 0;
-	Message_->authority.push_back(*oldDnsRR);
-	delete oldDnsRR;
+	oldDnsRR.CLASS = QCLASS_NONE; oldDnsRR.TTL = 0;
+	Message_->authority.push_front(oldDnsRR);
     }
 }
 
@@ -300,7 +596,6 @@ bool DNSUpdate::DnsRR_avail(DnsMessage *msg, DnsRR& RemoteDnsRR){
     bool flagSOA = false;
 
     if (msg->answers.empty()) {
-	delete msg;
 	return false;
     }
 
@@ -318,35 +613,43 @@ bool DNSUpdate::DnsRR_avail(DnsMessage *msg, DnsRR& RemoteDnsRR){
 
 		if ( !strcmp(Hostname_.c_str(),(it->NAME.label(0)).c_str()) ){
 		    RemoteDnsRR=*it;
-		    delete msg;
 		    return true;
 		}
 	    }
 	}
 	it++;
     }
-    delete msg;
 
     return false;
 }
 
-/** get old RR entry from Dns Server */
-DnsRR* DNSUpdate::get_oldDnsRR(){
+/** get zone (used to find old RR entries) from Dns Server */
+DnsMessage* DNSUpdate::getZone(unsigned int timeout){
 
-    DnsRR* RemoteDnsRR= NULL;
     DnsMessage *q = NULL, *a = NULL;
     int sockid = -1;
 
     try {
 	q = create_query(Zoneroot_, QTYPE_AXFR);
 
-	pos_cliresolver res;
         /// @todo: Make this over UDP or TCP, not always TCP (TCP blocks on connect())
 	_addr dnsAddr = ToPoslibAddr(DnsAddr_);
-	sockid = res.tcpconnect(&dnsAddr);
-	res.tcpsendmessage(q, sockid);
+	if (Pool_) {
+	    vector<DnsMessage*> queries(1, q), answers;
+	    vector<string> errors;
+	    Pool_->exchange(dnsAddr, queries, answers, errors, timeout);
+	    a = answers[0];
+	    if (!a) {
+		throw PException(errors[0].c_str());
+	    }
+	} else {
+	    pos_cliresolver res;
+	    res.tcp_timeout = timeout;
+	    sockid = res.tcpconnect(&dnsAddr);
+	    res.tcpsendmessage(q, sockid);
 
-	res.tcpwaitanswer(a, sockid);
+	    res.tcpwaitanswer(a, sockid);
+	}
 	if (!a) {
 	    throw PException("tcpwaitanswer returned NULL");
 	}
@@ -354,29 +657,12 @@ DnsRR* DNSUpdate::get_oldDnsRR(){
 
 	    throw PException((char*)str_rcode(a->RCODE).c_str());
 	}
-	if (!a->answers.empty())
-	    {
-		RemoteDnsRR = new DnsRR();
-		if (this->DnsRR_avail(a,*RemoteDnsRR) == false)
-		    {
-			delete RemoteDnsRR;
-			RemoteDnsRR = NULL;
-		    }
-	    }
-
-	if (a) {
-	    // delete a; /// @todo: Why is this commented out? Memory leak!
-	    a = 0;
-	}
-	if (q) {
-	    delete q;
-	    q = 0;
-	}
 
+	delete q;
 	if (sockid != -1)
 	    tcpclose(sockid);
 
-	return RemoteDnsRR;
+	return a;
 
     } catch (const PException& p) {
 	if (q) {
@@ -390,10 +676,7 @@ DnsRR* DNSUpdate::get_oldDnsRR(){
 	}
 	if (sockid != -1)
 	    tcpclose(sockid);
-	if (RemoteDnsRR)
-	    delete RemoteDnsRR;
-    Log(Error) << "DDNS: Attempt to get old DNS record failed:" << p.message << LogEnd;
-	return 0;
+	throw;
     }
 }
 
@@ -406,17 +689,54 @@ void DNSUpdate::sendMsg(unsigned int timeout) {
 	sendMsgUDP(timeout);
 	return;
     default:
-	Log(Error) << "DDNS: Invalid protocol (non-TCP, non-UDP) specified." << LogEnd;
+	throw PException("Invalid protocol (non-TCP, non-UDP) specified");
     }
 
     return;
 }
 
+/// @brief sends other message instead of own one (using sendMsg())
+///
+/// @param msg message to be sent
+/// @param timeout timeout (in ms)
+///
+/// @return error (empty if message was accepted)
+std::string DNSUpdate::sendOther(DnsMessage * msg, unsigned int timeout) {
+    DnsMessage * own = Message_;
+    Message_ = msg;
+    string error;
+    try {
+	sendMsg(timeout);
+    } catch (const PException& p) {
+	error = p.message;
+    }
+    Message_ = own;
+    return error;
+}
+
 /** send Update Message to server*/
 void DNSUpdate::sendMsgTCP(unsigned int timeout){
     DnsMessage *a = NULL;
     int sockid = -1;
 
+    if (Pool_) {
+	vector<DnsMessage*> queries(1, Message_), answers;
+	vector<string> errors;
+	_addr dnsAddr = ToPoslibAddr(DnsAddr_);
+	Pool_->exchange(dnsAddr, queries, answers, errors, timeout);
+	a = answers[0];
+	if (!a) {
+	    throw PException(errors[0].c_str());
+	}
+	if (a->RCODE != RCODE_NOERROR) {
+	    string rcode = str_rcode(a->RCODE);
+	    delete a;
+	    throw PException(rcode.c_str());
+	}
+	delete a;
+	return;
+    }
+
     try {
 	pos_cliresolver res;
 	res.tcp_timeout = timeout;
@@ -14,6 +14,7 @@
 #endif
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 /// @todo: remove poslib.h inclusion from here
@@ -43,6 +44,11 @@ enum DnsUpdateMode {
     DNSUPDATE_AAAA_CLEANUP=4
 };
 
+/* space reserved for TSIG record when coalesced messages are sized */
+#define DNSUPDATE_TSIG_SIZE 256
+
+class TDnsConnPool;
+
 class DNSUpdate {
 
  public:
@@ -59,11 +65,28 @@ private:
     void createSOAMsg();
     void addinMsg_newPTR();
     void addinMsg_newAAAA();
-    void addinMsg_delOldRR();
+    void addinMsg_delOldRR(DnsMessage *zone);
     void deleteAAAARecordFromRRSet();
     void deletePTRRecordFromRRSet();
     bool DnsRR_avail(DnsMessage *msg, DnsRR& RemoteDnsRR);
-    DnsRR* get_oldDnsRR();
+    DnsMessage* getZone(unsigned int timeout);
+    void checkOldRR(unsigned int timeout);
+    static void checkOldRR(const std::vector<DNSUpdate*>& updates, unsigned int timeout);
+    DnsUpdateResult failed(const std::string& error);
+
+    /// message carrying records of one or more updates of the same zone
+    struct TBatch {
+        DnsMessage * Msg;            ///< message to be sent
+        std::vector<size_t> Updates; ///< indexes of updates sent in it
+    };
+    std::string coalesceKey() const;
+    static void coalesce(const std::vector<DNSUpdate*>& updates,
+                         const std::vector<size_t>& zone, std::vector<TBatch>& batches);
+    static void batchDone(const TBatch& batch, const std::string& error,
+                          const std::vector<DNSUpdate*>& updates, int timeout,
+                          std::vector<DnsUpdateResult>& results);
+    static bool rejected(const std::string& error);
+    std::string sendOther(DnsMessage * msg, unsigned int timeout);
     void sendMsgTCP(unsigned int timeout);
     void sendMsgUDP(unsigned int timeout);
 
@@ -86,6 +109,11 @@ protected: // used to be private, but is now protected for testing
     std::string Algorithm_; /// specify algorithm used for the key
     uint32_t Fudge_; /// max difference between us signing and they are receiving
 
+    std::string Error_; /// error reported by the last send()
+    std::string LookupError_; /// error reported by old record lookup
+    bool OldRRChecked_; /// was old record already looked up?
+    TDnsConnPool * Pool_; /// TCP connections to be used (optional)
+
  public:
     DNSUpdate(const std::string& dns_address, const std::string& zonename, const std::string& hostname,
               std::string hostip, DnsUpdateMode updateMode,
@@ -95,5 +123,11 @@ protected: // used to be private, but is now protected for testing
                  const std::string& algro, uint32_t fudge = 600);
     virtual ~DNSUpdate();
     DnsUpdateResult run(int timeout);
+    DnsUpdateResult prepare();
+    DnsUpdateResult send(int timeout);
+    static void sendAll(const std::vector<DNSUpdate*>& updates, int timeout,
+                        std::vector<DnsUpdateResult>& results);
+    void setConnPool(TDnsConnPool * pool);
     void showResult(int result);
+    void showErrors();
 };
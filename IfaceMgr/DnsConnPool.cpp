@@ -0,0 +1,214 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include "DnsConnPool.h"
+
+#ifdef MSG_NOSIGNAL
+// server might have closed the connection, don't get killed by SIGPIPE
+#define DNSCONNPOOL_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define DNSCONNPOOL_SEND_FLAGS 0
+#endif
+
+using namespace std;
+
+TDnsConnPool::TDnsConnPool(unsigned int idleTimeout)
+    :IdleTimeout_(idleTimeout), NextId_((uint16_t)posrandom()) {
+    memset(&Stats_, 0, sizeof(Stats_));
+}
+
+TDnsConnPool::~TDnsConnPool() {
+    closeAll();
+}
+
+/// @brief sends messages to a DNS server and waits for all answers
+///
+/// Messages are sent over a single (reused, if possible) connection
+/// before any answer is read. Every message gets its own ID.
+///
+/// @param server address of the DNS server
+/// @param queries messages to be sent (their IDs are changed)
+/// @param answers [out] answers (NULL if there is no answer), caller deletes them
+/// @param errors [out] reason of the missing answer (empty if answered)
+/// @param timeout maximum time to wait for all answers (in ms)
+void TDnsConnPool::exchange(_addr& server, std::vector<DnsMessage*>& queries,
+                            std::vector<DnsMessage*>& answers,
+                            std::vector<std::string>& errors, unsigned int timeout) {
+    answers.assign(queries.size(), (DnsMessage*)NULL);
+    errors.assign(queries.size(), string());
+    Stats_.Exchanges++;
+
+    string key = addr_to_string(&server, true);
+    vector<size_t> pending;
+    for (size_t i = 0; i < queries.size(); i++)
+        pending.push_back(i);
+
+    // second round is used only if reused connection was closed by the server
+    for (int round = 0; round < 2 && !pending.empty(); round++) {
+        bool reused = false;
+        size_t answered = 0;
+        try {
+            int sock = getConn(server, key, reused);
+            postime_t end = getcurtime() + timeout;
+
+            // all messages are written at once (each prefixed with its length)
+            vector<char> out;
+            for (size_t i = 0; i < pending.size(); i++) {
+                DnsMessage * q = queries[pending[i]];
+                q->ID = ++NextId_;
+                message_buff buff = q->compile(TCP_MSG_SIZE);
+                out.push_back((char)(buff.len / 256));
+                out.push_back((char)buff.len);
+                out.insert(out.end(), (char*)buff.msg, (char*)buff.msg + buff.len);
+            }
+            sendAll(sock, &out[0], out.size(), end);
+            Stats_.Messages += pending.size();
+
+            while (!pending.empty()) {
+                unsigned char len_b[2];
+                tcpreadall(sock, (char*)len_b, 2, end.after(getcurtime()));
+                int len = len_b[0] * 256 + len_b[1];
+                vector<unsigned char> msg(len ? len : 1);
+                tcpreadall(sock, (char*)&msg[0], len, end.after(getcurtime()));
+
+                DnsMessage * a = new DnsMessage();
+                try {
+                    a->read_from_data(&msg[0], len);
+                } catch (...) {
+                    delete a;
+                    throw;
+                }
+
+                // answers for other (e.g. timed out) messages are ignored
+                vector<size_t>::iterator it = pending.begin();
+                while (it != pending.end() && queries[*it]->ID != a->ID)
+                    ++it;
+                if (it == pending.end()) {
+                    delete a;
+                    continue;
+                }
+                answers[*it] = a;
+                pending.erase(it);
+                answered++;
+            }
+            Conns_[key].LastUsed = time(NULL);
+        } catch (const PException& p) {
+            closeConn(key);
+            // server may close a connection at any time, but if it didn't
+            // answer in time, it wouldn't answer on a new one either
+            bool timedOut = strstr(p.message, "no data") || strstr(p.message, "timeout");
+            if (reused && !answered && !round && !timedOut) {
+                Stats_.Reconnects++;
+                continue;
+            }
+            for (size_t i = 0; i < pending.size(); i++)
+                errors[pending[i]] = p.message;
+            return;
+        }
+    }
+}
+
+/// @brief closes connections that were not used for a while
+void TDnsConnPool::closeIdle() {
+    time_t now = time(NULL);
+    map<string, TConn>::iterator it = Conns_.begin();
+    while (it != Conns_.end()) {
+        if (now - it->second.LastUsed >= (time_t)IdleTimeout_) {
+            tcpclose(it->second.Sock);
+            Conns_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/// @brief closes all connections
+void TDnsConnPool::closeAll() {
+    for (map<string, TConn>::iterator it = Conns_.begin(); it != Conns_.end(); ++it)
+        tcpclose(it->second.Sock);
+    Conns_.clear();
+}
+
+/// @brief returns number of open connections
+size_t TDnsConnPool::count() const {
+    return Conns_.size();
+}
+
+/// @brief returns statistics
+const TDnsConnPool::TStats& TDnsConnPool::getStats() const {
+    return Stats_;
+}
+
+/// @brief returns connection to a server, opens it if necessary
+///
+/// @param server address of the DNS server
+/// @param key server address as text
+/// @param reused [out] true if connection was already open
+///
+/// @return socket
+int TDnsConnPool::getConn(_addr& server, const std::string& key, bool& reused) {
+    map<string, TConn>::iterator it = Conns_.find(key);
+    if (it != Conns_.end()) {
+        // idle connection was likely closed by the server already
+        if (time(NULL) - it->second.LastUsed < (time_t)IdleTimeout_) {
+            reused = true;
+            return it->second.Sock;
+        }
+        closeConn(key);
+    }
+
+    reused = false;
+    TConn conn;
+    conn.Sock = tcpopen(&server);
+    conn.LastUsed = time(NULL);
+    Conns_[key] = conn;
+    Stats_.Connects++;
+    return conn.Sock;
+}
+
+/// @brief closes connection to a server
+///
+/// @param key server address as text
+void TDnsConnPool::closeConn(const std::string& key) {
+    map<string, TConn>::iterator it = Conns_.find(key);
+    if (it == Conns_.end())
+        return;
+    tcpclose(it->second.Sock);
+    Conns_.erase(it);
+}
+
+/// @brief sends whole buffer (or throws)
+///
+/// @param sock socket
+/// @param buf data to be sent
+/// @param len data length
+/// @param end deadline
+void TDnsConnPool::sendAll(int sock, const char* buf, int len, postime_t end) {
+    smallset_t set;
+    while (len > 0) {
+        postime_t cur = getcurtime();
+        if (end < cur)
+            throw PException("Could not send TCP message: timeout");
+        set.init(1);
+        set.set(0, sock);
+        set.waitwrite(end.after(cur));
+        if (!set.canwrite(0))
+            continue;
+        int ret = send(sock, buf, len, DNSCONNPOOL_SEND_FLAGS);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            throw PException("Could not send TCP message");
+        }
+        buf += ret;
+        len -= ret;
+    }
+}
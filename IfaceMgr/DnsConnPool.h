@@ -0,0 +1,75 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TDnsConnPool;
+#ifndef DNSCONNPOOL_H
+#define DNSCONNPOOL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <time.h>
+#include "poslib.h"
+
+/// connections not used for that long are closed (in seconds)
+#define DNSCONNPOOL_IDLE_TIMEOUT 30
+
+/// @brief Persistent TCP connections to DNS servers
+///
+/// Keeps a TCP connection open to every DNS server it talks to, so a DNS
+/// Update does not need its own TCP handshake. Several messages may be
+/// sent at once (pipelined) with distinct IDs; answers are matched by ID,
+/// so they may come in any order. If a connection turns out to be closed
+/// by the server (e.g. because it was idle), it is reopened and unanswered
+/// messages are sent again.
+///
+/// Does not use logger, so it may be used by a thread that does not hold
+/// the state lock. It is not thread-safe itself.
+class TDnsConnPool
+{
+  public:
+    struct TStats {
+        unsigned long Connects;   ///< connections opened
+        unsigned long Reconnects; ///< connections reopened after server closed them
+        unsigned long Messages;   ///< messages sent
+        unsigned long Exchanges;  ///< exchange() calls
+    };
+
+    TDnsConnPool(unsigned int idleTimeout = DNSCONNPOOL_IDLE_TIMEOUT);
+    ~TDnsConnPool();
+
+    void exchange(_addr& server, std::vector<DnsMessage*>& queries,
+                  std::vector<DnsMessage*>& answers, std::vector<std::string>& errors,
+                  unsigned int timeout);
+    void closeIdle();
+    void closeAll();
+    size_t count() const;
+    const TStats& getStats() const;
+
+  private:
+    // not copyable
+    TDnsConnPool(const TDnsConnPool&);
+    TDnsConnPool& operator=(const TDnsConnPool&);
+
+    struct TConn {
+        int Sock;
+        time_t LastUsed;
+    };
+
+    int getConn(_addr& server, const std::string& key, bool& reused);
+    void closeConn(const std::string& key);
+    static void sendAll(int sock, const char* buf, int len, postime_t end);
+
+    std::map<std::string, TConn> Conns_; ///< open connections, by server address
+    unsigned int IdleTimeout_;
+    uint16_t NextId_;
+    TStats Stats_;
+};
+
+#endif
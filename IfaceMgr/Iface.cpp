@@ -300,6 +300,13 @@ bool TIfaceIface::addSocket(SPtr<TIPv6Addr> addr,int port, bool ifaceonly, bool
     return true;
 }
 
+/*
+ * attaches socket that is already open (e.g. shared by several interfaces)
+ */
+void TIfaceIface::addSocket(SPtr<TIfaceSocket> sock) {
+    SocketsLst.append(sock);
+}
+
 #if 0
 /*
  * binds socket on whole interface
@@ -16,6 +16,10 @@
 #include <string>
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
+#ifndef WIN32
+#include <sys/time.h>
+#endif
 #include "Portable.h"
 #include "IfaceMgr.h"
 #include "Iface.h"
@@ -28,6 +32,18 @@
 
 using namespace std;
 
+/// maximum size of received UDP payload
+#define IFACEMGR_MAX_PKT_SIZE (0xffff - 20 - 8)
+
+#ifdef LINUX
+/// returns current time in microseconds
+static unsigned long nowUsec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long)tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+#endif
+
 /// constructor
 ///
 /// @param xmlFile xml file, where interface info will be stored
@@ -36,6 +52,12 @@ TIfaceMgr::TIfaceMgr(const std::string& xmlFile, bool getIfaces)
 {
     this->XmlFile = xmlFile;
     this->IsDone  = false;
+    Batching_ = false;
+    Ring_ = false;
+    BatchActive_ = false;
+    RecvIface_ = 0;
+    BatchStart_ = 0;
+    memset(&BatchStats_, 0, sizeof(BatchStats_));
     struct iface  * ptr;
     struct iface  * ifaceList;
 
@@ -132,6 +154,14 @@ SPtr<TIfaceIface> TIfaceMgr::getIfaceByID(int id) {
  * gets interface by socket descriptor (or NULL if no such interface exists)
  */
 SPtr<TIfaceIface> TIfaceMgr::getIfaceBySocket(int fd) {
+    // sockets know their interfaces, so there's no need to check every socket
+    TIfaceSocket * sock = TIfaceSocket::getReactor().getSocket(fd);
+    if (sock) {
+        SPtr<TIfaceIface> iface = getIfaceByID(sock->getIfaceID());
+        if (iface && iface->getSocketByFD(fd))
+            return iface;
+    }
+
     SPtr<TIfaceIface> ptr;
     IfaceLst.first();
     while ( ptr = IfaceLst.get() ) {
@@ -153,8 +183,6 @@ SPtr<TIfaceIface> TIfaceMgr::getIfaceBySocket(int fd) {
 int TIfaceMgr::select(unsigned long time, char *buf,
                       int &bufsize, SPtr<TIPv6Addr> peer,
                       SPtr<TIPv6Addr> myaddr) {
-    struct timeval czas;
-    int result;
     if (time > DHCPV6_INFINITY/2)
         time /=2;
 
@@ -164,71 +192,113 @@ int TIfaceMgr::select(unsigned long time, char *buf,
         time = 3600*24*7; // a week is enough
 #endif
 
-    czas.tv_sec=time;
-    czas.tv_usec=0;
+    if (time > ULONG_MAX/1000)
+        time = ULONG_MAX/1000;
 
-    // tricks with FDS macros
-    fd_set fds;
-    fds = *TIfaceSocket::getFDS();
+    return selectMsec(time*1000, buf, bufsize, peer, myaddr);
+}
 
-    int maxFD;
-    maxFD = TIfaceSocket::getMaxFD() + 1;
+/// tries to read data from any socket on all interfaces
+/// returns after msec milliseconds.
+///
+/// Sockets are watched by TSocketReactor (epoll on Linux), so the
+/// socket that received data is found directly by its descriptor.
+///
+/// @param msec listens for msec milliseconds
+/// @param buf buffer
+/// @param bufsize buffer size
+/// @param peer [out] sender address
+/// @param myaddr [out] local IPv6 address
+///
+/// @return socket descriptor (or negative values for errors)
+int TIfaceMgr::selectMsec(unsigned long msec, char *buf,
+                          int &bufsize, SPtr<TIPv6Addr> peer,
+                          SPtr<TIPv6Addr> myaddr) {
+    int result;
+    RecvIface_ = 0;
+
+#ifdef LINUX
+    if (Batching_) {
+        // return packets received in the last batch first
+        while (!RxQueue_.empty()) {
+            result = popReceived(buf, bufsize, peer, myaddr);
+            if (result >= 0)
+                return result;
+        }
+        // whole batch processed, send replies before waiting for more
+        flushSend();
+    }
+#endif
 
     // no sockets to listen  on... hopefully this is just inactive mode,
     // not an error
     if (!TIfaceSocket::getCount()) {
-        Log(Debug) << "No sockets open. Sleeping for " << time << " seconds." << LogEnd;
+        Log(Debug) << "No sockets open. Sleeping for " << msec/1000 << " seconds." << LogEnd;
 #ifdef WIN32
-        Sleep(time*1000); // Windows sleep is specified in milliseconds
+        Sleep(msec); // Windows sleep is specified in milliseconds
 #else
-        sleep(time); // Posix sleep is specified in seconds
+        sleep(msec/1000); // Posix sleep is specified in seconds
+        usleep((msec%1000)*1000);
 #endif
         return 0;
     }
-    result = ::select(maxFD, &fds, NULL, NULL, &czas);
 
-    // something received
+#ifdef LINUX
+    if (Ring_) {
+        result = receiveRing(msec);
+        if (result > 0)
+            return popReceived(buf, bufsize, peer, myaddr);
+        if (!result) { // timeout, nothing received
+            bufsize = 0;
+            return -1;
+        }
+        if (errno != EOPNOTSUPP) {
+            Log(Debug) << "Failed to read sockets (io_uring failed), error="
+                       << strerror(errno) << LogEnd;
+            return -1;
+        }
+        Log(Warning) << "Unable to receive using io_uring, switching to "
+                     << TIfaceSocket::getReactor().getBackend() << "." << LogEnd;
+        setRing(false);
+    }
+#endif
 
-    if (result==0) { // timeout, nothing received
+    TSocketReactor& reactor = TIfaceSocket::getReactor();
+    result = reactor.wait(msec);
+
+    if (result == TSocketReactor::TIMEOUT) { // timeout, nothing received
         bufsize = 0;
         return -1;
     }
-    if (result<0) {
+    if (result == TSocketReactor::FAILURE) {
         char buf[512];
         strncpy(buf, strerror(errno),512);
-        Log(Debug) << "Failed to read sockets (select() returned " << result
-                   << "), error=" << buf << LogEnd;
+        Log(Debug) << "Failed to read sockets (" << reactor.getBackend()
+                   << " failed), error=" << buf << LogEnd;
         return -1;
     }
 
-    SPtr<TIfaceIface> iface;
-    SPtr<TIfaceSocket> sock;
-    bool found = 0;
-    IfaceLst.first();
-    while ( (!found) && (iface = IfaceLst.get()) ) {
-        iface->firstSocket();
-        while ( sock = iface->getSocket() ) {
-            if (FD_ISSET(sock->getFD(),&fds)) {
-                found = true;
-                break;
-            }
-        }
-    }
-
-    if (!found) {
+    TIfaceSocket * sock = reactor.getSocket(result);
+    if (!sock) {
         Log(Error) << "Internal error. Can't find any socket with incoming data." << LogEnd;
         return -1;
     }
 
-    char myPlainAddr[48];   // my plain address
-    char peerPlainAddr[48]; // peer plain address
+#ifdef LINUX
+    if (Batching_) {
+        if (!receiveBatch(sock->getFD())) {
+            bufsize = 0;
+            return -1;
+        }
+        return popReceived(buf, bufsize, peer, myaddr);
+    }
+#endif
 
-    // receive data (pure C function used)
-    result = sock_recv(sock->getFD(), myPlainAddr, peerPlainAddr, buf, bufsize);
     char peerAddrPacked[16];
     char myAddrPacked[16];
-    inet_pton6(peerPlainAddr,peerAddrPacked);
-    inet_pton6(myPlainAddr,myAddrPacked);
+
+    // receive data (pure C function used), addresses are already packed
+    result = sock_recv_bin(sock->getFD(), myAddrPacked, peerAddrPacked, buf, bufsize);
     peer->setAddr(peerAddrPacked);
     myaddr->setAddr(myAddrPacked);
 
@@ -238,23 +308,378 @@ int TIfaceMgr::select(unsigned long time, char *buf,
         return -1;
     }
 
+    if (!acceptDstAddr(sock, myAddrPacked)) {
+        bufsize = 0;
+        return -1;
+    }
+
+    bufsize = result;
+    return sock->getFD();
+}
+
+/// checks if received data was addressed to the socket's address
+///
+/// @param sock socket the data was received on
+/// @param myAddrPacked packed destination address of the data
+///
+/// @return false if the data should be ignored
+bool TIfaceMgr::acceptDstAddr(TIfaceSocket * sock, char * myAddrPacked) {
 #ifdef MOD_SRV_DST_ADDR_CHECK
     // check if we've received data addressed to us. There's problem with sockets binding.
     // If there are 2 open sockets (one bound to multicast and one to global address),
     // each packet sent on multicast address is also received on unicast socket.
     char anycast[16] = {0};
-    if (!iface->flagLoopback()
+    SPtr<TIfaceIface> iface = getIfaceByID(sock->getIfaceID());
+    if (iface && !iface->flagLoopback()
         && memcmp(sock->getAddr()->getAddr(), myAddrPacked, 16)
         && memcmp(sock->getAddr()->getAddr(), anycast, 16) ) {
-            Log(Debug) << "Received data on address " << myPlainAddr << ", expected "
-                   << *sock->getAddr() << ", message ignored." << LogEnd;
-            bufsize = 0;
-            return -1;
+            Log(Debug) << "Received data on address " << TIPv6Addr(myAddrPacked).getPlain()
+                       << ", expected " << *sock->getAddr() << ", message ignored." << LogEnd;
+            return false;
     }
 #endif
+    return true;
+}
 
-    bufsize = result;
-    return sock->getFD();
+/// @brief enables or disables batched reception and transmission
+///
+/// When enabled, all datagrams waiting on a readable socket are received
+/// at once (recvmmsg) and returned by subsequent select() calls. Data sent
+/// while such batch is processed is queued and sent at once (sendmmsg)
+/// before select() waits for more data. Supported on Linux only.
+/// Disabling batching disables io_uring as well.
+///
+/// @param batching should batching be used?
+void TIfaceMgr::setBatching(bool batching) {
+#ifdef LINUX
+    if (!batching) {
+        setRing(false);
+        flushSend();
+    }
+    Batching_ = batching;
+    if (batching && RxBuf_.empty())
+        RxBuf_.resize(LOWLEVEL_MAX_BATCH * IFACEMGR_MAX_PKT_SIZE);
+#endif
+}
+
+/// @brief enables or disables io_uring based reception and transmission
+///
+/// When enabled, every open socket has a multishot receive posted in
+/// TSocketRing, so received data is waited for and fetched from the ring
+/// instead of the reactor. Replies are sent in batches (see setBatching(),
+/// which is enabled as well), all of them submitted in a single system
+/// call. If the ring can't be created, nothing changes.
+///
+/// @param ring should io_uring be used?
+///
+/// @return true if io_uring is used (or disabled as requested)
+bool TIfaceMgr::setRing(bool ring) {
+#ifdef LINUX
+    TSocketRing& sockRing = TIfaceSocket::getRing();
+    if (!ring) {
+        if (Ring_) {
+            flushSend();
+            Ring_ = false;
+            sockRing.close();
+            releaseSent();
+        }
+        return true;
+    }
+    if (Ring_)
+        return true;
+    if (!sockRing.open())
+        return false;
+
+    // sockets opened later are added by TIfaceSocket itself
+    firstIface();
+    while (SPtr<TIfaceIface> iface = getIface()) {
+        iface->firstSocket();
+        while (SPtr<TIfaceSocket> sock = iface->getSocket())
+            sockRing.add(sock->getFD());
+    }
+    setBatching(true);
+    Ring_ = true;
+    return true;
+#else
+    return !ring;
+#endif
+}
+
+/// @brief returns name of the mechanism used to wait for data
+const char * TIfaceMgr::getBackend() const {
+    if (Ring_)
+        return "io_uring";
+    return TIfaceSocket::getReactor().getBackend();
+}
+
+/// @brief returns true if sent data is queued (received batch is processed)
+bool TIfaceMgr::isQueueing() const {
+    return Batching_ && BatchActive_;
+}
+
+/// @brief queues data for transmission, if a received batch is processed
+///
+/// Data is not copied. If queued, the buffer is owned by IfaceMgr until
+/// it is sent (by flushSend() or later, when io_uring completes it) and is
+/// then handed to releaseSendBuffer().
+///
+/// @param fd socket descriptor
+/// @param iface interface index
+/// @param buf buffer with data to be sent (starting at its beginning)
+/// @param len data length
+/// @param addr destination address
+/// @param port destination port
+///
+/// @return true if data was queued, false if it should be sent immediately
+bool TIfaceMgr::queueSend(int fd, int iface, std::vector<char> * buf, int len,
+                          SPtr<TIPv6Addr> addr, int port) {
+    if (!isQueueing())
+        return false;
+
+    TQueuedPacket pkt;
+    pkt.FD = fd;
+    pkt.Iface = iface;
+    pkt.Port = port;
+    memcpy(pkt.Peer, addr->getAddr(), 16);
+    memset(pkt.Local, 0, 16);
+    pkt.Buf = buf;
+    pkt.Len = len;
+    TxQueue_.push_back(pkt);
+    return true;
+}
+
+/// @brief disposes of a transmitted buffer passed to queueSend()
+///
+/// @param buf buffer that is no longer used
+void TIfaceMgr::releaseSendBuffer(std::vector<char> * buf) {
+    delete buf;
+}
+
+/// @brief releases buffers of sends completed by io_uring
+void TIfaceMgr::releaseSent() {
+    std::vector<std::vector<char>*> sent;
+    TIfaceSocket::getRing().takeSent(sent);
+    for (size_t i = 0; i < sent.size(); i++)
+        releaseSendBuffer(sent[i]);
+}
+
+/// @brief sends queued data and finishes batch statistics
+void TIfaceMgr::flushSend() {
+#ifdef LINUX
+    struct sock_msg msgs[LOWLEVEL_MAX_BATCH];
+    size_t i = 0;
+    if (Ring_ && !TxQueue_.empty()) {
+        TSocketRing& ring = TIfaceSocket::getRing();
+        for (; i < TxQueue_.size(); i++) {
+            TQueuedPacket& pkt = TxQueue_[i];
+            msgs[0].buf = &(*pkt.Buf)[0];
+            msgs[0].buflen = pkt.Len;
+            memcpy(msgs[0].peer, pkt.Peer, 16);
+            msgs[0].port = pkt.Port;
+            msgs[0].iface = pkt.Iface;
+            if (ring.send(pkt.FD, msgs[0], pkt.Buf)) {
+                // buffer is returned by the ring when sent
+                pkt.Buf = NULL;
+                BatchStats_.Sent++;
+                continue;
+            }
+            // no free slot in the ring, send it directly
+            if (sock_send_bin(pkt.FD, pkt.Peer, msgs[0].buf, msgs[0].buflen,
+                                 pkt.Port, pkt.Iface) < 0) {
+                Log(Warning) << "Failed to send queued packet over socket " << pkt.FD
+                             << "." << LogEnd;
+                continue;
+            }
+            BatchStats_.Sent++;
+        }
+        if (!ring.submit()) {
+            Log(Warning) << "Failed to submit " << TxQueue_.size()
+                         << " queued packet(s) to io_uring: " << strerror(errno) << LogEnd;
+        }
+    }
+    while (i < TxQueue_.size()) {
+        // consecutive packets sent over the same socket go in one call
+        int fd = TxQueue_[i].FD;
+        int count = 0;
+        while (i + count < TxQueue_.size() && TxQueue_[i + count].FD == fd
+               && count < LOWLEVEL_MAX_BATCH) {
+            TQueuedPacket& pkt = TxQueue_[i + count];
+            msgs[count].buf = &(*pkt.Buf)[0];
+            msgs[count].buflen = pkt.Len;
+            memcpy(msgs[count].peer, pkt.Peer, 16);
+            msgs[count].port = pkt.Port;
+            msgs[count].iface = pkt.Iface;
+            count++;
+        }
+        int sent = sock_send_batch(fd, msgs, count);
+        if (sent < count) {
+            Log(Warning) << "Failed to send " << count - (sent > 0 ? sent : 0) << " of "
+                         << count << " queued packet(s) over socket " << fd << "." << LogEnd;
+        }
+        if (sent > 0)
+            BatchStats_.Sent += sent;
+        i += count;
+    }
+#endif
+    for (size_t j = 0; j < TxQueue_.size(); j++) {
+        if (TxQueue_[j].Buf)
+            releaseSendBuffer(TxQueue_[j].Buf);
+    }
+    TxQueue_.clear();
+#ifdef LINUX
+    if (Ring_)
+        releaseSent();
+
+    if (BatchActive_) {
+        unsigned long usec = nowUsec() - BatchStart_;
+        BatchStats_.TotalUsec += usec;
+        if (usec > BatchStats_.MaxUsec)
+            BatchStats_.MaxUsec = usec;
+        BatchActive_ = false;
+    }
+#endif
+}
+
+/// @brief returns statistics of batched processing
+const TBatchStats& TIfaceMgr::getBatchStats() const {
+    return BatchStats_;
+}
+
+/// @brief receives all datagrams waiting on a socket
+///
+/// @param fd socket descriptor
+///
+/// @return true if anything was received
+bool TIfaceMgr::receiveBatch(int fd) {
+#ifdef LINUX
+    struct sock_msg msgs[LOWLEVEL_MAX_BATCH];
+    for (int i = 0; i < LOWLEVEL_MAX_BATCH; i++) {
+        msgs[i].buf = &RxBuf_[i * IFACEMGR_MAX_PKT_SIZE];
+        msgs[i].buflen = IFACEMGR_MAX_PKT_SIZE;
+    }
+
+    int count = sock_recv_batch(fd, msgs, LOWLEVEL_MAX_BATCH);
+    if (count < 0) {
+        Log(Error) << "Socket recvmmsg() failure detected." << LogEnd;
+        return false;
+    }
+    if (!count)
+        return false;
+
+    for (int i = 0; i < count; i++)
+        queueReceived(fd, msgs[i]);
+    startBatch(count);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief receives datagrams from all sockets through io_uring
+///
+/// @param msec timeout (in milliseconds)
+///
+/// @return number of received datagrams, 0 on timeout or -1 on error
+int TIfaceMgr::receiveRing(unsigned long msec) {
+#ifdef LINUX
+    struct sock_msg msgs[LOWLEVEL_MAX_BATCH];
+    int fds[LOWLEVEL_MAX_BATCH];
+    for (int i = 0; i < LOWLEVEL_MAX_BATCH; i++) {
+        msgs[i].buf = &RxBuf_[i * IFACEMGR_MAX_PKT_SIZE];
+        msgs[i].buflen = IFACEMGR_MAX_PKT_SIZE;
+    }
+
+    int count = TIfaceSocket::getRing().receive(msec, fds, msgs, LOWLEVEL_MAX_BATCH);
+    // completed sends are reported together with received data
+    releaseSent();
+    if (count <= 0)
+        return count;
+
+    for (int i = 0; i < count; i++)
+        queueReceived(fds[i], msgs[i]);
+    startBatch(count);
+    return count;
+#else
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
+
+/// @brief appends received datagram to reception queue
+///
+/// @param fd socket descriptor
+/// @param msg received datagram
+void TIfaceMgr::queueReceived(int fd, const struct sock_msg& msg) {
+#ifdef LINUX
+    TQueuedPacket pkt;
+    pkt.FD = fd;
+    pkt.Iface = msg.iface;
+    pkt.Port = 0;
+    memcpy(pkt.Peer, msg.peer, 16);
+    memcpy(pkt.Local, msg.local, 16);
+    pkt.Data.assign(msg.buf, msg.len);
+    pkt.Buf = NULL;
+    pkt.Len = 0;
+    RxQueue_.push_back(pkt);
+#endif
+}
+
+/// @brief starts processing of a received batch
+///
+/// @param count number of datagrams in the batch
+void TIfaceMgr::startBatch(int count) {
+#ifdef LINUX
+    BatchActive_ = true;
+    BatchStart_ = nowUsec();
+    BatchStats_.Batches++;
+    BatchStats_.Packets += count;
+    if ((unsigned long)count > BatchStats_.MaxSize)
+        BatchStats_.MaxSize = count;
+#endif
+}
+
+/// @brief returns the first packet from reception queue
+///
+/// @param buf buffer
+/// @param bufsize buffer size
+/// @param peer [out] sender address
+/// @param myaddr [out] local IPv6 address
+///
+/// @return socket descriptor (or -1 if the packet was dropped)
+int TIfaceMgr::popReceived(char *buf, int &bufsize, SPtr<TIPv6Addr> peer,
+                           SPtr<TIPv6Addr> myaddr) {
+    TQueuedPacket pkt = RxQueue_.front();
+    RxQueue_.pop_front();
+
+    // socket might have been closed while the batch was processed
+    TIfaceSocket * sock = TIfaceSocket::getReactor().getSocket(pkt.FD);
+    if (!sock || !acceptDstAddr(sock, pkt.Local)) {
+        bufsize = 0;
+        return -1;
+    }
+
+    if ((int)pkt.Data.size() > bufsize) {
+        Log(Warning) << "Received " << pkt.Data.size() << " bytes, but only " << bufsize
+                     << " bytes fit in the buffer. Message truncated." << LogEnd;
+    } else {
+        bufsize = (int)pkt.Data.size();
+    }
+    memcpy(buf, pkt.Data.data(), bufsize);
+    peer->setAddr(pkt.Peer);
+    myaddr->setAddr(pkt.Local);
+    RecvIface_ = pkt.Iface;
+    return pkt.FD;
+}
+
+/// @brief returns index of interface the last datagram was received over
+///
+/// Taken from IPV6_PKTINFO, so it is known even for sockets bound to ::
+/// that receive on many interfaces. Reported only when batching is
+/// enabled (see setBatching()).
+///
+/// @return interface index (or 0 if not known)
+int TIfaceMgr::getRecvIface() const {
+    return RecvIface_;
 }
 
 /*
@@ -476,6 +901,8 @@ void TIfaceMgr::notifyScripts(const std::string& scriptName, SPtr<TMsg> question
 
 /// @brief closes all sockets
 void TIfaceMgr::closeSockets() {
+    flushSend();
+    RxQueue_.clear();
     Log(Debug) << "Closing all sockets." << LogEnd;
     firstIface();
     while (SPtr<TIfaceIface> iface = getIface()) {
@@ -18,9 +18,23 @@ class TIfaceMgr;
 
 #include "Iface.h"
 
+#include <deque>
+#include <string>
+#include <vector>
+
 class TMsg;
 class TOpt;
 
+/// @brief statistics of batched packet processing
+struct TBatchStats {
+    unsigned long Batches;   ///< number of received batches
+    unsigned long Packets;   ///< packets received in batches
+    unsigned long MaxSize;   ///< largest batch (in packets)
+    unsigned long Sent;      ///< packets sent in batches
+    unsigned long TotalUsec; ///< total time from batch reception to flush (in usec)
+    unsigned long MaxUsec;   ///< longest time from batch reception to flush (in usec)
+};
+
 class TIfaceMgr {
   public:
     friend std::ostream & operator <<(std::ostream & strum, TIfaceMgr &x);
@@ -38,6 +52,9 @@ class TIfaceMgr {
     // ---other---
     int select(unsigned long time, char *buf, int &bufsize, SPtr<TIPv6Addr> peer,
                SPtr<TIPv6Addr> myaddr);
+    int selectMsec(unsigned long msec, char *buf, int &bufsize, SPtr<TIPv6Addr> peer,
+                   SPtr<TIPv6Addr> myaddr);
+    int getRecvIface() const;
     std::string printMac(char * mac, int macLen);
     void dump();
     bool isDone();
@@ -51,14 +68,57 @@ class TIfaceMgr {
 
     virtual void closeSockets();
 
+    // ---batched transmission---
+    void setBatching(bool batching);
+    bool setRing(bool ring);
+    const char * getBackend() const;
+    bool isQueueing() const;
+    bool queueSend(int fd, int iface, std::vector<char> * buf, int len,
+                   SPtr<TIPv6Addr> addr, int port);
+    void flushSend();
+    const TBatchStats& getBatchStats() const;
+
     virtual ~TIfaceMgr();
 
  protected:
     virtual void optionToEnv(TNotifyScriptParams& params, SPtr<TOpt> opt, std::string txtPrefix );
+    virtual void releaseSendBuffer(std::vector<char> * buf);
 
     std::string XmlFile;
     List(TIfaceIface) IfaceLst; //Interface list
     bool IsDone;
+
+ private:
+    /// packet waiting in reception or transmission queue
+    struct TQueuedPacket {
+        int FD;
+        int Iface;          ///< receiving interface or destination scope
+        int Port;           ///< destination port (transmission only)
+        char Peer[16];      ///< packed source or destination address
+        char Local[16];     ///< packed local address (reception only)
+        std::string Data;   ///< received data (reception only)
+        std::vector<char> * Buf; ///< owned buffer with data (transmission only)
+        int Len;            ///< length of data in Buf (transmission only)
+    };
+
+    bool receiveBatch(int fd);
+    int receiveRing(unsigned long msec);
+    void queueReceived(int fd, const struct sock_msg& msg);
+    void startBatch(int count);
+    void releaseSent();
+    int popReceived(char *buf, int &bufsize, SPtr<TIPv6Addr> peer,
+                    SPtr<TIPv6Addr> myaddr);
+    bool acceptDstAddr(TIfaceSocket * sock, char * myAddrPacked);
+
+    bool Batching_;
+    bool Ring_;                           ///< io_uring is used instead of reactor
+    bool BatchActive_;                    ///< received batch is being processed
+    int RecvIface_;                       ///< interface the last datagram came from
+    unsigned long BatchStart_;            ///< reception time of that batch (in usec)
+    std::deque<TQueuedPacket> RxQueue_;
+    std::vector<TQueuedPacket> TxQueue_;
+    std::vector<char> RxBuf_;             ///< reception buffers for whole batch
+    TBatchStats BatchStats_;
 };
 
 #endif
@@ -25,7 +25,7 @@ using namespace std;
  * static elements of TIfaceSocket class
  */ 
 int TIfaceSocket::Count=0;
-int TIfaceSocket::MaxFD=0;
+bool TIfaceSocket::ReusePort=false;
 
 /**
  * creates socket bound to specific address on this interface
@@ -38,9 +38,6 @@ int TIfaceSocket::MaxFD=0;
  */
 TIfaceSocket::TIfaceSocket(char * iface, int ifindex, int port,
 				   SPtr<TIPv6Addr> addr, bool ifaceonly, bool reuse) { 
-    if (this->Count==0) {
-	FD_ZERO(getFDS());
-    }
     this->Count++;
     this->createSocket(iface, ifindex, addr, port, ifaceonly, reuse);
 }
@@ -59,10 +56,6 @@ enum EState TIfaceSocket::getStatus() {
  * @param reuse      should socket be bound with reuse flag in setsockopt()?
  */
 TIfaceSocket::TIfaceSocket(char * iface,int ifaceid, int port,bool ifaceonly, bool reuse) {
-    if (this->Count==0) {
-	FD_ZERO(getFDS());
-    }
-
     // bind it to any address (::)
     char anyaddr[] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
     SPtr<TIPv6Addr> smartAny (new TIPv6Addr(anyaddr));   
@@ -99,9 +92,10 @@ int TIfaceSocket::createSocket(char * iface, int ifaceid, SPtr<TIPv6Addr> addr,
     else
         this->Multicast = false;
 
-    // create socket
+    // create socket (other server processes may be bound to the same port)
     sock = sock_add(this->Iface, this->IfaceID, addr->getPlain(), 
-		    this->Port, ifaceonly?1:0, reuse?1:0);
+		    this->Port, ifaceonly?1:0,
+		    ReusePort ? LOWLEVEL_REUSE_PORT : (reuse?1:0));
 
     if (sock<0) {
 	printError(sock, iface, ifaceid, addr, port);
@@ -109,13 +103,19 @@ int TIfaceSocket::createSocket(char * iface, int ifaceid, SPtr<TIPv6Addr> addr,
 	return -3;
     }
 
+    // reactor refuses descriptors it is unable to watch (e.g. above FD_SETSIZE)
+    if (!getReactor().add(sock, this)) {
+	Log(Error) << "Unable to watch socket " << sock << " on " << addr->getPlain()
+		   << ":" << port << " on interface " << iface << "/" << ifaceid
+		   << ", closing it." << LogEnd;
+	sock_del(sock);
+	this->Status = STATE_FAILED;
+	return -4;
+    }
+
     this->FD = sock;
     this->Status = STATE_CONFIGURED;
-
-    // add FileDescriptior fd_set using FD_SET macro
-    FD_SET(this->FD,this->getFDS());
-    if (FD>MaxFD)
-        MaxFD = FD;
+    getRing().add(this->FD);
 
     return 0;
 }
@@ -129,15 +129,27 @@ int TIfaceSocket::createSocket(char * iface, int ifaceid, SPtr<TIPv6Addr> addr,
  * returns number of bytes sent or -1 if something went wrong
  */
 int TIfaceSocket::send(char * buf,int len, SPtr<TIPv6Addr> addr,int port) {
+    return send(buf, len, addr, port, this->IfaceID);
+}
+
+/**
+ * sends data through socket over specified interface (used by sockets
+ * bound to :: that serve several interfaces)
+ * @param buf - buffer to send
+ * @param len - number of bytes to send
+ * @param addr - where send this data
+ * @param port - to which port
+ * @param ifindex - scope of link-local destination address
+ * returns number of bytes sent or -1 if something went wrong
+ */
+int TIfaceSocket::send(char * buf,int len, SPtr<TIPv6Addr> addr,int port, int ifindex) {
 
     int result;
     
-    //extern "C" int sock_send(int fd, char * addr, char * buf, int buflen, int port, int ifaceID);
-
-    result = sock_send(this->FD, addr->getPlain(), buf, len, port, this->IfaceID);
+    result = sock_send_bin(this->FD, addr->getAddr(), buf, len, port, ifindex);
 
     if (result<0) {
-	printError(result, this->Iface, this->IfaceID, addr, port);
+	printError(result, this->Iface, ifindex, addr, port);
 	return -1;
     }
 
@@ -145,40 +157,85 @@ int TIfaceSocket::send(char * buf,int len, SPtr<TIPv6Addr> addr,int port) {
     return result;
 }
 
+/**
+ * joins multicast group on specified interface, so a socket bound
+ * to :: receives data sent to that group over that interface.
+ * Supported on Linux only.
+ * @param ifindex - interface index
+ * @param group - multicast address
+ * returns true if group was joined
+ */
+bool TIfaceSocket::join(int ifindex, SPtr<TIPv6Addr> group) {
+#ifdef LINUX
+    int result = sock_join(this->FD, ifindex, group->getAddr());
+    if (result<0) {
+	printError(result, this->Iface, ifindex, group, this->Port);
+	return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * opens sockets with SO_REUSEPORT, so several server processes may be
+ * bound to the same address and port. Supported on Linux only.
+ * @param reuse - should sockets be shared with other processes?
+ * returns false if sharing was requested, but is not supported (sockets
+ * are not shared then)
+ */
+bool TIfaceSocket::setReusePort(bool reuse) {
+#ifdef LINUX
+    if (reuse && !sock_reuseport_supported()) {
+	ReusePort = false;
+	return false;
+    }
+    ReusePort = reuse;
+    return true;
+#else
+    ReusePort = false;
+    return !reuse;
+#endif
+}
+
 /**
  * receives data from socket
  * @param buf - received data are stored here
  * @param addr - will contain info about sender
  */
 int TIfaceSocket::recv(char * buf, SPtr<TIPv6Addr> addr) {
-    char myPlainAddr[48];
-    char peerPlainAddr[48];
+    char myAddr[16];
+    char peerAddr[16];
 
     // maximum DHCPv6 packet size
     int len=1500;
 
-    len = sock_recv(this->FD, myPlainAddr, peerPlainAddr, buf, len);
+    len = sock_recv_bin(this->FD, myAddr, peerAddr, buf, len);
 
     if ( len  < 0 ) {
 	printError(len, this->Iface, this->IfaceID, addr, this->Port);
         return -1;
     }
 
-    // convert to packed form (plain->16-byte)
-    char packedAddr[16];
-    inet_pton6(peerPlainAddr,packedAddr);
-    addr->setAddr(packedAddr);
+    addr->setAddr(peerAddr);
     return len;
 }
 
 /**
- * returns FDS - FileDescriptorSet 
- * it's some really weird POSIX macro. It uses FD_SET, FD_ZERO and FD_CLR macros
- * defined somewhere in system headers
+ * returns reactor that watches all open sockets
+ */
+TSocketReactor& TIfaceSocket::getReactor() {
+    static TSocketReactor Reactor;
+    return Reactor;
+}
+
+/**
+ * returns io_uring used to receive on all open sockets (if enabled)
  */
-fd_set * TIfaceSocket::getFDS() {
-    static fd_set FDS;
-    return &FDS;
+TSocketRing& TIfaceSocket::getRing() {
+    static TSocketRing Ring;
+    return Ring;
 }
 
 /**
@@ -210,7 +267,7 @@ SPtr<TIPv6Addr> TIfaceSocket::getAddr() {
 }
 
 /**
- * closes socket, and removes its number from FDS
+ * closes socket, and stops watching it in the reactor
  */
 TIfaceSocket::~TIfaceSocket() {
     if (Status!=STATE_CONFIGURED) 
@@ -219,11 +276,12 @@ TIfaceSocket::~TIfaceSocket() {
     Log(Debug) << "Closing socket " << this->FD << " on " << Addr->getPlain()
                << ":" << Port << " on interface " << Iface << "/" << IfaceID << LogEnd;
 
+    getReactor().del(this->FD);
+    getRing().del(this->FD);
+
     //execute low-level function
     sock_del(this->FD);
 
-    FD_CLR(this->FD,getFDS());
-
     this->Count--;
 }
 
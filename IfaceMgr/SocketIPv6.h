@@ -23,6 +23,8 @@ class TIfaceSocket;
 #include "DHCPConst.h"
 #include "IPv6Addr.h"
 #include "SmartPtr.h"
+#include "SocketReactor.h"
+#include "SocketRing.h"
 
 /*
  * repesents network socket
@@ -37,6 +39,7 @@ class TIfaceSocket {
    
     // ---transmission---
     int send(char * buf,int len, SPtr<TIPv6Addr> addr,int port);
+    int send(char * buf,int len, SPtr<TIPv6Addr> addr,int port, int ifindex);
     int recv(char * buf,SPtr<TIPv6Addr> addr);
     
     // ---get info---
@@ -47,13 +50,15 @@ class TIfaceSocket {
     SPtr<TIPv6Addr> getAddr();
     enum EState getStatus();
 
-    // ---select() stuff---
-    // FileDescriptors Set, for use with select()
-    // (it's really messed up. fd_set is some really weird macro used
-    //  with POSIX select() function. )
-    static fd_set * getFDS();
-    inline static int getMaxFD() { return MaxFD; }
+    // reactor watching all open sockets (replaces select() fd_set)
+    static TSocketReactor& getReactor();
+    static TSocketRing& getRing();
     inline bool multicast() { return Multicast; }
+    bool join(int ifindex, SPtr<TIPv6Addr> group);
+
+    // sockets shared with other processes (SO_REUSEPORT)
+    static bool setReusePort(bool reuse);
+    inline static bool getReusePort() { return ReusePort; }
 
     ~TIfaceSocket();
  private:
@@ -89,10 +94,9 @@ class TIfaceSocket {
     // true = bounded to multicast socket
     bool Multicast;
 
-    // Static element. Class needs to know, when first object is
-    // created. It call FD_SET to zero fd_set 
+    // number of open sockets
     static int Count;
-    static int MaxFD; // needed instead of FD_MAXSIZE on Macs
+    static bool ReusePort; // open sockets with SO_REUSEPORT
 };
 
 
@@ -0,0 +1,201 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include "Portable.h"
+#ifdef LINUX
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+#if !defined(WIN32)
+#include <sys/select.h>
+#include <sys/time.h>
+#endif
+#include <errno.h>
+#include <string.h>
+#include "SocketReactor.h"
+#include "Logger.h"
+
+const int TSocketReactor::TIMEOUT;
+const int TSocketReactor::FAILURE;
+
+TSocketReactor::TSocketReactor() {
+#ifdef LINUX
+    EpollFD_ = -1;
+#endif
+}
+
+TSocketReactor::~TSocketReactor() {
+#ifdef LINUX
+    if (EpollFD_ >= 0)
+        close(EpollFD_);
+#endif
+}
+
+/// @brief starts watching a descriptor
+///
+/// @param fd file descriptor
+/// @param sock socket that owns the descriptor (may be NULL)
+///
+/// @return true if descriptor is watched
+bool TSocketReactor::add(int fd, TIfaceSocket * sock) {
+    if (fd < 0)
+        return false;
+    if (Sockets_.find(fd) != Sockets_.end()) {
+        Sockets_[fd] = sock;
+        return true;
+    }
+
+#ifdef LINUX
+    if (!open())
+        return false;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(EpollFD_, EPOLL_CTL_ADD, fd, &ev)) {
+        Log(Error) << "Unable to watch socket " << fd << ": " << strerror(errno)
+                   << LogEnd;
+        return false;
+    }
+#else
+    if (fd >= FD_SETSIZE) {
+        Log(Error) << "Unable to watch socket " << fd << ": descriptor exceeds "
+                   << FD_SETSIZE << " limit." << LogEnd;
+        return false;
+    }
+#endif
+
+    Sockets_[fd] = sock;
+    return true;
+}
+
+/// @brief stops watching a descriptor
+///
+/// Must be called before the descriptor is closed.
+///
+/// @param fd file descriptor
+///
+/// @return true if descriptor was watched
+bool TSocketReactor::del(int fd) {
+    SocketMap::iterator it = Sockets_.find(fd);
+    if (it == Sockets_.end())
+        return false;
+    Sockets_.erase(it);
+
+#ifdef LINUX
+    struct epoll_event ev; // ignored, but required by kernels before 2.6.9
+    memset(&ev, 0, sizeof(ev));
+    epoll_ctl(EpollFD_, EPOLL_CTL_DEL, fd, &ev);
+#endif
+    return true;
+}
+
+/// @brief returns socket registered with descriptor (or NULL)
+TIfaceSocket * TSocketReactor::getSocket(int fd) const {
+    SocketMap::const_iterator it = Sockets_.find(fd);
+    if (it == Sockets_.end())
+        return NULL;
+    return it->second;
+}
+
+/// @brief returns number of watched descriptors
+size_t TSocketReactor::count() const {
+    return Sockets_.size();
+}
+
+/// @brief waits until any of watched descriptors is readable
+///
+/// @param msec timeout (in milliseconds)
+///
+/// @return readable descriptor, TIMEOUT or FAILURE (errno is preserved)
+int TSocketReactor::wait(unsigned long msec) {
+    if (Ready_.empty() && !poll(msec))
+        return FAILURE;
+
+    while (!Ready_.empty()) {
+        int fd = Ready_.front();
+        Ready_.pop_front();
+        // descriptor might have been removed after it was reported
+        if (Sockets_.find(fd) != Sockets_.end())
+            return fd;
+    }
+    return TIMEOUT;
+}
+
+/// @brief returns name of the mechanism used to wait for data
+const char * TSocketReactor::getBackend() const {
+#ifdef LINUX
+    return "epoll";
+#else
+    return "select";
+#endif
+}
+
+#ifdef LINUX
+/// @brief creates epoll descriptor (if not created yet)
+///
+/// @return false if epoll is not available
+bool TSocketReactor::open() {
+    if (EpollFD_ >= 0)
+        return true;
+    EpollFD_ = epoll_create(SOCKETREACTOR_MAX_EVENTS);
+    if (EpollFD_ < 0) {
+        Log(Error) << "Unable to create epoll descriptor: " << strerror(errno)
+                   << LogEnd;
+        return false;
+    }
+    return true;
+}
+#endif
+
+/// @brief asks the kernel for readable descriptors and queues them
+///
+/// @param msec timeout (in milliseconds)
+///
+/// @return false if waiting failed
+bool TSocketReactor::poll(unsigned long msec) {
+    // both epoll_wait() and select() accept signed timeouts
+    if (msec > 0x7fffffffUL)
+        msec = 0x7fffffffUL;
+
+#ifdef LINUX
+    if (!open())
+        return false;
+    struct epoll_event events[SOCKETREACTOR_MAX_EVENTS];
+    int result = epoll_wait(EpollFD_, events, SOCKETREACTOR_MAX_EVENTS, (int)msec);
+    if (result < 0)
+        return false;
+    for (int i = 0; i < result; i++)
+        Ready_.push_back(events[i].data.fd);
+#else
+    fd_set fds;
+    FD_ZERO(&fds);
+    int maxFD = -1;
+    for (SocketMap::const_iterator it = Sockets_.begin(); it != Sockets_.end(); ++it) {
+        FD_SET(it->first, &fds);
+        if (it->first > maxFD)
+            maxFD = it->first;
+    }
+
+    struct timeval tv;
+    tv.tv_sec = msec / 1000;
+    tv.tv_usec = (msec % 1000) * 1000;
+    int result = ::select(maxFD + 1, &fds, NULL, NULL, &tv);
+    if (result < 0)
+        return false;
+    for (SocketMap::const_iterator it = Sockets_.begin();
+         result > 0 && it != Sockets_.end(); ++it) {
+        if (FD_ISSET(it->first, &fds)) {
+            Ready_.push_back(it->first);
+            result--;
+        }
+    }
+#endif
+    return true;
+}
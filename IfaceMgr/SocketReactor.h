@@ -0,0 +1,71 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TSocketReactor;
+#ifndef SOCKETREACTOR_H
+#define SOCKETREACTOR_H
+
+#include <stddef.h>
+#include <map>
+#include <deque>
+
+class TIfaceSocket;
+
+/// maximum number of events fetched from the kernel at once
+#define SOCKETREACTOR_MAX_EVENTS 64
+
+/// @brief Waits for data on a set of sockets
+///
+/// Keeps a direct map of file descriptors to sockets, so finding the
+/// socket that received data does not require walking all interfaces.
+/// On Linux, epoll is used, so the cost of waiting does not depend on
+/// the number of sockets and there is no FD_SETSIZE limit. Other
+/// systems use select(). Timeout is specified in milliseconds.
+///
+/// If several sockets are ready at once, they are queued and returned
+/// by subsequent calls to wait() without asking the kernel again.
+class TSocketReactor
+{
+  public:
+    /// returned by wait() if nothing was received before timeout
+    static const int TIMEOUT = -1;
+    /// returned by wait() if waiting failed
+    static const int FAILURE = -2;
+
+    TSocketReactor();
+    ~TSocketReactor();
+
+    bool add(int fd, TIfaceSocket * sock);
+    bool del(int fd);
+    TIfaceSocket * getSocket(int fd) const;
+    size_t count() const;
+
+    int wait(unsigned long msec);
+    const char * getBackend() const;
+
+  private:
+    // not copyable
+    TSocketReactor(const TSocketReactor&);
+    TSocketReactor& operator=(const TSocketReactor&);
+
+    bool poll(unsigned long msec);
+#ifdef LINUX
+    bool open();
+#endif
+
+    typedef std::map<int, TIfaceSocket*> SocketMap;
+
+    SocketMap Sockets_;     ///< registered descriptors
+    std::deque<int> Ready_; ///< descriptors reported ready, not returned yet
+#ifdef LINUX
+    int EpollFD_;
+#endif
+};
+
+#endif
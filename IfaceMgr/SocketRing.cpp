@@ -0,0 +1,587 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include "SocketRing.h"
+#include "Logger.h"
+#ifdef HAVE_IO_URING
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+#endif
+
+#ifdef HAVE_IO_URING
+
+/// space reserved for control data (IPV6_PKTINFO) in receive buffers
+#define SOCKETRING_CONTROL_SIZE 64
+
+// request type is stored in the top bits of user_data
+#define RING_RECV   1ULL
+#define RING_SEND   2ULL
+#define RING_CANCEL 3ULL
+
+/// @brief builds user_data of a request
+///
+/// @param kind request type
+/// @param gen generation of the receive (RING_RECV only)
+/// @param id socket descriptor or send slot
+static uint64_t ringTag(uint64_t kind, unsigned int gen, unsigned int id) {
+    return (kind << 62) | ((uint64_t)(gen & 0x3fffffff) << 32) | id;
+}
+
+/// @brief returns current monotonic time in milliseconds
+static unsigned long ringNowMsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+TSocketRing::TSocketRing()
+    :RingFD_(-1), SqMem_(NULL), SqMemLen_(0), CqMem_(NULL), CqMemLen_(0),
+     Sqes_(NULL), SqesLen_(0), SqHead_(NULL), SqTail_(NULL), SqMask_(NULL),
+     SqArray_(NULL), CqHead_(NULL), CqTail_(NULL), CqMask_(NULL), Cqes_(NULL),
+     SqEntries_(0), SqPending_(0), Failed_(false), BufRing_(NULL), BufTail_(0),
+     Gen_(0) {
+    for (int i = 0; i < SOCKETRING_SEND_SLOTS; i++)
+        Slots_[i].Buf = NULL;
+}
+
+#else
+
+TSocketRing::TSocketRing() {
+}
+
+#endif
+
+TSocketRing::~TSocketRing() {
+    close();
+    for (size_t i = 0; i < Sent_.size(); i++)
+        delete Sent_[i];
+}
+
+/// @brief creates the ring (if not created yet)
+///
+/// @return false if io_uring is not available
+bool TSocketRing::open() {
+#ifdef HAVE_IO_URING
+    if (RingFD_ >= 0)
+        return true;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    RingFD_ = (int)syscall(__NR_io_uring_setup, SOCKETRING_ENTRIES, &params);
+    if (RingFD_ < 0) {
+        Log(Warning) << "Unable to create io_uring: " << strerror(errno) << LogEnd;
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        Log(Warning) << "Kernel io_uring implementation is too old." << LogEnd;
+        close();
+        return false;
+    }
+
+    SqEntries_ = params.sq_entries;
+    SqMemLen_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    CqMemLen_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (CqMemLen_ > SqMemLen_)
+            SqMemLen_ = CqMemLen_;
+        CqMemLen_ = 0;
+    }
+    SqesLen_ = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    SqMem_ = mmap(NULL, SqMemLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  RingFD_, IORING_OFF_SQ_RING);
+    if (SqMem_ == MAP_FAILED) {
+        SqMem_ = NULL;
+        Log(Warning) << "Unable to map io_uring: " << strerror(errno) << LogEnd;
+        close();
+        return false;
+    }
+    if (CqMemLen_) {
+        CqMem_ = mmap(NULL, CqMemLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      RingFD_, IORING_OFF_CQ_RING);
+        if (CqMem_ == MAP_FAILED) {
+            CqMem_ = NULL;
+            Log(Warning) << "Unable to map io_uring: " << strerror(errno) << LogEnd;
+            close();
+            return false;
+        }
+    }
+    void * sqes = mmap(NULL, SqesLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       RingFD_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        Log(Warning) << "Unable to map io_uring: " << strerror(errno) << LogEnd;
+        close();
+        return false;
+    }
+    Sqes_ = (struct io_uring_sqe*)sqes;
+
+    char * sq = (char*)SqMem_;
+    char * cq = CqMem_ ? (char*)CqMem_ : sq;
+    SqHead_  = (unsigned int*)(sq + params.sq_off.head);
+    SqTail_  = (unsigned int*)(sq + params.sq_off.tail);
+    SqMask_  = (unsigned int*)(sq + params.sq_off.ring_mask);
+    SqArray_ = (unsigned int*)(sq + params.sq_off.array);
+    CqHead_  = (unsigned int*)(cq + params.cq_off.head);
+    CqTail_  = (unsigned int*)(cq + params.cq_off.tail);
+    CqMask_  = (unsigned int*)(cq + params.cq_off.ring_mask);
+    Cqes_    = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // ring of buffers the kernel picks from when data arrives
+    void * bufRing = mmap(NULL, SOCKETRING_BUFFERS * sizeof(struct io_uring_buf),
+                          PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufRing == MAP_FAILED) {
+        Log(Warning) << "Unable to allocate io_uring buffers: " << strerror(errno) << LogEnd;
+        close();
+        return false;
+    }
+    BufRing_ = (struct io_uring_buf_ring*)bufRing;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)BufRing_;
+    reg.ring_entries = SOCKETRING_BUFFERS;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, RingFD_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        Log(Warning) << "Unable to register io_uring buffers: " << strerror(errno) << LogEnd;
+        close();
+        return false;
+    }
+
+    Buffers_.resize(SOCKETRING_BUFFERS * SOCKETRING_BUF_SIZE);
+    BufTail_ = 0;
+    for (unsigned int i = 0; i < SOCKETRING_BUFFERS; i++)
+        recycle(i);
+
+    FreeSlots_.clear();
+    for (int i = SOCKETRING_SEND_SLOTS - 1; i >= 0; i--)
+        FreeSlots_.push_back(i);
+    SqPending_ = 0;
+    Failed_ = false;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief destroys the ring, all pending requests are cancelled
+void TSocketRing::close() {
+#ifdef HAVE_IO_URING
+    if (RingFD_ >= 0)
+        ::close(RingFD_);
+    RingFD_ = -1;
+    if (BufRing_)
+        munmap(BufRing_, SOCKETRING_BUFFERS * sizeof(struct io_uring_buf));
+    if (Sqes_)
+        munmap(Sqes_, SqesLen_);
+    if (CqMem_)
+        munmap(CqMem_, CqMemLen_);
+    if (SqMem_)
+        munmap(SqMem_, SqMemLen_);
+    BufRing_ = NULL;
+    Sqes_ = NULL;
+    CqMem_ = NULL;
+    SqMem_ = NULL;
+    Recvs_.clear();
+    Buffers_.clear();
+    FreeSlots_.clear();
+    for (int i = 0; i < SOCKETRING_SEND_SLOTS; i++) {
+        if (Slots_[i].Buf)
+            Sent_.push_back(Slots_[i].Buf);
+        Slots_[i].Buf = NULL;
+    }
+    SqPending_ = 0;
+#endif
+}
+
+/// @brief returns true if the ring was created
+bool TSocketRing::isOpen() const {
+#ifdef HAVE_IO_URING
+    return RingFD_ >= 0;
+#else
+    return false;
+#endif
+}
+
+/// @brief starts receiving on a socket
+///
+/// Socket must have IPV6_RECVPKTINFO enabled to report local addresses.
+///
+/// @param fd socket descriptor
+///
+/// @return true if receive was queued
+bool TSocketRing::add(int fd) {
+#ifdef HAVE_IO_URING
+    if (RingFD_ < 0 || fd < 0)
+        return false;
+    if (Recvs_.find(fd) != Recvs_.end())
+        return true;
+
+    TRecv& recv = Recvs_[fd];
+    memset(&recv.Hdr, 0, sizeof(recv.Hdr));
+    recv.Hdr.msg_namelen = sizeof(struct sockaddr_in6);
+    recv.Hdr.msg_controllen = SOCKETRING_CONTROL_SIZE;
+    recv.Gen = ++Gen_;
+    if (!arm(fd, recv)) {
+        Recvs_.erase(fd);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief stops receiving on a socket
+///
+/// Must be called before the descriptor is closed, as the posted receive
+/// keeps the socket alive until it is cancelled.
+///
+/// @param fd socket descriptor
+///
+/// @return true if socket was added before
+bool TSocketRing::del(int fd) {
+#ifdef HAVE_IO_URING
+    std::map<int, TRecv>::iterator it = Recvs_.find(fd);
+    if (it == Recvs_.end())
+        return false;
+
+    struct io_uring_sqe * sqe = getSqe();
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = ringTag(RING_RECV, it->second.Gen, fd);
+        sqe->user_data = ringTag(RING_CANCEL, 0, fd);
+    }
+    Recvs_.erase(it);
+    submit();
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief returns number of sockets receiving through the ring
+size_t TSocketRing::count() const {
+#ifdef HAVE_IO_URING
+    return Recvs_.size();
+#else
+    return 0;
+#endif
+}
+
+/// @brief returns received datagrams, waits if there are none
+///
+/// Queued sends are submitted before waiting. Caller provides buffers in
+/// msgs[].buf and msgs[].buflen, other fields are filled in.
+///
+/// @param msec timeout (in milliseconds)
+/// @param fds [out] descriptors of sockets that received datagrams
+/// @param msgs [out] received datagrams
+/// @param count size of both arrays
+///
+/// @return number of datagrams (0 on timeout) or -1 on error (errno is set)
+int TSocketRing::receive(unsigned long msec, int * fds, struct sock_msg * msgs, int count) {
+#ifdef HAVE_IO_URING
+    if (RingFD_ < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    unsigned long deadline = ringNowMsec() + msec;
+    int n = 0;
+    while (true) {
+        unsigned int head = *CqHead_;
+        unsigned int tail = __atomic_load_n(CqTail_, __ATOMIC_ACQUIRE);
+        while (head != tail && n < count) {
+            struct io_uring_cqe * cqe = &Cqes_[head & *CqMask_];
+            switch (cqe->user_data >> 62) {
+            case RING_RECV:
+                if (handleRecv(cqe, fds[n], msgs[n]))
+                    n++;
+                break;
+            case RING_SEND: {
+                int slot = (int)(cqe->user_data & 0xffffffffULL);
+                if (cqe->res < 0) {
+                    char plain[48];
+                    inet_ntop6((char*)&Slots_[slot].Dst.sin6_addr, plain);
+                    Log(Warning) << "Unable to send data to " << plain << ": "
+                                 << strerror(-cqe->res) << LogEnd;
+                }
+                Sent_.push_back(Slots_[slot].Buf);
+                Slots_[slot].Buf = NULL;
+                FreeSlots_.push_back(slot);
+                break;
+            }
+            default:
+                break;
+            }
+            head++;
+        }
+        __atomic_store_n(CqHead_, head, __ATOMIC_RELEASE);
+
+        if (Failed_) {
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+        if (n)
+            return n;
+
+        // completions of sends and cancels don't count, wait until deadline
+        unsigned long now = ringNowMsec();
+        if (now >= deadline && msec)
+            return 0;
+        int result = enter(1, msec ? deadline - now : 0);
+        if (result < 0)
+            return -1;
+        if (!result && !msec)
+            return 0;
+    }
+#else
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
+
+/// @brief queues a datagram for transmission
+///
+/// Data is not copied: on success the ring takes ownership of buf and
+/// keeps it until the send completes, then hands it back by takeSent().
+/// Datagram is passed to the kernel by the next submit() or receive().
+///
+/// @param fd socket descriptor
+/// @param msg datagram (buf, buflen, peer, port and iface are used)
+/// @param buf buffer that msg.buf points into
+///
+/// @return false if datagram was not queued and should be sent directly
+bool TSocketRing::send(int fd, const struct sock_msg& msg, std::vector<char> * buf) {
+#ifdef HAVE_IO_URING
+    if (RingFD_ < 0 || FreeSlots_.empty())
+        return false;
+    struct io_uring_sqe * sqe = getSqe();
+    if (!sqe)
+        return false;
+
+    int slot = FreeSlots_.back();
+    FreeSlots_.pop_back();
+    TSendSlot& s = Slots_[slot];
+    s.Buf = buf;
+    memset(&s.Dst, 0, sizeof(s.Dst));
+    s.Dst.sin6_family = AF_INET6;
+    s.Dst.sin6_port = htons(msg.port);
+    memcpy(&s.Dst.sin6_addr, msg.peer, 16);
+    if (IN6_IS_ADDR_LINKLOCAL(&s.Dst.sin6_addr) || IN6_IS_ADDR_MC_LINKLOCAL(&s.Dst.sin6_addr))
+        s.Dst.sin6_scope_id = msg.iface;
+    s.Iov.iov_base = msg.buf;
+    s.Iov.iov_len = msg.buflen;
+    memset(&s.Hdr, 0, sizeof(s.Hdr));
+    s.Hdr.msg_name = &s.Dst;
+    s.Hdr.msg_namelen = sizeof(s.Dst);
+    s.Hdr.msg_iov = &s.Iov;
+    s.Hdr.msg_iovlen = 1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)&s.Hdr;
+    sqe->len = 1;
+    sqe->user_data = ringTag(RING_SEND, 0, slot);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief passes queued requests to the kernel
+///
+/// @return false if submission failed
+bool TSocketRing::submit() {
+#ifdef HAVE_IO_URING
+    if (RingFD_ < 0)
+        return false;
+    if (!SqPending_)
+        return true;
+    return enter(0, 0) >= 0;
+#else
+    return false;
+#endif
+}
+
+/// @brief returns buffers of completed sends to the caller
+///
+/// @param bufs [out] buffers passed to send() that are no longer used
+void TSocketRing::takeSent(std::vector<std::vector<char>*>& bufs) {
+    bufs.insert(bufs.end(), Sent_.begin(), Sent_.end());
+    Sent_.clear();
+}
+
+#ifdef HAVE_IO_URING
+/// @brief queues multishot receive on a socket
+bool TSocketRing::arm(int fd, TRecv& recv) {
+    struct io_uring_sqe * sqe = getSqe();
+    if (!sqe) {
+        Log(Error) << "Unable to receive on socket " << fd << ": io_uring is full." << LogEnd;
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)&recv.Hdr;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_TRUNC;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = ringTag(RING_RECV, recv.Gen, fd);
+    return true;
+}
+
+/// @brief returns next free submission queue entry (cleared)
+///
+/// Entry is published immediately. This is safe, as the kernel looks at
+/// the queue only when asked to by io_uring_enter().
+///
+/// @return entry or NULL if the queue is full
+struct io_uring_sqe * TSocketRing::getSqe() {
+    unsigned int tail = *SqTail_;
+    if (tail - __atomic_load_n(SqHead_, __ATOMIC_ACQUIRE) >= SqEntries_) {
+        enter(0, 0);
+        if (tail - __atomic_load_n(SqHead_, __ATOMIC_ACQUIRE) >= SqEntries_)
+            return NULL;
+    }
+    unsigned int idx = tail & *SqMask_;
+    struct io_uring_sqe * sqe = &Sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    SqArray_[idx] = idx;
+    __atomic_store_n(SqTail_, tail + 1, __ATOMIC_RELEASE);
+    SqPending_++;
+    return sqe;
+}
+
+/// @brief submits queued requests and optionally waits for completions
+///
+/// @param wait number of completions to wait for (0 or 1)
+/// @param msec timeout (in milliseconds), used if wait is set
+///
+/// @return 1 if completions may be available, 0 on timeout, -1 on error
+int TSocketRing::enter(unsigned int wait, unsigned long msec) {
+    unsigned int flags = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (wait) {
+        ts.tv_sec = msec / 1000;
+        ts.tv_nsec = (msec % 1000) * 1000000;
+        arg.ts = (uintptr_t)&ts;
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    int result = (int)syscall(__NR_io_uring_enter, RingFD_, SqPending_, wait, flags,
+                              wait ? &arg : NULL, sizeof(arg));
+    if (result < 0) {
+        if (errno == ETIME)
+            return 0;
+        if (errno != EINTR)
+            Log(Debug) << "io_uring_enter() failed: " << strerror(errno) << LogEnd;
+        return -1;
+    }
+    SqPending_ = (unsigned int)result < SqPending_ ? SqPending_ - result : 0;
+    return 1;
+}
+
+/// @brief processes completion of a receive
+///
+/// Multishot receive stops on errors or when buffers run out. It is
+/// posted again then, unless the socket was removed meanwhile.
+///
+/// @param cqe completion
+/// @param fd [out] socket descriptor
+/// @param msg [out] received datagram
+///
+/// @return true if datagram was stored in msg
+bool TSocketRing::handleRecv(struct io_uring_cqe * cqe, int& fd, struct sock_msg& msg) {
+    int sock = (int)(cqe->user_data & 0xffffffffULL);
+    unsigned int gen = (unsigned int)(cqe->user_data >> 32) & 0x3fffffff;
+    std::map<int, TRecv>::iterator it = Recvs_.find(sock);
+    bool current = (it != Recvs_.end()) && ((it->second.Gen & 0x3fffffff) == gen);
+    bool received = false;
+    unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    bool hasBuf = (cqe->flags & IORING_CQE_F_BUFFER) && bid < SOCKETRING_BUFFERS;
+
+    if (cqe->res >= 0 && hasBuf && current) {
+        char * buf = &Buffers_[bid * SOCKETRING_BUF_SIZE];
+        struct io_uring_recvmsg_out * out = (struct io_uring_recvmsg_out*)buf;
+        char * name = buf + sizeof(*out);
+        char * control = name + it->second.Hdr.msg_namelen;
+        char * payload = control + it->second.Hdr.msg_controllen;
+        size_t avail = (size_t)cqe->res - (payload - buf);
+
+        if ((out->flags & MSG_TRUNC) || out->payloadlen > avail
+            || (int)out->payloadlen > msg.buflen) {
+            Log(Warning) << "Received too large datagram (" << out->payloadlen
+                         << " bytes) on socket " << sock << ", ignored." << LogEnd;
+        } else {
+            struct sockaddr_in6 * peer = (struct sockaddr_in6*)name;
+            memset(msg.peer, 0, 16);
+            memset(msg.local, 0, 16);
+            msg.port = 0;
+            msg.iface = 0;
+            if (out->namelen >= sizeof(struct sockaddr_in6)) {
+                memcpy(msg.peer, &peer->sin6_addr, 16);
+                msg.port = ntohs(peer->sin6_port);
+            }
+
+            struct msghdr hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_control = control;
+            hdr.msg_controllen = out->controllen;
+            for (struct cmsghdr * cm = CMSG_FIRSTHDR(&hdr); cm; cm = CMSG_NXTHDR(&hdr, cm)) {
+                if (cm->cmsg_level == IPPROTO_IPV6 && cm->cmsg_type == IPV6_PKTINFO) {
+                    struct in6_pktinfo * pktInfo = (struct in6_pktinfo*)CMSG_DATA(cm);
+                    memcpy(msg.local, &pktInfo->ipi6_addr, 16);
+                    msg.iface = pktInfo->ipi6_ifindex;
+                }
+            }
+
+            memcpy(msg.buf, payload, out->payloadlen);
+            msg.len = (int)out->payloadlen;
+            fd = sock;
+            received = true;
+        }
+    }
+    if (hasBuf)
+        recycle(bid);
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && current) {
+        if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+            Log(Error) << "Multishot receive is not supported by kernel: "
+                       << strerror(-cqe->res) << LogEnd;
+            Failed_ = true;
+        } else if (!arm(sock, it->second)) {
+            Recvs_.erase(it);
+        }
+    }
+    return received;
+}
+
+/// @brief gives receive buffer back to the kernel
+void TSocketRing::recycle(unsigned int bid) {
+    // bufs[] member is shifted by an empty struct in C++, so it's not used
+    struct io_uring_buf * buf = (struct io_uring_buf*)BufRing_
+        + (BufTail_ & (SOCKETRING_BUFFERS - 1));
+    buf->addr = (uintptr_t)&Buffers_[bid * SOCKETRING_BUF_SIZE];
+    buf->len = SOCKETRING_BUF_SIZE;
+    buf->bid = (unsigned short)bid;
+    BufTail_++;
+    __atomic_store_n(&BufRing_->tail, BufTail_, __ATOMIC_RELEASE);
+}
+#endif
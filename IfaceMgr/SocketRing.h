@@ -0,0 +1,127 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TSocketRing;
+#ifndef SOCKETRING_H
+#define SOCKETRING_H
+
+#include <stddef.h>
+#include <map>
+#include <vector>
+#include <string>
+#include "Portable.h"
+
+#ifdef LINUX
+#include <linux/version.h>
+// multishot recvmsg and provided buffer rings were added in Linux 6.0
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,0,0)
+#define HAVE_IO_URING 1
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+/// number of receive buffers shared by all sockets (power of 2)
+#define SOCKETRING_BUFFERS 64
+/// size of a receive buffer (headers, addresses and data)
+#define SOCKETRING_BUF_SIZE 8192
+/// maximum number of sends submitted, but not completed yet
+#define SOCKETRING_SEND_SLOTS 64
+/// number of submission queue entries
+#define SOCKETRING_ENTRIES 256
+
+/// @brief Receives and sends datagrams through io_uring
+///
+/// Each added socket has a multishot receive posted, so the kernel keeps
+/// receiving into a ring of shared buffers without further requests.
+/// Sends are only queued in the submission ring and passed to the kernel
+/// together by submit() or by the next receive(), so processing a batch
+/// of packets costs a single system call regardless of its size.
+///
+/// Available on Linux 6.0 or newer only. If io_uring can't be used
+/// (older kernel, disabled by administrator or seccomp), open() fails
+/// and the caller is expected to use TSocketReactor instead.
+class TSocketRing
+{
+  public:
+    TSocketRing();
+    ~TSocketRing();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    bool add(int fd);
+    bool del(int fd);
+    size_t count() const;
+
+    int receive(unsigned long msec, int * fds, struct sock_msg * msgs, int count);
+    bool send(int fd, const struct sock_msg& msg, std::vector<char> * buf);
+    bool submit();
+    void takeSent(std::vector<std::vector<char>*>& bufs);
+
+  private:
+    // not copyable
+    TSocketRing(const TSocketRing&);
+    TSocketRing& operator=(const TSocketRing&);
+
+#ifdef HAVE_IO_URING
+    /// multishot receive posted on a socket
+    struct TRecv {
+        struct msghdr Hdr;      ///< layout of name and control data in buffers
+        unsigned int Gen;       ///< distinguishes reused descriptors
+    };
+
+    /// send in progress
+    struct TSendSlot {
+        struct msghdr Hdr;
+        struct iovec Iov;
+        struct sockaddr_in6 Dst;
+        std::vector<char> * Buf;    ///< sent data, owned until completion
+    };
+
+    bool arm(int fd, TRecv& recv);
+    struct io_uring_sqe * getSqe();
+    int enter(unsigned int wait, unsigned long msec);
+    bool handleRecv(struct io_uring_cqe * cqe, int& fd, struct sock_msg& msg);
+    void recycle(unsigned int bid);
+
+    int RingFD_;
+    void * SqMem_;
+    size_t SqMemLen_;
+    void * CqMem_;
+    size_t CqMemLen_;
+    struct io_uring_sqe * Sqes_;
+    size_t SqesLen_;
+    unsigned int * SqHead_;
+    unsigned int * SqTail_;
+    unsigned int * SqMask_;
+    unsigned int * SqArray_;
+    unsigned int * CqHead_;
+    unsigned int * CqTail_;
+    unsigned int * CqMask_;
+    struct io_uring_cqe * Cqes_;
+    unsigned int SqEntries_;
+    unsigned int SqPending_;        ///< entries not submitted yet
+    bool Failed_;                   ///< multishot receive not supported
+
+    struct io_uring_buf_ring * BufRing_;
+    std::vector<char> Buffers_;
+    unsigned short BufTail_;
+
+    std::map<int, TRecv> Recvs_;
+    unsigned int Gen_;
+    TSendSlot Slots_[SOCKETRING_SEND_SLOTS];
+    std::vector<int> FreeSlots_;
+#endif
+    std::vector<std::vector<char>*> Sent_; ///< buffers of completed sends
+};
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * author: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "DnsConnPool.h"
+#include "DNSUpdate.h"
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+
+/// @brief stand-in DNS server, answers every message received over TCP
+///
+/// Answer is the header of the query with QR bit and configured RCODE set
+/// and all sections empty.
+class FakeDnsServer {
+public:
+    FakeDnsServer()
+        :rcode_(RCODE_NOERROR), closeAfter_(0), connections_(0), messages_(0),
+         authority_(0), additional_(0), stop_(false) {
+        fd_ = socket(AF_INET6, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_loopback;
+        bind(fd_, (struct sockaddr*)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(fd_, (struct sockaddr*)&addr, &len);
+        port_ = ntohs(addr.sin6_port);
+        listen(fd_, 5);
+        pthread_create(&thread_, NULL, run, this);
+    }
+
+    ~FakeDnsServer() {
+        stop_ = true;
+        shutdown(fd_, SHUT_RDWR);
+        pthread_join(thread_, NULL);
+        close(fd_);
+    }
+
+    /// returns server address in the form accepted by DNSUpdate
+    string address() const {
+        char buf[32];
+        sprintf(buf, "::1#%d", port_);
+        return buf;
+    }
+
+    static void * run(void * server) {
+        ((FakeDnsServer*)server)->serve();
+        return NULL;
+    }
+
+    /// handles one connection at a time
+    void serve() {
+        while (!stop_) {
+            int conn = accept(fd_, NULL, NULL);
+            if (conn < 0)
+                return;
+            connections_++;
+            int on = 1;
+            setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            unsigned int answered = 0;
+            unsigned char buf[TCP_MSG_SIZE + 2];
+            while (readAll(conn, buf, 2)) {
+                int len = buf[0] * 256 + buf[1];
+                if (len < 12 || !readAll(conn, buf + 2, len))
+                    break;
+                messages_++;
+                authority_ = buf[10] * 256 + buf[11];
+                additional_ = buf[12] * 256 + buf[13];
+                unsigned char answer[14];
+                answer[0] = 0;
+                answer[1] = 12;
+                memcpy(answer + 2, buf + 2, 4);
+                answer[4] |= 0x80;
+                answer[5] = (answer[5] & 0xf0) | rcode_;
+                memset(answer + 6, 0, 8);
+                if (::send(conn, answer, sizeof(answer), 0) != sizeof(answer))
+                    break;
+                if (closeAfter_ && ++answered == closeAfter_)
+                    break;
+            }
+            close(conn);
+        }
+    }
+
+    static bool readAll(int fd, unsigned char * buf, int len) {
+        while (len > 0) {
+            int ret = recv(fd, buf, len, 0);
+            if (ret <= 0)
+                return false;
+            buf += ret;
+            len -= ret;
+        }
+        return true;
+    }
+
+    int rcode_;                ///< RCODE of every answer
+    unsigned int closeAfter_;  ///< connection is closed after that many answers (0 = never)
+    volatile unsigned int connections_;
+    volatile unsigned int messages_;
+    volatile unsigned int authority_;  ///< number of records in the last update
+    volatile unsigned int additional_; ///< number of additional records (e.g. TSIG)
+
+private:
+    int fd_;
+    int port_;
+    volatile bool stop_;
+    pthread_t thread_;
+};
+
+/// creates n queries
+void createQueries(vector<DnsMessage*>& queries, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        queries.push_back(create_query(domainname("example.org"), DNS_TYPE_SOA));
+}
+
+void clear(vector<DnsMessage*>& msgs) {
+    for (size_t i = 0; i < msgs.size(); i++)
+        delete msgs[i];
+    msgs.clear();
+}
+
+// checks that several messages are sent over a single connection
+TEST(DnsConnPoolTest, pipelining) {
+    FakeDnsServer server;
+    TDnsConnPool pool;
+    _addr addr;
+    txt_to_addr(&addr, server.address().c_str());
+
+    vector<DnsMessage*> queries, answers;
+    vector<string> errors;
+    createQueries(queries, 3);
+    pool.exchange(addr, queries, answers, errors, 1000);
+
+    ASSERT_EQ(3u, answers.size());
+    ASSERT_EQ(3u, errors.size());
+    for (size_t i = 0; i < answers.size(); i++) {
+        ASSERT_TRUE(answers[i]) << errors[i];
+        EXPECT_EQ("", errors[i]);
+        EXPECT_EQ(queries[i]->ID, answers[i]->ID);
+        EXPECT_TRUE(answers[i]->QR);
+    }
+    EXPECT_NE(queries[0]->ID, queries[1]->ID);
+    EXPECT_NE(queries[1]->ID, queries[2]->ID);
+    EXPECT_EQ(1u, server.connections_);
+    EXPECT_EQ(3u, server.messages_);
+    EXPECT_EQ(1u, pool.count());
+    clear(answers);
+
+    // connection is reused
+    pool.exchange(addr, queries, answers, errors, 1000);
+    EXPECT_TRUE(answers[0] && answers[1] && answers[2]);
+    EXPECT_EQ(1u, server.connections_);
+    EXPECT_EQ(6u, server.messages_);
+    clear(answers);
+
+    TDnsConnPool::TStats stats = pool.getStats();
+    EXPECT_EQ(1u, stats.Connects);
+    EXPECT_EQ(0u, stats.Reconnects);
+    EXPECT_EQ(6u, stats.Messages);
+    EXPECT_EQ(2u, stats.Exchanges);
+
+    pool.closeAll();
+    EXPECT_EQ(0u, pool.count());
+    clear(queries);
+}
+
+// checks that connection closed by the server is reopened
+TEST(DnsConnPoolTest, reconnect) {
+    FakeDnsServer server;
+    server.closeAfter_ = 1;
+    TDnsConnPool pool;
+    _addr addr;
+    txt_to_addr(&addr, server.address().c_str());
+
+    vector<DnsMessage*> queries, answers;
+    vector<string> errors;
+    createQueries(queries, 1);
+    pool.exchange(addr, queries, answers, errors, 1000);
+    EXPECT_TRUE(answers[0]);
+    clear(answers);
+
+    // wait for the server to close the connection
+    usleep(100000);
+
+    pool.exchange(addr, queries, answers, errors, 1000);
+    EXPECT_TRUE(answers[0]) << errors[0];
+    EXPECT_EQ("", errors[0]);
+    clear(answers);
+
+    EXPECT_EQ(2u, server.connections_);
+    EXPECT_EQ(2u, pool.getStats().Connects);
+    EXPECT_EQ(1u, pool.getStats().Reconnects);
+    clear(queries);
+}
+
+// checks that failure is reported if the server is not there
+TEST(DnsConnPoolTest, noServer) {
+    string address;
+    {
+        FakeDnsServer server;
+        address = server.address();
+    }
+    TDnsConnPool pool;
+    _addr addr;
+    txt_to_addr(&addr, address.c_str());
+
+    vector<DnsMessage*> queries, answers;
+    vector<string> errors;
+    createQueries(queries, 2);
+    pool.exchange(addr, queries, answers, errors, 1000);
+    for (size_t i = 0; i < 2; i++) {
+        EXPECT_FALSE(answers[i]);
+        EXPECT_NE("", errors[i]);
+    }
+    EXPECT_EQ(0u, pool.count());
+    clear(queries);
+}
+
+// checks that DNS Updates for the same server share a connection
+TEST(DnsConnPoolTest, sendAll) {
+    FakeDnsServer server;
+    TDnsConnPool pool;
+
+    vector<DNSUpdate*> updates;
+    updates.push_back(new DNSUpdate(server.address(), "", "foo.example.org", "2001:db8:1::1",
+                                    DNSUPDATE_AAAA, DNSUpdate::DNSUPDATE_TCP));
+    updates.push_back(new DNSUpdate(server.address(), "", "bar.example.net", "2001:db8:1::2",
+                                    DNSUPDATE_AAAA, DNSUpdate::DNSUPDATE_TCP));
+    for (size_t i = 0; i < updates.size(); i++) {
+        EXPECT_EQ(DNSUPDATE_SUCCESS, updates[i]->prepare());
+        updates[i]->setConnPool(&pool);
+    }
+
+    vector<DnsUpdateResult> results;
+    DNSUpdate::sendAll(updates, 1000, results);
+    ASSERT_EQ(2u, results.size());
+    EXPECT_EQ(DNSUPDATE_SUCCESS, results[0]);
+    EXPECT_EQ(DNSUPDATE_SUCCESS, results[1]);
+
+    // old records lookups and both updates (zones differ, so they are not coalesced)
+    EXPECT_EQ(1u, server.connections_);
+    EXPECT_EQ(4u, server.messages_);
+
+    // error reported by the server
+    server.rcode_ = RCODE_REFUSED;
+    DNSUpdate::sendAll(updates, 1000, results);
+    EXPECT_EQ(DNSUPDATE_ERROR, results[0]);
+    EXPECT_EQ(DNSUPDATE_ERROR, results[1]);
+    EXPECT_EQ(1u, server.connections_);
+    EXPECT_EQ(6u, server.messages_);
+
+    for (size_t i = 0; i < updates.size(); i++)
+        delete updates[i];
+}
+
+// checks that updates of the same zone are sent in one signed message
+TEST(DnsConnPoolTest, coalesce) {
+    FakeDnsServer server;
+    TDnsConnPool pool;
+
+    vector<DNSUpdate*> updates;
+    updates.push_back(new DNSUpdate(server.address(), "", "foo.example.org", "2001:db8:1::1",
+                                    DNSUPDATE_AAAA, DNSUpdate::DNSUPDATE_TCP));
+    updates.push_back(new DNSUpdate(server.address(), "", "bar.example.org", "2001:db8:1::2",
+                                    DNSUPDATE_AAAA_CLEANUP, DNSUpdate::DNSUPDATE_TCP));
+    updates.push_back(new DNSUpdate(server.address(), "", "baz.example.org", "2001:db8:1::3",
+                                    DNSUPDATE_AAAA, DNSUpdate::DNSUPDATE_TCP));
+    for (size_t i = 0; i < updates.size(); i++) {
+        updates[i]->setTSIG("DDNS_KEY", "9SYMLnjK2ohb1N/56GZ5Jg==",
+                            "HMAC-MD5.SIG-ALG.REG.INT", 300);
+        EXPECT_EQ(DNSUPDATE_SUCCESS, updates[i]->prepare());
+        updates[i]->setConnPool(&pool);
+    }
+
+    vector<DnsUpdateResult> results;
+    DNSUpdate::sendAll(updates, 1000, results);
+    ASSERT_EQ(3u, results.size());
+    for (size_t i = 0; i < results.size(); i++)
+        EXPECT_EQ(DNSUPDATE_SUCCESS, results[i]);
+
+    // one zone lookup and one update with all records and single TSIG
+    EXPECT_EQ(2u, server.messages_);
+    EXPECT_EQ(3u, server.authority_);
+    EXPECT_EQ(1u, server.additional_);
+
+    // rejected message is sent again, update by update
+    server.rcode_ = RCODE_REFUSED;
+    DNSUpdate::sendAll(updates, 1000, results);
+    for (size_t i = 0; i < results.size(); i++)
+        EXPECT_EQ(DNSUPDATE_ERROR, results[i]);
+    EXPECT_EQ(6u, server.messages_);
+    EXPECT_EQ(1u, server.authority_);
+
+    // server refusing to update the zone at all is not asked again
+    server.rcode_ = RCODE_NOTAUTH;
+    DNSUpdate::sendAll(updates, 1000, results);
+    for (size_t i = 0; i < results.size(); i++)
+        EXPECT_EQ(DNSUPDATE_SRVNOTAUTH, results[i]);
+    EXPECT_EQ(7u, server.messages_);
+
+    for (size_t i = 0; i < updates.size(); i++)
+        delete updates[i];
+}
+
+// checks that coalesced message does not exceed maximum message size
+TEST(DnsConnPoolTest, coalesceLimit) {
+    FakeDnsServer server;
+    TDnsConnPool pool;
+
+    vector<DNSUpdate*> updates;
+    for (int i = 0; i < 1500; i++) {
+        char name[64], addr[64];
+        sprintf(name, "host%d.example.org", i);
+        sprintf(addr, "2001:db8:1::%x", i);
+        updates.push_back(new DNSUpdate(server.address(), "", name, addr,
+                                        DNSUPDATE_AAAA_CLEANUP, DNSUpdate::DNSUPDATE_TCP));
+        updates.back()->prepare();
+        updates.back()->setConnPool(&pool);
+    }
+
+    vector<DnsUpdateResult> results;
+    DNSUpdate::sendAll(updates, 1000, results);
+    ASSERT_EQ(1500u, results.size());
+    for (size_t i = 0; i < results.size(); i++)
+        ASSERT_EQ(DNSUPDATE_SUCCESS, results[i]);
+
+    // zone lookup and two updates
+    EXPECT_EQ(3u, server.messages_);
+    EXPECT_GT(1500u, server.authority_);
+
+    for (size_t i = 0; i < updates.size(); i++)
+        delete updates[i];
+}
+
+}
@@ -0,0 +1,99 @@
+#include <unistd.h>
+#include <time.h>
+#include "SocketReactor.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+class SocketReactorTest : public ::testing::Test {
+public:
+    SocketReactorTest() {
+        for (int i = 0; i < 2; i++) {
+            fds_[i][0] = fds_[i][1] = -1;
+            EXPECT_EQ(0, pipe(fds_[i]));
+        }
+    }
+
+    ~SocketReactorTest() {
+        for (int i = 0; i < 2; i++) {
+            close(fds_[i][0]);
+            close(fds_[i][1]);
+        }
+    }
+
+    void send(int i) {
+        char c = 'x';
+        EXPECT_EQ(1, write(fds_[i][1], &c, 1));
+    }
+
+    void recv(int i) {
+        char c;
+        EXPECT_EQ(1, read(fds_[i][0], &c, 1));
+    }
+
+    int fds_[2][2]; // two pipes, [0] is read end
+};
+
+TEST_F(SocketReactorTest, timeout) {
+    TSocketReactor reactor;
+    EXPECT_TRUE(reactor.add(fds_[0][0], NULL));
+    EXPECT_EQ(1u, reactor.count());
+
+    time_t start = time(NULL);
+    EXPECT_EQ(TSocketReactor::TIMEOUT, reactor.wait(50));
+    EXPECT_GE(1, time(NULL) - start);
+}
+
+TEST_F(SocketReactorTest, readable) {
+    TSocketReactor reactor;
+    TIfaceSocket * fake = (TIfaceSocket*)&reactor; // never dereferenced
+    EXPECT_TRUE(reactor.add(fds_[0][0], NULL));
+    EXPECT_TRUE(reactor.add(fds_[1][0], fake));
+    EXPECT_EQ(2u, reactor.count());
+    EXPECT_TRUE(reactor.getSocket(fds_[1][0]) == fake);
+    EXPECT_TRUE(reactor.getSocket(fds_[0][1]) == NULL);
+
+    send(1);
+    EXPECT_EQ(fds_[1][0], reactor.wait(1000));
+    recv(1);
+    EXPECT_EQ(TSocketReactor::TIMEOUT, reactor.wait(0));
+
+    // both ready, each one is returned once
+    send(0);
+    send(1);
+    int first = reactor.wait(1000);
+    int second = reactor.wait(1000);
+    EXPECT_NE(first, second);
+    EXPECT_TRUE(first == fds_[0][0] || first == fds_[1][0]);
+    EXPECT_TRUE(second == fds_[0][0] || second == fds_[1][0]);
+    recv(0);
+    recv(1);
+    EXPECT_EQ(TSocketReactor::TIMEOUT, reactor.wait(0));
+}
+
+TEST_F(SocketReactorTest, del) {
+    TSocketReactor reactor;
+    EXPECT_TRUE(reactor.add(fds_[0][0], NULL));
+    EXPECT_TRUE(reactor.add(fds_[1][0], NULL));
+    EXPECT_FALSE(reactor.add(-1, NULL));
+
+    EXPECT_TRUE(reactor.del(fds_[0][0]));
+    EXPECT_FALSE(reactor.del(fds_[0][0]));
+    EXPECT_EQ(1u, reactor.count());
+
+    send(0);
+    EXPECT_EQ(TSocketReactor::TIMEOUT, reactor.wait(0));
+
+    // descriptor removed after it was reported ready is not returned
+    send(1);
+    EXPECT_TRUE(reactor.add(fds_[0][0], NULL));
+    int fd = reactor.wait(1000);
+    EXPECT_TRUE(fd == fds_[0][0] || fd == fds_[1][0]);
+    int other = (fd == fds_[0][0]) ? fds_[1][0] : fds_[0][0];
+    EXPECT_TRUE(reactor.del(other));
+    EXPECT_EQ(TSocketReactor::TIMEOUT, reactor.wait(0));
+    recv(0);
+    recv(1);
+}
+
+}
@@ -0,0 +1,246 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+// Compares packets/sec handled by select(), epoll (TSocketReactor),
+// recvmmsg/sendmmsg batches and io_uring (TSocketRing) on loopback.
+//
+// A forked load generator keeps a window of packets in flight to a set
+// of server sockets and the server loop echoes every packet back, the
+// same way TIfaceMgr receives queries and sends replies.
+//
+// usage: SocketRing_bench [seconds] [sockets] [window]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <vector>
+#include "Portable.h"
+#include "SocketReactor.h"
+#include "SocketRing.h"
+
+#define BENCH_PKT_SIZE 128
+#define BENCH_MAX_SOCKETS 64
+
+static double nowSec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int openSocket(int& port) {
+    int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on, sizeof(on));
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr*)&addr, &len);
+    port = ntohs(addr.sin6_port);
+    return fd;
+}
+
+/// sends packets to server sockets, keeps window packets in flight
+static void generator(int fd, const std::vector<int>& ports, int window) {
+    char buf[BENCH_PKT_SIZE];
+    memset(buf, 'x', sizeof(buf));
+    struct sockaddr_in6 dst;
+    memset(&dst, 0, sizeof(dst));
+    dst.sin6_family = AF_INET6;
+    dst.sin6_addr = in6addr_loopback;
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 10000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    size_t next = 0;
+    while (true) {
+        for (int i = 0; i < window; i++) {
+            dst.sin6_port = htons(ports[next++ % ports.size()]);
+            sendto(fd, buf, sizeof(buf), 0, (struct sockaddr*)&dst, sizeof(dst));
+        }
+        // one more packet for every reply, start again if anything got lost
+        while (recv(fd, buf, sizeof(buf), 0) > 0) {
+            dst.sin6_port = htons(ports[next++ % ports.size()]);
+            sendto(fd, buf, sizeof(buf), 0, (struct sockaddr*)&dst, sizeof(dst));
+        }
+    }
+}
+
+static unsigned long runSelect(const std::vector<int>& fds, int port, double end) {
+    char buf[BENCH_PKT_SIZE * 2], my[16], peer[16];
+    unsigned long count = 0;
+    while (nowSec() < end) {
+        fd_set set;
+        FD_ZERO(&set);
+        int maxFD = 0;
+        for (size_t i = 0; i < fds.size(); i++) {
+            FD_SET(fds[i], &set);
+            if (fds[i] > maxFD)
+                maxFD = fds[i];
+        }
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        if (select(maxFD + 1, &set, NULL, NULL, &tv) <= 0)
+            continue;
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (!FD_ISSET(fds[i], &set))
+                continue;
+            int len = sock_recv_bin(fds[i], my, peer, buf, sizeof(buf));
+            if (len > 0 && sock_send_bin(fds[i], peer, buf, len, port, 0) >= 0)
+                count++;
+        }
+    }
+    return count;
+}
+
+static unsigned long runEpoll(const std::vector<int>& fds, int port, double end) {
+    char buf[BENCH_PKT_SIZE * 2], my[16], peer[16];
+    unsigned long count = 0;
+    TSocketReactor reactor;
+    for (size_t i = 0; i < fds.size(); i++)
+        reactor.add(fds[i], NULL);
+    while (nowSec() < end) {
+        int fd = reactor.wait(100);
+        if (fd < 0)
+            continue;
+        int len = sock_recv_bin(fd, my, peer, buf, sizeof(buf));
+        if (len > 0 && sock_send_bin(fd, peer, buf, len, port, 0) >= 0)
+            count++;
+    }
+    return count;
+}
+
+static unsigned long runBatch(const std::vector<int>& fds, int port, double end) {
+    static char bufs[LOWLEVEL_MAX_BATCH][BENCH_PKT_SIZE * 2];
+    struct sock_msg msgs[LOWLEVEL_MAX_BATCH];
+    unsigned long count = 0;
+    TSocketReactor reactor;
+    for (size_t i = 0; i < fds.size(); i++)
+        reactor.add(fds[i], NULL);
+    while (nowSec() < end) {
+        int fd = reactor.wait(100);
+        if (fd < 0)
+            continue;
+        for (int i = 0; i < LOWLEVEL_MAX_BATCH; i++) {
+            msgs[i].buf = bufs[i];
+            msgs[i].buflen = sizeof(bufs[i]);
+        }
+        int n = sock_recv_batch(fd, msgs, LOWLEVEL_MAX_BATCH);
+        for (int i = 0; i < n; i++) {
+            msgs[i].buflen = msgs[i].len;
+            msgs[i].port = port;
+            msgs[i].iface = 0;
+        }
+        if (n > 0) {
+            int sent = sock_send_batch(fd, msgs, n);
+            if (sent > 0)
+                count += sent;
+        }
+    }
+    return count;
+}
+
+static unsigned long runRing(const std::vector<int>& fds, int port, double end) {
+    static char bufs[LOWLEVEL_MAX_BATCH][BENCH_PKT_SIZE * 2];
+    struct sock_msg msgs[LOWLEVEL_MAX_BATCH];
+    int rcvFds[LOWLEVEL_MAX_BATCH];
+    unsigned long count = 0;
+    TSocketRing ring;
+    if (!ring.open())
+        return 0;
+    for (size_t i = 0; i < fds.size(); i++)
+        ring.add(fds[i]);
+    while (nowSec() < end) {
+        for (int i = 0; i < LOWLEVEL_MAX_BATCH; i++) {
+            msgs[i].buf = bufs[i];
+            msgs[i].buflen = sizeof(bufs[i]);
+        }
+        int n = ring.receive(100, rcvFds, msgs, LOWLEVEL_MAX_BATCH);
+        for (int i = 0; i < n; i++) {
+            msgs[i].buflen = msgs[i].len;
+            msgs[i].port = port;
+            msgs[i].iface = 0;
+            if (ring.send(rcvFds[i], msgs[i])
+                || sock_send_bin(rcvFds[i], msgs[i].peer, msgs[i].buf, msgs[i].len,
+                                 port, 0) >= 0)
+                count++;
+        }
+        ring.submit();
+    }
+    return count;
+}
+
+int main(int argc, char * argv[]) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 3;
+    int sockets = argc > 2 ? atoi(argv[2]) : 4;
+    int window = argc > 3 ? atoi(argv[3]) : 64;
+    if (seconds < 1 || sockets < 1 || sockets > BENCH_MAX_SOCKETS || window < 1) {
+        printf("usage: %s [seconds] [sockets (1-%d)] [window]\n", argv[0], BENCH_MAX_SOCKETS);
+        return EXIT_FAILURE;
+    }
+
+    const char * names[] = { "select", "epoll", "recvmmsg", "io_uring" };
+    unsigned long (*modes[])(const std::vector<int>&, int, double) =
+        { runSelect, runEpoll, runBatch, runRing };
+
+    printf("%d socket(s), %d packet(s) in flight, %d byte packets, %d second(s) per test\n",
+           sockets, window, BENCH_PKT_SIZE, seconds);
+    for (int m = 0; m < 4; m++) {
+        std::vector<int> fds;
+        std::vector<int> ports;
+        for (int i = 0; i < sockets; i++) {
+            int port;
+            fds.push_back(openSocket(port));
+            ports.push_back(port);
+        }
+        int clntPort;
+        int clnt = openSocket(clntPort);
+
+        pid_t pid = fork();
+        if (!pid) {
+            generator(clnt, ports, window);
+            _exit(0);
+        }
+
+        double start = nowSec();
+        unsigned long count = modes[m](fds, clntPort, start + seconds);
+        double elapsed = nowSec() - start;
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+
+        if (!count)
+            printf("%-9s: not available\n", names[m]);
+        else
+            printf("%-9s: %10lu packets, %10.0f packets/sec\n", names[m], count,
+                   count / elapsed);
+
+        close(clnt);
+        for (size_t i = 0; i < fds.size(); i++)
+            close(fds[i]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "SocketRing.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+class SocketRingTest : public ::testing::Test {
+public:
+    SocketRingTest() {
+        for (int i = 0; i < 2; i++)
+            fds_[i] = openSocket(ports_[i]);
+    }
+
+    ~SocketRingTest() {
+        for (int i = 0; i < 2; i++)
+            close(fds_[i]);
+    }
+
+    /// opens UDP socket on ::1, port is chosen by kernel
+    int openSocket(int& port) {
+        int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+        EXPECT_LE(0, fd);
+        int on = 1;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on, sizeof(on));
+        struct sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_loopback;
+        EXPECT_EQ(0, bind(fd, (struct sockaddr*)&addr, sizeof(addr)));
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (struct sockaddr*)&addr, &len);
+        port = ntohs(addr.sin6_port);
+        return fd;
+    }
+
+    /// sends data to i-th socket from the other one
+    void send(int i, const char * data) {
+        struct sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_loopback;
+        addr.sin6_port = htons(ports_[i]);
+        EXPECT_EQ((ssize_t)strlen(data), sendto(fds_[1 - i], data, strlen(data), 0,
+                                                (struct sockaddr*)&addr, sizeof(addr)));
+    }
+
+    int fds_[2];
+    int ports_[2];
+    char bufs_[4][512];
+};
+
+TEST_F(SocketRingTest, receive) {
+    TSocketRing ring;
+    if (!ring.open()) {
+        std::cout << "io_uring not available, test skipped." << std::endl;
+        return;
+    }
+    EXPECT_TRUE(ring.isOpen());
+    EXPECT_TRUE(ring.add(fds_[0]));
+    EXPECT_TRUE(ring.add(fds_[1]));
+    EXPECT_TRUE(ring.add(fds_[1])); // already added
+    EXPECT_FALSE(ring.add(-1));
+    EXPECT_EQ(2u, ring.count());
+
+    int fds[4];
+    struct sock_msg msgs[4];
+    for (int i = 0; i < 4; i++) {
+        msgs[i].buf = bufs_[i];
+        msgs[i].buflen = sizeof(bufs_[i]);
+    }
+
+    // nothing sent yet
+    EXPECT_EQ(0, ring.receive(50, fds, msgs, 4));
+
+    send(0, "first");
+    send(0, "second");
+    send(1, "third");
+
+    int total = 0;
+    bool first = false, second = false, third = false;
+    while (total < 3) {
+        int count = ring.receive(1000, fds + total, msgs + total, 4 - total);
+        ASSERT_LT(0, count);
+        total += count;
+    }
+    char loopback[16] = {0};
+    loopback[15] = 1;
+    for (int i = 0; i < 3; i++) {
+        std::string data(msgs[i].buf, msgs[i].len);
+        if (data == "first" || data == "second") {
+            EXPECT_EQ(fds_[0], fds[i]);
+            EXPECT_EQ(ports_[1], msgs[i].port);
+        } else {
+            EXPECT_EQ(fds_[1], fds[i]);
+            EXPECT_EQ(ports_[0], msgs[i].port);
+        }
+        first |= (data == "first");
+        second |= (data == "second");
+        third |= (data == "third");
+        EXPECT_EQ(0, memcmp(loopback, msgs[i].peer, 16));
+        EXPECT_EQ(0, memcmp(loopback, msgs[i].local, 16));
+    }
+    EXPECT_TRUE(first && second && third);
+    EXPECT_EQ(0, ring.receive(0, fds, msgs, 4));
+}
+
+TEST_F(SocketRingTest, send) {
+    TSocketRing ring;
+    if (!ring.open()) {
+        std::cout << "io_uring not available, test skipped." << std::endl;
+        return;
+    }
+    EXPECT_TRUE(ring.add(fds_[1]));
+
+    // many more than there are buffers or send slots
+    char data[] = "reply";
+    struct sock_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.buflen = 5;
+    msg.peer[15] = 1;
+    msg.port = ports_[1];
+    int queued = 0;
+    std::vector<std::vector<char>*> sent;
+    for (int i = 0; i < 3 * SOCKETRING_BUFFERS; i++) {
+        // ring owns the buffer until the send completes
+        std::vector<char> * buf = new std::vector<char>(data, data + 5);
+        msg.buf = &(*buf)[0];
+        if (!ring.send(fds_[0], msg, buf)) {
+            EXPECT_TRUE(ring.submit());
+            int fds[1];
+            struct sock_msg rcv;
+            rcv.buf = bufs_[0];
+            rcv.buflen = sizeof(bufs_[0]);
+            // completions of sends are processed while receiving
+            while (ring.receive(10, fds, &rcv, 1) > 0)
+                queued--;
+            ASSERT_TRUE(ring.send(fds_[0], msg, buf));
+        }
+        queued++;
+    }
+    EXPECT_TRUE(ring.submit());
+
+    int fds[4];
+    struct sock_msg msgs[4];
+    for (int i = 0; i < 4; i++) {
+        msgs[i].buf = bufs_[i];
+        msgs[i].buflen = sizeof(bufs_[i]);
+    }
+    while (queued > 0) {
+        int count = ring.receive(1000, fds, msgs, 4);
+        ASSERT_LT(0, count);
+        for (int i = 0; i < count; i++) {
+            EXPECT_EQ(fds_[1], fds[i]);
+            EXPECT_EQ(std::string("reply"), std::string(msgs[i].buf, msgs[i].len));
+            EXPECT_EQ(ports_[0], msgs[i].port);
+        }
+        queued -= count;
+    }
+    EXPECT_EQ(0, queued);
+
+    // every buffer is handed back once its send is completed
+    ring.takeSent(sent);
+    for (int i = 0; i < 100 && sent.size() < 3 * SOCKETRING_BUFFERS; i++) {
+        ring.receive(10, fds, msgs, 4);
+        ring.takeSent(sent);
+    }
+    EXPECT_EQ(3u * SOCKETRING_BUFFERS, sent.size());
+    for (size_t i = 0; i < sent.size(); i++)
+        delete sent[i];
+}
+
+TEST_F(SocketRingTest, del) {
+    TSocketRing ring;
+    if (!ring.open()) {
+        std::cout << "io_uring not available, test skipped." << std::endl;
+        return;
+    }
+    EXPECT_TRUE(ring.add(fds_[0]));
+    EXPECT_TRUE(ring.add(fds_[1]));
+    EXPECT_TRUE(ring.del(fds_[0]));
+    EXPECT_FALSE(ring.del(fds_[0]));
+    EXPECT_EQ(1u, ring.count());
+
+    int fds[2];
+    struct sock_msg msgs[2];
+    for (int i = 0; i < 2; i++) {
+        msgs[i].buf = bufs_[i];
+        msgs[i].buflen = sizeof(bufs_[i]);
+    }
+
+    // removed socket is not received from any more
+    send(0, "ignored");
+    send(1, "received");
+    ASSERT_EQ(1, ring.receive(1000, fds, msgs, 2));
+    EXPECT_EQ(fds_[1], fds[0]);
+    EXPECT_EQ(std::string("received"), std::string(msgs[0].buf, msgs[0].len));
+    EXPECT_EQ(0, ring.receive(50, fds, msgs, 2));
+
+    ring.close();
+    EXPECT_FALSE(ring.isOpen());
+    EXPECT_EQ(0u, ring.count());
+    EXPECT_FALSE(ring.add(fds_[0]));
+}
+
+}
@@ -64,6 +64,7 @@ void TMsg::setAttribs(int iface, SPtr<TIPv6Addr> addr, int msgType, long transID
 
 int TMsg::getSize()
 {
+    parseAllOptions();
     int pktsize=0;
     TOptList::iterator opt;
     for (opt = Options.begin(); opt!=Options.end(); ++opt)
@@ -90,6 +91,7 @@ long TMsg::getTransID()
 
 TOptList & TMsg::getOptLst()
 {
+    parseAllOptions();
     return Options;
 }
 
@@ -108,6 +110,7 @@ int TMsg::storeSelf(char * buffer)
     buffer[0] = tmp%256;  tmp = tmp/256;
     buffer+=3;
 
+    parseAllOptions();
     TOptList::iterator option;
     for (option=Options.begin(); option!=Options.end(); ++option) {
         (*option)->storeSelf(buffer);
@@ -206,6 +209,16 @@ void TMsg::calculateDigests(char* buffer, size_t len) {
 }
 
 SPtr<TOpt> TMsg::getOption(int type) {
+    // only requested options are parsed
+    for (std::vector<TOptView>::iterator view = OptViews_.begin();
+         view != OptViews_.end(); ++view) {
+        if (view->Type == type) {
+            SPtr<TOpt> opt = getOptionView(*view);
+            if (opt)
+                return opt;
+        }
+    }
+
     TOptList::iterator opt;
     for (opt = Options.begin(); opt!=Options.end(); ++opt)
         if ( (*opt)->getOptType()==type) 
@@ -213,14 +226,125 @@ SPtr<TOpt> TMsg::getOption(int type) {
     return 0;
 }
 
+/// @brief appends all options of specified type (in order of reception)
+///
+/// @param type option type
+/// @param opts options will be appended here
+void TMsg::getOptions(int type, TOptList& opts) {
+    for (std::vector<TOptView>::iterator view = OptViews_.begin();
+         view != OptViews_.end(); ++view) {
+        if (view->Type == type) {
+            SPtr<TOpt> opt = getOptionView(*view);
+            if (opt)
+                opts.push_back(opt);
+        }
+    }
+    for (TOptList::iterator opt = Options.begin(); opt != Options.end(); ++opt)
+        if ((*opt)->getOptType() == type)
+            opts.push_back(*opt);
+}
+
+/// @brief returns types of all options (without parsing them)
+///
+/// Options that were not parsed yet are listed, even if they
+/// later turn out to be invalid.
+///
+/// @param types option types (in order of reception)
+void TMsg::getOptionTypes(std::vector<uint16_t>& types) {
+    types.clear();
+    for (std::vector<TOptView>::const_iterator view = OptViews_.begin();
+         view != OptViews_.end(); ++view) {
+        if (!view->Parsed || view->Opt)
+            types.push_back(view->Type);
+    }
+    for (TOptList::const_iterator opt = Options.begin(); opt != Options.end(); ++opt)
+        types.push_back((*opt)->getOptType());
+}
+
 void TMsg::firstOption() {
+    parseAllOptions();
     NextOpt = Options.begin();
 }
 
 int TMsg::countOption() {
+    parseAllOptions();
     return Options.size();
 }
 
+/// @brief adds received option, that will be parsed on first access
+///
+/// @param type option type
+/// @param offset offset of option data in OptData_
+/// @param len length of option data
+void TMsg::addOptionView(uint16_t type, size_t offset, uint16_t len) {
+    TOptView view;
+    view.Type = type;
+    view.Len = len;
+    view.Offset = offset;
+    view.Parsed = false;
+    OptViews_.push_back(view);
+}
+
+/// @brief adds received option that was already parsed
+///
+/// Keeps the order of received options, if some of them are parsed
+/// immediately and other on first access.
+///
+/// @param opt parsed option (0 if it was invalid)
+void TMsg::addOptionView(SPtr<TOpt> opt) {
+    TOptView view;
+    view.Type = opt ? opt->getOptType() : 0;
+    view.Len = 0;
+    view.Offset = 0;
+    view.Parsed = true;
+    view.Opt = opt;
+    OptViews_.push_back(view);
+}
+
+/// @brief returns received option, parses it if necessary
+///
+/// @param view option to be returned
+///
+/// @return parsed option (or 0 if it is not supported or invalid)
+SPtr<TOpt> TMsg::getOptionView(TOptView& view) {
+    if (!view.Parsed) {
+        view.Parsed = true;
+        view.Opt = parseOption(view.Type, &OptData_[0] + view.Offset, view.Len);
+    }
+    return view.Opt;
+}
+
+/// @brief parses all received options not parsed yet
+///
+/// Parsed options are moved to Options list (in order of reception),
+/// so the rest of the code can use it as usual.
+void TMsg::parseAllOptions() {
+    if (OptViews_.empty())
+        return;
+    for (std::vector<TOptView>::iterator view = OptViews_.begin();
+         view != OptViews_.end(); ++view) {
+        SPtr<TOpt> opt = getOptionView(*view);
+        if (opt)
+            Options.push_back(opt);
+    }
+    OptViews_.clear();
+    OptData_.clear();
+}
+
+/// @brief creates option object from received data
+///
+/// Used for options added with addOptionView(). Messages that use
+/// lazy parsing must implement it.
+///
+/// @param type option type
+/// @param buf option data
+/// @param len length of option data
+///
+/// @return parsed option (or 0 if it is not supported or invalid)
+SPtr<TOpt> TMsg::parseOption(uint16_t type, char* buf, uint16_t len) {
+    return 0;
+}
+
 SPtr<TOpt> TMsg::getOption() {
     if (NextOpt != Options.end()) {
 	TOptList::iterator it = NextOpt;
@@ -520,6 +644,19 @@ bool TMsg::check(bool clntIDmandatory, bool srvIDmandatory)
     int authCnt = 0;
     bool status = true;
 
+    // only options counted below need to be parsed
+    for (std::vector<TOptView>::iterator view = OptViews_.begin();
+         view != OptViews_.end(); ++view) {
+        if ( (view->Type != OPTION_CLIENTID) && (view->Type != OPTION_SERVERID) &&
+             (view->Type != OPTION_AUTH) )
+            continue;
+        if (!getOptionView(*view))
+            continue;
+        clntCnt += (view->Type == OPTION_CLIENTID);
+        srvCnt += (view->Type == OPTION_SERVERID);
+        authCnt += (view->Type == OPTION_AUTH);
+    }
+
     for (TOptList::iterator opt=Options.begin(); opt!=Options.end(); ++opt)
     {
 	switch ( (*opt)->getOptType() ) {
@@ -572,6 +709,7 @@ bool TMsg::check(bool clntIDmandatory, bool srvIDmandatory)
 
 bool TMsg::delOption(int code)
 {
+    parseAllOptions();
     for (TOptList::iterator opt = Options.begin(); opt!=Options.end(); ++opt)
     {
 	if ( (*opt)->getOptType() == code) {
@@ -25,7 +25,7 @@ class TMsg;
 #include "ScriptParams.h"
 
 // Hey! It's grampa of all messages
-class TMsg
+class TMsg: public TPooled
 {
   public:
     // Used to create TMsg object (normal way)
@@ -47,9 +47,11 @@ class TMsg
 
     // returns requested option (or NULL, there is no such option)
     SPtr<TOpt> getOption(int type);
+    void getOptions(int type, TOptList& opts);
+    void getOptionTypes(std::vector<uint16_t>& types);
     void firstOption();
     int countOption();
-    void addOption(SPtr<TOpt> opt) { Options.push_back(opt); }
+    void addOption(SPtr<TOpt> opt) { parseAllOptions(); Options.push_back(opt); }
 
     virtual SPtr<TOpt> getOption();
 
@@ -90,6 +92,28 @@ class TMsg
 
     bool delOption(int code);
 
+    /// @brief option found in received message, but not parsed yet
+    ///
+    /// Received messages may keep their options as (type, offset, length)
+    /// entries over a single copy of the received data. Option objects
+    /// are created on first access (see parseOption()).
+    struct TOptView {
+        uint16_t Type;
+        uint16_t Len;
+        size_t Offset;   ///< offset of option data in OptData_
+        bool Parsed;     ///< was parseOption() called already?
+        SPtr<TOpt> Opt;  ///< parsed option (0 if not parsed yet or invalid)
+    };
+
+    void addOptionView(uint16_t type, size_t offset, uint16_t len);
+    void addOptionView(SPtr<TOpt> opt);
+    SPtr<TOpt> getOptionView(TOptView& view);
+    void parseAllOptions();
+    virtual SPtr<TOpt> parseOption(uint16_t type, char* buf, uint16_t len);
+
+    std::string OptData_;            ///< copy of received options (used by OptViews_)
+    std::vector<TOptView> OptViews_; ///< options not moved to Options yet
+
     TOptList Options;
     TOptList::iterator NextOpt; // to be removed together with firstOption() and getOption();
     void setAttribs(int iface, SPtr<TIPv6Addr> addr,
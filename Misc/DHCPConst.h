@@ -218,6 +218,14 @@ enum EState {
     STATE_TENTATIVECHECK,
     STATE_TENTATIVE};
 
+/// state of DNS Update performed for an IA
+enum EFQDNState {
+    FQDNSTATE_NONE,     ///< no records (not updated or already removed)
+    FQDNSTATE_PENDING,  ///< update queued or in progress
+    FQDNSTATE_DONE,     ///< records added
+    FQDNSTATE_FAILED    ///< update failed
+};
+
 // specifies server behavior, when receiving unknown FQDN
 enum EUnknownFQDNMode {
     UNKNOWN_FQDN_REJECT = 0,      // reject unknown FQDNs (do not assign a name from pool)
@@ -47,11 +47,15 @@
 #define SERVER_DEFAULT_TA_PREF_LIFETIME 3600
 #define SERVER_DEFAULT_TA_VALID_LIFETIME 7200
 #define SERVER_DEFAULT_CACHE_SIZE 1048576   /* cache size, specified in bytes */
+#define SERVER_DEFAULT_JOURNAL_SIZE 1048576 /* lease journal size that triggers snapshot, in bytes */
 
 #define SERVER_MAX_IA_RANDOM_TRIES 100
 #define SERVER_MAX_TA_RANDOM_TRIES 100
 #define SERVER_MAX_PD_RANDOM_TRIES 100
 
+/* pools up to this size keep a bitmap of free addresses (1 bit per address) */
+#define SERVER_MAX_BITMAP_POOL 4194304
+
 // see DHCPConst.h for available enums
 #define SERVER_DEFAULT_UNKNOWN_FQDN UNKNOWN_FQDN_REJECT
 
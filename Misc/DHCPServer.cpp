@@ -8,19 +8,30 @@
  *
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#ifdef LINUX
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#endif
 #include "DHCPServer.h"
 #include "AddrClient.h"
 #include "Logger.h"
 #include "SrvIfaceMgr.h"
 #include "SrvCfgMgr.h"
 #include "SrvTransMgr.h"
+#include "SrvTxBuffers.h"
+#include "SocketIPv6.h"
 
 using namespace std;
 
 volatile int serviceShutdown;
 
 TDHCPServer::TDHCPServer(const std::string& config)
-    :IsDone_(false)
+    :IsDone_(false), Process_(0)
 {
     serviceShutdown = 0;
     srand((uint32_t)time(NULL));
@@ -33,6 +44,18 @@ TDHCPServer::TDHCPServer(const std::string& config)
     }
     SrvIfaceMgr().dump();
 
+    // sockets are opened by TransMgr, so socket mode has to be chosen before
+    const char * sockets = getenv("DIBBLER_SOCKET_MODE");
+    bool wildcard = false;
+    if (sockets && !TSrvIfaceMgr::parseSocketMode(sockets, wildcard)) {
+        Log(Warning) << "Invalid DIBBLER_SOCKET_MODE value: " << sockets
+                     << " (wildcard or per-interface expected)." << LogEnd;
+    }
+    if (wildcard && !SrvIfaceMgr().setWildcard(true)) {
+        Log(Warning) << "Unable to use single wildcard socket, opening sockets on "
+                     << "every interface." << LogEnd;
+    }
+
     TSrvCfgMgr::instanceCreate(config, SRVCFGMGR_FILE);
     if ( SrvCfgMgr().isDone() ) {
         Log(Crit) << "Fatal error during CfgMgr initialization." << LogEnd;
@@ -41,12 +64,24 @@ TDHCPServer::TDHCPServer(const std::string& config)
     }
     SrvCfgMgr().dump();
 
-    TSrvAddrMgr::instanceCreate(SRVADDRMGR_FILE, true /*always load DB*/ );
+    // several processes are experimental, so they have to be requested explicitly
+    std::string addrDb = SRVADDRMGR_FILE;
+    std::string cacheDb = SRVCACHE_BIN_FILE;
+    const char * processes = getenv("DIBBLER_PROCESSES");
+    if (processes && atoi(processes) > 1 &&
+        !startProcesses(atoi(processes), addrDb, cacheDb)) {
+        IsDone_ = true;
+        return;
+    }
+
+    TSrvAddrMgr::instanceCreate(addrDb, true /*always load DB*/, cacheDb);
     if ( SrvAddrMgr().isDone() ) {
         Log(Crit) << "Fatal error during AddrMgr initialization." << LogEnd;
         IsDone_ = true;
         return;
     }
+    if (LeaseTable_.isOpen())
+        SrvAddrMgr().setLeaseTable(&LeaseTable_);
 
     TSrvTransMgr::instanceCreate(SRVTRANSMGR_FILE, DHCPSERVER_PORT);
     if ( SrvTransMgr().isDone() ) {
@@ -70,12 +105,277 @@ TDHCPServer::TDHCPServer(const std::string& config)
     SrvTransMgr().dump();
 }
 
+/// @brief returns number of leases that configured pools may hand out
+///
+/// Used to size the lease table shared by server processes.
+static unsigned long countConfiguredLeases()
+{
+    unsigned long total = 0;
+    SPtr<TSrvCfgIface> iface;
+    SrvCfgMgr().firstIface();
+    while (iface = SrvCfgMgr().getIface()) {
+        unsigned long leases = 0;
+        SPtr<TSrvCfgAddrClass> addrClass;
+        iface->firstAddrClass();
+        while (addrClass = iface->getAddrClass())
+            leases += addrClass->getClassMaxLease();
+        SPtr<TSrvCfgTA> ta;
+        iface->firstTA();
+        while (ta = iface->getTA())
+            leases += ta->getClassMaxLease();
+        SPtr<TSrvCfgPD> pd;
+        iface->firstPD();
+        while (pd = iface->getPD())
+            leases += pd->getPD_MaxLease();
+
+        if (iface->getIfaceMaxLease() >= 0 &&
+            leases > (unsigned long)iface->getIfaceMaxLease())
+            leases = iface->getIfaceMaxLease();
+        total += leases;
+    }
+    return total;
+}
+
+/// @brief starts other server processes
+///
+/// Every process opens its own sockets (bound with SO_REUSEPORT) and keeps
+/// its own copy of the configuration and its own lease database. Leases
+/// are also stored in the lease table shared by all processes.
+///
+/// @param processes total number of server processes
+/// @param addrDb [out] lease database file of this process
+/// @param cacheDb [out] address cache file of this process
+///
+/// @return false if the shared lease table can't be used
+bool TDHCPServer::startProcesses(unsigned int processes, std::string& addrDb,
+                                 std::string& cacheDb)
+{
+#ifdef LINUX
+    // all processes have to receive on the same sockets
+    if (!TIfaceSocket::setReusePort(true)) {
+        Log(Warning) << "Sockets can't be shared (SO_REUSEPORT not supported), running "
+                     << "a single server process." << LogEnd;
+        return true;
+    }
+    if (processes > SRVLEASETABLE_MAX_PROCESSES) {
+        Log(Warning) << "Too many server processes requested, starting "
+                     << SRVLEASETABLE_MAX_PROCESSES << "." << LogEnd;
+        processes = SRVLEASETABLE_MAX_PROCESSES;
+    }
+    unsigned long leases = countConfiguredLeases();
+    if (!LeaseTable_.open(SRVLEASETABLE_FILE, TSrvLeaseTable::getBuckets(leases))) {
+        Log(Crit) << "Unable to open lease table shared by server processes." << LogEnd;
+        TIfaceSocket::setReusePort(false);
+        return false;
+    }
+
+    pid_t parent = getpid();
+    for (unsigned int i = 1; i < processes; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            Log(Error) << "Unable to start server process: " << strerror(errno) << LogEnd;
+            break;
+        }
+        if (pid)  {
+            Children_.push_back(pid);
+            continue;
+        }
+
+        // don't outlive the first process (it would not stop us on shutdown)
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parent)
+            _exit(0);
+
+        Children_.clear();
+        Process_ = i;
+        std::ostringstream name;
+        name << logger::getLogName() << "-" << i;
+        logger::setLogName(name.str());
+        std::ostringstream db;
+        db << "server-AddrMgr-" << i << ".xml";
+        addrDb = db.str();
+        std::ostringstream cache;
+        cache << "server-cache-" << i << ".bin";
+        cacheDb = cache.str();
+        return LeaseTable_.attach(i);
+    }
+
+    Log(Notice) << "Running " << Children_.size() + 1 << " server processes." << LogEnd;
+    return LeaseTable_.attach(0);
+#else
+    Log(Warning) << "Several server processes are not supported on this platform." << LogEnd;
+    return true;
+#endif
+}
+
+/// @brief checks if received message should be handled by this process
+///
+/// Unicast is delivered (by SO_REUSEPORT) to a single process only, but
+/// multicast is received by all of them, so it is split between running
+/// processes by client DUID. When a process dies, its clients are handled
+/// by the remaining ones.
+///
+/// @param buf received data
+/// @param bufsize size of received data
+/// @param peer address of the sender
+/// @param myaddr address the data was received on
+///
+/// @return true if this process should handle the message
+bool TDHCPServer::isOwnMsg(const char* buf, int bufsize, SPtr<TIPv6Addr> peer,
+                           SPtr<TIPv6Addr> myaddr)
+{
+    if (!LeaseTable_.isOpen() || !myaddr->multicast())
+        return true;
+
+    std::vector<unsigned int> alive;
+    LeaseTable_.getAlive(alive);
+    if (alive.empty())
+        return true;
+    unsigned int shard = TSrvIfaceMgr::getShard(buf, bufsize, peer->getAddr(),
+                                                alive.size());
+    return alive[shard] == Process_;
+}
+
+/// @brief collects server processes that have terminated
+void TDHCPServer::reapProcesses()
+{
+#ifdef LINUX
+    for (size_t i = 0; i < Children_.size(); ) {
+        int status;
+        if (waitpid(Children_[i], &status, WNOHANG) <= 0) {
+            i++;
+            continue;
+        }
+        Log(Warning) << "Server process " << Children_[i] << " has terminated (status="
+                     << status << "), its clients are handled by remaining processes."
+                     << LogEnd;
+        Children_.erase(Children_.begin() + i);
+    }
+#endif
+}
+
+/// @brief stops other server processes and waits for them
+void TDHCPServer::stopProcesses()
+{
+#ifdef LINUX
+    for (size_t i = 0; i < Children_.size(); i++)
+        kill(Children_[i], SIGTERM);
+    for (size_t i = 0; i < Children_.size(); i++)
+        waitpid(Children_[i], NULL, 0);
+    Children_.clear();
+#endif
+}
+
+/// @brief handles message received by the server
+///
+/// @param msg received message
+static void processMsg(SPtr<TSrvMsg> msg)
+{
+    SPtr<TIfaceIface>  physicalIface = SrvIfaceMgr().getIfaceByID(msg->getPhysicalIface());
+    SPtr<TSrvCfgIface> logicalIface = SrvCfgMgr().getIfaceByID(msg->getIface());
+    if (!physicalIface) {
+        Log(Error) << "Received data over unknown physical interface: ifindex="
+                   << msg->getPhysicalIface() << LogEnd;
+        return;
+    }
+    if (!logicalIface) {
+        Log(Error) << "Received data over unknown logical interface: ifindex="
+                   << msg->getIface() << LogEnd;
+        return;
+    }
+    // options are not parsed here, only when they are used
+    vector<uint16_t> types;
+    msg->getOptionTypes(types);
+    Log(Notice) << "Received " << msg->getName() << " on " << physicalIface->getFullName()
+                << hex << ", trans-id=0x" << msg->getTransID() << dec
+                << ", " << types.size() << " opts:";
+    for (vector<uint16_t>::const_iterator type = types.begin(); type != types.end(); ++type)
+        Log(Cont) << " " << *type;
+    if (msg->RelayInfo_.size()) {
+        Log(Cont) << " (" << logicalIface->getFullName() << ", "
+                  << msg->RelayInfo_.size() << " relay(s)." << LogEnd;
+    } else {
+        Log(Cont) << " (non-relayed)" << LogEnd;
+    }
+
+    if (SrvCfgMgr().stateless() && ( (msg->getType()!=INFORMATION_REQUEST_MSG) &&
+                                     (msg->getType()!=RELAY_FORW_MSG))) {
+        Log(Warning)
+            << "Stateful configuration message received while running in "
+            << "the stateless mode. Message ignored." << LogEnd;
+        return;
+    }
+
+    // client might have been served by other server process so far
+    SrvAddrMgr().importClient(msg->getClientDUID());
+
+    SrvTransMgr().relayMsg(msg);
+}
+
 void TDHCPServer::run()
 {
     Log(Notice) << "Server begins operation." << LogEnd;
 
+    SrvIfaceMgr().setBatching(true);
+
+    // io_uring is experimental, so it has to be requested explicitly
+    const char * backend = getenv("DIBBLER_IO_BACKEND");
+    if (backend && !strcmp(backend, "io_uring") && !SrvIfaceMgr().setRing(true)) {
+        Log(Warning) << "Unable to use io_uring, falling back to "
+                     << SrvIfaceMgr().getBackend() << "." << LogEnd;
+    }
+    // replies to a received batch are queued in their buffers until sent
+#ifdef LINUX
+    TSrvTxBuffers::preallocate(LOWLEVEL_MAX_BATCH);
+#else
+    TSrvTxBuffers::preallocate(1);
+#endif
+
+    // DNS Updates are sent in the background, so they don't delay replies
+    TSrvDnsUpdater& dnsUpdater = SrvIfaceMgr().getDnsUpdater();
+    if (dnsUpdater.start())
+        Log(Info) << "Performing DNS Updates in a background thread." << LogEnd;
+
+    // notify scripts are executed in the background, so they don't delay replies
+    // (DIBBLER_SCRIPT_CHILDREN=0 executes them synchronously, DIBBLER_SCRIPT_DAEMON=N
+    // streams them to a single long-lived script instead, up to N at once)
+    TSrvScriptExecutor& scripts = SrvIfaceMgr().getScriptExecutor();
+    if (!SrvCfgMgr().getScriptName().empty()) {
+        unsigned int children = SRVSCRIPTEXECUTOR_CHILDREN;
+        const char * env = getenv("DIBBLER_SCRIPT_CHILDREN");
+        if (env)
+            children = atoi(env);
+        env = getenv("DIBBLER_SCRIPT_QUEUE");
+        if (env && atoi(env) > 0)
+            scripts.setMaxQueue(atoi(env));
+        env = getenv("DIBBLER_SCRIPT_OVERFLOW");
+        TSrvScriptExecutor::EOverflow overflow;
+        if (env && TSrvScriptExecutor::parseOverflow(env, overflow)) {
+            scripts.setOverflow(overflow);
+        } else if (env) {
+            Log(Warning) << "Invalid DIBBLER_SCRIPT_OVERFLOW value: " << env
+                         << " (drop, drop-oldest or wait expected)." << LogEnd;
+        }
+        env = getenv("DIBBLER_SCRIPT_DAEMON");
+        size_t batch = env && atoi(env) > 0 ? atoi(env) : 0;
+        scripts.setDaemon(batch);
+        if (scripts.start(children)) {
+            if (batch)
+                Log(Info) << "Sending notify events to " << SrvCfgMgr().getScriptName()
+                          << " running as hook daemon, up to " << batch << " at a time."
+                          << LogEnd;
+            else
+                Log(Info) << "Executing notify scripts in a background thread, up to "
+                          << children << " at a time." << LogEnd;
+        }
+    }
+
+    Log(Info) << "Waiting for packets using " << SrvIfaceMgr().getBackend() << "." << LogEnd;
+
     bool silent = false;
     while ( (!isDone()) && (!SrvTransMgr().isDone()) ) {
+        if (!Children_.empty())
+            reapProcesses();
         if (serviceShutdown)
             SrvTransMgr().shutdown();
 
@@ -97,50 +397,69 @@ void TDHCPServer::run()
         }
 #endif
 
-        SPtr<TSrvMsg> msg=SrvIfaceMgr().select(timeout);
-        if (!msg)
+        static char buf[SRVIFACEMGR_MAX_MSG_SIZE];
+        int bufsize = SRVIFACEMGR_MAX_MSG_SIZE;
+        SPtr<TIPv6Addr> peer(new TIPv6Addr());
+        SPtr<TIPv6Addr> myaddr(new TIPv6Addr());
+        int ifindex = SrvIfaceMgr().receiveMsg(timeout, buf, bufsize, peer, myaddr);
+        if (ifindex < 0)
             continue;
         silent = false;
-        SPtr<TIfaceIface>  physicalIface = SrvIfaceMgr().getIfaceByID(msg->getPhysicalIface());
-        SPtr<TSrvCfgIface> logicalIface = SrvCfgMgr().getIfaceByID(msg->getIface());
-        if (!physicalIface) {
-            Log(Error) << "Received data over unknown physical interface: ifindex="
-                       << msg->getPhysicalIface() << LogEnd;
-            continue;
-        }
-        if (!logicalIface) {
-            Log(Error) << "Received data over unknown logical interface: ifindex="
-                       << msg->getIface() << LogEnd;
+        if (!isOwnMsg(buf, bufsize, peer, myaddr))
             continue;
-        }
-        Log(Notice) << "Received " << msg->getName() << " on " << physicalIface->getFullName()
-                    << hex << ", trans-id=0x" << msg->getTransID() << dec
-                    << ", " << msg->countOption() << " opts:";
-        SPtr<TOpt> ptrOpt;
-        msg->firstOption();
-        while (ptrOpt = msg->getOption() )
-            Log(Cont) << " " << ptrOpt->getOptType();
-        if (msg->RelayInfo_.size()) {
-            Log(Cont) << " (" << logicalIface->getFullName() << ", "
-                      << msg->RelayInfo_.size() << " relay(s)." << LogEnd;
-        } else {
-            Log(Cont) << " (non-relayed)" << LogEnd;
-        }
 
-        if (SrvCfgMgr().stateless() && ( (msg->getType()!=INFORMATION_REQUEST_MSG) &&
-                                         (msg->getType()!=RELAY_FORW_MSG))) {
-            Log(Warning)
-                << "Stateful configuration message received while running in "
-                << "the stateless mode. Message ignored." << LogEnd;
-            continue;
-        }
-        SrvTransMgr().relayMsg(msg);
+        SPtr<TSrvMsg> msg = SrvIfaceMgr().decodeReceived(ifindex, buf, bufsize, peer, myaddr);
+        if (msg)
+            processMsg(msg);
+    }
+
+    if (dnsUpdater.isRunning()) {
+        // finish updates that are already queued
+        dnsUpdater.stop();
+        dnsUpdater.processCompleted();
+    }
+    TSrvDnsUpdater::TStats ddns = dnsUpdater.getStats();
+    if (ddns.Queued) {
+        Log(Info) << "DNS Updates: " << ddns.Queued << " queued, " << ddns.Succeeded
+                  << " succeeded, " << ddns.Failed << " failed, " << ddns.Retried
+                  << " retried, " << ddns.Dropped << " dropped (queue full), "
+                  << ddns.Messages << " sent over " << ddns.Connects
+                  << " TCP connection(s)." << LogEnd;
+    }
+
+    if (scripts.isRunning()) {
+        // wait for queued scripts
+        scripts.stop();
+        scripts.processCompleted();
+    }
+    TSrvScriptExecutor::TStats notify = scripts.getStats();
+    if (notify.Executed) {
+        Log(Info) << "Notify scripts: " << notify.Executed << " executed, " << notify.Failed
+                  << " failed, " << notify.Dropped << " dropped (queue full), "
+                  << notify.Waited << " time(s) waited for queue; waiting time: average "
+                  << notify.TotalWait / notify.Executed << "ms, max " << notify.MaxWait
+                  << "ms; running time: average " << notify.TotalRun / notify.Executed
+                  << "ms, max " << notify.MaxRun << "ms." << LogEnd;
+        if (notify.Batches)
+            Log(Info) << "Hook daemon: " << notify.Batches << " batch(es) sent, started "
+                      << notify.Restarts << " time(s)." << LogEnd;
     }
 
     SrvCfgMgr().setPerformanceMode(false);
     SrvAddrMgr().dump();
 
     SrvIfaceMgr().closeSockets();
+    stopProcesses();
+
+    const TBatchStats& stats = SrvIfaceMgr().getBatchStats();
+    if (stats.Batches) {
+        Log(Info) << "Received " << stats.Packets << " packet(s) in " << stats.Batches
+                  << " batch(es), largest batch: " << stats.MaxSize << ", average: "
+                  << stats.Packets / stats.Batches << "; sent " << stats.Sent
+                  << " packet(s) in batches. Batch processing time: average "
+                  << stats.TotalUsec / stats.Batches << " usec, max " << stats.MaxUsec
+                  << " usec." << LogEnd;
+    }
     Log(Notice) << "Bye bye." << LogEnd;
 }
 
@@ -164,6 +483,12 @@ void TDHCPServer::setWorkdir(std::string workdir) {
     SrvCfgMgr().dump();
 }
 
+/// @brief returns true in server processes started by startProcesses()
+bool TDHCPServer::isChildProcess() const {
+    return Process_ != 0;
+}
+
 TDHCPServer::~TDHCPServer()
 {
+    stopProcesses();
 }
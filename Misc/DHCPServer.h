@@ -12,7 +12,10 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include "SmartPtr.h"
+#include "IPv6Addr.h"
+#include "SrvLeaseTable.h"
 
 class TDHCPServer
 {
@@ -23,10 +26,27 @@ class TDHCPServer
     bool isDone();
     bool checkPrivileges();
     void setWorkdir(std::string workdir);
+    bool isChildProcess() const;
     ~TDHCPServer();
 
   private:
+    bool startProcesses(unsigned int processes, std::string& addrDb,
+                        std::string& cacheDb);
+    bool isOwnMsg(const char* buf, int bufsize, SPtr<TIPv6Addr> peer,
+                  SPtr<TIPv6Addr> myaddr);
+    void reapProcesses();
+    void stopProcesses();
+
     bool IsDone_;
+
+    /// leases shared by all server processes (if there are more of them)
+    TSrvLeaseTable LeaseTable_;
+
+    /// index of this server process (0 for the process that started the others)
+    unsigned int Process_;
+
+    /// pids of other server processes (in the first process only)
+    std::vector<int> Children_;
 };
 
 #endif
@@ -14,8 +14,9 @@ class TDUID;
 #include <vector>
 #include <string>
 #include <stdint.h>
+#include "MemPool.h"
 
-class TDUID
+class TDUID: public TPooled
 {
     friend std::ostream& operator<<(std::ostream& out,TDUID &range);
  public:
@@ -14,7 +14,7 @@
 #include <list>
 #include <SmartPtr.h>
 
-class TIPv6Addr
+class TIPv6Addr: public TPooled
 {
         friend std::ostream& operator<<(std::ostream& out,TIPv6Addr& group);
 public:
@@ -0,0 +1,219 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include "Portable.h"
+#include "MemPool.h"
+
+#ifdef LINUX
+#include <stdint.h>
+#include <pthread.h>
+#endif
+
+namespace {
+
+/// number of different object sizes
+const size_t MEMPOOL_CLASSES = MEMPOOL_MAX_OBJECT / MEMPOOL_GRANULARITY;
+
+/// released object (its memory is used to link free list)
+struct TFreeObject {
+    TFreeObject * Next;
+};
+
+/// pool of a single thread
+struct TThreadPool {
+    TFreeObject * Free[MEMPOOL_CLASSES]; ///< released objects, by size
+    char * Chunk;                        ///< unused part of current chunk
+    size_t Left;                         ///< bytes left in current chunk
+    TMemPool::TStats Stats;
+#ifdef LINUX
+    pthread_mutex_t RemoteLock;            ///< protects Remote lists
+    TFreeObject * Remote[MEMPOOL_CLASSES]; ///< objects released by other threads
+    volatile unsigned long RemoteCnt;      ///< objects on Remote lists
+#endif
+};
+
+#ifdef LINUX
+/// @brief header at the beginning of every chunk
+///
+/// Chunks are aligned to their size, so chunk of an object (and the pool
+/// that owns it) is found from the object address.
+struct TChunkHeader {
+    TThreadPool * Owner;
+};
+
+/// pools outlive their threads, objects may be released after the thread exits
+__thread TThreadPool * Pool;
+
+/// @brief returns pool of the calling thread (creates it on first use)
+TThreadPool * getPool() {
+    if (!Pool) {
+        TThreadPool * pool = (TThreadPool*)calloc(1, sizeof(TThreadPool));
+        if (!pool)
+            throw std::bad_alloc();
+        pthread_mutex_init(&pool->RemoteLock, NULL);
+        Pool = pool;
+    }
+    return Pool;
+}
+
+/// @brief returns pool that owns the object
+TThreadPool * getOwner(void * ptr) {
+    uintptr_t chunk = (uintptr_t)ptr & ~(uintptr_t)(MEMPOOL_CHUNK_SIZE - 1);
+    return ((TChunkHeader*)chunk)->Owner;
+}
+
+/// @brief moves objects released by other threads to the free list
+void drainRemote(TThreadPool * pool, size_t cls) {
+    if (!pool->RemoteCnt)
+        return;
+    pthread_mutex_lock(&pool->RemoteLock);
+    TFreeObject * obj = pool->Remote[cls];
+    pool->Remote[cls] = 0;
+    while (obj) {
+        TFreeObject * next = obj->Next;
+        obj->Next = pool->Free[cls];
+        pool->Free[cls] = obj;
+        pool->RemoteCnt--;
+        obj = next;
+    }
+    pthread_mutex_unlock(&pool->RemoteLock);
+}
+#else
+TThreadPool ThePool;
+
+TThreadPool * getPool() {
+    return &ThePool;
+}
+#endif
+
+}
+
+/// @brief allocates memory for an object
+///
+/// @param size object size
+///
+/// @return allocated memory (throws std::bad_alloc, if there is no memory)
+void * TMemPool::alloc(size_t size) {
+    TThreadPool * pool = getPool();
+    if (size > MEMPOOL_MAX_OBJECT) {
+        pool->Stats.Large++;
+        return ::operator new(size);
+    }
+    if (!size)
+        size = 1;
+
+    size_t cls = (size - 1) / MEMPOOL_GRANULARITY;
+    pool->Stats.Allocs++;
+#ifdef LINUX
+    if (!pool->Free[cls])
+        drainRemote(pool, cls);
+#endif
+    if (pool->Free[cls]) {
+        TFreeObject * obj = pool->Free[cls];
+        pool->Free[cls] = obj->Next;
+        pool->Stats.Reused++;
+        return obj;
+    }
+
+    size = (cls + 1) * MEMPOOL_GRANULARITY;
+    if (pool->Left < size) {
+        // remaining part of the old chunk is lost
+        char * chunk = 0;
+#ifdef LINUX
+        void * mem = 0;
+        if (!posix_memalign(&mem, MEMPOOL_CHUNK_SIZE, MEMPOOL_CHUNK_SIZE))
+            chunk = (char*)mem;
+#else
+        chunk = (char*)malloc(MEMPOOL_CHUNK_SIZE);
+#endif
+        if (!chunk) {
+            pool->Stats.Allocs--;
+            throw std::bad_alloc();
+        }
+        pool->Stats.Chunks++;
+        pool->Chunk = chunk;
+        pool->Left = MEMPOOL_CHUNK_SIZE;
+#ifdef LINUX
+        // first granule holds the header
+        ((TChunkHeader*)chunk)->Owner = pool;
+        pool->Chunk += MEMPOOL_GRANULARITY;
+        pool->Left -= MEMPOOL_GRANULARITY;
+#endif
+    }
+    void * obj = pool->Chunk;
+    pool->Chunk += size;
+    pool->Left -= size;
+    return obj;
+}
+
+/// @brief returns object memory to the pool
+///
+/// Object released by other thread than the one that allocated it is
+/// returned to the pool of that thread, so memory does not move from
+/// allocating threads to releasing ones.
+///
+/// @param ptr object allocated with alloc()
+/// @param size object size (the same as passed to alloc())
+void TMemPool::release(void * ptr, size_t size) {
+    if (!ptr)
+        return;
+    TThreadPool * pool = getPool();
+    if (size > MEMPOOL_MAX_OBJECT) {
+        ::operator delete(ptr);
+        return;
+    }
+    if (!size)
+        size = 1;
+
+    size_t cls = (size - 1) / MEMPOOL_GRANULARITY;
+    TFreeObject * obj = (TFreeObject*)ptr;
+    pool->Stats.Frees++;
+#ifdef LINUX
+    TThreadPool * owner = getOwner(ptr);
+    if (owner != pool) {
+        pool->Stats.Remote++;
+        pthread_mutex_lock(&owner->RemoteLock);
+        obj->Next = owner->Remote[cls];
+        owner->Remote[cls] = obj;
+        owner->RemoteCnt++;
+        pthread_mutex_unlock(&owner->RemoteLock);
+        return;
+    }
+#endif
+    obj->Next = pool->Free[cls];
+    pool->Free[cls] = obj;
+}
+
+/// @brief returns allocation counters of the calling thread
+///
+/// @return counters (since the thread was started)
+TMemPool::TStats TMemPool::getStats() {
+    return getPool()->Stats;
+}
+
+/// @brief returns allocation counters of the calling thread
+///
+/// Used to count allocations made while processing a single message.
+///
+/// @param since counters returned by getStats() earlier
+///
+/// @return counters (since getStats() returned @a since)
+TMemPool::TStats TMemPool::getStats(const TStats& since) {
+    TStats stats = getPool()->Stats;
+    stats.Allocs -= since.Allocs;
+    stats.Frees  -= since.Frees;
+    stats.Reused -= since.Reused;
+    stats.Chunks -= since.Chunks;
+    stats.Large  -= since.Large;
+    stats.Remote -= since.Remote;
+    return stats;
+}
@@ -0,0 +1,75 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TMemPool;
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <stddef.h>
+
+/// objects are allocated in multiples of that size
+#define MEMPOOL_GRANULARITY 16
+
+/// largest object allocated from the pool (larger use operator new)
+#define MEMPOOL_MAX_OBJECT 1024
+
+/// pool takes memory from system heap in chunks of that size
+#define MEMPOOL_CHUNK_SIZE 65536
+
+/// @brief Allocator for small objects created for every message
+///
+/// Every received message creates many short-lived objects: options,
+/// addresses, DUIDs and reference counters of smart pointers. They are
+/// allocated from large chunks (bump allocation), so the system heap is
+/// used only when a new chunk is needed. Released objects are kept on
+/// free lists (one per size) and used again by the next messages.
+///
+/// Chunks are never returned to the system, so the pool grows to the
+/// peak number of objects in use and stays there.
+///
+/// Every thread has its own chunks, free lists and counters, so no
+/// locking is needed. Object released by other thread than the one that
+/// allocated it is returned to the pool of the allocating thread (owner of
+/// its chunk): it is put on a locked list of that pool, which is moved to
+/// its free lists when it runs out of released objects.
+class TMemPool
+{
+  public:
+    /// allocation counters (of the calling thread)
+    struct TStats {
+        unsigned long Allocs;   ///< objects allocated from the pool
+        unsigned long Frees;    ///< objects returned to the pool
+        unsigned long Reused;   ///< allocations that used released object
+        unsigned long Chunks;   ///< chunks taken from system heap
+        unsigned long Large;    ///< objects too large for the pool
+        unsigned long Remote;   ///< objects returned to pools of other threads
+    };
+
+    static void * alloc(size_t size);
+    static void release(void * ptr, size_t size);
+    static TStats getStats();
+    static TStats getStats(const TStats& since);
+};
+
+/// @brief Base class for objects allocated from TMemPool
+///
+/// Objects deleted using pointer to their base class must have virtual
+/// destructor, so the right size is passed to operator delete.
+class TPooled
+{
+  public:
+    static void * operator new(size_t size) {
+        return TMemPool::alloc(size);
+    }
+    static void operator delete(void * ptr, size_t size) {
+        TMemPool::release(ptr, size);
+    }
+};
+
+#endif
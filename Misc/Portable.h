@@ -114,6 +114,8 @@ struct link_state_notify_t
 #define SRVADDRMGR_FILE   "server-AddrMgr.xml"
 #define SRVTRANSMGR_FILE  "server-TransMgr.xml"
 #define SRVCACHE_FILE     "server-cache.xml"
+#define SRVCACHE_BIN_FILE "server-cache.bin"
+#define SRVLEASETABLE_FILE "server-leases.shm"
 
 #define RELCFGMGR_FILE    "relay-CfgMgr.xml"
 #define RELIFACEMGR_FILE  "relay-IfaceMgr.xml"
@@ -229,6 +231,9 @@ struct link_state_notify_t
 #define LOWLEVEL_TENTATIVE_NO  0
 #define LOWLEVEL_TENTATIVE_DONT_KNOW -1
 
+/* sock_add() reuse parameter: SO_REUSEADDR and SO_REUSEPORT (Linux only) */
+#define LOWLEVEL_REUSE_PORT 2
+
 /* ********************************************************************** */
 /* *** time related functions ******************************************* */
 /* ********************************************************************** */
@@ -267,6 +272,29 @@ unsigned long pref, unsigned long valid, int prefixLength);
     extern int sock_del(int fd);
     extern int sock_send(int fd, char* addr, char* buf, int buflen, int port, int iface);
     extern int sock_recv(int fd, char* myPlainAddr, char* peerPlainAddr, char* buf, int buflen);
+    /* same as above, but addresses are packed (16 bytes) */
+    extern int sock_send_bin(int fd, char* addr, char* buf, int buflen, int port, int iface);
+    extern int sock_recv_bin(int fd, char* myAddr, char* peerAddr, char* buf, int buflen);
+
+#ifdef LINUX
+    /* batched transmission (recvmmsg/sendmmsg) */
+#define LOWLEVEL_MAX_BATCH 16
+    struct sock_msg {
+        char* buf;      /* data buffer */
+        int buflen;     /* buffer size (recv) or data length (send) */
+        int len;        /* received data length (recv only) */
+        char peer[16];  /* packed source (recv) or destination (send) address */
+        char local[16]; /* packed local address (recv only) */
+        int port;       /* destination port (send only) */
+        int iface;      /* receiving interface (recv) or link-local scope (send) */
+    };
+    extern int sock_recv_batch(int fd, struct sock_msg* msgs, int count);
+    extern int sock_send_batch(int fd, struct sock_msg* msgs, int count);
+    /* joins multicast group (packed address) on interface */
+    extern int sock_join(int fd, int ifindex, char* addr);
+    /* checks if sockets can be shared with other processes (SO_REUSEPORT) */
+    extern int sock_reuseport_supported();
+#endif
 
     /** @brief gets MAC address from the specified IPv6 address
      *
@@ -337,6 +365,10 @@ unsigned long pref, unsigned long valid, int prefixLength);
     uint32_t getAAASPIfromFile();
 
     int execute(const char *filename, const char * argv[], const char *env[]);
+    /* POSIX only */
+    int execute_async(const char *filename, const char * argv[], const char *env[]);
+    int execute_wait(int pid, int * status, int wait);
+    int execute_daemon(const char *filename, const char * argv[], const char *env[], int * sock);
 
     /** @brief fills specified buffer with random data
      * @param buffer random data will be written here
@@ -12,13 +12,14 @@
 #define SPtr_H
 
 #include <iostream>
+#include "MemPool.h"
 
 //Don't use this class alone, it's used only in casting
 //one smartpointer to another smartpointer
 //e.g.
 //SPtr<a> a(new a()); SPtr<b> b(new(b)); a=b;
 
-class Ptr {
+class Ptr: public TPooled {
 public:
     //constructor used in case of NULL SPtr
     Ptr() {
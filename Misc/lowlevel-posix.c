@@ -14,7 +14,10 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <fcntl.h>
 #include "Portable.h"
 
 int execute(const char *filename, const char * argv[], const char *env[])
@@ -35,28 +38,108 @@ int execute(const char *filename, const char * argv[], const char *env[])
     }
 #endif
 
-    pid_t pid;
     int status = 0;
+    int pid = execute_async(filename, argv, env);
+    if (pid < 0)
+        return LOWLEVEL_ERROR_UNSPEC;
 
-    pid = fork();
+    /* printf("#### before waitpid() pid=%d status=%d\n", pid, status); */
+    execute_wait(pid, &status, 1);
+    /* printf("#### after waitpid() pid=%d status=%d\n", pid, status); */
+    return status;
+}
+
+/** @brief starts a script, does not wait for it to finish
+ *
+ * Child process uses default signal mask (caller may have signals blocked).
+ *
+ * @param filename script to be executed
+ * @param argv parameters (NULL terminated)
+ * @param env environment variables (NULL terminated)
+ * @return pid of the child process or LOWLEVEL_ERROR_UNSPEC if fork failed
+ */
+int execute_async(const char *filename, const char * argv[], const char *env[])
+{
+    pid_t pid = fork();
     if (!pid) {
-        int result = execve(filename, (char * const *)argv, (char * const *)env);
-        result = errno;
-        /* printf("#### Error during attempt to execute %s script: %s\n", filename, strerror(result)); */
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        execve(filename, (char * const *)argv, (char * const *)env);
         /* errors only. if execution succeeds, this process is replaced by instance of filename */
-        if (result>0) {
-            result = -result;
-        }
-        exit(-1);
-    } else {
-        /* printf("#### before waitpid() pid=%d status=%d\n", pid, status); */
-        waitpid(pid, &status, 0);
-        /* printf("#### after waitpid() pid=%d status=%d\n", pid, status); */
-        if (WIFEXITED(status))
-            return WEXITSTATUS(status);
-        else
-            return LOWLEVEL_ERROR_UNSPEC;
+        _exit(-1);
     }
+    if (pid < 0)
+        return LOWLEVEL_ERROR_UNSPEC;
+    return pid;
+}
+
+/** @brief starts a long-lived script connected to a Unix socket
+ *
+ * Script's standard input and output are connected to one end of a stream
+ * socket pair, the other end is returned to the caller (it is not
+ * inherited by other children).
+ *
+ * @param filename script to be executed
+ * @param argv parameters (NULL terminated)
+ * @param env environment variables (NULL terminated)
+ * @param sock [out] caller's end of the socket
+ * @return pid of the child process or LOWLEVEL_ERROR_UNSPEC on failure
+ */
+int execute_daemon(const char *filename, const char * argv[], const char *env[], int * sock)
+{
+    int fds[2];
+    pid_t pid;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        return LOWLEVEL_ERROR_UNSPEC;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+    pid = fork();
+    if (!pid) {
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        dup2(fds[1], 0);
+        dup2(fds[1], 1);
+        if (fds[1] > 1)
+            close(fds[1]);
+        execve(filename, (char * const *)argv, (char * const *)env);
+        _exit(-1);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return LOWLEVEL_ERROR_UNSPEC;
+    }
+    *sock = fds[0];
+    return pid;
+}
+
+/** @brief checks if a script started with execute_async() has finished
+ *
+ * @param pid pid returned by execute_async()
+ * @param status [out] return code of the script (LOWLEVEL_ERROR_UNSPEC if
+ *        it did not exit normally)
+ * @param wait should it wait for the script to finish?
+ * @return 1 if script finished, 0 if it is still running, LOWLEVEL_ERROR_UNSPEC on error
+ */
+int execute_wait(int pid, int * status, int wait)
+{
+    int result;
+    pid_t ret;
+    do {
+        ret = waitpid(pid, &result, wait ? 0 : WNOHANG);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0)
+        return LOWLEVEL_ERROR_UNSPEC;
+    if (ret == 0)
+        return 0;
+    if (WIFEXITED(result))
+        *status = WEXITSTATUS(result);
+    else
+        *status = LOWLEVEL_ERROR_UNSPEC;
+    return 1;
 }
 
 /** @brief returns host name of this host
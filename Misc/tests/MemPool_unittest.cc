@@ -0,0 +1,136 @@
+#include "MemPool.h"
+#include "SmartPtr.h"
+#include "IPv6Addr.h"
+
+#include <vector>
+#include <gtest/gtest.h>
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+class Small: public TPooled {
+public:
+    Small() :value(1) { }
+    virtual ~Small() { }
+    int value;
+};
+
+class Big: public Small {
+public:
+    Big() { memset(data, 0, sizeof(data)); }
+    char data[200];
+};
+
+class Huge: public TPooled {
+public:
+    char data[MEMPOOL_MAX_OBJECT + 1];
+};
+
+#ifdef LINUX
+/// releases objects in other thread
+void * releaseObjects(void * arg) {
+    vector<Small*>& objs = *(vector<Small*>*)arg;
+    TMemPool::TStats start = TMemPool::getStats();
+    for (size_t i = 0; i < objs.size(); i++)
+        delete objs[i];
+    TMemPool::TStats stats = TMemPool::getStats(start);
+    return (void*)stats.Remote;
+}
+#endif
+
+TEST(MemPoolTest, reuse) {
+    TMemPool::TStats start = TMemPool::getStats();
+
+    Small* a = new Small();
+    Small* b = new Big();
+    void* addrA = a;
+    void* addrB = b;
+    delete a;
+    delete b; // through base class, size of Big is used
+
+    TMemPool::TStats stats = TMemPool::getStats(start);
+    EXPECT_EQ(2u, stats.Allocs);
+    EXPECT_EQ(2u, stats.Frees);
+
+    // released objects are used again, for objects of the same size
+    Small* c = new Big();
+    Small* d = new Small();
+    EXPECT_EQ(addrB, (void*)c);
+    EXPECT_EQ(addrA, (void*)d);
+    delete c;
+    delete d;
+
+    stats = TMemPool::getStats(start);
+    EXPECT_EQ(4u, stats.Allocs);
+    EXPECT_LE(2u, stats.Reused);
+    EXPECT_LE(stats.Chunks, 1u);
+
+    // too large for the pool
+    Huge* h = new Huge();
+    delete h;
+    stats = TMemPool::getStats(start);
+    EXPECT_EQ(4u, stats.Allocs);
+    EXPECT_EQ(1u, stats.Large);
+}
+
+TEST(MemPoolTest, smartPtr) {
+    // warm up, so released objects are available
+    {
+        vector<SPtr<TIPv6Addr> > addrs;
+        for (int i = 0; i < 100; i++)
+            addrs.push_back(new TIPv6Addr("2001:db8::1", true));
+    }
+
+    TMemPool::TStats start = TMemPool::getStats();
+    {
+        vector<SPtr<TIPv6Addr> > addrs;
+        for (int i = 0; i < 100; i++)
+            addrs.push_back(new TIPv6Addr("2001:db8::1", true));
+        EXPECT_EQ(string("2001:db8::1"), addrs[99]->getPlain());
+    }
+    TMemPool::TStats stats = TMemPool::getStats(start);
+
+    // address and its reference counter, both reused
+    EXPECT_EQ(200u, stats.Allocs);
+    EXPECT_EQ(200u, stats.Reused);
+    EXPECT_EQ(200u, stats.Frees);
+    EXPECT_EQ(0u, stats.Chunks);
+}
+
+#ifdef LINUX
+TEST(MemPoolTest, otherThread) {
+    // warm up, so following allocations don't need a new chunk
+    vector<Small*> objs;
+    for (int i = 0; i < 100; i++)
+        objs.push_back(new Small());
+    for (int i = 0; i < 100; i++)
+        delete objs[i];
+    objs.clear();
+
+    TMemPool::TStats start = TMemPool::getStats();
+    for (int i = 0; i < 100; i++)
+        objs.push_back(new Small());
+
+    // objects released by other thread are returned to this thread
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, releaseObjects, &objs));
+    void * remote = 0;
+    ASSERT_EQ(0, pthread_join(thread, &remote));
+    EXPECT_EQ(100u, (unsigned long)remote);
+
+    for (int i = 0; i < 100; i++)
+        objs[i] = new Small();
+    TMemPool::TStats stats = TMemPool::getStats(start);
+    EXPECT_EQ(200u, stats.Allocs);
+    EXPECT_EQ(200u, stats.Reused);
+    EXPECT_EQ(0u, stats.Chunks);
+    for (int i = 0; i < 100; i++)
+        delete objs[i];
+}
+#endif
+
+}
@@ -24,7 +24,7 @@ typedef SPtr<TOpt> TOptPtr;
 typedef std::list< TOptPtr > TOptList;
 typedef TContainer< TOptPtr > TOptContainer;
 
-class TOpt
+class TOpt: public TPooled
 {
   public:
 
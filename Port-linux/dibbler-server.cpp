@@ -65,7 +65,8 @@ int run() {
     
     ptr = &srv;
     if (ptr->isDone()) {
-	die(SRVPID_FILE);
+	if (!ptr->isChildProcess())
+	    die(SRVPID_FILE);
 	return -1;
     }
     
@@ -75,7 +76,9 @@ int run() {
     
     ptr->run();
 
-    die(SRVPID_FILE);
+    // pid file belongs to the first server process
+    if (!ptr->isChildProcess())
+	die(SRVPID_FILE);
     return 0;
 }
 
@@ -515,6 +515,14 @@ int sock_add(char * ifacename,int ifaceid, char * addr, int port, int thisifaceo
 	}
     }
 
+    /* let several processes receive on the same address and port */
+    if (reuse == LOWLEVEL_REUSE_PORT) {
+	if (setsockopt(Insock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)  {
+	    sprintf(Message, "Unable to set up socket option SO_REUSEPORT.");
+	    return LOWLEVEL_ERROR_REUSE_FAILED;
+	}
+    }
+
     /* bind socket to a specified port */
     bzero(&bindme, sizeof(struct sockaddr_in6));
     bindme.sin6_family = AF_INET6;
@@ -559,23 +567,35 @@ int sock_del(int fd)
 
 int sock_send(int sock, char *addr, char *buf, int message_len, int port, int iface )
 {
-    struct addrinfo hints, *res;
-    int result;
-    char cport[10];
-    sprintf(cport,"%d",port);
-    
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = PF_INET6;
-    hints.ai_socktype = SOCK_DGRAM;
-    if (getaddrinfo(addr, cport, &hints, &res) < 0) {
-	return -1; /* Error in transmitting */
+    char packed[16];
+    if (!inet_pton6(addr, packed)) {
+	sprintf(Message, "Unable to send data (invalid dst addr: %s)", addr);
+	return LOWLEVEL_ERROR_SOCKET;
     }
+    return sock_send_bin(sock, packed, buf, message_len, port, iface);
+}
 
-    result = sendto(sock, buf, message_len, 0, res->ai_addr, res->ai_addrlen);
-    freeaddrinfo(res);
+/*
+ * sends data to packed (16 bytes long) address
+ */
+int sock_send_bin(int sock, char *addr, char *buf, int message_len, int port, int iface)
+{
+    struct sockaddr_in6 dst;
+    int result;
+
+    bzero(&dst, sizeof(dst));
+    dst.sin6_family = AF_INET6;
+    dst.sin6_port = htons(port);
+    memcpy(&dst.sin6_addr, addr, 16);
+    if (IN6_IS_ADDR_LINKLOCAL(&dst.sin6_addr) || IN6_IS_ADDR_MC_LINKLOCAL(&dst.sin6_addr))
+	dst.sin6_scope_id = iface;
+
+    result = sendto(sock, buf, message_len, 0, (struct sockaddr*)&dst, sizeof(dst));
 
     if (result<0) {
-	sprintf(Message, "Unable to send data (dst addr: %s)", addr);
+	char plain[48];
+	inet_ntop6(addr, plain);
+	sprintf(Message, "Unable to send data (dst addr: %s)", plain);
 	return LOWLEVEL_ERROR_SOCKET;
     }
     return LOWLEVEL_NO_ERROR;
@@ -585,31 +605,46 @@ int sock_send(int sock, char *addr, char *buf, int message_len, int port, int if
  *
  */
 int sock_recv(int fd, char * myPlainAddr, char * peerPlainAddr, char * buf, int buflen)
+{
+    char myAddr[16];
+    char peerAddr[16];
+    int result = sock_recv_bin(fd, myAddr, peerAddr, buf, buflen);
+
+    if (result < 0)
+	return result;
+
+    inet_ntop6(peerAddr, peerPlainAddr);
+    inet_ntop6(myAddr, myPlainAddr);
+    return result;
+}
+
+/*
+ * receives data, stores packed (16 bytes long) local and peer addresses
+ */
+int sock_recv_bin(int fd, char * myAddr, char * peerAddr, char * buf, int buflen)
 {
     struct msghdr msg;            /* message received by recvmsg */
-    struct sockaddr_in6 peerAddr; /* sender address */
-    struct sockaddr_in6 myAddr;   /* my address */
+    struct sockaddr_in6 peer;     /* sender address */
     struct iovec iov;             /* simple structure containing buffer address and length */
 
     struct cmsghdr *cm;           /* control message */
     struct in6_pktinfo *pktinfo; 
 
     char control[CMSG_SPACE(sizeof(struct in6_pktinfo))];
-    char controlLen = CMSG_SPACE(sizeof(struct in6_pktinfo));
     int result = 0;
     bzero(&msg, sizeof(msg));
-    bzero(&peerAddr, sizeof(peerAddr));
-    bzero(&myAddr, sizeof(myAddr));
+    bzero(&peer, sizeof(peer));
     bzero(&control, sizeof(control));
+    bzero(myAddr, 16);
     iov.iov_base = buf;
     iov.iov_len  = buflen;
 
-    msg.msg_name       = &peerAddr;
-    msg.msg_namelen    = sizeof(peerAddr);
+    msg.msg_name       = &peer;
+    msg.msg_namelen    = sizeof(peer);
     msg.msg_iov        = &iov;
     msg.msg_iovlen     = 1;
     msg.msg_control    = control;
-    msg.msg_controllen = controlLen;
+    msg.msg_controllen = sizeof(control);
 
     result = recvmsg(fd, &msg, 0);
 
@@ -618,18 +653,154 @@ int sock_recv(int fd, char * myPlainAddr, char * peerPlainAddr, char * buf, int
     }
 
     /* get source address */
-    inet_ntop6((void*)&peerAddr.sin6_addr, peerPlainAddr);
+    memcpy(peerAddr, &peer.sin6_addr, 16);
 
     /* get destination address */
     for(cm = (struct cmsghdr *) CMSG_FIRSTHDR(&msg); cm; cm = (struct cmsghdr *) CMSG_NXTHDR(&msg, cm)){
 	if (cm->cmsg_level != IPPROTO_IPV6 || cm->cmsg_type != IPV6_PKTINFO)
 	    continue;
 	pktinfo= (struct in6_pktinfo *) (CMSG_DATA(cm));
-	inet_ntop6((void*)&pktinfo->ipi6_addr, myPlainAddr);
+	memcpy(myAddr, &pktinfo->ipi6_addr, 16);
     }
     return result;
 }
 
+/*
+ * receives up to count datagrams that are already waiting on a socket
+ * returns number of received datagrams (0 if there was nothing to read)
+ */
+int sock_recv_batch(int fd, struct sock_msg* msgs, int count)
+{
+    struct mmsghdr hdrs[LOWLEVEL_MAX_BATCH];
+    struct iovec iovs[LOWLEVEL_MAX_BATCH];
+    struct sockaddr_in6 peerAddrs[LOWLEVEL_MAX_BATCH];
+    char controls[LOWLEVEL_MAX_BATCH][CMSG_SPACE(sizeof(struct in6_pktinfo))];
+    struct cmsghdr *cm;
+    struct in6_pktinfo *pktinfo;
+    int result, i;
+
+    if (count > LOWLEVEL_MAX_BATCH)
+        count = LOWLEVEL_MAX_BATCH;
+
+    bzero(hdrs, sizeof(hdrs));
+    bzero(peerAddrs, sizeof(peerAddrs));
+    bzero(controls, sizeof(controls));
+    for (i = 0; i < count; i++) {
+        iovs[i].iov_base = msgs[i].buf;
+        iovs[i].iov_len  = msgs[i].buflen;
+        hdrs[i].msg_hdr.msg_name       = &peerAddrs[i];
+        hdrs[i].msg_hdr.msg_namelen    = sizeof(peerAddrs[i]);
+        hdrs[i].msg_hdr.msg_iov        = &iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen     = 1;
+        hdrs[i].msg_hdr.msg_control    = controls[i];
+        hdrs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+    }
+
+    result = recvmmsg(fd, hdrs, count, MSG_DONTWAIT, NULL);
+    if (result < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return LOWLEVEL_ERROR_UNSPEC;
+    }
+
+    for (i = 0; i < result; i++) {
+        msgs[i].len = hdrs[i].msg_len;
+        memcpy(msgs[i].peer, &peerAddrs[i].sin6_addr, 16);
+        bzero(msgs[i].local, 16);
+        msgs[i].iface = 0;
+        for (cm = CMSG_FIRSTHDR(&hdrs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&hdrs[i].msg_hdr, cm)) {
+            if (cm->cmsg_level != IPPROTO_IPV6 || cm->cmsg_type != IPV6_PKTINFO)
+                continue;
+            pktinfo = (struct in6_pktinfo *) (CMSG_DATA(cm));
+            memcpy(msgs[i].local, &pktinfo->ipi6_addr, 16);
+            msgs[i].iface = pktinfo->ipi6_ifindex;
+        }
+    }
+    return result;
+}
+
+/*
+ * sends count datagrams through a socket
+ * returns number of sent datagrams (or negative error code if none was sent)
+ */
+int sock_send_batch(int fd, struct sock_msg* msgs, int count)
+{
+    struct mmsghdr hdrs[LOWLEVEL_MAX_BATCH];
+    struct iovec iovs[LOWLEVEL_MAX_BATCH];
+    struct sockaddr_in6 dstAddrs[LOWLEVEL_MAX_BATCH];
+    int done = 0, sent = 0, result, i;
+
+    if (count > LOWLEVEL_MAX_BATCH)
+        count = LOWLEVEL_MAX_BATCH;
+
+    bzero(hdrs, sizeof(hdrs));
+    bzero(dstAddrs, sizeof(dstAddrs));
+    for (i = 0; i < count; i++) {
+        dstAddrs[i].sin6_family = AF_INET6;
+        dstAddrs[i].sin6_port = htons(msgs[i].port);
+        memcpy(&dstAddrs[i].sin6_addr, msgs[i].peer, 16);
+        if (IN6_IS_ADDR_LINKLOCAL(&dstAddrs[i].sin6_addr) ||
+            IN6_IS_ADDR_MC_LINKLOCAL(&dstAddrs[i].sin6_addr))
+            dstAddrs[i].sin6_scope_id = msgs[i].iface;
+        iovs[i].iov_base = msgs[i].buf;
+        iovs[i].iov_len  = msgs[i].buflen;
+        hdrs[i].msg_hdr.msg_name    = &dstAddrs[i];
+        hdrs[i].msg_hdr.msg_namelen = sizeof(dstAddrs[i]);
+        hdrs[i].msg_hdr.msg_iov     = &iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    /* sendmmsg() stops at the first message that can't be sent, skip it */
+    while (done < count) {
+        result = sendmmsg(fd, hdrs + done, count - done, 0);
+        if (result <= 0) {
+            done++;
+            continue;
+        }
+        done += result;
+        sent += result;
+    }
+
+    if (!sent) {
+        sprintf(Message, "Unable to send data batch (%d messages)", count);
+        return LOWLEVEL_ERROR_SOCKET;
+    }
+    return sent;
+}
+
+/*
+ * joins multicast group on specified interface, so a socket bound to ::
+ * receives messages sent to that group over that interface
+ * returns 0 (also if the group was joined already) or negative error code
+ */
+int sock_join(int fd, int ifindex, char* addr)
+{
+    struct ipv6_mreq mreq6;
+
+    memset(&mreq6, 0, sizeof(mreq6));
+    mreq6.ipv6mr_interface = ifindex;
+    memcpy(&mreq6.ipv6mr_multiaddr, addr, 16);
+    if (setsockopt(fd, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, &mreq6, sizeof(mreq6))
+        && errno != EADDRINUSE) {
+        sprintf(Message, "Unable to join ipv6 group on interface %d: %s", ifindex,
+                strerror(errno));
+        return LOWLEVEL_ERROR_MCAST_MEMBERSHIP;
+    }
+    return LOWLEVEL_NO_ERROR;
+}
+
+int sock_reuseport_supported()
+{
+    int on = 1;
+    int result;
+    int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return 0;
+    result = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == 0;
+    close(fd);
+    return result;
+}
+
 void microsleep(int microsecs)
 {
     struct timespec x,y;
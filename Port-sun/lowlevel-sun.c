@@ -387,6 +387,18 @@ int sock_del(int fd) {
 }
 
 int sock_send(int sock, char *addr, char *buf, int message_len, int port, int iface) {
+    char packed[16];
+    if (!inet_pton6(addr, packed)) {
+        sprintf(Message, "Unable to send data (invalid dst addr: %s)", addr);
+        return LOWLEVEL_ERROR_SOCKET;
+    }
+    return sock_send_bin(sock, packed, buf, message_len, port, iface);
+}
+
+/*
+ * sends data to packed (16 bytes long) address
+ */
+int sock_send_bin(int sock, char *addr, char *buf, int message_len, int port, int iface) {
     int result;
     struct sockaddr_in6 dst;
 
@@ -394,13 +406,15 @@ int sock_send(int sock, char *addr, char *buf, int message_len, int port, int if
     // dst.sin6_len = sizeof(struct sockaddr_in6); // field missing on Solaris 11
     dst.sin6_family = PF_INET6;
     dst.sin6_port = htons(port); // htons?
-    inet_pton6(addr,(char*)&dst.sin6_addr);
+    memcpy(&dst.sin6_addr, addr, 16);
     dst.sin6_scope_id = iface;
 
     result = sendto(sock, buf, message_len, 0, (struct sockaddr*)&dst, sizeof(struct sockaddr_in6));
 
     if (result < 0) {
-        sprintf(Message, "Unable to send data (dst addr: %s), error=%d", addr, result);
+        char plain[48];
+        inet_ntop6(addr, plain);
+        sprintf(Message, "Unable to send data (dst addr: %s), error=%d", plain, result);
         return LOWLEVEL_ERROR_SOCKET;
     }
     return LOWLEVEL_NO_ERROR;
@@ -411,9 +425,25 @@ int sock_send(int sock, char *addr, char *buf, int message_len, int port, int if
  */
 int sock_recv(int fd, char * myPlainAddr, char * peerPlainAddr, char * buf,
         int buflen) {
+    char myAddr[16];
+    char peerAddr[16];
+    int result = sock_recv_bin(fd, myAddr, peerAddr, buf, buflen);
+
+    if (result < 0)
+        return result;
+
+    inet_ntop6(peerAddr, peerPlainAddr);
+    inet_ntop6(myAddr, myPlainAddr);
+    return result;
+}
+
+/*
+ * receives data, stores packed (16 bytes long) local and peer addresses
+ */
+int sock_recv_bin(int fd, char * myAddr, char * peerAddr, char * buf,
+        int buflen) {
     struct msghdr msg; /* message received by recvmsg */
-    struct sockaddr_in6 peerAddr; /* sender address */
-    struct sockaddr_in6 myAddr; /* my address */
+    struct sockaddr_in6 peer; /* sender address */
     struct iovec iov; /* simple structure containing buffer address and length */
 
     struct cmsghdr *cm; /* control message */
@@ -423,14 +453,14 @@ int sock_recv(int fd, char * myPlainAddr, char * peerPlainAddr, char * buf,
     char controlLen = CMSG_SPACE(sizeof (struct in6_pktinfo));
     int result = 0;
     bzero(&msg, sizeof (msg));
-    bzero(&peerAddr, sizeof (peerAddr));
-    bzero(&myAddr, sizeof (myAddr));
+    bzero(&peer, sizeof (peer));
     bzero(&control, sizeof (control));
+    bzero(myAddr, 16);
     iov.iov_base = buf;
     iov.iov_len = buflen;
 
-    msg.msg_name = &peerAddr;
-    msg.msg_namelen = sizeof (peerAddr);
+    msg.msg_name = &peer;
+    msg.msg_namelen = sizeof (peer);
     msg.msg_iov = &iov;
     msg.msg_iovlen = 1;
     msg.msg_control = control;
@@ -443,14 +473,14 @@ int sock_recv(int fd, char * myPlainAddr, char * peerPlainAddr, char * buf,
     }
 
     /* get source address */
-    inet_ntop6((void*) & peerAddr.sin6_addr, peerPlainAddr);
+    memcpy(peerAddr, &peer.sin6_addr, 16);
 
     /* get destination address */
     for (cm = (struct cmsghdr *) CMSG_FIRSTHDR(&msg); cm; cm = (struct cmsghdr *) CMSG_NXTHDR(&msg, cm)) {
         if (cm->cmsg_level != IPPROTO_IPV6 || cm->cmsg_type != IPV6_PKTINFO)
             continue;
         pktinfo = (struct in6_pktinfo *) (CMSG_DATA(cm));
-        inet_ntop6((void*) & pktinfo->ipi6_addr, myPlainAddr);
+        memcpy(myAddr, &pktinfo->ipi6_addr, 16);
     }
     return result;
 }
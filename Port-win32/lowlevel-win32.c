@@ -464,6 +464,34 @@ int sock_send(int fd, char * addr, char * buf, int buflen, int port,int iface)
     return LOWLEVEL_NO_ERROR;
 }
 
+/* Windows resolves scope through getaddrinfo(), so packed address is
+   formatted and passed to sock_send() */
+int sock_send_bin(int fd, char * addr, char * buf, int buflen, int port, int iface)
+{
+    char addrStr[sizeof("ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255")+5];
+    memset(addrStr, 0, sizeof(addrStr));
+    inet_ntop6(addr, addrStr);
+    return sock_send(fd, addrStr, buf, buflen, port, iface);
+}
+
+int sock_recv_bin(int fd, char * myAddr, char * peerAddr, char * buf, int buflen)
+{
+    struct sockaddr_in6 info;
+    int infolen;
+    int readBytes;
+
+    /* destination address is not known */
+    memset(myAddr, 0, 16);
+    infolen=sizeof(info);
+    if(!(readBytes=recvfrom(fd,buf,buflen,0,(SOCKADDR*)&info,&infolen))) {
+        sprintf(Message, "socket reception failed (recvfrom() function returned 0 bytes read)\n");
+        return LOWLEVEL_ERROR_UNSPEC;
+    }
+    if (readBytes > 0)
+        memcpy(peerAddr, &info.sin6_addr, 16);
+    return readBytes;
+}
+
 int sock_recv(int fd, char * myPlainAddr, char * peerPlainAddr, char * buf, int buflen)
 {
     struct sockaddr_in6 info;  
@@ -11,6 +11,9 @@
  */
 
 #include <cstdlib>
+#include <climits>
+#include <ctime>
+#include <sstream>
 #include "SrvAddrMgr.h"
 #include "AddrClient.h"
 #include "AddrIA.h"
@@ -19,13 +22,36 @@
 #include "SrvCfgAddrClass.h"
 #include "Portable.h"
 #include "SrvCfgMgr.h"
+#include "DHCPDefaults.h"
 
 using namespace std;
 
 TSrvAddrMgr * TSrvAddrMgr::Instance = 0;
 
-TSrvAddrMgr::TSrvAddrMgr(const std::string& xmlfile, bool loadDB)
-    :TAddrMgr(xmlfile, loadDB) {
+/// @brief returns key used in the address indexes
+static std::string addrKey(SPtr<TIPv6Addr> addr) {
+    return std::string(addr->getAddr(), 16);
+}
+
+TSrvAddrMgr::TSrvAddrMgr(const std::string& xmlfile, bool loadDB,
+                         const std::string& cachefile /* = SRVCACHE_BIN_FILE */)
+    :TAddrMgr(xmlfile, loadDB), SnapshotDue_(true), SnapshotSize_(0),
+     JournaledReplay_(0), LeaseTable_(0), Importing_(false), CacheFile_(cachefile) {
+
+    // apply changes made after the snapshot was written. If there are
+    // none, current snapshot is good enough. Database loaded from XML
+    // (e.g. written by older version) is converted to binary snapshot
+    // on the first dump.
+    std::string journal = xmlfile + ".journal";
+    if (loadDB && !journalReplay(journal.c_str()) &&
+        snapshotIsCurrent(snapshotName(xmlfile), xmlfile))
+        SnapshotDue_ = false;
+    JournaledReplay_ = ReplayDetectionValue_;
+    Journal_.open(journal, !loadDB);
+
+    // leases loaded by TAddrMgr constructor are not indexed yet
+    rebuildAddrIndex();
+    rebuildExpiry();
 
     this->CacheMaxSize = 999999999;
     this->cacheRead();
@@ -69,13 +95,39 @@ bool TSrvAddrMgr::addClntAddr(SPtr<TDUID> clntDuid , SPtr<TIPv6Addr> clntAddr,
     }
 
     // find this client
-    SPtr <TAddrClient> ptrClient;
-    this->firstClient();
-    while ( ptrClient = this->getClient() ) {
-        if ( (*ptrClient->getDUID()) == (*clntDuid) )
-            break;
+    SPtr <TAddrClient> ptrClient = getClient(clntDuid);
+
+    // find this IA
+    SPtr <TAddrIA> ptrIA;
+    if (ptrClient) {
+        ptrClient->firstIA();
+        while ( ptrIA = ptrClient->getIA() ) {
+            if ( ptrIA->getIAID() == IAID)
+                break;
+        }
     }
 
+    SPtr <TAddrAddr> ptrAddr;
+    if (ptrIA) {
+        ptrIA->firstAddr();
+        while ( ptrAddr = ptrIA->getAddr() ) {
+            if (*ptrAddr->get()==*addr)
+                break;
+        }
+    }
+
+    // address already exists
+    if (ptrAddr) {
+        Log(Warning) << "Address " << *ptrAddr
+                     << " is already assigned to this IA." << LogEnd;
+        return false;
+    }
+
+    // other server process might have just assigned it
+    if (!claimLease(IATYPE_IA, clntDuid, clntAddr, iface, cfgIface->getName(), IAID, T1, T2,
+                    addr, 128, pref, valid))
+        return false;
+
     // have we found this client?
     if (!ptrClient) {
         if (!quiet) Log(Debug) << "Adding client (DUID=" << clntDuid->getPlain()
@@ -84,14 +136,6 @@ bool TSrvAddrMgr::addClntAddr(SPtr<TDUID> clntDuid , SPtr<TIPv6Addr> clntAddr,
         this->addClient(ptrClient);
     }
 
-    // find this IA
-    SPtr <TAddrIA> ptrIA;
-    ptrClient->firstIA();
-    while ( ptrIA = ptrClient->getIA() ) {
-        if ( ptrIA->getIAID() == IAID)
-            break;
-    }
-
     // have we found this IA?
     if (!ptrIA) {
         ptrIA = new TAddrIA(cfgIface->getName(), iface, IATYPE_IA, clntAddr, clntDuid, T1, T2, IAID);
@@ -100,23 +144,12 @@ bool TSrvAddrMgr::addClntAddr(SPtr<TDUID> clntDuid , SPtr<TIPv6Addr> clntAddr,
             Log(Debug) << "Adding IA (IAID=" << IAID << ") to addrDB." << LogEnd;
     }
 
-    SPtr <TAddrAddr> ptrAddr;
-    ptrIA->firstAddr();
-    while ( ptrAddr = ptrIA->getAddr() ) {
-        if (*ptrAddr->get()==*addr)
-            break;
-    }
-
-    // address already exists
-    if (ptrAddr) {
-        Log(Warning) << "Address " << *ptrAddr
-                     << " is already assigned to this IA." << LogEnd;
-        return false;
-    }
-
     // add address
     ptrAddr = new TAddrAddr(addr, pref, valid);
     ptrIA->addAddr(ptrAddr);
+    indexAddr(AddrIdx_, addr, ptrClient);
+    scheduleExpiry(IATYPE_IA, clntDuid, IAID, ptrAddr);
+    clientChanged(clntDuid);
     if (!quiet)
         Log(Debug) << "Adding " << ptrAddr->get()->getPlain()
                    << " to IA (IAID=" << IAID << ") to addrDB." << LogEnd;
@@ -136,12 +169,7 @@ bool TSrvAddrMgr::delClntAddr(SPtr<TDUID> clntDuid, unsigned long IAID,
 {
 
     // find this client
-    SPtr <TAddrClient> ptrClient;
-    this->firstClient();
-    while ( ptrClient = this->getClient() ) {
-        if ( (*ptrClient->getDUID()) == (*clntDuid) )
-            break;
-    }
+    SPtr <TAddrClient> ptrClient = getClient(clntDuid);
     if (!ptrClient) { // have we found this client?
         Log(Warning) << "Client (DUID=" << clntDuid->getPlain()
                      << ") not found in addrDB, cannot delete address and/or client." << LogEnd;
@@ -174,6 +202,9 @@ bool TSrvAddrMgr::delClntAddr(SPtr<TDUID> clntDuid, unsigned long IAID,
     }
 
     ptrIA->delAddr(clntAddr);
+    unindexAddr(AddrIdx_, clntAddr, ptrClient);
+    cancelExpiry(IATYPE_IA, clntDuid, IAID, clntAddr);
+    clientChanged(clntDuid);
     this->addCachedEntry(clntDuid, clntAddr, IATYPE_IA);
     if (!quiet)
         Log(Debug) << "Deleted address " << *clntAddr << " from addrDB." << LogEnd;
@@ -220,13 +251,39 @@ bool TSrvAddrMgr::addTAAddr(SPtr<TDUID> clntDuid , SPtr<TIPv6Addr> clntAddr,
     }
 
     // find this client
-    SPtr <TAddrClient> ptrClient;
-    this->firstClient();
-    while ( ptrClient = this->getClient() ) {
-        if ( (*ptrClient->getDUID()) == (*clntDuid) )
-            break;
+    SPtr <TAddrClient> ptrClient = getClient(clntDuid);
+
+    // find this TA
+    SPtr <TAddrIA> ta;
+    if (ptrClient) {
+        ptrClient->firstTA();
+        while ( ta = ptrClient->getTA() ) {
+            if ( ta->getIAID() == iaid)
+                break;
+        }
+    }
+
+    SPtr <TAddrAddr> ptrAddr;
+    if (ta) {
+        ta->firstAddr();
+        while ( ptrAddr = ta->getAddr() ) {
+            if (*ptrAddr->get()==*addr)
+                break;
+        }
+    }
+
+    // address already exists
+    if (ptrAddr) {
+        Log(Warning) << "Address " << *ptrAddr << " is already assigned to TA (iaid="
+                     << iaid << ")." << LogEnd;
+        return false;
     }
 
+    // other server process might have just assigned it
+    if (!claimLease(IATYPE_TA, clntDuid, clntAddr, iface, cfgIface->getName(), iaid,
+                    DHCPV6_INFINITY, DHCPV6_INFINITY, addr, 128, pref, valid))
+        return false;
+
     // have we found this client?
     if (!ptrClient) {
         Log(Debug) << "Adding client (DUID=" << clntDuid->getPlain() << ") to the addrDB." << LogEnd;
@@ -234,14 +291,6 @@ bool TSrvAddrMgr::addTAAddr(SPtr<TDUID> clntDuid , SPtr<TIPv6Addr> clntAddr,
         this->addClient(ptrClient);
     }
 
-    // find this TA
-    SPtr <TAddrIA> ta;
-    ptrClient->firstTA();
-    while ( ta = ptrClient->getTA() ) {
-        if ( ta->getIAID() == iaid)
-            break;
-    }
-
     // have we found this TA?
     if (!ta) {
         ta = new TAddrIA(cfgIface->getName(), iface, IATYPE_TA, clntAddr, clntDuid,
@@ -250,23 +299,12 @@ bool TSrvAddrMgr::addTAAddr(SPtr<TDUID> clntDuid , SPtr<TIPv6Addr> clntAddr,
         Log(Debug) << "Adding TA (IAID=" << iaid << ") to the addrDB." << LogEnd;
     }
 
-    SPtr <TAddrAddr> ptrAddr;
-    ta->firstAddr();
-    while ( ptrAddr = ta->getAddr() ) {
-        if (*ptrAddr->get()==*addr)
-            break;
-    }
-
-    // address already exists
-    if (ptrAddr) {
-        Log(Warning) << "Address " << *ptrAddr << " is already assigned to TA (iaid="
-                     << iaid << ")." << LogEnd;
-        return false;
-    }
-
     // add address
     ptrAddr = new TAddrAddr(addr, pref, valid);
     ta->addAddr(ptrAddr);
+    indexAddr(TaAddrIdx_, addr, ptrClient);
+    scheduleExpiry(IATYPE_TA, clntDuid, iaid, ptrAddr);
+    clientChanged(clntDuid);
     Log(Debug) << "Adding " << ptrAddr->get()->getPlain() << " to TA (IAID=" << iaid
                << ") to addrDB." << LogEnd;
     return true;
@@ -285,12 +323,7 @@ bool TSrvAddrMgr::addTAAddr(SPtr<TDUID> clntDuid , SPtr<TIPv6Addr> clntAddr,
 bool TSrvAddrMgr::delTAAddr(SPtr<TDUID> clntDuid, unsigned long iaid,
                             SPtr<TIPv6Addr> clntAddr, bool quiet) {
     // find this client
-    SPtr <TAddrClient> ptrClient;
-    this->firstClient();
-    while ( ptrClient = this->getClient() ) {
-        if ( (*ptrClient->getDUID()) == (*clntDuid) )
-            break;
-    }
+    SPtr <TAddrClient> ptrClient = getClient(clntDuid);
 
     // have we found this client?
     if (!ptrClient) {
@@ -328,6 +361,9 @@ bool TSrvAddrMgr::delTAAddr(SPtr<TDUID> clntDuid, unsigned long iaid,
     }
 
     ta->delAddr(clntAddr);
+    unindexAddr(TaAddrIdx_, clntAddr, ptrClient);
+    cancelExpiry(IATYPE_TA, clntDuid, iaid, clntAddr);
+    clientChanged(clntDuid);
     if (!quiet)
         Log(Debug) << "Deleted temp. address " << *clntAddr << " from addrDB." << LogEnd;
 
@@ -347,11 +383,60 @@ bool TSrvAddrMgr::delTAAddr(SPtr<TDUID> clntDuid, unsigned long iaid,
     return true;
 }
 
+bool TSrvAddrMgr::addPrefix(SPtr<TDUID> clntDuid, SPtr<TIPv6Addr> clntAddr,
+                            const std::string& ifname, int ifindex, unsigned long IAID,
+                            unsigned long T1, unsigned long T2, SPtr<TIPv6Addr> prefix,
+                            unsigned long pref, unsigned long valid, int length, bool quiet)
+{
+    // other server process might have just assigned it
+    if (!claimLease(IATYPE_PD, clntDuid, clntAddr, ifindex, ifname, IAID, T1, T2,
+                    prefix, length, pref, valid))
+        return false;
+
+    if (!TAddrMgr::addPrefix(clntDuid, clntAddr, ifname, ifindex, IAID, T1, T2,
+                             prefix, pref, valid, length, quiet))
+        return false;
+    clientChanged(clntDuid);
+
+    SPtr<TAddrClient> client = getClient(clntDuid);
+    SPtr<TAddrIA> pd = client ? client->getPD(IAID) : SPtr<TAddrIA>();
+    if (!pd)
+        return true;
+
+    SPtr<TAddrPrefix> ptrPrefix;
+    pd->firstPrefix();
+    while (ptrPrefix = pd->getPrefix()) {
+        if (*ptrPrefix->get() == *prefix) {
+            scheduleExpiry(IATYPE_PD, clntDuid, IAID, (Ptr*)ptrPrefix);
+            break;
+        }
+    }
+    return true;
+}
+
+bool TSrvAddrMgr::updatePrefix(SPtr<TDUID> duid , SPtr<TIPv6Addr> addr,
+                               const std::string& ifname, int ifindex, unsigned long IAID,
+                               unsigned long T1, unsigned long T2, SPtr<TIPv6Addr> prefix,
+                               unsigned long pref, unsigned long valid, int length, bool quiet)
+{
+    if (!TAddrMgr::updatePrefix(duid, addr, ifname, ifindex, IAID, T1, T2,
+                                prefix, pref, valid, length, quiet))
+        return false;
+
+    SPtr<TAddrClient> client = getClient(duid);
+    if (client)
+        leaseRenewed(duid, client->getPD(IAID), IATYPE_PD);
+    return true;
+}
+
 bool TSrvAddrMgr::delPrefix(SPtr<TDUID> clntDuid, unsigned long IAID, SPtr<TIPv6Addr> prefix, bool quiet)
 {
     bool result = TAddrMgr::delPrefix(clntDuid, IAID, prefix, quiet);
-    if (result)
+    if (result) {
+        cancelExpiry(IATYPE_PD, clntDuid, IAID, prefix);
+        clientChanged(clntDuid);
         addCachedEntry(clntDuid, prefix, IATYPE_PD);
+    }
     return result;
 }
 
@@ -361,12 +446,7 @@ bool TSrvAddrMgr::delPrefix(SPtr<TDUID> clntDuid, unsigned long IAID, SPtr<TIPv6
 ///
 /// @return number of leases (addresses and/or prefixes)
 unsigned long TSrvAddrMgr::getLeaseCount(SPtr<TDUID> duid) {
-    SPtr <TAddrClient> ptrClient;
-    ClntsLst.first();
-    while ( ptrClient = ClntsLst.get() ) {
-        if ( (*ptrClient->getDUID()) == (*duid))
-            break;
-    }
+    SPtr <TAddrClient> ptrClient = getClient(duid);
     // Have we found this client?
     if (!ptrClient) {
         return 0;
@@ -396,25 +476,21 @@ unsigned long TSrvAddrMgr::getLeaseCount(SPtr<TDUID> duid) {
     return count;
 }
 
+/**
+ * Verifies if addr is not leased (as non-temporary address) to any client
+ *
+ * @param addr
+ *
+ * @return true if address is free
+ */
 bool TSrvAddrMgr::addrIsFree(SPtr<TIPv6Addr> addr)
 {
-    // for each client...
-    SPtr <TAddrClient> ptrClient;
-    ClntsLst.first();
-    while ( ptrClient = ClntsLst.get() )
-    {
+    if (AddrIdx_.find(addrKey(addr)) != AddrIdx_.end())
+        return false;
 
-        // look at each client's IAs
-        SPtr <TAddrIA> ptrIA;
-        ptrClient->firstIA();
-        while ( ptrIA = ptrClient->getIA() )
-        {
-            SPtr<TAddrAddr> ptrAddr;
-            if (ptrAddr = ptrIA->getAddr(addr) )
-                return false;
-        }
-    }
-    return true;
+    // it might be leased by other server process
+    TSrvLeaseTable::TLease lease;
+    return !LeaseTable_ || !LeaseTable_->find(IATYPE_IA, addr, 128, lease);
 }
 
 /**
@@ -426,20 +502,126 @@ bool TSrvAddrMgr::addrIsFree(SPtr<TIPv6Addr> addr)
  */
 bool TSrvAddrMgr::taAddrIsFree(SPtr<TIPv6Addr> addr)
 {
-    // for each client...
-    SPtr <TAddrClient> ptrClient;
-    ClntsLst.first();
-    while ( ptrClient = ClntsLst.get() ) {
-        // look at each client's TAs
-        SPtr <TAddrIA> ta;
-        ptrClient->firstTA();
-        while ( ta = ptrClient->getTA() )
-        {
-            if (ta->getAddr(addr) )
-                return false;
+    if (TaAddrIdx_.find(addrKey(addr)) != TaAddrIdx_.end())
+        return false;
+
+    TSrvLeaseTable::TLease lease;
+    return !LeaseTable_ || !LeaseTable_->find(IATYPE_TA, addr, 128, lease);
+}
+
+/**
+ * Verifies if prefix is not delegated to any client (by this or other
+ * server process)
+ *
+ * @param prefix
+ * @param length prefix length
+ *
+ * @return true if prefix is free
+ */
+bool TSrvAddrMgr::prefixIsFree(SPtr<TIPv6Addr> prefix, int length)
+{
+    if (!TAddrMgr::prefixIsFree(prefix, length))
+        return false;
+
+    // other processes delegate prefixes of the same length from the same pools
+    TSrvLeaseTable::TLease lease;
+    return !LeaseTable_ || !LeaseTable_->find(IATYPE_PD, prefix, length, lease);
+}
+
+/**
+ * Verifies if address (or prefix) is leased by other server process
+ *
+ * Such leases are released without this process being told, so they
+ * should only be skipped (not marked as used in free lists of pools).
+ *
+ * @param type lease type
+ * @param addr address or prefix
+ * @param prefixLen prefix length (128 for addresses)
+ *
+ * @return true if other server process holds the lease
+ */
+bool TSrvAddrMgr::leasedElsewhere(TIAType type, SPtr<TIPv6Addr> addr, int prefixLen)
+{
+    TSrvLeaseTable::TLease lease;
+    return LeaseTable_ && LeaseTable_->find(type, addr, prefixLen, lease) &&
+        lease.Owner != LeaseTable_->getProcess();
+}
+
+/**
+ * @brief returns client that leased specified address
+ *
+ * @param leasedAddr address leased to the client
+ *
+ * @return smart pointer to the client (or 0 if client is not found)
+ */
+SPtr<TAddrClient> TSrvAddrMgr::getClient(SPtr<TIPv6Addr> leasedAddr)
+{
+    AddrToClientIndex::const_iterator i = AddrIdx_.find(addrKey(leasedAddr));
+    if (i == AddrIdx_.end())
+        return 0;
+    return i->second;
+}
+
+/// @brief (re)creates address indexes from the current client list
+///
+/// Used after database is loaded, as loaded leases do not go through
+/// addClntAddr()/addTAAddr().
+void TSrvAddrMgr::rebuildAddrIndex()
+{
+    AddrIdx_.clear();
+    TaAddrIdx_.clear();
+
+    for (std::list< SPtr<TAddrClient> >::const_iterator cli = ClntsLst.getSTL().begin();
+         cli != ClntsLst.getSTL().end(); ++cli) {
+        SPtr<TAddrIA> ia;
+        SPtr<TAddrAddr> addr;
+
+        (*cli)->firstIA();
+        while (ia = (*cli)->getIA()) {
+            ia->firstAddr();
+            while (addr = ia->getAddr())
+                indexAddr(AddrIdx_, addr->get(), *cli);
+        }
+
+        (*cli)->firstTA();
+        while (ia = (*cli)->getTA()) {
+            ia->firstAddr();
+            while (addr = ia->getAddr())
+                indexAddr(TaAddrIdx_, addr->get(), *cli);
+        }
+    }
+}
+
+/// @brief records that address is leased to a client
+///
+/// @param idx address index to be updated (AddrIdx_ or TaAddrIdx_)
+/// @param addr leased address
+/// @param client client that leased the address
+void TSrvAddrMgr::indexAddr(AddrToClientIndex& idx, SPtr<TIPv6Addr> addr,
+                            SPtr<TAddrClient> client)
+{
+    idx.insert(std::make_pair(addrKey(addr), client));
+}
+
+/// @brief removes address-client pair from the index
+///
+/// The same address may be (temporarily) held by more than one client,
+/// so only the entry for the specified client is removed.
+///
+/// @param idx address index to be updated (AddrIdx_ or TaAddrIdx_)
+/// @param addr released address
+/// @param client client that held the address
+void TSrvAddrMgr::unindexAddr(AddrToClientIndex& idx, SPtr<TIPv6Addr> addr,
+                              SPtr<TAddrClient> client)
+{
+    std::pair<AddrToClientIndex::iterator, AddrToClientIndex::iterator> range =
+        idx.equal_range(addrKey(addr));
+    for (AddrToClientIndex::iterator i = range.first; i != range.second; ++i) {
+        if (i->second == client) {
+            idx.erase(i);
+            return;
         }
     }
-    return true;
 }
 
 void TSrvAddrMgr::getAddrsCount(SPtr< List(TSrvCfgAddrClass) > classes,
@@ -510,92 +692,234 @@ SPtr<TIPv6Addr> TSrvAddrMgr::getFirstAddr(SPtr<TDUID> clntDuid)
 /* *** ADDRESS CACHE ************************************************************** */
 /* ******************************************************************************** */
 
-/// @brief  remove outdated addresses
+/// @brief returns number of seconds until the first lease expires
 ///
-/// @param addrLst
-/// @param tempAddrLst
-/// @param prefixLst
+/// @return 0 if there are expired leases, UINT_MAX if there are no leases
+unsigned long TSrvAddrMgr::getValidTimeout()
+{
+    unsigned long next = Expiry_.getNext();
+    if (next == ULONG_MAX)
+        return UINT_MAX;
+
+    unsigned long now = (unsigned long)time(NULL);
+    if (next > now)
+        return next - now;
+    return 0;
+}
+
+/// @brief updates expiration of all leases in an IA, TA or PD
 ///
+/// Must be called after lease timestamps or lifetimes were modified
+/// outside of address manager (e.g. on RENEW).
+///
+/// @param duid client's DUID
+/// @param ia IA, TA or PD that was renewed
+/// @param type type of the container (IATYPE_IA, IATYPE_TA or IATYPE_PD)
+void TSrvAddrMgr::leaseRenewed(SPtr<TDUID> duid, SPtr<TAddrIA> ia, TIAType type)
+{
+    scheduleExpiry(duid, ia, type);
+    clientChanged(duid);
+}
+
+/// @brief (re)schedules expiration of all leases in an IA, TA or PD
+///
+/// @param duid client's DUID
+/// @param ia IA, TA or PD
+/// @param type type of the container (IATYPE_IA, IATYPE_TA or IATYPE_PD)
+void TSrvAddrMgr::scheduleExpiry(SPtr<TDUID> duid, SPtr<TAddrIA> ia, TIAType type)
+{
+    if (!ia)
+        return;
+
+    if (type == IATYPE_PD) {
+        SPtr<TAddrPrefix> prefix;
+        ia->firstPrefix();
+        while (prefix = ia->getPrefix())
+            scheduleExpiry(type, duid, ia->getIAID(), (Ptr*)prefix);
+    } else {
+        SPtr<TAddrAddr> addr;
+        ia->firstAddr();
+        while (addr = ia->getAddr())
+            scheduleExpiry(type, duid, ia->getIAID(), addr);
+    }
+}
+
+/// @brief returns leases with expired valid lifetime
+///
+/// Only leases that reached their expiration time are visited. Leases
+/// are not removed here, caller is expected to delete them.
+///
+/// @param addrLst expired addresses will be appended here
+/// @param tempAddrLst expired temporary addresses will be appended here
+/// @param prefixLst expired prefixes will be appended here
 void TSrvAddrMgr::doDuties(std::vector<TExpiredInfo>& addrLst,
                            std::vector<TExpiredInfo>& tempAddrLst,
                            std::vector<TExpiredInfo>& prefixLst)
 {
-    SPtr<TAddrClient> ptrClient;
-    SPtr<TAddrIA>     ptrIA;
-    SPtr<TAddrAddr>   ptrAddr;
+    std::vector<std::string> keys;
+    Expiry_.popExpired((unsigned long)time(NULL), keys);
+
+    for (std::vector<std::string>::const_iterator key = keys.begin();
+         key != keys.end(); ++key) {
+        // see expiryKey() for the layout
+        TIAType type = static_cast<TIAType>((*key)[0]);
+        SPtr<TIPv6Addr> addr = new TIPv6Addr(key->data() + 1, false);
+        const unsigned char* id = (const unsigned char*)key->data() + 17;
+        unsigned long iaid = ((unsigned long)id[0] << 24) | ((unsigned long)id[1] << 16) |
+            ((unsigned long)id[2] << 8) | (unsigned long)id[3];
+
+        DuidToClientIndex::const_iterator cli = ClntsIdx_.find(key->substr(21));
+        if (cli == ClntsIdx_.end())
+            continue; // client is gone
+        SPtr<TAddrClient> client = *cli->second;
+
+        SPtr<TAddrIA> ia;
+        SPtr<TAddrAddr> lease;
+        int prefixLen = 0;
+        switch (type) {
+        case IATYPE_IA:
+            ia = client->getIA(iaid);
+            if (ia)
+                lease = ia->getAddr(addr);
+            break;
+        case IATYPE_TA:
+            ia = client->getTA(iaid);
+            if (ia)
+                lease = ia->getAddr(addr);
+            break;
+        case IATYPE_PD:
+        {
+            ia = client->getPD(iaid);
+            if (!ia)
+                break;
+            SPtr<TAddrPrefix> prefix;
+            ia->firstPrefix();
+            while (prefix = ia->getPrefix()) {
+                if (*prefix->get() == *addr) {
+                    lease = (Ptr*)prefix;
+                    prefixLen = prefix->getLength();
+                    break;
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        if (!lease)
+            continue; // lease is gone
 
-    // for each client...
-    this->firstClient();
-    while (ptrClient = this->getClient() )
-    {
-        // ... which has outdated adresses
-        if (ptrClient->getValidTimeout())
+        if (lease->getValidTimeout()) {
+            // lease was extended without leaseRenewed() notification
+            scheduleExpiry(type, client->getDUID(), iaid, lease);
             continue;
+        }
 
-        // check for expired addresses
-        ptrClient->firstIA();
-        while ( ptrIA = ptrClient->getIA() )
-        {
-            // has this IA outdated addressess?
-            if ( ptrIA->getValidTimeout() )
-                continue;
+        TExpiredInfo expire;
+        expire.client = client;
+        expire.ia = ia;
+        expire.addr = lease->get();
+        switch (type) {
+        case IATYPE_IA:
+            addrLst.push_back(expire);
+            break;
+        case IATYPE_TA:
+            tempAddrLst.push_back(expire);
+            break;
+        default:
+            expire.prefixLen = prefixLen;
+            prefixLst.push_back(expire);
+            break;
+        }
+    }
+}
 
-            ptrIA->firstAddr();
-            while ( ptrAddr = ptrIA->getAddr() )
-            {
-                if (ptrAddr->getValidTimeout())
-                    continue;
+/// @brief returns key used in the expiration queue
+///
+/// Key consists of IA type (1 byte), address or prefix (16 bytes),
+/// IAID (4 bytes, network order) and client DUID (packed).
+///
+/// @param type lease type (IATYPE_IA, IATYPE_TA or IATYPE_PD)
+/// @param duid client's DUID
+/// @param iaid IAID of the container
+/// @param addr leased address or prefix
+///
+/// @return expiration queue key
+std::string TSrvAddrMgr::expiryKey(TIAType type, SPtr<TDUID> duid, unsigned long iaid,
+                                   SPtr<TIPv6Addr> addr)
+{
+    std::string key(1, (char)type);
+    key.append(addr->getAddr(), 16);
+    key.push_back((char)((iaid >> 24) & 0xff));
+    key.push_back((char)((iaid >> 16) & 0xff));
+    key.push_back((char)((iaid >> 8) & 0xff));
+    key.push_back((char)(iaid & 0xff));
+    key += duidKey(duid);
+    return key;
+}
 
-                TExpiredInfo expire;
-                expire.client = ptrClient;
-                expire.ia = ptrIA;
-                expire.addr = ptrAddr->get();
-                addrLst.push_back(expire);
-                // delClntAddr(ptrClient->getDUID(), ptrIA->getIAID(),  ptrAddr->get(), false);
-            }
-        }
+/// @brief (re)schedules lease expiration
+///
+/// @param type lease type (IATYPE_IA, IATYPE_TA or IATYPE_PD)
+/// @param duid client's DUID
+/// @param iaid IAID of the container
+/// @param lease leased address or prefix
+void TSrvAddrMgr::scheduleExpiry(TIAType type, SPtr<TDUID> duid, unsigned long iaid,
+                                 SPtr<TAddrAddr> lease)
+{
+    if (!lease || !duid)
+        return;
 
-        ptrClient->firstTA();
-        while (ptrIA = ptrClient->getTA()) {
-            if (ptrIA->getValidTimeout())
-                continue;
-            ptrIA->firstAddr();
-            while ( ptrAddr = ptrIA->getAddr() )
-            {
-                if (ptrAddr->getValidTimeout())
-                    continue;
+    std::string key = expiryKey(type, duid, iaid, lease->get());
+    unsigned long ts = (unsigned long)lease->getTimestamp();
+    unsigned long expires = ts + lease->getValid();
+    if (expires < ts) {
+        // overflow, this lease never expires
+        Expiry_.cancel(key);
+        return;
+    }
+    Expiry_.schedule(key, expires);
+}
 
-                TExpiredInfo expire;
-                expire.client = ptrClient;
-                expire.ia = ptrIA;
-                expire.addr = ptrAddr->get();
-                tempAddrLst.push_back(expire);
-                // delTAAddr(ptrClient->getDUID(), ptrIA->getIAID(), ptrAddr->get());
-            }
-        }
+/// @brief removes lease from the expiration queue
+///
+/// @param type lease type (IATYPE_IA, IATYPE_TA or IATYPE_PD)
+/// @param duid client's DUID
+/// @param iaid IAID of the container
+/// @param addr leased address or prefix
+void TSrvAddrMgr::cancelExpiry(TIAType type, SPtr<TDUID> duid, unsigned long iaid,
+                               SPtr<TIPv6Addr> addr)
+{
+    if (!addr || !duid)
+        return;
+    Expiry_.cancel(expiryKey(type, duid, iaid, addr));
+}
 
-        SPtr<TAddrIA> pd;
-        SPtr<TAddrPrefix> prefix;
-        ptrClient->firstPD();
-        while (pd = ptrClient->getPD()) {
-            if (pd->getValidTimeout())
-                continue;
-
-            pd->firstPrefix();
-            while (prefix = pd->getPrefix()) {
-                if (prefix->getValidTimeout())
-                    continue;
+/// @brief (re)creates expiration queue from the current client list
+///
+/// Used after database is loaded, as loaded leases do not go through
+/// addClntAddr()/addTAAddr()/addPrefix().
+void TSrvAddrMgr::rebuildExpiry()
+{
+    Expiry_.clear();
+
+    for (std::list< SPtr<TAddrClient> >::const_iterator cli = ClntsLst.getSTL().begin();
+         cli != ClntsLst.getSTL().end(); ++cli) {
+        SPtr<TDUID> duid = (*cli)->getDUID();
+        SPtr<TAddrIA> ia;
+
+        (*cli)->firstIA();
+        while (ia = (*cli)->getIA())
+            scheduleExpiry(duid, ia, IATYPE_IA);
 
-                TExpiredInfo expire;
-                expire.client = ptrClient;
-                expire.ia = pd;
-                expire.addr = prefix->get();
-                expire.prefixLen = prefix->getLength();
-                prefixLst.push_back(expire);
-                // delPrefix(ptrClient->getDUID(), pd->getIAID(), prefix->get(), false);
-            } // while (prefix)
-        } // while (pd)
-    } // while (client)
+        (*cli)->firstTA();
+        while (ia = (*cli)->getTA())
+            scheduleExpiry(duid, ia, IATYPE_TA);
+
+        (*cli)->firstPD();
+        while (ia = (*cli)->getPD())
+            scheduleExpiry(duid, ia, IATYPE_PD);
+    }
 }
 
 /// @brief Checks if address is still supported in current configuration (used in loadDB)
@@ -636,8 +960,19 @@ bool TSrvAddrMgr::verifyPrefix(SPtr<TIPv6Addr> prefix) {
     return false;
 }
 
+/// @brief returns key used in the cache index of clients
+static std::string cacheKey(TIAType type, SPtr<TDUID> duid) {
+    return std::string(1, (char)type) + std::string(duid->get(), duid->getLen());
+}
+
+/// @brief returns key used in the cache index of addresses and prefixes
+static std::string cacheKey(TIAType type, SPtr<TIPv6Addr> addr) {
+    return std::string(1, (char)type) + std::string(addr->getAddr(), 16);
+}
+
 /**
- * returns address or prefix cached for this client.
+ * returns address or prefix cached for this client. Entry becomes
+ * the most recently used one.
  *
  * @param clntDuid
  * @param type type of entry looked for (TYPE_IA for address or TYPE_PD for prefix)
@@ -645,25 +980,32 @@ bool TSrvAddrMgr::verifyPrefix(SPtr<TIPv6Addr> prefix) {
  * @return cached address or prefix. 0 if cached address is not found.
  */
 SPtr<TIPv6Addr> TSrvAddrMgr::getCachedEntry(SPtr<TDUID> clntDuid, TIAType type) {
-    if (!this->CacheMaxSize)
+    if (!this->CacheMaxSize || !clntDuid)
+        return 0;
+
+    CacheIdx::const_iterator it = CacheByDuid_.find(cacheKey(type, clntDuid));
+    if (it == CacheByDuid_.end()) {
+        Log(Debug) << "Cache: There are no cached " << (type==IATYPE_IA?"address":"prefix")
+                   << " address entries for client (DUID=" << clntDuid->getPlain() << ")." << LogEnd;
         return 0;
-    SPtr<TSrvCacheEntry> entry;
-    this->Cache.first();
-
-    while (entry = this->Cache.get()) {
-            if (!entry->Duid)
-                continue; // something is wrong. VERY wrong. But shut up and continue.
-            if ((entry->type==type) && (*entry->Duid == *clntDuid) ) {
-                Log(Debug) << "Cache: Cached " << (type==IATYPE_IA?"address":"prefix")
-                           << " for client (DUID=" << clntDuid->getPlain() << ") found: "
-                           << entry->Addr->getPlain() << LogEnd;
-                return entry->Addr;
-            }
     }
 
-    Log(Debug) << "Cache: There are no cached " << (type==IATYPE_IA?"address":"prefix")
-               << " address entries for client (DUID=" << clntDuid->getPlain() << ")." << LogEnd;
-    return 0;
+    Cache.splice(Cache.end(), Cache, it->second);
+    Log(Debug) << "Cache: Cached " << (type==IATYPE_IA?"address":"prefix")
+               << " for client (DUID=" << clntDuid->getPlain() << ") found: "
+               << it->second->Addr->getPlain() << LogEnd;
+    return it->second->Addr;
+}
+
+/**
+ * removes entry from the cache and its indexes
+ *
+ * @param entry entry to be removed
+ */
+void TSrvAddrMgr::cacheErase(CacheList::iterator entry) {
+    CacheByDuid_.erase(cacheKey(entry->type, entry->Duid));
+    CacheByAddr_.erase(cacheKey(entry->type, entry->Addr));
+    Cache.erase(entry);
 }
 
 /**
@@ -675,24 +1017,19 @@ SPtr<TIPv6Addr> TSrvAddrMgr::getCachedEntry(SPtr<TDUID> clntDuid, TIAType type)
  * @return
  */
 bool TSrvAddrMgr::delCachedEntry(SPtr<TIPv6Addr> addr, TIAType type) {
-    if (!this->CacheMaxSize)
-            return false;
-
-    this->Cache.first();
-    SPtr<TSrvCacheEntry> entry;
-    while (entry = this->Cache.get()) {
-            if (!entry->Addr)
-                continue; // something is wrong. VERY wrong. But shut up and continue.
-            if ( (entry->type==type) && (*(entry->Addr) == *addr) ) {
-                this->Cache.del();
-                this->Cache.first();
-                Log(Debug) << "Cache: " << (type==IATYPE_IA?"Address ":"Prefix ")
-                           << *addr << " was deleted." << LogEnd;
-                return true;
-            }
+    if (!this->CacheMaxSize || !addr)
+        return false;
+
+    CacheIdx::iterator it = CacheByAddr_.find(cacheKey(type, addr));
+    if (it == CacheByAddr_.end()) {
+        Log(Debug) << "Cache: Attempt to delete " << *addr << " failed." << LogEnd;
+        return false;
     }
-    Log(Debug) << "Cache: Attempt to delete " << *addr << " failed." << LogEnd;
-    return false;
+
+    cacheErase(it->second);
+    Log(Debug) << "Cache: " << (type==IATYPE_IA?"Address ":"Prefix ")
+               << *addr << " was deleted." << LogEnd;
+    return true;
 }
 
  /**
@@ -704,28 +1041,23 @@ bool TSrvAddrMgr::delCachedEntry(SPtr<TIPv6Addr> addr, TIAType type) {
  * @return
  */
 bool TSrvAddrMgr::delCachedEntry(SPtr<TDUID> clntDuid, TIAType type) {
-    if (!this->CacheMaxSize)
+    if (!this->CacheMaxSize || !clntDuid)
         return false;
 
-    this->Cache.first();
-    SPtr<TSrvCacheEntry> entry;
-    while (entry = this->Cache.get()) {
-        if (!entry->Duid)
-            continue; // something is wrong. VERY wrong. But shut up and continue.
-        if ( (entry->type==type) && (*(entry->Duid) == *clntDuid) ) {
-            this->Cache.del();
-            this->Cache.first();
-            Log(Debug) << "Cache: Entry for client (DUID=" << clntDuid->getPlain() << ") was deleted." << LogEnd;
-            return true;
-        }
+    CacheIdx::iterator it = CacheByDuid_.find(cacheKey(type, clntDuid));
+    if (it == CacheByDuid_.end()) {
+        // delete attempt is done on multiple occasions as a safety precausion, so don't warn if it is missing
+        return false;
     }
-    // delete attempt is done on multiple occasions as a safety precausion, so don't warn if it is missing
-    // Log(Debug) << "Cache: Attempt to delete entry for client (DUID=" << clntDuid->getPlain() << ") failed." << LogEnd;
-    return false;
+
+    cacheErase(it->second);
+    Log(Debug) << "Cache: Entry for client (DUID=" << clntDuid->getPlain() << ") was deleted." << LogEnd;
+    return true;
 }
 
 /**
- * this function adds an address or prefix to a cache. If there is entry for this client, updates it
+ * this function adds an address or prefix to a cache. If there is entry for this client
+ * (or for this address), it is replaced. New entry becomes the most recently used one.
  *
  * @param clntDuid
  * @param cachedAddr
@@ -734,7 +1066,7 @@ bool TSrvAddrMgr::delCachedEntry(SPtr<TDUID> clntDuid, TIAType type) {
 void TSrvAddrMgr::addCachedEntry(SPtr<TDUID> clntDuid, SPtr<TIPv6Addr> cachedAddr, TIAType type) {
 
     // if cache is disabled (size set to 0)
-    if (!this->CacheMaxSize)
+    if (!this->CacheMaxSize || !clntDuid || !cachedAddr)
         return;
 
     // if this address is reserved, don't add it to cache)
@@ -745,18 +1077,26 @@ void TSrvAddrMgr::addCachedEntry(SPtr<TDUID> clntDuid, SPtr<TIPv6Addr> cachedAdd
     if ( (type == IATYPE_PD) && (SrvCfgMgr().prefixReserved(cachedAddr)))
         return;
 
-    SPtr<TSrvCacheEntry> entry;
-
-    // is there an entry for this client, delete it. New entry will be added at the end
-    this->delCachedEntry(clntDuid, type);
-
-    entry = new TSrvCacheEntry();
-    entry->type = type;
-    entry->Duid = clntDuid;
-    entry->Addr = cachedAddr;
+    std::string duidKey = cacheKey(type, clntDuid);
+    std::string addrKey = cacheKey(type, cachedAddr);
+
+    // is there an entry for this client or address, delete it. New entry will be added at the end
+    CacheIdx::iterator it = CacheByDuid_.find(duidKey);
+    if (it != CacheByDuid_.end())
+        cacheErase(it->second);
+    it = CacheByAddr_.find(addrKey);
+    if (it != CacheByAddr_.end())
+        cacheErase(it->second);
+
+    TSrvCacheEntry entry;
+    entry.type = type;
+    entry.Duid = clntDuid;
+    entry.Addr = cachedAddr;
     Log(Debug) << "Cache: " << (type==IATYPE_IA?"Address ":"Prefix ") << cachedAddr->getPlain()
                << " added for client (DUID=" << clntDuid->getPlain() << "). " << LogEnd;
-    this->Cache.append(entry);
+    CacheList::iterator pos = Cache.insert(Cache.end(), entry);
+    CacheByDuid_[duidKey] = pos;
+    CacheByAddr_[addrKey] = pos;
     this->checkCacheSize();
 }
 
@@ -768,81 +1108,481 @@ void TSrvAddrMgr::setCacheSize(int bytes) {
     this->checkCacheSize();
 }
 
+/// @brief returns number of cached entries
+size_t TSrvAddrMgr::getCacheCount() const {
+    return Cache.size();
+}
+
 /**
- * this function checks if the cache size was not exceeded. If that is so, oldest entries are removed
+ * this function checks if the cache size was not exceeded. If that is so,
+ * least recently used entries are removed
  *
  */
 void TSrvAddrMgr::checkCacheSize() {
-    if (this->Cache.count() <= this->CacheMaxSize)
-        return;
-
     // there are too many cached elements, delete some
-    while (this->Cache.count() > this->CacheMaxSize) {
-        this->Cache.delFirst();
+    while (Cache.size() > this->CacheMaxSize) {
+        cacheErase(Cache.begin());
     }
 }
 
 void TSrvAddrMgr::print(std::ostream & out) {
-    out << "  <cache size=\"" << this->Cache.count() << "\"/>" << endl;
+    out << "  <cache size=\"" << this->Cache.size() << "\"/>" << endl;
 }
 
-void TSrvAddrMgr::dump() {
+/// @brief records that client's state has changed
+///
+/// Client (or the fact that it was deleted) will be written to the lease
+/// journal on next dump().
+///
+/// @param duid client's DUID
+void TSrvAddrMgr::clientChanged(SPtr<TDUID> duid)
+{
+    if (duid && duid->getLen())
+        Dirty_.insert(duidKey(duid));
+    if (duid && LeaseTable_ && !Importing_)
+        syncClient(duid);
+}
 
+/// @brief returns number of seconds until lease journal must be synced
+///
+/// @return 0 if dump() should be called now, UINT_MAX if there is nothing to do
+unsigned long TSrvAddrMgr::getJournalTimeout()
+{
+    if (!Dirty_.empty())
+        return 0;
+    return Journal_.getSyncTimeout();
+}
+
+/// @brief writes whole database to disk and truncates the lease journal
+///
+/// Database is written to the XML file (the same format as before, so it
+/// is still readable by other tools), then to the binary snapshot, which
+/// is used on next startup, together with the address cache.
+void TSrvAddrMgr::snapshot()
+{
     // Do not write anything to disk if there is performance mode enabled
     if (SrvCfgMgr().getPerformanceMode())
         return;
 
-    TAddrMgr::dump(); // perform normal dump of the AddrMgr
+    std::ostringstream xml;
+    xml << *this;
+    if (!TLeaseJournal::writeFile(XmlFile, xml.str())) {
+        Log(Error) << "Failed to write database snapshot to " << XmlFile
+                   << " file." << LogEnd;
+        return;
+    }
+    // binary snapshot identifies the XML file it was written with
+    std::string bin = snapshotName(XmlFile);
+    if (!binaryDump(bin.c_str(), xml.str())) {
+        Log(Error) << "Failed to write binary database snapshot to " << bin
+                   << " file." << LogEnd;
+        return;
+    }
+    SnapshotSize_ = xml.str().size();
+    SnapshotDue_ = false;
+    Dirty_.clear();
+    JournaledReplay_ = ReplayDetectionValue_;
+    Journal_.truncate();
+
     cacheDump();
 }
 
-/**
- * dumps address cache into a file specified by SRVCACHE_FILE
- *
- */
-void TSrvAddrMgr::cacheDump() {
-    std::ofstream f;
-    f.open(SRVCACHE_FILE);
-    if (!f.is_open()) {
-        Log(Error) << "Cache: File " << SRVCACHE_FILE << " creation failed." << LogEnd;
+/// @brief stores changes made since last dump()
+///
+/// Every changed client is appended to the lease journal (see
+/// TAddrMgr::journalReplay()), so the cost does not depend on
+/// database size. Once the journal grows larger than the database
+/// itself, it is compacted into a new snapshot.
+void TSrvAddrMgr::dump() {
+
+    // Do not write anything to disk if there is performance mode enabled
+    if (SrvCfgMgr().getPerformanceMode())
         return;
+
+    if (SnapshotDue_ || !Journal_.isOpen()) {
+        snapshot();
+        return;
+    }
+
+    for (std::set<std::string>::const_iterator key = Dirty_.begin();
+         key != Dirty_.end(); ++key) {
+        std::ostringstream record;
+        DuidToClientIndex::const_iterator cli = ClntsIdx_.find(*key);
+        if (cli != ClntsIdx_.end()) {
+            record << **cli->second;
+        } else {
+            TDUID duid(key->data(), (int)key->size());
+            record << "  <DelClient>" << duid.getPlain() << "</DelClient>" << endl;
+        }
+        Journal_.append(record.str());
+    }
+    Dirty_.clear();
+
+    if (JournaledReplay_ != ReplayDetectionValue_) {
+        std::ostringstream record;
+        record << "  <replayDetection>" << ReplayDetectionValue_
+               << "</replayDetection>" << endl;
+        Journal_.append(record.str());
+        JournaledReplay_ = ReplayDetectionValue_;
     }
-    f << "<cache size=\"" << this->Cache.count() << "\">" << endl;
-    SPtr<TSrvCacheEntry> x;
-    this->Cache.first();
-    while (x=this->Cache.get()) {
-        f << "  <entry type=\"";
-        switch (x->type) {
+
+    Journal_.flush();
+
+    size_t limit = SnapshotSize_ > SERVER_DEFAULT_JOURNAL_SIZE ?
+        SnapshotSize_ : SERVER_DEFAULT_JOURNAL_SIZE;
+    if (Journal_.size() > limit)
+        snapshot();
+}
+
+/// @brief attaches lease table shared with other server processes
+///
+/// Leases held by this process are written to the table immediately.
+///
+/// @param table lease table (or NULL to detach)
+void TSrvAddrMgr::setLeaseTable(TSrvLeaseTable * table)
+{
+    LeaseTable_ = table;
+    if (!table)
+        return;
+
+    std::vector<SPtr<TDUID> > duids;
+    SPtr<TAddrClient> client;
+    firstClient();
+    while (client = getClient())
+        duids.push_back(client->getDUID());
+    for (size_t i = 0; i < duids.size(); i++)
+        syncClient(duids[i]);
+}
+
+TSrvLeaseTable * TSrvAddrMgr::getLeaseTable()
+{
+    return LeaseTable_;
+}
+
+/// @brief takes over client's leases assigned by other server processes
+///
+/// Called before message from a client is handled, so a client that used
+/// to be served by other (e.g. crashed) process keeps its leases. Local
+/// copy of the client, if there is any, is replaced with leases from the
+/// table.
+///
+/// @param duid client's DUID
+///
+/// @return true if any leases were imported
+bool TSrvAddrMgr::importClient(SPtr<TDUID> duid)
+{
+    if (!LeaseTable_ || !duid)
+        return false;
+
+    std::vector<TSrvLeaseTable::TLease> leases;
+    LeaseTable_->getByDuid(duid, leases);
+    bool foreign = false;
+    for (size_t i = 0; i < leases.size(); i++) {
+        if (leases[i].Owner != LeaseTable_->getProcess())
+            foreign = true;
+    }
+    if (!foreign)
+        return false;
+
+    Log(Info) << "Importing " << leases.size() << " lease(s) of client "
+              << duid->getPlain() << " from the lease table." << LogEnd;
+    Importing_ = true;
+
+    // local copy is outdated
+    SPtr<TAddrClient> client = getClient(duid);
+    if (client) {
+        std::vector<TSrvLeaseTable::TLease> old;
+        getLeases(client, old);
+        for (size_t i = 0; i < old.size(); i++) {
+            switch (old[i].Type) {
+            case IATYPE_IA:
+                delClntAddr(duid, old[i].Iaid, old[i].Addr, true);
+                break;
+            case IATYPE_TA:
+                delTAAddr(duid, old[i].Iaid, old[i].Addr, true);
+                break;
+            case IATYPE_PD:
+                delPrefix(duid, old[i].Iaid, old[i].Addr, true);
+                break;
+            }
+        }
+    }
+
+    unsigned long now = (unsigned long)time(NULL);
+    for (size_t i = 0; i < leases.size(); i++) {
+        TSrvLeaseTable::TLease& l = leases[i];
+        // leases keep their remaining lifetimes
+        unsigned long age = now > l.Timestamp ? now - l.Timestamp : 0;
+        unsigned long pref = l.Pref == DHCPV6_INFINITY ? l.Pref : (l.Pref > age ? l.Pref - age : 0);
+        unsigned long valid = l.Valid == DHCPV6_INFINITY ? l.Valid : (l.Valid > age ? l.Valid - age : 0);
+        switch (l.Type) {
         case IATYPE_IA:
-            f << "addr";
+            addClntAddr(duid, l.ClntAddr, l.Iface, l.Iaid, l.T1, l.T2, l.Addr, pref, valid, true);
+            break;
+        case IATYPE_TA:
+            addTAAddr(duid, l.ClntAddr, l.Iface, l.Iaid, l.Addr, pref, valid);
             break;
         case IATYPE_PD:
-            f << "prefix";
+            addPrefix(duid, l.ClntAddr, l.Ifname, l.Iface, l.Iaid, l.T1, l.T2, l.Addr,
+                      pref, valid, l.PrefixLen, true);
             break;
-        default:
-            Log(Error) << "Invalid cache type entry. Skipping." << LogEnd;
-            continue;
         }
+    }
+
+    Importing_ = false;
+    syncClient(duid);
+    return true;
+}
+
+/// @brief stores a lease in the lease table, unless other client holds it
+///
+/// If the table has no room left for the lease, it is refused as well:
+/// other server processes would not see it and could grant it again. The
+/// caller should try another address (or prefix).
+///
+/// @return false if address (or prefix) is leased by other server process
+///         or can't be stored in the table
+bool TSrvAddrMgr::claimLease(TIAType type, SPtr<TDUID> duid, SPtr<TIPv6Addr> clntAddr,
+                             int iface, const std::string& ifname, unsigned long iaid,
+                             unsigned long T1, unsigned long T2, SPtr<TIPv6Addr> addr,
+                             int prefixLen, unsigned long pref, unsigned long valid)
+{
+    if (!LeaseTable_)
+        return true;
+
+    TSrvLeaseTable::TLease lease;
+    lease.Type = type;
+    lease.Addr = addr;
+    lease.PrefixLen = prefixLen;
+    lease.Duid = duid;
+    lease.ClntAddr = clntAddr;
+    lease.Iface = iface;
+    lease.Ifname = ifname;
+    lease.Iaid = iaid;
+    lease.T1 = T1;
+    lease.T2 = T2;
+    lease.Pref = pref;
+    lease.Valid = valid;
+    lease.Timestamp = (unsigned long)time(NULL);
+    if (LeaseTable_->add(lease))
+        return true;
 
-        f << "\" duid=\"";
-        if (x->Duid)
-            f << x->Duid->getPlain();
-        f << "\">";
-        if (x->Addr)
-            f << x->Addr->getPlain();
-        f << "</entry>" << endl;
+    TSrvLeaseTable::TLease other;
+    if (LeaseTable_->find(type, addr, prefixLen, other) && !(*other.Duid == *duid)) {
+        Log(Warning) << addr->getPlain() << " is already leased by other server process."
+                     << LogEnd;
+        return false;
+    }
+
+    // table is full, other processes would not see this lease
+    Log(Warning) << "Unable to share " << addr->getPlain() << " with other server processes "
+                 << "(lease table is full), not leasing it." << LogEnd;
+    return false;
+}
+
+/// @brief appends addresses (or prefixes) held in an IA to the list
+static void getIALeases(SPtr<TAddrIA> ia, TIAType type, TSrvLeaseTable::TLease& lease,
+                        std::vector<TSrvLeaseTable::TLease>& leases)
+{
+    lease.Type = type;
+    lease.ClntAddr = ia->getSrvAddr();
+    lease.Iface = ia->getIfindex();
+    lease.Ifname = ia->getIfacename();
+    lease.Iaid = ia->getIAID();
+    lease.T1 = ia->getT1();
+    lease.T2 = ia->getT2();
+    if (type == IATYPE_PD) {
+        SPtr<TAddrPrefix> prefix;
+        ia->firstPrefix();
+        while (prefix = ia->getPrefix()) {
+            lease.Addr = prefix->get();
+            lease.PrefixLen = prefix->getLength();
+            lease.Pref = prefix->getPref();
+            lease.Valid = prefix->getValid();
+            lease.Timestamp = prefix->getTimestamp();
+            leases.push_back(lease);
+        }
+        return;
+    }
+    SPtr<TAddrAddr> addr;
+    ia->firstAddr();
+    while (addr = ia->getAddr()) {
+        lease.Addr = addr->get();
+        lease.PrefixLen = 128;
+        lease.Pref = addr->getPref();
+        lease.Valid = addr->getValid();
+        lease.Timestamp = addr->getTimestamp();
+        leases.push_back(lease);
+    }
+}
+
+/// @brief returns all leases of a client
+///
+/// @param client client
+/// @param leases [out] client's addresses and prefixes
+void TSrvAddrMgr::getLeases(SPtr<TAddrClient> client,
+                            std::vector<TSrvLeaseTable::TLease>& leases)
+{
+    TSrvLeaseTable::TLease lease;
+    lease.Duid = client->getDUID();
+    lease.Owner = LeaseTable_ ? LeaseTable_->getProcess() : -1;
+
+    SPtr<TAddrIA> ia;
+    client->firstIA();
+    while (ia = client->getIA())
+        getIALeases(ia, IATYPE_IA, lease, leases);
+    client->firstTA();
+    while (ia = client->getTA())
+        getIALeases(ia, IATYPE_TA, lease, leases);
+    client->firstPD();
+    while (ia = client->getPD())
+        getIALeases(ia, IATYPE_PD, lease, leases);
+}
+
+/// @brief writes client's leases to the lease table
+///
+/// Leases the client does not have anymore are removed from the table
+/// (unless they belong to other running process).
+///
+/// @param duid client's DUID
+void TSrvAddrMgr::syncClient(SPtr<TDUID> duid)
+{
+    std::vector<TSrvLeaseTable::TLease> local;
+    SPtr<TAddrClient> client = getClient(duid);
+    if (client)
+        getLeases(client, local);
+
+    std::vector<TSrvLeaseTable::TLease> stored;
+    LeaseTable_->getByDuid(duid, stored);
+    for (size_t i = 0; i < stored.size(); i++) {
+        bool found = false;
+        for (size_t j = 0; j < local.size() && !found; j++) {
+            found = local[j].Type == stored[i].Type &&
+                local[j].PrefixLen == stored[i].PrefixLen &&
+                *local[j].Addr == *stored[i].Addr;
+        }
+        if (!found)
+            LeaseTable_->del(stored[i].Type, stored[i].Addr, stored[i].PrefixLen, duid);
+    }
+
+    for (size_t i = 0; i < local.size(); i++) {
+        if (!LeaseTable_->add(local[i]))
+            Log(Warning) << local[i].Addr->getPlain() << " leased to " << duid->getPlain()
+                         << " is held by other server process." << LogEnd;
+    }
+}
+
+/// binary cache file starts with these 8 bytes
+static const char CACHE_MAGIC[] = "DIBCACHE";
+
+/// binary cache file format version
+#define CACHE_VERSION 1
+
+/**
+ * dumps address cache into a file specified by CacheFile_ (SRVCACHE_BIN_FILE,
+ * unless several server processes are running)
+ *
+ * File consists of a header (magic, version and number of entries) and
+ * entries (type, address, DUID length and DUID), least recently used
+ * first. All integers are in network byte order.
+ */
+void TSrvAddrMgr::cacheDump() {
+    std::string buf;
+    char tmp[4];
+    buf.append(CACHE_MAGIC, 8);
+    writeUint32(tmp, CACHE_VERSION);
+    buf.append(tmp, 4);
+    writeUint32(tmp, (uint32_t)Cache.size());
+    buf.append(tmp, 4);
+
+    for (CacheList::const_iterator x = Cache.begin(); x != Cache.end(); ++x) {
+        buf.push_back((char)x->type);
+        buf.append(x->Addr->getAddr(), 16);
+        writeUint16(tmp, (uint16_t)x->Duid->getLen());
+        buf.append(tmp, 2);
+        buf.append(x->Duid->get(), x->Duid->getLen());
+    }
+
+    if (!TLeaseJournal::writeFile(CacheFile_, buf)) {
+        Log(Error) << "Cache: File " << CacheFile_ << " creation failed." << LogEnd;
     }
-    f << "</cache>" << endl;
-    f.close();
 }
 
 /**
- * dumps address cache into a file specified by SRVCACHE_FILE
+ * reads address cache from a file specified by CacheFile_ or
+ * (if there is no such file) from file in the old XML format, specified
+ * by SRVCACHE_FILE
  *
  */
 void TSrvAddrMgr::cacheRead() {
+    while (!Cache.empty())
+        cacheErase(Cache.begin());
+
+    if (!cacheReadBinary())
+        cacheReadXml();
+}
+
+/**
+ * reads address cache from a file specified by CacheFile_
+ *
+ * @return false if there is no such file
+ */
+bool TSrvAddrMgr::cacheReadBinary() {
+    FILE * f = fopen(CacheFile_.c_str(), "rb");
+    if (!f)
+        return false;
+    std::string buf;
+    char tmp[4096];
+    size_t len;
+    while ((len = fread(tmp, 1, sizeof(tmp), f)) > 0)
+        buf.append(tmp, len);
+    fclose(f);
+
+    if (buf.size() < 16 || buf.compare(0, 8, CACHE_MAGIC, 8)) {
+        Log(Error) << "Cache: " << CacheFile_ << " file is not a cache file." << LogEnd;
+        return true;
+    }
+    uint32_t version = readUint32(buf.c_str() + 8);
+    if (version != CACHE_VERSION) {
+        Log(Error) << "Cache: " << CacheFile_ << " file has unsupported version "
+                   << version << "." << LogEnd;
+        return true;
+    }
+    uint32_t entries = readUint32(buf.c_str() + 12);
 
-    this->Cache.clear();
+    size_t pos = 16;
+    for (uint32_t i = 0; i < entries; i++) {
+        if (buf.size() - pos < 19)
+            break;
+        TIAType type = static_cast<TIAType>(buf[pos]);
+        SPtr<TIPv6Addr> addr = new TIPv6Addr(buf.c_str() + pos + 1, false);
+        size_t duidLen = readUint16(buf.c_str() + pos + 17);
+        pos += 19;
+        if (buf.size() - pos < duidLen)
+            break;
+        SPtr<TDUID> duid = new TDUID(buf.c_str() + pos, (int)duidLen);
+        pos += duidLen;
+        if ( (type != IATYPE_IA) && (type != IATYPE_PD) ) {
+            Log(Error) << "Cache: Invalid cache type entry. Skipping." << LogEnd;
+            continue;
+        }
+        addCachedEntry(duid, addr, type);
+    }
+
+    if (pos != buf.size()) {
+        Log(Warning) << CacheFile_ << " seems truncated." << LogEnd;
+    }
+    Log(Debug) << "Cache: " << Cache.size() << " entries read from " << CacheFile_
+               << " file." << LogEnd;
+    return true;
+}
+
+/**
+ * reads address cache from a file specified by SRVCACHE_FILE (format used
+ * by older versions)
+ *
+ */
+void TSrvAddrMgr::cacheReadXml() {
     bool started = false;
     bool ended = false;
     bool parsed = false;
@@ -928,9 +1668,9 @@ void TSrvAddrMgr::cacheRead() {
     }
     f.close();
 
-    if (this->Cache.count() != entries) {
+    if (this->Cache.size() != entries) {
         Log(Debug) << "Cache: " << SRVCACHE_FILE << " file: " << entries << " entries expected, but "
-                   << this->Cache.count() << " found." << LogEnd;
+                   << this->Cache.size() << " found." << LogEnd;
     }
     if (!parsed) {
         Log(Info) << "Did not find any useful information in " << SRVCACHE_FILE << LogEnd;
@@ -940,13 +1680,14 @@ void TSrvAddrMgr::cacheRead() {
     }
 }
 
-void TSrvAddrMgr::instanceCreate(const std::string& xmlFile, bool loadDB)
+void TSrvAddrMgr::instanceCreate(const std::string& xmlFile, bool loadDB,
+                                 const std::string& cacheFile /* = SRVCACHE_BIN_FILE */)
 {
     if (Instance) {
         Log(Crit) << "SrvAddrMgr already exists! Application error" << LogEnd;
         return;
     }
-    Instance = new TSrvAddrMgr(xmlFile, loadDB);
+    Instance = new TSrvAddrMgr(xmlFile, loadDB, cacheFile);
 }
 
 TSrvAddrMgr & TSrvAddrMgr::instance()
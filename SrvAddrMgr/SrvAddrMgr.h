@@ -13,7 +13,13 @@
 #define SRVADDRMGR_H
 
 #include <vector>
+#include <list>
+#include <map>
+#include <set>
 #include "AddrMgr.h"
+#include "ExpiryQueue.h"
+#include "LeaseJournal.h"
+#include "SrvLeaseTable.h"
 #include "SrvCfgAddrClass.h"
 #include "SrvCfgPD.h"
 
@@ -22,7 +28,8 @@
 class TSrvAddrMgr : public TAddrMgr
 {
   public:
-    static void instanceCreate(const std::string& xmlFile, bool loadDB);
+    static void instanceCreate(const std::string& xmlFile, bool loadDB,
+                               const std::string& cacheFile = SRVCACHE_BIN_FILE);
     static TSrvAddrMgr & instance();
 
     class TSrvCacheEntry
@@ -43,6 +50,9 @@ class TSrvAddrMgr : public TAddrMgr
 
     ~TSrvAddrMgr();
 
+    using TAddrMgr::getClient;
+    virtual SPtr<TAddrClient> getClient(SPtr<TIPv6Addr> leasedAddr);
+
     // IA address management
     bool addClntAddr(SPtr<TDUID> clntDuid, SPtr<TIPv6Addr> clntAddr,
                      int iface, unsigned long IAID, unsigned long T1, unsigned long T2,
@@ -59,12 +69,25 @@ class TSrvAddrMgr : public TAddrMgr
     bool delTAAddr(SPtr<TDUID> duid,unsigned long iaid, SPtr<TIPv6Addr> addr, bool quiet);
 
     // prefix management
+    virtual bool addPrefix(SPtr<TDUID> clntDuid, SPtr<TIPv6Addr> clntAddr,
+                           const std::string& ifname,
+                           int ifindex, unsigned long IAID, unsigned long T1, unsigned long T2,
+                           SPtr<TIPv6Addr> prefix, unsigned long pref, unsigned long valid,
+                           int length, bool quiet);
+    virtual bool updatePrefix(SPtr<TDUID> duid , SPtr<TIPv6Addr> addr,
+                              const std::string& ifname,
+                              int ifindex, unsigned long IAID, unsigned long T1,
+                              unsigned long T2, SPtr<TIPv6Addr> prefix, unsigned long pref,
+                              unsigned long valid, int length, bool quiet);
     virtual bool delPrefix(SPtr<TDUID> clntDuid, unsigned long IAID, SPtr<TIPv6Addr> prefix, bool quiet);
     virtual bool verifyPrefix(SPtr<TIPv6Addr> addr);
 
     // how many addresses does this client have?
     unsigned long getLeaseCount(SPtr<TDUID> duid);
 
+    // lease expiration
+    virtual unsigned long getValidTimeout();
+    void leaseRenewed(SPtr<TDUID> duid, SPtr<TAddrIA> ia, TIAType type);
     void doDuties(std::vector<TExpiredInfo>& addrLst,
                   std::vector<TExpiredInfo>& tempAddrLst,
                   std::vector<TExpiredInfo>& prefixLst);
@@ -74,6 +97,9 @@ class TSrvAddrMgr : public TAddrMgr
 
     bool addrIsFree(SPtr<TIPv6Addr> addr);
     bool taAddrIsFree(SPtr<TIPv6Addr> addr);
+    using TAddrMgr::prefixIsFree;
+    bool prefixIsFree(SPtr<TIPv6Addr> prefix, int length);
+    bool leasedElsewhere(TIAType type, SPtr<TIPv6Addr> addr, int prefixLen);
 
     SPtr<TIPv6Addr> getFirstAddr(SPtr<TDUID> clntDuid);
 
@@ -84,18 +110,106 @@ class TSrvAddrMgr : public TAddrMgr
     void addCachedEntry(SPtr<TDUID> clntDuid, SPtr<TIPv6Addr> cachedEntry, TIAType type);
 
     void setCacheSize(int bytes);
+    size_t getCacheCount() const;
+
+    // persistence (lease journal and database snapshots)
+    void clientChanged(SPtr<TDUID> duid);
+    unsigned long getJournalTimeout();
+    void snapshot();
     void dump();
 
+    // leases shared with other server processes
+    void setLeaseTable(TSrvLeaseTable * table);
+    TSrvLeaseTable * getLeaseTable();
+    bool importClient(SPtr<TDUID> duid);
+
  protected:
     void print(std::ostream & out);
 
-    TSrvAddrMgr(const std::string& xmlfile, bool loadDB);
+    TSrvAddrMgr(const std::string& xmlfile, bool loadDB,
+                const std::string& cachefile = SRVCACHE_BIN_FILE);
     static TSrvAddrMgr * Instance;
 
+    /// holds leased address (packed form) to client mapping
+    typedef std::multimap<std::string, SPtr<TAddrClient> > AddrToClientIndex;
+
+    void rebuildAddrIndex();
+    void indexAddr(AddrToClientIndex& idx, SPtr<TIPv6Addr> addr,
+                   SPtr<TAddrClient> client);
+    void unindexAddr(AddrToClientIndex& idx, SPtr<TIPv6Addr> addr,
+                     SPtr<TAddrClient> client);
+
+    /// IA (non-temporary) addresses, updated by addClntAddr()/delClntAddr()
+    AddrToClientIndex AddrIdx_;
+
+    /// temporary addresses, updated by addTAAddr()/delTAAddr()
+    AddrToClientIndex TaAddrIdx_;
+
+    static std::string expiryKey(TIAType type, SPtr<TDUID> duid, unsigned long iaid,
+                                 SPtr<TIPv6Addr> addr);
+    void rebuildExpiry();
+    void scheduleExpiry(TIAType type, SPtr<TDUID> duid, unsigned long iaid,
+                        SPtr<TAddrAddr> lease);
+    void cancelExpiry(TIAType type, SPtr<TDUID> duid, unsigned long iaid,
+                      SPtr<TIPv6Addr> addr);
+    void scheduleExpiry(SPtr<TDUID> duid, SPtr<TAddrIA> ia, TIAType type);
+
+    /// @brief valid lifetime expiration of every address and prefix
+    ///
+    /// Updated whenever lease is added, renewed or removed, so expired
+    /// leases can be found without walking the whole database.
+    TExpiryQueue Expiry_;
+
+    /// @brief changes made since last snapshot (see dump() and snapshot())
+    TLeaseJournal Journal_;
+
+    /// clients (DUID in packed form) changed since last dump()
+    std::set<std::string> Dirty_;
+
+    /// should the next dump() write a full snapshot?
+    bool SnapshotDue_;
+
+    /// size of the last snapshot (in bytes)
+    size_t SnapshotSize_;
+
+    /// replay detection value stored in the journal or snapshot
+    uint64_t JournaledReplay_;
+
+    bool claimLease(TIAType type, SPtr<TDUID> duid, SPtr<TIPv6Addr> clntAddr, int iface,
+                    const std::string& ifname, unsigned long iaid, unsigned long T1,
+                    unsigned long T2, SPtr<TIPv6Addr> addr, int prefixLen,
+                    unsigned long pref, unsigned long valid);
+    void getLeases(SPtr<TAddrClient> client, std::vector<TSrvLeaseTable::TLease>& leases);
+    void syncClient(SPtr<TDUID> duid);
+
+    /// @brief leases of all server processes (if there are more of them)
+    ///
+    /// Every change of a client is written to the table (see clientChanged()),
+    /// so other processes do not assign the same addresses or prefixes.
+    TSrvLeaseTable * LeaseTable_;
+
+    /// are leases being imported from the table (see importClient())?
+    bool Importing_;
+
+    /// @brief address cache, least recently used entries first
+    ///
+    /// Entries are also indexed by (type, DUID) and by (type, address),
+    /// so no operation needs to walk the list.
+    typedef std::list<TSrvCacheEntry> CacheList;
+    typedef std::map<std::string, CacheList::iterator> CacheIdx;
+
+    /// binary address cache file (one per server process)
+    std::string CacheFile_;
+
     void cacheRead();
+    bool cacheReadBinary();
+    void cacheReadXml();
     void cacheDump();
     void checkCacheSize();
-    List(TSrvCacheEntry) Cache; // list of cached addresses
+    void cacheErase(CacheList::iterator entry);
+    CacheList Cache; // list of cached addresses
+    CacheIdx CacheByDuid_; ///< (type, DUID) -> entry in Cache
+    CacheIdx CacheByAddr_; ///< (type, address) -> entry in Cache
     size_t CacheMaxSize; // maximum number of cached elements
 };
 
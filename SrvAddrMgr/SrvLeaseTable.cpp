@@ -0,0 +1,693 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <time.h>
+#include "Portable.h"
+#include "SrvLeaseTable.h"
+#include "Logger.h"
+
+#ifdef LINUX
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/// lease table file starts with these 8 bytes
+static const char LEASETABLE_MAGIC[] = "DIBLEASE";
+
+/// lease table file format version
+#define LEASETABLE_VERSION 2
+
+#ifdef LINUX
+
+/// lease, as stored in the table
+struct TSrvLeaseTable::TShmEntry {
+    uint8_t Used;
+    uint8_t Type;
+    uint8_t PrefixLen;
+    uint8_t DuidLen;
+    int32_t Owner;
+    int32_t Iface;
+    uint32_t Iaid;
+    uint32_t T1;
+    uint32_t T2;
+    uint32_t Pref;
+    uint32_t Valid;
+    uint32_t Timestamp;
+    char Addr[16];
+    char ClntAddr[16];
+    char Duid[SRVLEASETABLE_MAX_DUID];
+    char Ifname[SRVLEASETABLE_MAX_IFNAME];
+};
+
+/// address index bucket (leases are stored directly in the bucket)
+struct TSrvLeaseTable::TShmBucket {
+    pthread_mutex_t Lock;
+    TShmEntry Slots[SRVLEASETABLE_BUCKET_SLOTS];
+};
+
+/// DUID index entry, points to a lease in the address index
+struct TShmRef {
+    uint8_t Used;
+    uint8_t Type;
+    uint8_t PrefixLen;
+    uint32_t DuidHash;
+    char Addr[16];
+};
+
+/// DUID index bucket
+struct TSrvLeaseTable::TShmDuidBucket {
+    pthread_mutex_t Lock;
+    TShmRef Slots[SRVLEASETABLE_BUCKET_SLOTS];
+};
+
+/// process slot, Alive is locked by the process as long as it runs
+struct TShmProcess {
+    pthread_mutex_t Alive;
+    int32_t Pid;
+};
+
+struct TSrvLeaseTable::TShmHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Buckets;
+    uint32_t Slots;
+    uint32_t EntrySize;
+    TShmProcess Procs[SRVLEASETABLE_MAX_PROCESSES];
+};
+
+/// @brief initializes process-shared, robust mutex
+static bool initMutex(pthread_mutex_t * mutex) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int result = pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return !result;
+}
+
+/// @brief locks the whole table file (for reading or writing)
+///
+/// Record locks are released by the kernel when a process exits, so
+/// a lock held by a crashed process never blocks the others.
+///
+/// @param fd table file
+/// @param type F_RDLCK or F_WRLCK
+///
+/// @return false if other process holds a conflicting lock
+static bool lockFile(int fd, short type) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = 0;
+    fl.l_len = 0; // whole file
+    return !fcntl(fd, F_SETLK, &fl);
+}
+
+/// @brief locks a bucket, even if the process that held it has died
+static void lockMutex(pthread_mutex_t * mutex) {
+    // a single entry is updated at a time, so the data is still usable
+    if (pthread_mutex_lock(mutex) == EOWNERDEAD)
+        pthread_mutex_consistent(mutex);
+}
+
+/// @brief FNV-1a hash
+static uint32_t hashData(uint32_t hash, const char * data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t hashAddr(TIAType type, const char * addr, int prefixLen) {
+    char key[18];
+    key[0] = (char)type;
+    key[1] = (char)prefixLen;
+    memcpy(key + 2, addr, 16);
+    return hashData(2166136261u, key, sizeof(key));
+}
+
+static uint32_t hashDuid(const char * duid, size_t len) {
+    return hashData(2166136261u, duid, len);
+}
+
+#endif
+
+TSrvLeaseTable::TSrvLeaseTable()
+    :Fd_(-1), Map_(0), MapSize_(0), Header_(0), Buckets_(0), Process_(-1) {
+}
+
+TSrvLeaseTable::~TSrvLeaseTable() {
+    close();
+}
+
+/// @brief opens (or creates) lease table
+///
+/// Leases stored in existing table (of the same size) are kept. Locks are
+/// initialized again, so no other process may use the table at this time
+/// (i.e. table is opened before other server processes are started).
+/// Every attached process holds a read lock on the file (see attach()), so
+/// the table is not opened while server processes of another instance are
+/// still running.
+///
+/// @param file name of the file that holds the table
+/// @param buckets number of buckets in each index
+///
+/// @return true if table is ready to use
+bool TSrvLeaseTable::open(const std::string& file, unsigned int buckets) {
+#ifdef LINUX
+    close();
+    if (!buckets)
+        return false;
+
+    size_t size = sizeof(TShmHeader) + buckets * (sizeof(TShmBucket) + sizeof(TShmDuidBucket));
+    Fd_ = ::open(file.c_str(), O_RDWR | O_CREAT, 0600);
+    if (Fd_ < 0) {
+        Log(Error) << "Unable to open lease table file " << file << ": "
+                   << strerror(errno) << LogEnd;
+        return false;
+    }
+    if (!lockFile(Fd_, F_WRLCK)) {
+        Log(Error) << "Lease table file " << file << " is used by running server "
+                   << "process(es), unable to open it." << LogEnd;
+        close();
+        return false;
+    }
+    struct stat st;
+    bool keep = !fstat(Fd_, &st) && (size_t)st.st_size == size;
+    if (!keep && (ftruncate(Fd_, 0) || ftruncate(Fd_, size))) {
+        Log(Error) << "Unable to resize lease table file " << file << ": "
+                   << strerror(errno) << LogEnd;
+        close();
+        return false;
+    }
+    void * map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd_, 0);
+    if (map == MAP_FAILED) {
+        Log(Error) << "Unable to map lease table file " << file << ": "
+                   << strerror(errno) << LogEnd;
+        close();
+        return false;
+    }
+    Map_ = (char*)map;
+    MapSize_ = size;
+    Header_ = (TShmHeader*)Map_;
+    Buckets_ = buckets;
+
+    if (keep && (memcmp(Header_->Magic, LEASETABLE_MAGIC, 8) ||
+                 Header_->Version != LEASETABLE_VERSION || Header_->Buckets != buckets ||
+                 Header_->Slots != SRVLEASETABLE_BUCKET_SLOTS ||
+                 Header_->EntrySize != sizeof(TShmEntry))) {
+        Log(Warning) << "Lease table file " << file << " has different format, "
+                     << "stored leases are dropped." << LogEnd;
+        memset(Map_, 0, size);
+        keep = false;
+    }
+
+    memcpy(Header_->Magic, LEASETABLE_MAGIC, 8);
+    Header_->Version = LEASETABLE_VERSION;
+    Header_->Buckets = buckets;
+    Header_->Slots = SRVLEASETABLE_BUCKET_SLOTS;
+    Header_->EntrySize = sizeof(TShmEntry);
+
+    bool ok = true;
+    for (unsigned int i = 0; i < SRVLEASETABLE_MAX_PROCESSES; i++) {
+        ok = initMutex(&Header_->Procs[i].Alive) && ok;
+        Header_->Procs[i].Pid = 0;
+    }
+    for (unsigned int i = 0; i < buckets; i++) {
+        ok = initMutex(&getBucket(i)->Lock) && ok;
+        ok = initMutex(&getDuidBucket(i)->Lock) && ok;
+    }
+    if (!ok) {
+        Log(Error) << "Unable to initialize lease table locks." << LogEnd;
+        close();
+        return false;
+    }
+    // other processes may attach now
+    lockFile(Fd_, F_RDLCK);
+
+    Log(Debug) << "Lease table " << file << " opened (" << buckets << " buckets, "
+               << (keep ? count() : 0) << " lease(s) kept)." << LogEnd;
+    return true;
+#else
+    Log(Error) << "Shared lease table is not supported on this platform." << LogEnd;
+    return false;
+#endif
+}
+
+/// @brief closes the table (leases are kept in the file)
+void TSrvLeaseTable::close() {
+#ifdef LINUX
+    if (Header_ && Process_ >= 0) {
+        Header_->Procs[Process_].Pid = 0;
+        pthread_mutex_unlock(&Header_->Procs[Process_].Alive);
+    }
+    if (Map_)
+        munmap(Map_, MapSize_);
+    if (Fd_ >= 0)
+        ::close(Fd_);
+#endif
+    Fd_ = -1;
+    Map_ = 0;
+    MapSize_ = 0;
+    Header_ = 0;
+    Buckets_ = 0;
+    Process_ = -1;
+}
+
+bool TSrvLeaseTable::isOpen() const {
+    return Header_ != 0;
+}
+
+/// @brief returns number of buckets suitable for specified number of leases
+///
+/// Buckets are at most half full on average, but there are at least
+/// SRVLEASETABLE_DEFAULT_BUCKETS and at most SRVLEASETABLE_MAX_BUCKETS.
+///
+/// @param leases expected number of leases (e.g. sum of configured limits)
+///
+/// @return number of buckets
+unsigned int TSrvLeaseTable::getBuckets(unsigned long leases) {
+    unsigned long buckets = leases / (SRVLEASETABLE_BUCKET_SLOTS / 2) + 1;
+    if (buckets < SRVLEASETABLE_DEFAULT_BUCKETS)
+        return SRVLEASETABLE_DEFAULT_BUCKETS;
+    if (buckets > SRVLEASETABLE_MAX_BUCKETS)
+        return SRVLEASETABLE_MAX_BUCKETS;
+    return buckets;
+}
+
+/// @brief registers calling process in a process slot
+///
+/// Slot stays taken until the table is closed or the process exits. The
+/// process also holds a read lock on the table file, so the table can't be
+/// opened again (e.g. by a new server instance) while it runs.
+///
+/// @param process process slot (0..SRVLEASETABLE_MAX_PROCESSES-1)
+///
+/// @return false if slot is invalid or already taken
+bool TSrvLeaseTable::attach(unsigned int process) {
+#ifdef LINUX
+    if (!Header_ || Process_ >= 0 || process >= SRVLEASETABLE_MAX_PROCESSES)
+        return false;
+    TShmProcess& slot = Header_->Procs[process];
+    int result = pthread_mutex_trylock(&slot.Alive);
+    if (result == EOWNERDEAD) {
+        pthread_mutex_consistent(&slot.Alive);
+        result = 0;
+    }
+    if (result) {
+        Log(Error) << "Lease table: process slot " << process << " is already used by pid "
+                   << slot.Pid << "." << LogEnd;
+        return false;
+    }
+    if (!lockFile(Fd_, F_RDLCK)) {
+        Log(Error) << "Lease table: unable to lock table file: " << strerror(errno) << LogEnd;
+        pthread_mutex_unlock(&slot.Alive);
+        return false;
+    }
+    slot.Pid = getpid();
+    Process_ = process;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief returns process slot of this process (or -1 if not attached)
+int TSrvLeaseTable::getProcess() const {
+    return Process_;
+}
+
+/// @brief checks if process registered in a slot is still running
+///
+/// @param process process slot
+///
+/// @return true if process is running
+bool TSrvLeaseTable::isAlive(unsigned int process) {
+#ifdef LINUX
+    if (!Header_ || process >= SRVLEASETABLE_MAX_PROCESSES)
+        return false;
+    if ((int)process == Process_)
+        return true;
+    TShmProcess& slot = Header_->Procs[process];
+    if (!slot.Pid)
+        return false;
+    int result = pthread_mutex_trylock(&slot.Alive);
+    if (result == EBUSY)
+        return true;
+    if (result == EOWNERDEAD)
+        pthread_mutex_consistent(&slot.Alive);
+    if (!result || result == EOWNERDEAD) {
+        // process has died, its slot is free again
+        slot.Pid = 0;
+        pthread_mutex_unlock(&slot.Alive);
+    }
+#endif
+    return false;
+}
+
+/// @brief returns running processes (in ascending slot order)
+///
+/// @param processes [out] process slots
+void TSrvLeaseTable::getAlive(std::vector<unsigned int>& processes) {
+    processes.clear();
+    for (unsigned int i = 0; i < SRVLEASETABLE_MAX_PROCESSES; i++) {
+        if (isAlive(i))
+            processes.push_back(i);
+    }
+}
+
+/// @brief adds a lease or updates existing one
+///
+/// Lease is owned by this process afterwards.
+///
+/// @param lease lease to be stored
+///
+/// @return false if the address (or prefix) is leased to another client or
+///         there is no room for it
+bool TSrvLeaseTable::add(const TLease& lease) {
+#ifdef LINUX
+    if (!Header_ || !lease.Addr || !lease.Duid)
+        return false;
+    size_t duidLen = lease.Duid->getLen();
+    if (duidLen > SRVLEASETABLE_MAX_DUID) {
+        Log(Warning) << "Lease table: DUID " << lease.Duid->getPlain()
+                     << " is too long." << LogEnd;
+        return false;
+    }
+    const char * addr = lease.Addr->getAddr();
+    uint32_t duidHash = hashDuid(lease.Duid->get(), duidLen);
+    TShmBucket * buckets[SRVLEASETABLE_ADDR_PROBES];
+    unsigned int cnt = lockBuckets(hashAddr(lease.Type, addr, lease.PrefixLen), buckets);
+
+    TShmEntry * entry = findEntry(buckets, cnt, lease.Type, addr, lease.PrefixLen);
+    if (entry && !isExpired(entry) &&
+        (entry->DuidLen != duidLen || memcmp(entry->Duid, lease.Duid->get(), duidLen))) {
+        unlockBuckets(buckets, cnt);
+        return false;
+    }
+    if (entry) {
+        uint32_t oldHash = hashDuid(entry->Duid, entry->DuidLen);
+        if (oldHash != duidHash) {
+            delRef(entry, oldHash);
+            entry->Used = 0;
+        }
+    } else {
+        // take free slot or, if there is none, the one that has expired
+        TShmEntry * expired = 0;
+        for (unsigned int b = 0; b < cnt && !entry; b++) {
+            TShmEntry * slots = buckets[b]->Slots;
+            for (unsigned int i = 0; i < SRVLEASETABLE_BUCKET_SLOTS && !entry; i++) {
+                if (!slots[i].Used)
+                    entry = &slots[i];
+                else if (!expired && isExpired(&slots[i]))
+                    expired = &slots[i];
+            }
+        }
+        if (!entry && expired) {
+            delRef(expired, hashDuid(expired->Duid, expired->DuidLen));
+            expired->Used = 0;
+            entry = expired;
+        }
+    }
+    if (!entry) {
+        unlockBuckets(buckets, cnt);
+        Log(Warning) << "Lease table: buckets are full, unable to store "
+                     << lease.Addr->getPlain() << "." << LogEnd;
+        return false;
+    }
+
+    bool added = !entry->Used;
+    entry->Type = lease.Type;
+    entry->PrefixLen = lease.PrefixLen;
+    entry->DuidLen = duidLen;
+    entry->Owner = Process_;
+    entry->Iface = lease.Iface;
+    entry->Iaid = lease.Iaid;
+    entry->T1 = lease.T1;
+    entry->T2 = lease.T2;
+    entry->Pref = lease.Pref;
+    entry->Valid = lease.Valid;
+    entry->Timestamp = lease.Timestamp;
+    memcpy(entry->Addr, addr, 16);
+    if (lease.ClntAddr)
+        memcpy(entry->ClntAddr, lease.ClntAddr->getAddr(), 16);
+    else
+        memset(entry->ClntAddr, 0, 16);
+    memcpy(entry->Duid, lease.Duid->get(), duidLen);
+    strncpy(entry->Ifname, lease.Ifname.c_str(), SRVLEASETABLE_MAX_IFNAME - 1);
+    entry->Ifname[SRVLEASETABLE_MAX_IFNAME - 1] = 0;
+    entry->Used = 1;
+    if (added)
+        addRef(entry, duidHash);
+    unlockBuckets(buckets, cnt);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief removes a lease
+///
+/// Lease held by another process may be removed only if that process is
+/// not running anymore.
+///
+/// @param type lease type
+/// @param addr address or prefix
+/// @param prefixLen prefix length (128 for addresses)
+/// @param duid DUID of the client that holds the lease
+///
+/// @return true if lease was removed
+bool TSrvLeaseTable::del(TIAType type, SPtr<TIPv6Addr> addr, int prefixLen,
+                         SPtr<TDUID> duid) {
+#ifdef LINUX
+    if (!Header_ || !addr || !duid)
+        return false;
+    TShmBucket * buckets[SRVLEASETABLE_ADDR_PROBES];
+    unsigned int cnt = lockBuckets(hashAddr(type, addr->getAddr(), prefixLen), buckets);
+    bool removed = false;
+
+    TShmEntry * entry = findEntry(buckets, cnt, type, addr->getAddr(), prefixLen);
+    if (entry && entry->DuidLen == duid->getLen() &&
+        !memcmp(entry->Duid, duid->get(), entry->DuidLen) && isMine(entry)) {
+        delRef(entry, hashDuid(entry->Duid, entry->DuidLen));
+        entry->Used = 0;
+        removed = true;
+    }
+    unlockBuckets(buckets, cnt);
+    return removed;
+#else
+    return false;
+#endif
+}
+
+/// @brief finds a lease that has not expired yet
+///
+/// @param type lease type
+/// @param addr address or prefix
+/// @param prefixLen prefix length (128 for addresses)
+/// @param lease [out] copy of the lease
+///
+/// @return true if lease was found
+bool TSrvLeaseTable::find(TIAType type, SPtr<TIPv6Addr> addr, int prefixLen,
+                          TLease& lease) {
+#ifdef LINUX
+    if (!Header_ || !addr)
+        return false;
+    TShmBucket * buckets[SRVLEASETABLE_ADDR_PROBES];
+    unsigned int cnt = lockBuckets(hashAddr(type, addr->getAddr(), prefixLen), buckets);
+
+    TShmEntry * entry = findEntry(buckets, cnt, type, addr->getAddr(), prefixLen);
+    if (!entry || isExpired(entry)) {
+        unlockBuckets(buckets, cnt);
+        return false;
+    }
+    lease.Type = (TIAType)entry->Type;
+    lease.Addr = new TIPv6Addr(entry->Addr);
+    lease.PrefixLen = entry->PrefixLen;
+    lease.Duid = new TDUID(entry->Duid, entry->DuidLen);
+    lease.ClntAddr = new TIPv6Addr(entry->ClntAddr);
+    lease.Iface = entry->Iface;
+    lease.Ifname = entry->Ifname;
+    lease.Iaid = entry->Iaid;
+    lease.T1 = entry->T1;
+    lease.T2 = entry->T2;
+    lease.Pref = entry->Pref;
+    lease.Valid = entry->Valid;
+    lease.Timestamp = entry->Timestamp;
+    lease.Owner = entry->Owner;
+    unlockBuckets(buckets, cnt);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief returns all leases (that have not expired yet) of a client
+///
+/// @param duid client's DUID
+/// @param leases [out] copies of the leases
+void TSrvLeaseTable::getByDuid(SPtr<TDUID> duid, std::vector<TLease>& leases) {
+    leases.clear();
+#ifdef LINUX
+    if (!Header_ || !duid)
+        return;
+    uint32_t hash = hashDuid(duid->get(), duid->getLen());
+
+    // copy references first, leases are looked up without DUID bucket locked
+    std::vector<TShmRef> refs;
+    for (unsigned int probe = 0; probe < SRVLEASETABLE_DUID_PROBES && probe < Buckets_; probe++) {
+        TShmDuidBucket * bucket = getDuidBucket(hash + probe);
+        lockMutex(&bucket->Lock);
+        for (unsigned int i = 0; i < SRVLEASETABLE_BUCKET_SLOTS; i++) {
+            if (bucket->Slots[i].Used && bucket->Slots[i].DuidHash == hash)
+                refs.push_back(bucket->Slots[i]);
+        }
+        pthread_mutex_unlock(&bucket->Lock);
+    }
+
+    for (size_t i = 0; i < refs.size(); i++) {
+        TLease lease;
+        SPtr<TIPv6Addr> addr = new TIPv6Addr(refs[i].Addr);
+        if (find((TIAType)refs[i].Type, addr, refs[i].PrefixLen, lease) &&
+            *lease.Duid == *duid)
+            leases.push_back(lease);
+    }
+#endif
+}
+
+/// @brief returns number of leases that have not expired yet
+unsigned long TSrvLeaseTable::count() {
+    unsigned long cnt = 0;
+#ifdef LINUX
+    for (unsigned int i = 0; Header_ && i < Buckets_; i++) {
+        TShmBucket * bucket = getBucket(i);
+        lockMutex(&bucket->Lock);
+        for (unsigned int j = 0; j < SRVLEASETABLE_BUCKET_SLOTS; j++) {
+            if (bucket->Slots[j].Used && !isExpired(&bucket->Slots[j]))
+                cnt++;
+        }
+        pthread_mutex_unlock(&bucket->Lock);
+    }
+#endif
+    return cnt;
+}
+
+#ifdef LINUX
+TSrvLeaseTable::TShmBucket * TSrvLeaseTable::getBucket(unsigned int hash) {
+    return (TShmBucket*)(Map_ + sizeof(TShmHeader)) + hash % Buckets_;
+}
+
+TSrvLeaseTable::TShmDuidBucket * TSrvLeaseTable::getDuidBucket(unsigned int hash) {
+    return (TShmDuidBucket*)(Map_ + sizeof(TShmHeader) + Buckets_ * sizeof(TShmBucket))
+        + hash % Buckets_;
+}
+
+/// @brief locks buckets a lease may be stored in
+///
+/// Buckets are locked in ascending order, so processes that lock
+/// overlapping ranges never wait for each other in a cycle.
+///
+/// @param hash lease hash
+/// @param buckets [out] locked buckets (SRVLEASETABLE_ADDR_PROBES at most)
+///
+/// @return number of locked buckets
+unsigned int TSrvLeaseTable::lockBuckets(unsigned int hash, TShmBucket ** buckets) {
+    unsigned int cnt = SRVLEASETABLE_ADDR_PROBES < Buckets_ ? SRVLEASETABLE_ADDR_PROBES
+                                                            : Buckets_;
+    for (unsigned int i = 0; i < cnt; i++)
+        buckets[i] = getBucket(hash % Buckets_ + i);
+    std::sort(buckets, buckets + cnt);
+    for (unsigned int i = 0; i < cnt; i++)
+        lockMutex(&buckets[i]->Lock);
+    return cnt;
+}
+
+void TSrvLeaseTable::unlockBuckets(TShmBucket ** buckets, unsigned int cnt) {
+    for (unsigned int i = 0; i < cnt; i++)
+        pthread_mutex_unlock(&buckets[i]->Lock);
+}
+
+/// @brief finds lease in buckets (buckets must be locked)
+TSrvLeaseTable::TShmEntry * TSrvLeaseTable::findEntry(TShmBucket ** buckets,
+                                                      unsigned int cnt, TIAType type,
+                                                      const char * addr, int prefixLen) {
+    for (unsigned int b = 0; b < cnt; b++) {
+        for (unsigned int i = 0; i < SRVLEASETABLE_BUCKET_SLOTS; i++) {
+            TShmEntry * entry = &buckets[b]->Slots[i];
+            if (entry->Used && entry->Type == type && entry->PrefixLen == prefixLen &&
+                !memcmp(entry->Addr, addr, 16))
+                return entry;
+        }
+    }
+    return 0;
+}
+
+bool TSrvLeaseTable::isExpired(const TShmEntry * entry) const {
+    if (entry->Valid == DHCPV6_INFINITY)
+        return false;
+    return (uint64_t)entry->Timestamp + entry->Valid <= (uint64_t)time(NULL);
+}
+
+/// @brief checks if lease may be removed by this process
+bool TSrvLeaseTable::isMine(const TShmEntry * entry) {
+    return entry->Owner < 0 || entry->Owner == Process_ || !isAlive(entry->Owner);
+}
+
+/// @brief adds lease to the DUID index (lease bucket must be locked)
+///
+/// Reference is stored in the first DUID bucket that is not full.
+void TSrvLeaseTable::addRef(const TShmEntry * entry, unsigned int duidHash) {
+    for (unsigned int probe = 0; probe < SRVLEASETABLE_DUID_PROBES && probe < Buckets_; probe++) {
+        TShmDuidBucket * bucket = getDuidBucket(duidHash + probe);
+        lockMutex(&bucket->Lock);
+        for (unsigned int i = 0; i < SRVLEASETABLE_BUCKET_SLOTS; i++) {
+            TShmRef& ref = bucket->Slots[i];
+            if (ref.Used)
+                continue;
+            ref.Type = entry->Type;
+            ref.PrefixLen = entry->PrefixLen;
+            ref.DuidHash = duidHash;
+            memcpy(ref.Addr, entry->Addr, 16);
+            ref.Used = 1;
+            pthread_mutex_unlock(&bucket->Lock);
+            return;
+        }
+        pthread_mutex_unlock(&bucket->Lock);
+    }
+    Log(Warning) << "Lease table: DUID index is full, lease will not be found by DUID."
+                 << LogEnd;
+}
+
+/// @brief removes lease from the DUID index (lease bucket must be locked)
+void TSrvLeaseTable::delRef(const TShmEntry * entry, unsigned int duidHash) {
+    for (unsigned int probe = 0; probe < SRVLEASETABLE_DUID_PROBES && probe < Buckets_; probe++) {
+        TShmDuidBucket * bucket = getDuidBucket(duidHash + probe);
+        lockMutex(&bucket->Lock);
+        for (unsigned int i = 0; i < SRVLEASETABLE_BUCKET_SLOTS; i++) {
+            TShmRef& ref = bucket->Slots[i];
+            if (ref.Used && ref.DuidHash == duidHash && ref.Type == entry->Type &&
+                ref.PrefixLen == entry->PrefixLen && !memcmp(ref.Addr, entry->Addr, 16)) {
+                ref.Used = 0;
+                pthread_mutex_unlock(&bucket->Lock);
+                return;
+            }
+        }
+        pthread_mutex_unlock(&bucket->Lock);
+    }
+}
+#endif
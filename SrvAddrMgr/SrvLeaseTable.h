@@ -0,0 +1,139 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TSrvLeaseTable;
+#ifndef SRVLEASETABLE_H
+#define SRVLEASETABLE_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include "SmartPtr.h"
+#include "DHCPConst.h"
+#include "DUID.h"
+#include "IPv6Addr.h"
+
+/// maximum number of server processes sharing the table
+#define SRVLEASETABLE_MAX_PROCESSES 64
+
+/// default number of buckets (in both address and DUID index)
+#define SRVLEASETABLE_DEFAULT_BUCKETS 4096
+
+/// number of leases (or DUID index entries) in a single bucket
+#define SRVLEASETABLE_BUCKET_SLOTS 16
+
+/// number of consecutive DUID index buckets a client's leases may take
+#define SRVLEASETABLE_DUID_PROBES 4
+
+/// number of consecutive buckets a lease may be stored in (if its own is full)
+#define SRVLEASETABLE_ADDR_PROBES 4
+
+/// maximum number of buckets (when sized from configured pools)
+#define SRVLEASETABLE_MAX_BUCKETS 65536
+
+/// maximum DUID length (2 bytes of type and up to 128 bytes of data)
+#define SRVLEASETABLE_MAX_DUID 130
+
+/// maximum interface name length (including terminating zero)
+#define SRVLEASETABLE_MAX_IFNAME 32
+
+/// @brief Leases shared by several server processes
+///
+/// Table is stored in a file mapped into memory of every server process,
+/// so a lease assigned by one process is visible to all the others (and
+/// is not lost when the process crashes). Leases are indexed by address
+/// (or prefix) and by client DUID. Both indexes are hash tables with
+/// fixed number of buckets, every bucket is protected by a process-shared,
+/// robust mutex, so a process that dies while holding it does not block
+/// the others. When its bucket is full, a lease is stored in one of the
+/// following ones (see SRVLEASETABLE_ADDR_PROBES), so the table fills up
+/// evenly. Its size should follow the number of configured leases (see
+/// getBuckets()).
+///
+/// A lease belongs to the process that assigned (or renewed) it. Other
+/// processes may take it over (see TSrvAddrMgr::importClient()), but may
+/// remove it only when its owner is no longer running. Leases that are
+/// past their valid lifetime are ignored.
+///
+/// Every process registers itself in one of the process slots, so the
+/// others can tell if it is still running.
+///
+/// Available on Linux only.
+class TSrvLeaseTable
+{
+  public:
+    /// copy of a lease stored in the table
+    struct TLease {
+        TIAType Type;
+        SPtr<TIPv6Addr> Addr;       ///< address or prefix
+        int PrefixLen;              ///< 128 for addresses
+        SPtr<TDUID> Duid;
+        SPtr<TIPv6Addr> ClntAddr;   ///< client's (link-local) address
+        int Iface;
+        std::string Ifname;
+        unsigned long Iaid;
+        unsigned long T1;
+        unsigned long T2;
+        unsigned long Pref;
+        unsigned long Valid;
+        unsigned long Timestamp;
+        int Owner;                  ///< process that holds the lease
+    };
+
+    TSrvLeaseTable();
+    ~TSrvLeaseTable();
+
+    bool open(const std::string& file, unsigned int buckets = SRVLEASETABLE_DEFAULT_BUCKETS);
+    void close();
+    bool isOpen() const;
+    static unsigned int getBuckets(unsigned long leases);
+
+    // server processes
+    bool attach(unsigned int process);
+    int getProcess() const;
+    bool isAlive(unsigned int process);
+    void getAlive(std::vector<unsigned int>& processes);
+
+    // leases
+    bool add(const TLease& lease);
+    bool del(TIAType type, SPtr<TIPv6Addr> addr, int prefixLen, SPtr<TDUID> duid);
+    bool find(TIAType type, SPtr<TIPv6Addr> addr, int prefixLen, TLease& lease);
+    void getByDuid(SPtr<TDUID> duid, std::vector<TLease>& leases);
+    unsigned long count();
+
+  private:
+    // not copyable
+    TSrvLeaseTable(const TSrvLeaseTable&);
+    TSrvLeaseTable& operator=(const TSrvLeaseTable&);
+
+    struct TShmHeader;
+    struct TShmEntry;
+    struct TShmBucket;
+    struct TShmDuidBucket;
+
+    TShmBucket * getBucket(unsigned int hash);
+    TShmDuidBucket * getDuidBucket(unsigned int hash);
+    unsigned int lockBuckets(unsigned int hash, TShmBucket ** buckets);
+    void unlockBuckets(TShmBucket ** buckets, unsigned int cnt);
+    TShmEntry * findEntry(TShmBucket ** buckets, unsigned int cnt, TIAType type,
+                          const char * addr, int prefixLen);
+    bool isExpired(const TShmEntry * entry) const;
+    bool isMine(const TShmEntry * entry);
+    void addRef(const TShmEntry * entry, unsigned int duidHash);
+    void delRef(const TShmEntry * entry, unsigned int duidHash);
+
+    int Fd_;
+    char * Map_;
+    size_t MapSize_;
+    TShmHeader * Header_;
+    unsigned int Buckets_;
+    int Process_;   ///< process slot of this process (or -1)
+};
+
+#endif
@@ -81,11 +81,13 @@ void  NodeClientSpecific::analyseMessage(SPtr<TSrvMsg> msg)
     vendor_class_num = "";
     vendor_class_data = "";
 
-    SPtr<TOpt> ptrOpt;
+    // only options used here are parsed
+    TOptList opts;
+    msg->getOptions(OPTION_VENDOR_OPTS, opts);
+    msg->getOptions(OPTION_VENDOR_CLASS, opts);
 
-    msg->firstOption();
-
-    while (ptrOpt = msg->getOption())	{
+    for (TOptList::iterator it = opts.begin(); it != opts.end(); ++it) {
+	SPtr<TOpt> ptrOpt = *it;
 	switch (ptrOpt->getOptType()) {
 	case OPTION_VENDOR_OPTS:
 	{
@@ -146,5 +148,5 @@ void  NodeClientSpecific::analyseMessage(SPtr<TSrvMsg> msg)
 	    break;
 
 	} // switch
-    } // while
+    } // for
 }
@@ -10,6 +10,7 @@
  */
 
 #include "SrvCfgAddrClass.h"
+#include "SrvCfgMgr.h"
 #include "SmartPtr.h"
 #include "SrvParsGlobalOpt.h"
 #include "DHCPConst.h"
@@ -201,6 +202,13 @@ void TSrvCfgAddrClass::setOptions(SPtr<TSrvParsGlobalOpt> opt)
     if (ClassMaxLease_ > AddrsCount_)
         ClassMaxLease_ = AddrsCount_;
 
+    // small and medium pools keep track of free addresses, so allocation
+    // does not need to guess
+    size_t last;
+    FreeAddrs_ = 0;
+    if (addrOffset(Pool_->getAddrR(), last) && last < SERVER_MAX_BITMAP_POOL)
+        FreeAddrs_ = new TLeaseBitmap(last + 1);
+
     AddrParams_ = opt->getAddrParams();
 }
 
@@ -219,6 +227,91 @@ SPtr<TIPv6Addr> TSrvCfgAddrClass::getRandomAddr()
     return Pool_->getRandomAddr();
 }
 
+/**
+ * @brief returns offset of the address within the pool
+ *
+ * @param addr address
+ * @param offset offset will be stored here
+ *
+ * @return false if address is outside of the pool or too far from its beginning
+ */
+bool TSrvCfgAddrClass::addrOffset(SPtr<TIPv6Addr> addr, size_t& offset)
+{
+    if (!addr || !Pool_->in(addr))
+        return false;
+    TIPv6Addr diff = *addr - *Pool_->getAddrL();
+    for (int i = 0; i < 8; i++) {
+        if (diff.getAddr()[i])
+            return false;
+    }
+    uint64_t x = readUint64(diff.getAddr() + 8);
+    if (x > (size_t)-1)
+        return false;
+    offset = (size_t)x;
+    return true;
+}
+
+/**
+ * @brief returns free address from this pool
+ *
+ * For pools that keep a bitmap of free addresses, a free address is
+ * found directly (starting from a random place in the pool), so this
+ * method returns 0 only if the pool is really exhausted. Addresses leased
+ * by other server processes are skipped, but stay in the bitmap. For
+ * larger pools, random addresses are tried.
+ *
+ * @return free address (or 0 if none was found)
+ */
+SPtr<TIPv6Addr> TSrvCfgAddrClass::getFreeAddr()
+{
+    SPtr<TIPv6Addr> candidate;
+    if (!FreeAddrs_) {
+        for (int i = 0; i < SERVER_MAX_IA_RANDOM_TRIES; i++) {
+            candidate = getRandomAddr();
+            if (SrvAddrMgr().addrIsFree(candidate) && !SrvCfgMgr().addrReserved(candidate))
+                return candidate;
+        }
+        Log(Debug) << "Unable to randomly choose address from class " << ID_ << " after "
+                   << SERVER_MAX_IA_RANDOM_TRIES << " tries." << LogEnd;
+        return 0;
+    }
+
+    size_t start = 0;
+    size_t skipped = FreeAddrs_->size(); // first address leased by other process
+    addrOffset(getRandomAddr(), start);
+    for (;;) {
+        size_t offset = FreeAddrs_->findFree(start);
+        if (offset >= FreeAddrs_->size() || offset == skipped)
+            return 0;
+
+        TIPv6Addr x;
+        writeUint64(x.getAddr() + 8, offset);
+        candidate = new TIPv6Addr(x + *Pool_->getAddrL());
+        if (SrvAddrMgr().addrIsFree(candidate) && !SrvCfgMgr().addrReserved(candidate))
+            return candidate;
+        start = offset + 1;
+
+        // other server process will release it without telling us, so it is
+        // only skipped this time (search ends when we get back to it)
+        if (!SrvCfgMgr().addrReserved(candidate) &&
+            SrvAddrMgr().leasedElsewhere(IATYPE_IA, candidate, 128)) {
+            if (skipped == FreeAddrs_->size())
+                skipped = offset;
+            continue;
+        }
+
+        // address is used or reserved, but was not reported by leaseAssigned()
+        // (e.g. reserved for other client). Don't look at it again.
+        FreeAddrs_->take(offset);
+    }
+}
+
+/// @brief does this class keep track of its free addresses?
+bool TSrvCfgAddrClass::hasFreeMap()
+{
+    return FreeAddrs_ != 0;
+}
+
 SPtr<TIPv6Addr> TSrvCfgAddrClass::getFirstAddr() {
 	return Pool_->getAddrL();
 }
@@ -249,6 +342,20 @@ long TSrvCfgAddrClass::decrAssigned(int count) {
     return AddrsAssigned_;
 }
 
+/// @brief marks address as used, so getFreeAddr() won't return it
+void TSrvCfgAddrClass::leaseAssigned(SPtr<TIPv6Addr> addr) {
+    size_t offset;
+    if (FreeAddrs_ && addrOffset(addr, offset))
+        FreeAddrs_->take(offset);
+}
+
+/// @brief marks address as free
+void TSrvCfgAddrClass::leaseReleased(SPtr<TIPv6Addr> addr) {
+    size_t offset;
+    if (FreeAddrs_ && addrOffset(addr, offset))
+        FreeAddrs_->release(offset);
+}
+
 unsigned long TSrvCfgAddrClass::getAssignedCount() {
     return AddrsAssigned_;
 }
@@ -27,6 +27,7 @@ class TSrvCfgAddrClass;
 #include "SmartPtr.h"
 #include "SrvOptAddrParams.h"
 #include "SrvCfgClientClass.h"
+#include "LeaseBitmap.h"
 
 class TSrvCfgAddrClass
 {
@@ -45,6 +46,8 @@ class TSrvCfgAddrClass
     bool addrInPool(SPtr<TIPv6Addr> addr);
     unsigned long countAddrInPool();
     SPtr<TIPv6Addr> getRandomAddr();
+    SPtr<TIPv6Addr> getFreeAddr();
+    bool hasFreeMap();
     SPtr<TIPv6Addr> getFirstAddr();
     SPtr<TIPv6Addr> getLastAddr();
 
@@ -61,6 +64,8 @@ class TSrvCfgAddrClass
     unsigned long getAssignedCount();
     long incrAssigned(int count=1);
     long decrAssigned(int count=1);
+    void leaseAssigned(SPtr<TIPv6Addr> addr);
+    void leaseReleased(SPtr<TIPv6Addr> addr);
 
     void setOptions(SPtr<TSrvParsGlobalOpt> opt);
     SPtr<TSrvOptAddrParams> getAddrParams();
@@ -80,12 +85,16 @@ class TSrvCfgAddrClass
     uint32_t Share_;
 
     uint32_t chooseTime(uint32_t beg, uint32_t end, uint32_t clntTime);
+    bool addrOffset(SPtr<TIPv6Addr> addr, size_t& offset);
 
     SPtr<THostRange> Pool_;
     unsigned long ClassMaxLease_;
     unsigned long AddrsAssigned_;
     unsigned long AddrsCount_;
 
+    /// free addresses (only for pools up to SERVER_MAX_BITMAP_POOL addresses)
+    SPtr<TLeaseBitmap> FreeAddrs_;
+
     SPtr<TSrvOptAddrParams> AddrParams_; // AddrParams - experimental option
 
     // new, better white/black-list
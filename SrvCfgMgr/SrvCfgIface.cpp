@@ -25,6 +25,12 @@ void TSrvCfgIface::addClientExceptionsLst(List(TSrvCfgOptions) exLst)
 {
     Log(Debug) << exLst.count() << " per-client configurations (exceptions) added." << LogEnd;
     ExceptionsLst_ = exLst;
+
+    // reserved prefixes must not be assigned to anyone else
+    SPtr<TSrvCfgPD> pd;
+    SrvCfgPDLst_.first();
+    while (pd = SrvCfgPDLst_.get())
+        excludeReservedPrefixes(pd);
 }
 
 bool TSrvCfgIface::leaseQuerySupport() const
@@ -283,6 +289,20 @@ bool TSrvCfgIface::supportPrefixDelegation() const {
 
 void TSrvCfgIface::addTA(SPtr<TSrvCfgTA> ta) {
     SrvCfgTALst_.append(ta);
+    TAIdx_.add(ta->getFirstAddr(), ta->getLastAddr(), TAByIdx_.size());
+    TAByIdx_.push_back(ta);
+}
+
+/// @brief returns TA class that address belongs to
+///
+/// @param addr temporary address
+///
+/// @return TA class (or 0 if address is not in any pool)
+SPtr<TSrvCfgTA> TSrvCfgIface::getTAByAddr(SPtr<TIPv6Addr> addr) {
+    size_t idx = TAIdx_.find(addr);
+    if (idx == TRangeIndex::NONE)
+        return 0;
+    return TAByIdx_[idx];
 }
 
 void TSrvCfgIface::firstTA() {
@@ -294,6 +314,38 @@ SPtr<TSrvCfgTA> TSrvCfgIface::getTA() {
 
 void TSrvCfgIface::addPD(SPtr<TSrvCfgPD> pd) {
     SrvCfgPDLst_.append(pd);
+    excludeReservedPrefixes(pd);
+
+    List(THostRange) pools = pd->getPoolLst();
+    SPtr<THostRange> pool;
+    pools.first();
+    while (pool = pools.get())
+        PDIdx_.add(pool->getAddrL(), pool->getAddrR(), PDByIdx_.size());
+    PDByIdx_.push_back(pd);
+}
+
+/// @brief returns PD class that prefix belongs to
+///
+/// @param prefix delegated prefix
+///
+/// @return PD class (or 0 if prefix is not in any pool)
+SPtr<TSrvCfgPD> TSrvCfgIface::getPDByPrefix(SPtr<TIPv6Addr> prefix) {
+    size_t idx = PDIdx_.find(prefix);
+    if (idx == TRangeIndex::NONE)
+        return 0;
+    return PDByIdx_[idx];
+}
+
+/// @brief removes prefixes reserved for specific clients from dynamic allocation
+///
+/// @param pd prefix pool
+void TSrvCfgIface::excludeReservedPrefixes(SPtr<TSrvCfgPD> pd) {
+    SPtr<TSrvCfgOptions> x;
+    ExceptionsLst_.first();
+    while (x = ExceptionsLst_.get()) {
+        if (x->getPrefix())
+            pd->excludePrefix(x->getPrefix(), x->getPrefixLen());
+    }
 }
 
 SPtr<TSrvCfgTA> TSrvCfgIface::getTA(SPtr<TDUID> clntDuid, SPtr<TIPv6Addr> clntAddr) {
@@ -331,34 +383,30 @@ SPtr<TSrvCfgAddrClass> TSrvCfgIface::getClassByID(unsigned long id) {
 }
 
 void TSrvCfgIface::addClntAddr(SPtr<TIPv6Addr> ptrAddr, bool quiet /* =false*/) {
-    SPtr<TSrvCfgAddrClass> ptrClass;
-    firstAddrClass();
-    while (ptrClass = getAddrClass() ) {
-        if (ptrClass->addrInPool(ptrAddr)) {
-            unsigned int count = ptrClass->incrAssigned();
-            if (quiet)
-                return;
-            Log(Debug) << "Address usage for class " << ptrClass->getID()
-                       << " increased to " << count << "." << LogEnd;
+    SPtr<TSrvCfgAddrClass> ptrClass = getClassByAddr(ptrAddr);
+    if (ptrClass) {
+        unsigned int count = ptrClass->incrAssigned();
+        ptrClass->leaseAssigned(ptrAddr);
+        if (quiet)
             return;
-        }
+        Log(Debug) << "Address usage for class " << ptrClass->getID()
+                   << " increased to " << count << "." << LogEnd;
+        return;
     }
     Log(Warning) << "Unable to increase address usage: no class found for "
                  << *ptrAddr << LogEnd;
 }
 
 void TSrvCfgIface::delClntAddr(SPtr<TIPv6Addr> ptrAddr, bool quiet /* =false*/) {
-    SPtr<TSrvCfgAddrClass> ptrClass;
-    firstAddrClass();
-    while (ptrClass = getAddrClass() ) {
-        if (ptrClass->addrInPool(ptrAddr)) {
-            unsigned long count = ptrClass->decrAssigned();
-            if (quiet)
-                return;
-            Log(Debug) << "Address usage for class " << ptrClass->getID()
-                       << " decreased to " << count << "." << LogEnd;
+    SPtr<TSrvCfgAddrClass> ptrClass = getClassByAddr(ptrAddr);
+    if (ptrClass) {
+        unsigned long count = ptrClass->decrAssigned();
+        ptrClass->leaseReleased(ptrAddr);
+        if (quiet)
             return;
-        }
+        Log(Debug) << "Address usage for class " << ptrClass->getID()
+                   << " decreased to " << count << "." << LogEnd;
+        return;
     }
     Log(Warning) << "Unable to decrease address usage: no class found for "
                  << *ptrAddr << LogEnd;
@@ -412,17 +460,15 @@ SPtr<TSrvCfgPD> TSrvCfgIface::getPDByID(unsigned long id) {
 }
 
 bool TSrvCfgIface::addClntPrefix(SPtr<TIPv6Addr> ptrAddr, bool quiet /* =false */) {
-    SPtr<TSrvCfgPD> ptrPD;
-    firstPD();
-    while (ptrPD = getPD() ) {
-        if (ptrPD->prefixInPool(ptrAddr)) {
-            unsigned long count = ptrPD->incrAssigned();
-            if (quiet)
-                return true;
-            Log(Debug) << "PD: Prefix usage for class " << ptrPD->getID()
-                       << " increased to " << count << "." << LogEnd;
+    SPtr<TSrvCfgPD> ptrPD = getPDByPrefix(ptrAddr);
+    if (ptrPD) {
+        unsigned long count = ptrPD->incrAssigned();
+        ptrPD->prefixAssigned(ptrAddr);
+        if (quiet)
             return true;
-        }
+        Log(Debug) << "PD: Prefix usage for class " << ptrPD->getID()
+                   << " increased to " << count << "." << LogEnd;
+        return true;
     }
     Log(Warning) << "Unable to increase prefix usage: no prefix found for "
                  << *ptrAddr << LogEnd;
@@ -430,17 +476,15 @@ bool TSrvCfgIface::addClntPrefix(SPtr<TIPv6Addr> ptrAddr, bool quiet /* =false *
 }
 
 bool TSrvCfgIface::delClntPrefix(SPtr<TIPv6Addr> ptrAddr, bool quiet /* =false */) {
-    SPtr<TSrvCfgPD> ptrPD;
-    firstPD();
-    while (ptrPD = getPD() ) {
-        if (ptrPD->prefixInPool(ptrAddr)) {
-            unsigned long count = ptrPD->decrAssigned();
-            if (quiet)
-                return true;
-            Log(Debug) << "PD: Prefix usage for class " << ptrPD->getID()
-                       << " decreased to " << count << "." << LogEnd;
+    SPtr<TSrvCfgPD> ptrPD = getPDByPrefix(ptrAddr);
+    if (ptrPD) {
+        unsigned long count = ptrPD->decrAssigned();
+        ptrPD->prefixReleased(ptrAddr);
+        if (quiet)
             return true;
-        }
+        Log(Debug) << "PD: Prefix usage for class " << ptrPD->getID()
+                   << " decreased to " << count << "." << LogEnd;
+        return true;
     }
     Log(Warning) << "Unable to decrease address usage: no class found for "
                  << *ptrAddr << LogEnd;
@@ -590,6 +634,25 @@ bool TSrvCfgIface::getRapidCommit() const {
 
 void TSrvCfgIface::addAddrClass(SPtr<TSrvCfgAddrClass> addrClass) {
     SrvCfgAddrClassLst_.append(addrClass);
+    AddrClassIdx_.add(addrClass->getFirstAddr(), addrClass->getLastAddr(),
+                      AddrClassByIdx_.size());
+    AddrClassByIdx_.push_back(addrClass);
+}
+
+/// @brief returns address class that address belongs to
+///
+/// Classes are looked up in a sorted range table, so it takes O(log n)
+/// regardless of number of classes. If pools overlap, the class that
+/// was defined first is returned.
+///
+/// @param addr address
+///
+/// @return address class (or 0 if address is not in any pool)
+SPtr<TSrvCfgAddrClass> TSrvCfgIface::getClassByAddr(SPtr<TIPv6Addr> addr) {
+    size_t idx = AddrClassIdx_.find(addr);
+    if (idx == TRangeIndex::NONE)
+        return 0;
+    return AddrClassByIdx_[idx];
 }
 
 long TSrvCfgIface::getIfaceMaxLease() const {
@@ -1095,54 +1158,30 @@ EAddrStatus TSrvCfgIface::confirmAddress(TIAType type, SPtr<TIPv6Addr> addr) {
     }
 }
 
-/// checks if address is in NA pool
+/// checks if address is in any NA pool
 ///
 /// @param addr address to be checked
 ///
 /// @return true if in pool, false otherwise
 bool TSrvCfgIface::addrInPool(SPtr<TIPv6Addr> addr) {
-    firstAddrClass();
-    SPtr<TSrvCfgAddrClass> ptrClass;
-    bool inPool = false;
-    while (ptrClass = getAddrClass()) {
-        inPool = ptrClass->addrInPool(addr);
-        if (!inPool)
-            return false;
-    }
-    return inPool;
+    return getClassByAddr(addr) != 0;
 }
 
-/// checks if address is in TA pool
+/// checks if address is in any TA pool
 ///
 /// @param addr address to be checked
 ///
 /// @return true if in pool, false otherwise
 bool TSrvCfgIface::addrInTaPool(SPtr<TIPv6Addr> addr) {
-    firstTA();
-    SPtr<TSrvCfgTA> ptrClass;
-    bool inPool = false;
-    while (ptrClass = getTA()) {
-        inPool = ptrClass->addrInPool(addr);
-        if (!inPool)
-            return false;
-    }
-    return inPool;
+    return getTAByAddr(addr) != 0;
 }
 
-/// checks if prefix is in PD pool
+/// checks if prefix is in any PD pool
 ///
 /// @param prefix prefix to be checked
 ///
 /// @return true if in pool, false otherwise
 bool TSrvCfgIface::prefixInPdPool(SPtr<TIPv6Addr> prefix) {
-    firstPD();
-    SPtr<TSrvCfgPD> ptrClass;
-    bool inPool = false;
-    while (ptrClass = getPD()) {
-        inPool = ptrClass->prefixInPool(prefix);
-        if (!inPool)
-            return false;
-    }
-    return inPool;
+    return getPDByPrefix(prefix) != 0;
 }
 
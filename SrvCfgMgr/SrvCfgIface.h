@@ -17,6 +17,7 @@ class TSrvCfgIface;
 #include "SrvCfgAddrClass.h"
 #include "SrvCfgTA.h"
 #include "SrvCfgPD.h"
+#include "RangeIndex.h"
 #include "SrvParsGlobalOpt.h"
 #include <iostream>
 #include <string>
@@ -46,6 +47,7 @@ public:
 
     SPtr<TSrvCfgAddrClass> getAddrClass();
     SPtr<TSrvCfgAddrClass> getClassByID(unsigned long id);
+    SPtr<TSrvCfgAddrClass> getClassByAddr(SPtr<TIPv6Addr> addr);
     SPtr<TSrvCfgAddrClass> getRandomClass(SPtr<TDUID> clntDuid, SPtr<TIPv6Addr> clntAddr);
     long countAddrClass() const;
 
@@ -54,6 +56,7 @@ public:
     void firstTA();
     SPtr<TSrvCfgTA> getTA();
     SPtr<TSrvCfgTA> getTA(SPtr<TDUID> duid, SPtr<TIPv6Addr> clntAddr);
+    SPtr<TSrvCfgTA> getTAByAddr(SPtr<TIPv6Addr> addr);
 
     // prefix management (IA_PD)
     void addPDClass(SPtr<TSrvCfgPD> PDClass);
@@ -63,6 +66,7 @@ public:
     void addPD(SPtr<TSrvCfgPD> pd);
     void firstPD();
     SPtr<TSrvCfgPD> getPD();
+    SPtr<TSrvCfgPD> getPDByPrefix(SPtr<TIPv6Addr> prefix);
     bool addClntPrefix(SPtr<TIPv6Addr> ptrPD, bool quiet = false);
     bool delClntPrefix(SPtr<TIPv6Addr> ptrPD, bool quiet = false);
     bool supportPrefixDelegation() const;
@@ -140,6 +144,7 @@ public:
     uint32_t getValid(uint32_t proposal);
 private:
     uint32_t chooseTime(uint32_t min, uint32_t max, uint32_t proposal);
+    void excludeReservedPrefixes(SPtr<TSrvCfgPD> pd);
 
     unsigned char Preference_;
     int	ID_;
@@ -150,13 +155,19 @@ private:
     unsigned long ClntMaxLease_;
     bool RapidCommit_;
     List(TSrvCfgAddrClass) SrvCfgAddrClassLst_; // IA_NA list (normal addresses)
+    std::vector<SPtr<TSrvCfgAddrClass> > AddrClassByIdx_;
+    TRangeIndex AddrClassIdx_; // pool ranges -> position in AddrClassByIdx_
     bool LeaseQuery_;
 
     // --- Temporary Addresses ---
     List(TSrvCfgTA) SrvCfgTALst_; // IA_TA list (temporary addresses)
+    std::vector<SPtr<TSrvCfgTA> > TAByIdx_;
+    TRangeIndex TAIdx_;
 
     // --- Prefix Delegation ---
     List(TSrvCfgPD) SrvCfgPDLst_;
+    std::vector<SPtr<TSrvCfgPD> > PDByIdx_;
+    TRangeIndex PDIdx_;
 
     // --- subnets ---
     std::vector<THostRange> Subnets_;
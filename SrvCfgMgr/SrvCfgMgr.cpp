@@ -449,14 +449,7 @@ SPtr<TSrvCfgAddrClass> TSrvCfgMgr::getClassByAddr(int iface, SPtr<TIPv6Addr> add
         return 0; // NULL
     }
 
-    SPtr<TSrvCfgAddrClass> ptrClass;
-    ptrIface->firstAddrClass();
-    while (ptrClass = ptrIface->getAddrClass()) {
-        if (ptrClass->addrInPool(addr))
-            return ptrClass;
-    }
-
-    return 0; // NULL
+    return ptrIface->getClassByAddr(addr);
 }
 
 /**
@@ -478,14 +471,7 @@ SPtr<TSrvCfgPD> TSrvCfgMgr::getClassByPrefix(int iface, SPtr<TIPv6Addr> addr)
         return 0;
     }
 
-    SPtr<TSrvCfgPD> ptrClass;
-    ptrIface->firstPD();
-    while (ptrClass = ptrIface->getPD()) {
-        if (ptrClass->prefixInPool(addr))
-            return ptrClass;
-    }
-
-    return 0;
+    return ptrIface->getPDByPrefix(addr);
 }
 
 
@@ -15,6 +15,7 @@
 #include "DHCPConst.h"
 #include "Logger.h"
 #include "SrvMsg.h"
+#include "SrvCfgMgr.h"
 
 using namespace std;
 
@@ -135,6 +136,12 @@ bool TSrvCfgPD::setOptions(SPtr<TSrvParsGlobalOpt> opt, int prefixLength)
        << CommonPool->getAddrR()->getPlain() << ", pool length: "
        << CommonPool->getPrefixLength() << "." << LogEnd; */
 
+    // keep track of free values of the common part, if it's not too long
+    FreePrefixes_ = 0;
+    int commonBits = prefixLength - poolLength;
+    if (commonBits >= 0 && commonBits < 64)
+        FreePrefixes_ = new TFreeRanges((uint64_t)1 << commonBits);
+
     // set up prefix counter counts
     PD_Assigned_ = 0;
     if (PD_MaxLease_ > PD_Count_)
@@ -156,6 +163,11 @@ bool TSrvCfgPD::prefixInPool(SPtr<TIPv6Addr> prefix)
     return false;
 }
 
+/// @brief returns list of pools (ranges of prefixes) in this class
+List(THostRange) TSrvCfgPD::getPoolLst() {
+    return PoolLst_;
+}
+
 /**
  * returns random prefix from a first pool
  *
@@ -203,6 +215,172 @@ List(TIPv6Addr) TSrvCfgPD::getRandomList() {
     return lst;
 }
 
+/// @brief returns value of bits [from, to) of the address
+static uint64_t getBits(const char * addr, int from, int to) {
+    uint64_t x = 0;
+    for (int i = from; i < to; i++) {
+        x = (x << 1) | ((addr[i / 8] >> (7 - i % 8)) & 1);
+    }
+    return x;
+}
+
+/// @brief sets bits [from, to) of the address to specified value
+static void setBits(char * addr, int from, int to, uint64_t value) {
+    for (int i = to - 1; i >= from; i--) {
+        char mask = (char)(1 << (7 - i % 8));
+        if (value & 1)
+            addr[i / 8] |= mask;
+        else
+            addr[i / 8] &= ~mask;
+        value >>= 1;
+    }
+}
+
+/**
+ * @brief returns value of the common part of the prefix
+ *
+ * @param prefix prefix
+ * @param index value will be stored here
+ *
+ * @return false if prefix does not belong to any pool
+ */
+bool TSrvCfgPD::prefixIndex(SPtr<TIPv6Addr> prefix, uint64_t& index)
+{
+    if (!FreePrefixes_ || !prefix || !prefixInPool(prefix))
+        return false;
+    index = getBits(prefix->getAddr(), CommonPool_->getPrefixLength(), PD_Length_);
+    return true;
+}
+
+/**
+ * @brief returns prefixes with specified common part (one from each pool)
+ *
+ * @param index value of the common part
+ *
+ * @return list of prefixes
+ */
+List(TIPv6Addr) TSrvCfgPD::getPrefixList(uint64_t index)
+{
+    List(TIPv6Addr) lst;
+    SPtr<THostRange> range;
+    PoolLst_.first();
+    while (range = PoolLst_.get()) {
+        SPtr<TIPv6Addr> x = new TIPv6Addr(*range->getAddrL());
+        x->truncate(0, CommonPool_->getPrefixLength());
+        setBits(x->getAddr(), CommonPool_->getPrefixLength(), PD_Length_, index);
+        lst.append(x);
+    }
+    return lst;
+}
+
+/**
+ * @brief returns free prefixes (one from each pool)
+ *
+ * Free values of the common part are tracked, so free prefixes are found
+ * directly (starting from a random place). Empty list is returned only if
+ * there are no free prefixes left. Prefixes that turn out to be used or
+ * reserved are marked as used and skipped from then on (those delegated by
+ * other server processes are only skipped this time). If the common part
+ * is too long to be tracked, random prefixes are tried instead.
+ *
+ * @return list of prefixes (empty if there are no free prefixes)
+ */
+List(TIPv6Addr) TSrvCfgPD::getFreeList()
+{
+    SPtr<TIPv6Addr> prefix;
+    if (!FreePrefixes_) {
+        for (int i = 0; i < SERVER_MAX_PD_RANDOM_TRIES; i++) {
+            List(TIPv6Addr) lst = getRandomList();
+            bool allFree = true;
+            lst.first();
+            while (prefix = lst.get()) {
+                if (!SrvAddrMgr().prefixIsFree(prefix, PD_Length_) ||
+                    SrvCfgMgr().prefixReserved(prefix))
+                    allFree = false;
+            }
+            if (allFree)
+                return lst;
+        }
+        return List(TIPv6Addr)();
+    }
+
+    uint64_t start;
+    uint64_t skipped = FreePrefixes_->size(); // first one leased by other process
+    fill_random((uint8_t*)&start, sizeof(start));
+    start %= FreePrefixes_->size();
+    for (;;) {
+        uint64_t index = FreePrefixes_->findFree(start);
+        if (index >= FreePrefixes_->size() || index == skipped)
+            return List(TIPv6Addr)();
+
+        List(TIPv6Addr) lst = getPrefixList(index);
+        bool allFree = true;
+        bool elsewhere = true;
+        lst.first();
+        while (prefix = lst.get()) {
+            if (SrvCfgMgr().prefixReserved(prefix)) {
+                allFree = elsewhere = false;
+            } else if (!SrvAddrMgr().prefixIsFree(prefix, PD_Length_)) {
+                allFree = false;
+                if (!SrvAddrMgr().leasedElsewhere(IATYPE_PD, prefix, PD_Length_))
+                    elsewhere = false;
+            }
+        }
+        if (allFree)
+            return lst;
+        start = index + 1;
+
+        // other server process will release it without telling us, so it is
+        // only skipped this time (search ends when we get back to it)
+        if (elsewhere) {
+            if (skipped == FreePrefixes_->size())
+                skipped = index;
+            continue;
+        }
+
+        // used or reserved, but we were not told about it. Don't look at it again.
+        FreePrefixes_->take(index);
+    }
+}
+
+/// @brief marks prefix as used, so getFreeList() won't return it
+void TSrvCfgPD::prefixAssigned(SPtr<TIPv6Addr> prefix)
+{
+    uint64_t index;
+    if (prefixIndex(prefix, index))
+        FreePrefixes_->take(index);
+}
+
+/// @brief marks prefix as free
+void TSrvCfgPD::prefixReleased(SPtr<TIPv6Addr> prefix)
+{
+    uint64_t index;
+    if (prefixIndex(prefix, index))
+        FreePrefixes_->release(index);
+}
+
+/**
+ * @brief excludes prefix (e.g. reserved one) from dynamic allocation
+ *
+ * @param prefix prefix
+ * @param length prefix length. If it's shorter than delegated prefixes,
+ *        all delegated prefixes within it are excluded.
+ */
+void TSrvCfgPD::excludePrefix(SPtr<TIPv6Addr> prefix, int length)
+{
+    uint64_t index;
+    int poolLength = CommonPool_ ? CommonPool_->getPrefixLength() : 0;
+    if (length < poolLength || !prefixIndex(prefix, index))
+        return;
+    if (length >= (int)PD_Length_) {
+        FreePrefixes_->take(index);
+        return;
+    }
+    int shift = PD_Length_ - length;
+    uint64_t first = (index >> shift) << shift;
+    FreePrefixes_->takeRange(first, first + (((uint64_t)1 << shift) - 1));
+}
+
 unsigned long TSrvCfgPD::getPD_MaxLease() {
     return PD_MaxLease_;
 }
@@ -44,6 +44,7 @@ class TSrvCfgPD;
 #include "SmartPtr.h"
 #include "SrvCfgPD.h"
 #include "Node.h"
+#include "FreeRanges.h"
 
 class TSrvCfgClientClass;
 
@@ -61,9 +62,11 @@ class TSrvCfgPD
 
     //checks if the prefix belongs to the pool
     bool prefixInPool(SPtr<TIPv6Addr> prefix);
+    List(THostRange) getPoolLst();
     unsigned long countPrefixesInPool();
     SPtr<TIPv6Addr> getRandomPrefix();
     List(TIPv6Addr) getRandomList();
+    List(TIPv6Addr) getFreeList();
 
     unsigned long getT1(unsigned long hintT1);
     unsigned long getT2(unsigned long hintT2);
@@ -80,6 +83,9 @@ class TSrvCfgPD
     unsigned long getTotalCount();
     long incrAssigned(int count=1);
     long decrAssigned(int count=1);
+    void prefixAssigned(SPtr<TIPv6Addr> prefix);
+    void prefixReleased(SPtr<TIPv6Addr> prefix);
+    void excludePrefix(SPtr<TIPv6Addr> prefix, int length);
 
     bool setOptions(SPtr<TSrvParsGlobalOpt> opt, int PDPrefix);
     virtual ~TSrvCfgPD();
@@ -97,6 +103,8 @@ class TSrvCfgPD
     unsigned long PD_ValidEnd_;
 
     unsigned long chooseTime(unsigned long beg, unsigned long end, unsigned long clntTime);
+    bool prefixIndex(SPtr<TIPv6Addr> prefix, uint64_t& index);
+    List(TIPv6Addr) getPrefixList(uint64_t index);
 
     unsigned long ID_;
     static unsigned long StaticID_;
@@ -107,6 +115,10 @@ class TSrvCfgPD
     unsigned long PD_Assigned_;
     unsigned long PD_Count_;
 
+    /// free values of the common part (section b), one bit wide for every
+    /// prefix length bit between pool and delegated prefix
+    SPtr<TFreeRanges> FreePrefixes_;
+
     List(std::string) AllowLst_;
     List(std::string) DenyLst_;
 
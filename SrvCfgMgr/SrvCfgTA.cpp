@@ -226,6 +226,14 @@ bool TSrvCfgTA::addrInPool(SPtr<TIPv6Addr> addr)
     return Pool->in(addr);
 }
 
+SPtr<TIPv6Addr> TSrvCfgTA::getFirstAddr() {
+    return Pool->getAddrL();
+}
+
+SPtr<TIPv6Addr> TSrvCfgTA::getLastAddr() {
+    return Pool->getAddrR();
+}
+
 ostream& operator<<(ostream& out,TSrvCfgTA& addrClass)
 {
     out << "    <taClass id=\"" << addrClass.ID << "\" pref=\"" << addrClass.Pref
@@ -37,6 +37,8 @@ class TSrvCfgTA
     unsigned long countAddrInPool();
     SPtr<TIPv6Addr> getRandomAddr();
     bool addrInPool(SPtr<TIPv6Addr> addr);
+    SPtr<TIPv6Addr> getFirstAddr();
+    SPtr<TIPv6Addr> getLastAddr();
 
     unsigned long getPref();
     unsigned long getValid();
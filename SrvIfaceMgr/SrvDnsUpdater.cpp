@@ -0,0 +1,385 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+#include "Portable.h"
+#include "SrvDnsUpdater.h"
+#include "DNSUpdate.h"
+#include "DnsConnPool.h"
+#include "Logger.h"
+
+using namespace std;
+
+/// @brief creates a job (updates are added with addUpdate())
+///
+/// @param addr leased address
+/// @param name FQDN
+/// @param add true if records are added, false if removed
+/// @param timeout timeout of a single attempt (in ms)
+TSrvDnsUpdater::TJob::TJob(const std::string& addr, const std::string& name, bool add,
+                           unsigned int timeout)
+    :Addr(addr), Name(name), Add(add), Timeout(timeout), Attempts(0), Due(0) {
+}
+
+TSrvDnsUpdater::TJob::~TJob() {
+    for (size_t i = 0; i < Updates.size(); i++)
+        delete Updates[i];
+}
+
+/// @brief adds an update to the job (job takes ownership of it)
+///
+/// @param update update (not prepared yet)
+void TSrvDnsUpdater::TJob::addUpdate(DNSUpdate * update) {
+    Updates.push_back(update);
+    Results.push_back(DNSUPDATE_SKIP);
+}
+
+/// @brief returns true if all updates were successful
+bool TSrvDnsUpdater::TJob::success() const {
+    for (size_t i = 0; i < Results.size(); i++) {
+        if (Results[i] != DNSUPDATE_SUCCESS)
+            return false;
+    }
+    return true;
+}
+
+TSrvDnsUpdater::TSrvDnsUpdater(TCallback callback)
+    :Callback_(callback), Retries_(SRVDNSUPDATER_RETRIES), Backoff_(SRVDNSUPDATER_BACKOFF),
+     MaxQueue_(SRVDNSUPDATER_MAX_QUEUE), InProgress_(0), Running_(false), Stop_(false),
+     Pool_(new TDnsConnPool()), Connects_(0), Messages_(0) {
+    memset(&Stats_, 0, sizeof(Stats_));
+#ifdef LINUX
+    pthread_mutex_init(&Mutex_, NULL);
+    pthread_cond_init(&Cond_, NULL);
+#endif
+}
+
+TSrvDnsUpdater::~TSrvDnsUpdater() {
+    stop();
+    for (size_t i = 0; i < Queue_.size(); i++)
+        delete Queue_[i];
+    for (size_t i = 0; i < Done_.size(); i++)
+        delete Done_[i];
+    delete Pool_;
+#ifdef LINUX
+    pthread_mutex_destroy(&Mutex_);
+    pthread_cond_destroy(&Cond_);
+#endif
+}
+
+/// @brief starts updater thread
+///
+/// @return true if thread was started
+bool TSrvDnsUpdater::start() {
+#ifdef LINUX
+    if (Running_)
+        return false;
+
+    // signals are handled by the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    Stop_ = false;
+    int status = pthread_create(&Thread_, NULL, run, this);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (status) {
+        Log(Error) << "Unable to start DNS Update thread: " << strerror(status) << LogEnd;
+        return false;
+    }
+    Running_ = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief stops updater thread
+///
+/// Queued updates are sent first (without waiting for retry delay). They
+/// are not completed, processCompleted() has to be called afterwards.
+void TSrvDnsUpdater::stop() {
+#ifdef LINUX
+    if (!Running_)
+        return;
+    pthread_mutex_lock(&Mutex_);
+    Stop_ = true;
+    pthread_cond_signal(&Cond_);
+    pthread_mutex_unlock(&Mutex_);
+    pthread_join(Thread_, NULL);
+    Running_ = false;
+    Pool_->closeAll();
+#endif
+}
+
+/// @brief returns true if updates are performed by updater thread
+bool TSrvDnsUpdater::isRunning() const {
+    return Running_;
+}
+
+/// @brief sets retry policy
+///
+/// @param retries number of retries of a failed update
+/// @param backoff delay before the first retry (in milliseconds)
+void TSrvDnsUpdater::setRetries(unsigned int retries, unsigned int backoff) {
+    Retries_ = retries;
+    Backoff_ = backoff;
+}
+
+/// @brief sets maximum number of jobs waiting to be performed
+///
+/// @param maxQueue maximum number of jobs
+void TSrvDnsUpdater::setMaxQueue(size_t maxQueue) {
+    MaxQueue_ = maxQueue;
+}
+
+/// @brief prepares updates and queues them
+///
+/// Must be called with state lock held. If the updater thread is not
+/// running, job is performed (and completed) immediately. Job is
+/// dropped, if there are too many jobs waiting already. Dropped job is
+/// completed immediately as failed.
+///
+/// @param job job to be performed (updater takes ownership of it)
+///
+/// @return true if job was queued (or performed successfully)
+bool TSrvDnsUpdater::enqueue(TJob * job) {
+    // messages are created here, as it prints them (update that can't be
+    // prepared fails when it's sent)
+    for (size_t i = 0; i < job->Updates.size(); i++) {
+        job->Updates[i]->prepare();
+        job->Updates[i]->setConnPool(Pool_);
+    }
+
+    if (!Running_) {
+        Stats_.Queued++;
+        std::vector<TJob*> jobs(1, job);
+        attempt(jobs);
+        bool success = job->success();
+        complete(job);
+        return success;
+    }
+
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+    if (Queue_.size() + InProgress_ + Done_.size() >= MaxQueue_) {
+        pthread_mutex_unlock(&Mutex_);
+        Stats_.Dropped++;
+        Log(Warning) << "DDNS: Too many DNS Updates waiting (" << MaxQueue_
+                     << "), update for " << job->Name << " dropped." << LogEnd;
+        Callback_(*job);
+        delete job;
+        return false;
+    }
+    Stats_.Queued++;
+    job->Due = 0;
+    Queue_.push_back(job);
+    pthread_cond_signal(&Cond_);
+    pthread_mutex_unlock(&Mutex_);
+#endif
+    return true;
+}
+
+/// @brief completes jobs performed by the updater thread
+///
+/// Must be called with state lock held.
+///
+/// @return number of completed (or rescheduled) jobs
+unsigned int TSrvDnsUpdater::processCompleted() {
+    std::deque<TJob*> done;
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+    done.swap(Done_);
+    pthread_mutex_unlock(&Mutex_);
+#else
+    done.swap(Done_);
+#endif
+
+    for (size_t i = 0; i < done.size(); i++)
+        complete(done[i]);
+    return done.size();
+}
+
+/// @brief returns number of jobs that are not completed yet
+size_t TSrvDnsUpdater::countPending() {
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+    size_t cnt = Queue_.size() + InProgress_ + Done_.size();
+    pthread_mutex_unlock(&Mutex_);
+    return cnt;
+#else
+    return Queue_.size() + Done_.size();
+#endif
+}
+
+/// @brief returns statistics
+///
+/// Statistics are updated with state lock held only.
+TSrvDnsUpdater::TStats TSrvDnsUpdater::getStats() {
+    TStats stats = Stats_;
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+#endif
+    stats.Connects = Connects_;
+    stats.Messages = Messages_;
+#ifdef LINUX
+    pthread_mutex_unlock(&Mutex_);
+#endif
+    return stats;
+}
+
+/// @brief returns current time (in milliseconds)
+unsigned long long TSrvDnsUpdater::now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/// @brief sends updates that were not successful yet
+///
+/// Updates of all jobs are sent at once, so the ones for the same DNS
+/// server are pipelined. Does not use logger (nor anything else protected
+/// by state lock).
+///
+/// @param jobs jobs to be performed
+void TSrvDnsUpdater::attempt(std::vector<TJob*>& jobs) {
+    std::vector<DNSUpdate*> updates;
+    std::vector<int*> results;
+    unsigned int timeout = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        TJob& job = *jobs[i];
+        job.Attempts++;
+        if (job.Timeout > timeout)
+            timeout = job.Timeout;
+        for (size_t j = 0; j < job.Updates.size(); j++) {
+            if (job.Results[j] != DNSUPDATE_SUCCESS) {
+                updates.push_back(job.Updates[j]);
+                results.push_back(&job.Results[j]);
+            }
+        }
+    }
+
+    std::vector<DnsUpdateResult> sent;
+    DNSUpdate::sendAll(updates, timeout, sent);
+    for (size_t i = 0; i < sent.size(); i++)
+        *results[i] = sent[i];
+
+    const TDnsConnPool::TStats& stats = Pool_->getStats();
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+#endif
+    Connects_ = stats.Connects;
+    Messages_ = stats.Messages;
+#ifdef LINUX
+    pthread_mutex_unlock(&Mutex_);
+#endif
+}
+
+/// @brief prints results of a performed job, reschedules or finishes it
+///
+/// @param job performed job
+void TSrvDnsUpdater::complete(TJob * job) {
+    for (size_t i = 0; i < job->Updates.size(); i++) {
+        job->Updates[i]->showErrors();
+        job->Updates[i]->showResult(job->Results[i]);
+    }
+
+    bool success = job->success();
+    if (!success && Running_ && job->Attempts <= Retries_) {
+        unsigned long long delay = (unsigned long long)Backoff_ << (job->Attempts - 1);
+        Log(Info) << "DDNS: Update for " << job->Name << " (" << job->Addr
+                  << ") failed, retrying in " << delay << "ms." << LogEnd;
+        Stats_.Retried++;
+#ifdef LINUX
+        pthread_mutex_lock(&Mutex_);
+        job->Due = now() + delay;
+        Queue_.push_back(job);
+        pthread_cond_signal(&Cond_);
+        pthread_mutex_unlock(&Mutex_);
+#endif
+        return;
+    }
+
+    if (success)
+        Stats_.Succeeded++;
+    else
+        Stats_.Failed++;
+    Callback_(*job);
+    delete job;
+}
+
+#ifdef LINUX
+void * TSrvDnsUpdater::run(void * updater) {
+    ((TSrvDnsUpdater*)updater)->work();
+    return NULL;
+}
+
+/// @brief sends queued updates until the thread is stopped
+///
+/// All jobs that are due are sent at once. Connections to DNS servers
+/// are closed when they are not used for a while.
+void TSrvDnsUpdater::work() {
+    pthread_mutex_lock(&Mutex_);
+    while (true) {
+        if (Queue_.empty() && Stop_)
+            break;
+
+        // find the job that is due first (retried jobs may wait)
+        std::deque<TJob*>::iterator next = Queue_.end();
+        for (std::deque<TJob*>::iterator it = Queue_.begin(); it != Queue_.end(); ++it) {
+            if (next == Queue_.end() || (*it)->Due < (*next)->Due)
+                next = it;
+        }
+
+        unsigned long long current = now();
+        if (next == Queue_.end() || ((*next)->Due > current && !Stop_)) {
+            // wake up to close idle connections, if there are any
+            unsigned long long due = (unsigned long long)-1;
+            if (next != Queue_.end())
+                due = (*next)->Due;
+            if (Pool_->count() && due > current + DNSCONNPOOL_IDLE_TIMEOUT * 1000)
+                due = current + DNSCONNPOOL_IDLE_TIMEOUT * 1000;
+
+            if (due == (unsigned long long)-1) {
+                pthread_cond_wait(&Cond_, &Mutex_);
+            } else {
+                struct timespec ts;
+                ts.tv_sec = due / 1000;
+                ts.tv_nsec = (due % 1000) * 1000000;
+                pthread_cond_timedwait(&Cond_, &Mutex_, &ts);
+            }
+            Pool_->closeIdle();
+            continue;
+        }
+
+        std::vector<TJob*> jobs;
+        std::deque<TJob*>::iterator it = Queue_.begin();
+        while (it != Queue_.end() && jobs.size() < SRVDNSUPDATER_MAX_BATCH) {
+            if ((*it)->Due <= current || Stop_) {
+                jobs.push_back(*it);
+                it = Queue_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        InProgress_ += jobs.size();
+        pthread_mutex_unlock(&Mutex_);
+
+        attempt(jobs);
+
+        pthread_mutex_lock(&Mutex_);
+        InProgress_ -= jobs.size();
+        Done_.insert(Done_.end(), jobs.begin(), jobs.end());
+    }
+    pthread_mutex_unlock(&Mutex_);
+}
+#endif
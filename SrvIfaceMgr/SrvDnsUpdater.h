@@ -0,0 +1,150 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TSrvDnsUpdater;
+#ifndef SRVDNSUPDATER_H
+#define SRVDNSUPDATER_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <stddef.h>
+
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
+class DNSUpdate;
+class TDnsConnPool;
+
+/// maximum number of updates waiting to be performed (or retried)
+#define SRVDNSUPDATER_MAX_QUEUE 256
+
+/// number of retries of a failed update
+#define SRVDNSUPDATER_RETRIES 3
+
+/// delay before the first retry (doubled for every next one), in milliseconds
+#define SRVDNSUPDATER_BACKOFF 1000
+
+/// maximum number of jobs sent at once
+#define SRVDNSUPDATER_MAX_BATCH 256
+
+/// @brief Performs DNS Updates in a separate thread
+///
+/// Updates requested while a message is processed are only prepared and
+/// queued, so the reply is not delayed by the DNS server. The updater
+/// thread sends them (including lookup of old records) and passes
+/// finished updates back. They are completed by processCompleted(),
+/// called by the main loop (with state lock held): results are printed,
+/// failed updates are retried with increasing delay and the callback is
+/// called for the rest.
+///
+/// The updater thread sends all jobs that are due at once. Records of
+/// updates of the same zone are sent in common messages (e.g. removals of
+/// many expired leases). TCP updates use persistent connections (see
+/// TDnsConnPool) and messages for the same DNS server are pipelined over
+/// one connection.
+///
+/// The updater thread does not use managers, logger or smart pointers,
+/// so it does not need the state lock.
+///
+/// If the thread is not running (or not supported), updates are
+/// performed synchronously and are not retried.
+class TSrvDnsUpdater
+{
+  public:
+    /// DNS Update requested for a single lease
+    class TJob {
+      public:
+        TJob(const std::string& addr, const std::string& name, bool add,
+             unsigned int timeout);
+        ~TJob();
+        void addUpdate(DNSUpdate * update);
+
+        std::string Addr;        ///< leased address
+        std::string Name;        ///< FQDN
+        bool Add;                ///< are records added (or removed)?
+        unsigned int Timeout;    ///< timeout of a single attempt (in ms)
+        std::vector<DNSUpdate*> Updates; ///< PTR and/or AAAA updates (owned)
+        std::vector<int> Results;        ///< result of every update
+        unsigned int Attempts;   ///< number of attempts so far
+        unsigned long long Due;  ///< when to perform next attempt (in ms)
+
+        bool success() const;
+
+      private:
+        // not copyable
+        TJob(const TJob&);
+        TJob& operator=(const TJob&);
+    };
+
+    /// called (with state lock held) for every finished (or dropped) job
+    typedef void (*TCallback)(const TJob& job);
+
+    struct TStats {
+        unsigned long Queued;    ///< jobs accepted
+        unsigned long Succeeded; ///< jobs finished successfully
+        unsigned long Failed;    ///< jobs failed (after all retries)
+        unsigned long Retried;   ///< retries performed
+        unsigned long Dropped;   ///< jobs dropped (queue full)
+        unsigned long Connects;  ///< TCP connections opened
+        unsigned long Messages;  ///< messages sent over TCP connections
+    };
+
+    TSrvDnsUpdater(TCallback callback);
+    ~TSrvDnsUpdater();
+
+    bool start();
+    void stop();
+    bool isRunning() const;
+
+    void setRetries(unsigned int retries, unsigned int backoff);
+    void setMaxQueue(size_t maxQueue);
+
+    bool enqueue(TJob * job);
+    unsigned int processCompleted();
+    size_t countPending();
+    TStats getStats();
+
+  private:
+    // not copyable
+    TSrvDnsUpdater(const TSrvDnsUpdater&);
+    TSrvDnsUpdater& operator=(const TSrvDnsUpdater&);
+
+    static unsigned long long now();
+    void attempt(std::vector<TJob*>& jobs);
+    void complete(TJob * job);
+
+    TCallback Callback_;
+    unsigned int Retries_;
+    unsigned int Backoff_;   ///< in milliseconds
+    size_t MaxQueue_;
+    TStats Stats_;
+
+    std::deque<TJob*> Queue_;   ///< jobs waiting for the updater thread
+    std::deque<TJob*> Done_;    ///< jobs waiting for processCompleted()
+    size_t InProgress_;         ///< jobs being sent right now
+    bool Running_;
+    bool Stop_;
+
+    TDnsConnPool * Pool_;       ///< used by the thread that sends updates only
+    unsigned long Connects_;    ///< copy of pool statistics
+    unsigned long Messages_;
+
+#ifdef LINUX
+    static void * run(void * updater);
+    void work();
+
+    pthread_t Thread_;
+    pthread_mutex_t Mutex_;     ///< protects queues and flags above
+    pthread_cond_t Cond_;       ///< signalled when Queue_ or Stop_ change
+#endif
+};
+
+#endif
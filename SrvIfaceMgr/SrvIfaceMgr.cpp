@@ -43,6 +43,8 @@
 #include "OptIAAddress.h"
 #include "OptIAPrefix.h"
 #include "DNSUpdate.h"
+#include "SrvDnsUpdater.h"
+#include "SrvAddrMgr.h"
 
 using namespace std;
 
@@ -53,7 +55,9 @@ TSrvIfaceMgr * TSrvIfaceMgr::Instance = 0;
  * constructor.
  */
 TSrvIfaceMgr::TSrvIfaceMgr(const std::string& xmlFile)
-    : TIfaceMgr(xmlFile, false) {
+    : TIfaceMgr(xmlFile, false), Wildcard_(false),
+      DnsUpdater_(new TSrvDnsUpdater(fqdnUpdated)),
+      ScriptExecutor_(new TSrvScriptExecutor()) {
 
     struct iface * ptr;
     struct iface * ifaceList;
@@ -96,6 +100,8 @@ TSrvIfaceMgr::TSrvIfaceMgr(const std::string& xmlFile)
 
 TSrvIfaceMgr::~TSrvIfaceMgr() {
     Log(Debug) << "SrvIfaceMgr cleanup." << LogEnd;
+    delete DnsUpdater_;
+    delete ScriptExecutor_;
 }
 
 void TSrvIfaceMgr::dump()
@@ -118,14 +124,70 @@ void TSrvIfaceMgr::dump()
  */
 bool TSrvIfaceMgr::send(int iface, char *msg, int size,
                         SPtr<TIPv6Addr> addr, int port) {
+    SPtr<TIfaceSocket> sock = getSendSocket(iface, addr);
+    if (!sock)
+        return false;
+
+    // one socket serves all interfaces, source address is selected by kernel
+    if (WildcardSock_)
+        return WildcardSock_->send(msg, size, addr, port, iface) == 0;
+
+    // send it!
+    if (sock->send(msg,size,addr,port) == 0) {
+        return true; // all ok
+    } else {
+        return false;
+    }
+}
+
+/// @brief sends data from a transmit buffer
+///
+/// If a received batch is processed, the reply is queued together with its
+/// buffer (nothing is copied) and the buffer goes back to the pool once
+/// the reply is sent. Otherwise it is sent immediately by send().
+///
+/// @param iface interface index
+/// @param buf buffer with data to be sent
+/// @param size data length
+/// @param addr destination address
+/// @param port destination port
+///
+/// @return true if data was sent or queued
+bool TSrvIfaceMgr::sendBuffer(int iface, TSrvTxBuffers::TBuffer& buf, int size,
+                              SPtr<TIPv6Addr> addr, int port) {
+    if (isQueueing()) {
+        SPtr<TIfaceSocket> sock = getSendSocket(iface, addr);
+        if (!sock)
+            return false;
+        // replies to a batch of received messages are sent together
+        std::vector<char> * data = buf.detach();
+        if (queueSend(sock->getFD(), iface, data, size, addr, port))
+            return true;
+        TSrvTxBuffers::give(data);
+        return false;
+    }
+    return send(iface, buf.get(), size, addr, port);
+}
+
+/// @brief finds socket used to send data to specified address
+///
+/// @param iface interface index
+/// @param addr destination address
+///
+/// @return socket (or NULL if there is no suitable socket)
+SPtr<TIfaceSocket> TSrvIfaceMgr::getSendSocket(int iface, SPtr<TIPv6Addr> addr) {
     // find this interface
     SPtr<TIfaceIface> ptrIface;
     ptrIface = this->getIfaceByID(iface);
     if (!ptrIface) {
             Log(Error)  << "Send failed: No such interface id=" << iface << LogEnd;
-            return false;
+            return SPtr<TIfaceSocket>();
     }
 
+    // one socket serves all interfaces
+    if (WildcardSock_)
+        return WildcardSock_;
+
     // find this socket
     SPtr<TIfaceSocket> sock;
     SPtr<TIfaceSocket> backup;
@@ -145,7 +207,7 @@ bool TSrvIfaceMgr::send(int iface, char *msg, int size,
     if (!sock && !backup) {
         Log(Error) << "Send failed: interface " << ptrIface->getFullName()
                    << " has no suitable open sockets." << LogEnd;
-        return false;
+        return SPtr<TIfaceSocket>();
     }
     if (!sock) {
         Log(Warning) << "No preferred socket found for transmission to "
@@ -153,13 +215,14 @@ bool TSrvIfaceMgr::send(int iface, char *msg, int size,
                      << ". Using backup socket " << backup->getFD() << LogEnd;
         sock = backup;
     }
+    return sock;
+}
 
-    // send it!
-    if (sock->send(msg,size,addr,port) == 0) {
-        return true; // all ok
-    } else {
-        return false;
-    }
+/// @brief returns buffer of a sent reply to the pool
+///
+/// @param buf buffer passed to queueSend() by sendBuffer()
+void TSrvIfaceMgr::releaseSendBuffer(std::vector<char> * buf) {
+    TSrvTxBuffers::give(buf);
 }
 
 /// @brief tries to receive a packet
@@ -191,20 +254,144 @@ SPtr<TSrvMsg> TSrvIfaceMgr::select(unsigned long timeout) {
     // static buffer speeds things up. We use maximum size for UDP (almost 64k)
     // to be on the safe side. Otherwise someone could send us a fragmented
     // huge UDP packet and we would be in for a surprise. :)
-    const int maxBufsize = 0xffff - 20 - 8;
-    int bufsize=maxBufsize;
-    static char buf[maxBufsize];
+    int bufsize = SRVIFACEMGR_MAX_MSG_SIZE;
+    static char buf[SRVIFACEMGR_MAX_MSG_SIZE];
 
     SPtr<TIPv6Addr> peer(new TIPv6Addr());
     SPtr<TIPv6Addr> myaddr(new TIPv6Addr());
-    int sockid;
 
+    int ifindex = receiveMsg(timeout, buf, bufsize, peer, myaddr);
+    if (ifindex < 0) {
+        return 0;
+    }
+    return decodeReceived(ifindex, buf, bufsize, peer, myaddr);
+}
+
+/// @brief receives data and finds interface it was received on
+///
+/// @param timeout select() timeout in seconds
+/// @param buf pointer to reception buffer
+/// @param bufsize reference to buffer size (will be updated to received data size)
+/// @param peer address of the pkt sender
+/// @param myaddr address the packet was received on
+///
+/// @return index of the physical interface (or negative value if nothing was received)
+int TSrvIfaceMgr::receiveMsg(unsigned long timeout, char* buf, int& bufsize,
+                             SPtr<TIPv6Addr> peer, SPtr<TIPv6Addr> myaddr) {
     // read data
-    sockid = receive(timeout, buf, bufsize, peer, myaddr);
+    int sockid = receive(timeout, buf, bufsize, peer, myaddr);
     if (sockid < 0) {
-        return 0;
+        return -1;
     }
 
+    SPtr<TIfaceIface> ptrIface;
+
+    // get interface
+    if (WildcardSock_ && sockid == WildcardSock_->getFD()) {
+        // socket is shared, interface is reported by IPV6_PKTINFO
+        if (!WildcardIfaces_.count(getRecvIface())) {
+            Log(Debug) << "Received " << bufsize << " bytes on not configured interface "
+                       << getRecvIface() << ", message ignored." << LogEnd;
+            return -1;
+        }
+        ptrIface = getIfaceByID(getRecvIface());
+    } else {
+        ptrIface = (Ptr*)getIfaceBySocket(sockid);
+    }
+    if (!ptrIface) {
+        Log(Error) << "Received " << bufsize << " bytes on unknown socket " << sockid
+                   << ", message ignored." << LogEnd;
+        return -1;
+    }
+
+    Log(Debug) << "Received " << bufsize << " bytes on interface " << ptrIface->getName() << "/"
+               << ptrIface->getID() << " (socket=" << sockid << ", addr=" << *peer << "."
+               << ")." << LogEnd;
+    return ptrIface->getID();
+}
+
+/// @brief finds client-id option in a message
+///
+/// Relayed messages are searched recursively, so client-id of the
+/// innermost (client's) message is found.
+///
+/// @param buf message data
+/// @param bufsize message size
+/// @param duid [out] beginning of the DUID
+/// @param duidLen [out] length of the DUID
+///
+/// @return true if client-id was found
+static bool findClientId(const char* buf, int bufsize, const char*& duid, int& duidLen) {
+    for (int hops = 0; hops <= HOP_COUNT_LIMIT; hops++) {
+        bool relayed = bufsize > 0 && buf[0] == RELAY_FORW_MSG;
+        // msg-type, hop-count, link-address, peer-address or msg-type, transaction-id
+        int offset = relayed ? 34 : 4;
+        const char* inner = 0;
+        int innerLen = 0;
+
+        while (offset + 4 <= bufsize) {
+            uint16_t type = readUint16(buf + offset);
+            uint16_t len = readUint16(buf + offset + 2);
+            offset += 4;
+            if (offset + len > bufsize)
+                return false; // truncated option
+            if (!relayed && type == OPTION_CLIENTID) {
+                duid = buf + offset;
+                duidLen = len;
+                return true;
+            }
+            if (relayed && type == OPTION_RELAY_MSG) {
+                inner = buf + offset;
+                innerLen = len;
+            }
+            offset += len;
+        }
+        if (!inner)
+            return false;
+        buf = inner;
+        bufsize = innerLen;
+    }
+    return false;
+}
+
+/// @brief selects server process (shard) for received data
+///
+/// Data is assigned by hash of client DUID, so all messages from a
+/// client go to the same process. Messages without client-id are assigned
+/// by sender address. Only client-id is looked for, data is not decoded.
+///
+/// @param buf message data
+/// @param bufsize message size
+/// @param peer packed sender address
+/// @param shards number of shards
+///
+/// @return shard number (0..shards-1)
+unsigned int TSrvIfaceMgr::getShard(const char* buf, int bufsize, const char* peer,
+                                    unsigned int shards) {
+    const char* key = peer;
+    int keyLen = 16;
+    findClientId(buf, bufsize, key, keyLen);
+
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < keyLen; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619u;
+    }
+    return shards ? hash % shards : 0;
+}
+
+/// @brief creates message object from received data
+///
+/// @param ifindex index of the physical interface the data was received on
+/// @param buf received data
+/// @param bufsize size of received data
+/// @param peer address of the pkt sender
+/// @param myaddr address the packet was received on
+///
+/// @return message object (or NULL)
+SPtr<TSrvMsg> TSrvIfaceMgr::decodeReceived(int ifindex, char* buf, int bufsize,
+                                           SPtr<TIPv6Addr> peer, SPtr<TIPv6Addr> myaddr) {
     SPtr<TSrvMsg> ptr;
 
     if (bufsize<4) {
@@ -220,14 +407,12 @@ SPtr<TSrvMsg> TSrvIfaceMgr::select(unsigned long timeout) {
     // check message type
     int msgtype = buf[0];
 
-    SPtr<TIfaceIface> ptrIface;
-
-    // get interface
-    ptrIface = (Ptr*)getIfaceBySocket(sockid);
-
-    Log(Debug) << "Received " << bufsize << " bytes on interface " << ptrIface->getName() << "/"
-               << ptrIface->getID() << " (socket=" << sockid << ", addr=" << *peer << "."
-               << ")." << LogEnd;
+    SPtr<TIfaceIface> ptrIface = getIfaceByID(ifindex);
+    if (!ptrIface) {
+        Log(Error) << "Received data over unknown interface: ifindex=" << ifindex
+                   << ", message ignored." << LogEnd;
+        return 0;
+    }
 
     // create specific message object
     switch (msgtype) {
@@ -634,6 +819,103 @@ void TSrvIfaceMgr::redetectIfaces() {
     if_list_release(ifaceList); // allocated in pure C, and so release it there
 }
 
+/// @brief enables or disables single wildcard socket mode
+///
+/// In this mode, instead of separate unicast, multicast and link-local
+/// sockets on every interface, a single socket is bound to :: and joins
+/// multicast groups on all configured interfaces. Received messages are
+/// dispatched using the interface index reported by IPV6_PKTINFO, so the
+/// number of sockets does not grow with the number of interfaces and each
+/// message is received only once. Requires batching (enabled here), so it
+/// is supported on Linux only. Must be set before sockets are opened.
+///
+/// @param wildcard should single wildcard socket be used?
+///
+/// @return true if requested mode is used
+bool TSrvIfaceMgr::setWildcard(bool wildcard) {
+    if (WildcardSock_) {
+        Log(Error) << "Unable to change socket mode, sockets are already open." << LogEnd;
+        return Wildcard_ == wildcard;
+    }
+#ifdef LINUX
+    if (wildcard)
+        setBatching(true);
+    Wildcard_ = wildcard;
+    return true;
+#else
+    return !wildcard;
+#endif
+}
+
+/// @brief checks if single wildcard socket mode is enabled
+///
+/// @return true if one socket serves all interfaces
+bool TSrvIfaceMgr::isWildcard() const {
+    return Wildcard_;
+}
+
+/// @brief parses socket mode name (wildcard or per-interface)
+///
+/// @param txt mode name
+/// @param wildcard [out] true if single wildcard socket should be used
+///
+/// @return true if name is valid
+bool TSrvIfaceMgr::parseSocketMode(const std::string& txt, bool& wildcard) {
+    if (txt == "wildcard")
+        wildcard = true;
+    else if (txt == "per-interface")
+        wildcard = false;
+    else
+        return false;
+    return true;
+}
+
+/// @brief starts receiving on specified interface through wildcard socket
+///
+/// The socket is opened on first call. Then the multicast group is joined
+/// on the interface and the socket is attached to it, so it is listed
+/// among interface sockets.
+///
+/// @param iface interface
+/// @param group multicast address to join on that interface
+/// @param port UDP port
+///
+/// @return true if successful
+bool TSrvIfaceMgr::addWildcardIface(SPtr<TIfaceIface> iface, SPtr<TIPv6Addr> group,
+                                    int port) {
+    if (!WildcardSock_) {
+        SPtr<TIfaceSocket> sock = new TIfaceSocket(iface->getName(), iface->getID(), port,
+                                                   false, false);
+        if (sock->getStatus() != STATE_CONFIGURED)
+            return false;
+        WildcardSock_ = sock;
+        Log(Notice) << "Created socket " << sock->getFD() << " bound to [::]:" << port
+                    << ", shared by all interfaces." << LogEnd;
+    }
+    if (WildcardSock_->getPort() != port) {
+        Log(Error) << "Wildcard socket is bound to port " << WildcardSock_->getPort()
+                   << ", unable to receive on port " << port << "." << LogEnd;
+        return false;
+    }
+
+    if (!WildcardSock_->join(iface->getID(), group)) {
+        Log(Error) << "Unable to join " << group->getPlain() << " on "
+                   << iface->getFullName() << " interface." << LogEnd;
+        return false;
+    }
+    if (!iface->getSocketByFD(WildcardSock_->getFD()))
+        iface->addSocket(WildcardSock_);
+    WildcardIfaces_.insert(iface->getID());
+    return true;
+}
+
+/// @brief closes all sockets, including the wildcard one
+void TSrvIfaceMgr::closeSockets() {
+    TIfaceMgr::closeSockets();
+    WildcardSock_ = 0;
+    WildcardIfaces_.clear();
+}
+
 void TSrvIfaceMgr::instanceCreate(const std::string& xmlDumpFile)
 {
     if (Instance) {
@@ -653,11 +935,37 @@ TSrvIfaceMgr & TSrvIfaceMgr::instance()
     return *Instance;
 }
 
+/// @brief queues DNS Update that adds records for a leased address
+///
+/// Update is performed in the background (see TSrvDnsUpdater), so the
+/// reply is not delayed. Result is stored in the IA (see fqdnUpdated()).
+///
+/// @param iface interface index
+/// @param dnsAddr address of the DNS server
+/// @param addr leased address
+/// @param name FQDN
+///
+/// @return true if update was queued (or performed successfully)
 bool TSrvIfaceMgr::addFQDN(int iface, SPtr<TIPv6Addr> dnsAddr, SPtr<TIPv6Addr> addr,
                            const std::string& name) {
+    return queueFQDN(iface, dnsAddr, addr, name, true);
+}
 
-    bool success = true;
+/// @brief queues DNS Update that removes records of a leased address
+///
+/// @param iface interface index
+/// @param dnsAddr address of the DNS server
+/// @param addr leased address
+/// @param name FQDN
+///
+/// @return true if update was queued (or performed successfully)
+bool TSrvIfaceMgr::delFQDN(int iface, SPtr<TIPv6Addr> dnsAddr, SPtr<TIPv6Addr> addr,
+                           const std::string& name) {
+    return queueFQDN(iface, dnsAddr, addr, name, false);
+}
 
+bool TSrvIfaceMgr::queueFQDN(int iface, SPtr<TIPv6Addr> dnsAddr, SPtr<TIPv6Addr> addr,
+                             const std::string& name, bool add) {
 #ifndef MOD_SRV_DISABLE_DNSUPDATE
     SPtr<TSrvCfgIface> cfgIface = SrvCfgMgr().getIfaceByID(iface);
     if (!cfgIface) {
@@ -670,6 +978,9 @@ bool TSrvIfaceMgr::addFQDN(int iface, SPtr<TIPv6Addr> dnsAddr, SPtr<TIPv6Addr> a
 
     SPtr<TSIGKey> key = SrvCfgMgr().getKey();
 
+    // that's ugly but required. Otherwise we would have to include CfgMgr.h in DNSUpdate.h
+    // and that would include both poslib and Dibbler headers in one place. Universe would
+    // implode then.
     TCfgMgr::DNSUpdateProtocol proto = SrvCfgMgr().getDDNSProtocol();
     DNSUpdate::DnsUpdateProtocol proto2 = DNSUpdate::DNSUPDATE_TCP;
     if (proto == TCfgMgr::DNSUPDATE_UDP)
@@ -678,129 +989,82 @@ bool TSrvIfaceMgr::addFQDN(int iface, SPtr<TIPv6Addr> dnsAddr, SPtr<TIPv6Addr> a
         proto2 = DNSUpdate::DNSUPDATE_ANY;
     unsigned int timeout = SrvCfgMgr().getDDNSTimeout();
 
+    TSrvDnsUpdater::TJob * job = new TSrvDnsUpdater::TJob(addr->getPlain(), name, add,
+                                                          timeout);
+
     // FQDNMode: 0 = NONE, 1 = PTR only, 2 = BOTH PTR and AAAA
     if ((FQDNMode == DNSUPDATE_MODE_PTR) || (FQDNMode == DNSUPDATE_MODE_BOTH)) {
-        //Test for DNS update
         char zoneroot[128];
         doRevDnsZoneRoot(addr->getAddr(), zoneroot, cfgIface->getRevDNSZoneRootLength());
-        /* add PTR only */
-        DnsUpdateResult result = DNSUPDATE_SKIP;
-        DNSUpdate *act = new DNSUpdate(dnsAddr->getPlain(), zoneroot, name, addr->getPlain(),
-                                       DNSUPDATE_PTR, proto2);
-	
-	if (key) {
-	    act->setTSIG(key->Name_, key->getPackedData(), key->getAlgorithmText(),
-			 key->Fudge_);
-	}
-
-        result = act->run(timeout);
-        act->showResult(result);
-        delete act;
-
-        success = (result == DNSUPDATE_SUCCESS);
+        job->addUpdate(new DNSUpdate(dnsAddr->getPlain(), zoneroot, name, addr->getPlain(),
+                                     add ? DNSUPDATE_PTR : DNSUPDATE_PTR_CLEANUP, proto2));
     }
 
     if (FQDNMode == DNSUPDATE_MODE_BOTH) {
-        DnsUpdateResult result = DNSUPDATE_SKIP;
-        DNSUpdate *act = new DNSUpdate(dnsAddr->getPlain(), "", name,
-                                       addr->getPlain(),
-                                       DNSUPDATE_AAAA, proto2);
-
-	if (key) {
-	    act->setTSIG(key->Name_, key->getPackedData(), key->getAlgorithmText(),
-			 key->Fudge_);
-	}
+        job->addUpdate(new DNSUpdate(dnsAddr->getPlain(), "", name, addr->getPlain(),
+                                     add ? DNSUPDATE_AAAA : DNSUPDATE_AAAA_CLEANUP, proto2));
+    }
 
-        result = act->run(timeout);
-        act->showResult(result);
-        delete act;
-        success = (result == DNSUPDATE_SUCCESS) && success;
+    if (key) {
+        for (size_t i = 0; i < job->Updates.size(); i++) {
+            job->Updates[i]->setTSIG(key->Name_, key->getPackedData(),
+                                     key->getAlgorithmText(), key->Fudge_);
+        }
     }
+
+    if (job->Updates.empty()) {
+        delete job;
+        return true;
+    }
+
+    setFQDNState(addr, FQDNSTATE_PENDING);
+    return DnsUpdater_->enqueue(job);
 #else
     Log(Info) << "DNSUpdate not compiled in. Pretending success." << LogEnd;
+    return true;
 #endif
-
-    return success;
 }
 
-bool TSrvIfaceMgr::delFQDN(int iface, SPtr<TIPv6Addr> dnsAddr, SPtr<TIPv6Addr> addr,
-                           const std::string& name) {
-
-    bool success = true;
+/// @brief returns DNS Update engine
+TSrvDnsUpdater& TSrvIfaceMgr::getDnsUpdater() {
+    return *DnsUpdater_;
+}
 
-#ifndef MOD_SRV_DISABLE_DNSUPDATE
-    SPtr<TSrvCfgIface> cfgIface = SrvCfgMgr().getIfaceByID(iface);
-    if (!cfgIface) {
-        Log(Error) << "Unable find cfgIface with ifindex=" << iface << ", DDNS failed."
-                   << LogEnd;
+/// @brief stores state of the DNS Update in IA that holds specified address
+///
+/// @param addr leased address
+/// @param state new state
+///
+/// @return true if IA was found
+bool TSrvIfaceMgr::setFQDNState(SPtr<TIPv6Addr> addr, EFQDNState state) {
+    SPtr<TAddrClient> client = SrvAddrMgr().getClient(addr);
+    if (!client)
         return false;
-    }
-
-    DnsUpdateModeCfg FQDNMode = static_cast<DnsUpdateModeCfg>(cfgIface->getFQDNMode());
-
-    SPtr<TSIGKey> key = SrvCfgMgr().getKey();
-
-    char zoneroot[128];
-    doRevDnsZoneRoot(addr->getAddr(), zoneroot, cfgIface->getRevDNSZoneRootLength());
-
-    // that's ugly but required. Otherwise we would have to include CfgMgr.h in DNSUpdate.h
-    // and that would include both poslib and Dibbler headers in one place. Universe would
-    // implode then.
-    TCfgMgr::DNSUpdateProtocol proto = SrvCfgMgr().getDDNSProtocol();
-    DNSUpdate::DnsUpdateProtocol proto2 = DNSUpdate::DNSUPDATE_TCP;
-    if (proto == TCfgMgr::DNSUPDATE_UDP)
-        proto2 = DNSUpdate::DNSUPDATE_UDP;
-    if (proto == TCfgMgr::DNSUPDATE_ANY)
-        proto2 = DNSUpdate::DNSUPDATE_ANY;
-    unsigned int timeout = SrvCfgMgr().getDDNSTimeout();
-
-    // FQDNMode: 0 = NONE, 1 = PTR only, 2 = BOTH PTR and AAAA
-    if ((FQDNMode == DNSUPDATE_MODE_PTR) || (FQDNMode == DNSUPDATE_MODE_BOTH)) {
-        /* PTR cleanup */
-        // Log(Notice) << "FQDN: Attempting to clean up PTR record in DNS Server "
-        //            << dnsAddr->getPlain() << ", IP = " << addr->getPlain()
-        //            << " and FQDN=" << name << LogEnd;
-        DNSUpdate *act = new DNSUpdate(dnsAddr->getPlain(), zoneroot, name, addr->getPlain(),
-                                       DNSUPDATE_PTR_CLEANUP, proto2);
-
-	if (key) {
-	    act->setTSIG(key->Name_, key->getPackedData(), key->getAlgorithmText(),
-			 key->Fudge_);
-	}
 
-        int result = act->run(timeout);
-        act->showResult(result);
-        delete act;
-        success = (result == DNSUPDATE_SUCCESS);
+    SPtr<TAddrIA> ia;
+    client->firstIA();
+    while (ia = client->getIA()) {
+        if (ia->getAddr(addr)) {
+            ia->setFQDNState(state);
+            return true;
+        }
     }
+    return false;
+}
 
-    if (FQDNMode == DNSUPDATE_MODE_BOTH) {
-        /* AAAA Cleanup */
-        //Log(Notice) << "FQDN: Attempting to clean up AAAA and PTR record in DNS Server "
-        //            << dnsAddr->getPlain() << ", IP = " << addr->getPlain()
-        //            << " and FQDN=" << name << LogEnd;
-
-        DNSUpdate *act = new DNSUpdate(dnsAddr->getPlain(), "", name, addr->getPlain(),
-                                       DNSUPDATE_AAAA_CLEANUP, proto2);
-
-	if (key) {
-	    act->setTSIG(key->Name_, key->getPackedData(), key->getAlgorithmText(),
-			 key->Fudge_);
-	}
-
-        int result = act->run(timeout);
-        act->showResult(result);
-        delete act;
-
-        success = (result == DNSUPDATE_SUCCESS) && success;
-
+/// @brief called when DNS Update is finished (with state lock held)
+///
+/// @param job finished update
+void TSrvIfaceMgr::fqdnUpdated(const TSrvDnsUpdater::TJob& job) {
+    EFQDNState state = FQDNSTATE_FAILED;
+    if (job.success())
+        state = job.Add ? FQDNSTATE_DONE : FQDNSTATE_NONE;
+
+    SPtr<TIPv6Addr> addr = new TIPv6Addr(job.Addr.c_str(), true);
+    if (!SrvIfaceMgr().setFQDNState(addr, state)) {
+        Log(Debug) << "DDNS: Lease for " << job.Addr << " (" << job.Name
+                   << ") no longer exists, update result not stored." << LogEnd;
     }
-#else
-    Log(Info) << "DNSUpdate not compiled in. Pretending success." << LogEnd;
-#endif
-
-    return success;
-
 }
 
 void TSrvIfaceMgr::notifyScripts(const std::string& scriptName, SPtr<TMsg> question,
@@ -833,6 +1097,33 @@ void TSrvIfaceMgr::notifyScripts(const std::string& scriptName, SPtr<TMsg> quest
     TIfaceMgr::notifyScripts(scriptName, question, answer);
 }
 
+/// @brief executes notify script (or queues it, if executor thread is running)
+///
+/// @param scriptName script to be executed
+/// @param action action passed to the script (add, update, delete, expire)
+/// @param params environment variables (copied, if the script is queued)
+void TSrvIfaceMgr::notifyScript(const std::string& scriptName, std::string action,
+                                TNotifyScriptParams& params) {
+    if (!ScriptExecutor_->isRunning()) {
+        TIfaceMgr::notifyScript(scriptName, action, params);
+        return;
+    }
+
+    char * path = getenv("PATH");
+    if (path) {
+        params.addParam("PATH", string(path));
+    }
+
+    Log(Debug) << "Queueing " << scriptName << " script, " << params.envCnt
+               << " variables." << LogEnd;
+    ScriptExecutor_->enqueue(new TSrvScriptExecutor::TJob(scriptName, action, params));
+}
+
+/// @brief returns notify script executor
+TSrvScriptExecutor& TSrvIfaceMgr::getScriptExecutor() {
+    return *ScriptExecutor_;
+}
+
 ostream & operator <<(ostream & strum, TSrvIfaceMgr &x) {
     strum << "<SrvIfaceMgr>" << std::endl;
     SPtr<TIfaceIface> ptr;
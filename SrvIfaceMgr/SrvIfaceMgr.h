@@ -12,13 +12,20 @@
 #ifndef SRVIFACEMGR_H
 #define SRVIFACEMGR_H
 
+#include <set>
 #include "SmartPtr.h"
 #include "IfaceMgr.h"
 #include "Iface.h"
 #include "SrvMsg.h"
+#include "SrvTxBuffers.h"
+#include "SrvDnsUpdater.h"
+#include "SrvScriptExecutor.h"
 
 #define SrvIfaceMgr() (TSrvIfaceMgr::instance())
 
+/// maximum size of received message (maximum UDP payload)
+#define SRVIFACEMGR_MAX_MSG_SIZE (0xffff - 20 - 8)
+
 class TSrvIfaceMgr :public TIfaceMgr {
  public:
    static void instanceCreate(const std::string& xmlDumpFile);
@@ -41,11 +48,19 @@ class TSrvIfaceMgr :public TIfaceMgr {
 
    // --- transmission/reception methods ---
    virtual bool send(int iface, char *msg, int size, SPtr<TIPv6Addr> addr, int port);
+   bool sendBuffer(int iface, TSrvTxBuffers::TBuffer& buf, int size,
+                   SPtr<TIPv6Addr> addr, int port);
    virtual int receive(unsigned long timeout, char* buf, int& bufsize,
                        SPtr<TIPv6Addr> peer, SPtr<TIPv6Addr> myaddr);
 
    // ---receives messages---
    SPtr<TSrvMsg> select(unsigned long timeout);
+   int receiveMsg(unsigned long timeout, char* buf, int& bufsize,
+                  SPtr<TIPv6Addr> peer, SPtr<TIPv6Addr> myaddr);
+   SPtr<TSrvMsg> decodeReceived(int ifindex, char* buf, int bufsize,
+                                SPtr<TIPv6Addr> peer, SPtr<TIPv6Addr> myaddr);
+   static unsigned int getShard(const char* buf, int bufsize, const char* peer,
+                                unsigned int shards);
 
    bool addFQDN(int iface, SPtr<TIPv6Addr> dnsAddr, SPtr<TIPv6Addr> addr,
                 const std::string& domainname);
@@ -53,16 +68,42 @@ class TSrvIfaceMgr :public TIfaceMgr {
    bool delFQDN(int iface, SPtr<TIPv6Addr> dnsAddr, SPtr<TIPv6Addr> addr,
                 const std::string& domainname);
 
+   TSrvDnsUpdater& getDnsUpdater();
+   bool setFQDNState(SPtr<TIPv6Addr> addr, EFQDNState state);
+
    virtual void notifyScripts(const std::string& scriptName,
                               SPtr<TMsg> question, SPtr<TMsg> answer);
+   virtual void notifyScript(const std::string& scriptName, std::string action,
+                             TNotifyScriptParams& params);
+   TSrvScriptExecutor& getScriptExecutor();
 
    void redetectIfaces();
 
+   // --- single socket bound to :: shared by all interfaces ---
+   bool setWildcard(bool wildcard);
+   bool isWildcard() const;
+   static bool parseSocketMode(const std::string& txt, bool& wildcard);
+   bool addWildcardIface(SPtr<TIfaceIface> iface, SPtr<TIPv6Addr> group, int port);
+   virtual void closeSockets();
+
 protected:
    TSrvIfaceMgr(const std::string& xmlFile);
    static TSrvIfaceMgr * Instance;
 
    std::string XmlFile;
+
+   bool Wildcard_;                  ///< should one socket serve all interfaces?
+   SPtr<TIfaceSocket> WildcardSock_; ///< socket bound to :: (if opened)
+   std::set<int> WildcardIfaces_;   ///< interfaces served by that socket
+
+   SPtr<TIfaceSocket> getSendSocket(int iface, SPtr<TIPv6Addr> addr);
+   virtual void releaseSendBuffer(std::vector<char> * buf);
+
+   bool queueFQDN(int iface, SPtr<TIPv6Addr> dnsAddr, SPtr<TIPv6Addr> addr,
+                  const std::string& domainname, bool add);
+   static void fqdnUpdated(const TSrvDnsUpdater::TJob& job);
+   TSrvDnsUpdater * DnsUpdater_;    ///< performs DNS Updates in the background
+   TSrvScriptExecutor * ScriptExecutor_; ///< executes notify scripts in the background
 };
 
 #endif
@@ -0,0 +1,677 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#ifdef LINUX
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#endif
+#include "Portable.h"
+#include "SrvScriptExecutor.h"
+#include "Logger.h"
+
+using namespace std;
+
+/// how often children are checked if pidfd is not available (in ms)
+#define SRVSCRIPTEXECUTOR_POLL_INTERVAL 10
+
+/// @brief creates a job (parameters are copied)
+///
+/// @param script script to be executed
+/// @param action action passed as the first parameter
+/// @param params environment variables
+TSrvScriptExecutor::TJob::TJob(const std::string& script, const std::string& action,
+                               const TNotifyScriptParams& params)
+    :Script(script), Action(action), Status(0), Queued(0), Started(0), Finished(0),
+     Attempts(0)
+#ifdef LINUX
+    , Pid(-1), PidFd(-1)
+#endif
+{
+    for (int i = 0; i < params.envCnt; i++)
+        Env.push_back(params.env[i]);
+}
+
+TSrvScriptExecutor::TSrvScriptExecutor()
+    :MaxQueue_(SRVSCRIPTEXECUTOR_MAX_QUEUE), Overflow_(OVERFLOW_DROP), Running_(0),
+     Batch_(0), Started_(false), Stop_(false) {
+    memset(&Stats_, 0, sizeof(Stats_));
+#ifdef LINUX
+    Children_ = 0;
+    WakePipe_[0] = WakePipe_[1] = -1;
+    DaemonPid_ = -1;
+    DaemonSock_ = -1;
+    Batches_ = Restarts_ = 0;
+    pthread_mutex_init(&Mutex_, NULL);
+    pthread_cond_init(&Cond_, NULL);
+#endif
+}
+
+TSrvScriptExecutor::~TSrvScriptExecutor() {
+    stop();
+    for (size_t i = 0; i < Queue_.size(); i++)
+        delete Queue_[i];
+    for (size_t i = 0; i < Done_.size(); i++)
+        delete Done_[i];
+#ifdef LINUX
+    pthread_mutex_destroy(&Mutex_);
+    pthread_cond_destroy(&Cond_);
+#endif
+}
+
+/// @brief starts executor thread
+///
+/// @param children maximum number of scripts executed at the same time
+///                 (ignored in hook daemon mode)
+///
+/// @return true if thread was started
+bool TSrvScriptExecutor::start(unsigned int children) {
+#ifdef LINUX
+    if (Started_ || (!children && !Batch_))
+        return false;
+
+    if (pipe(WakePipe_)) {
+        Log(Error) << "Unable to create pipe for script executor: " << strerror(errno)
+                   << LogEnd;
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(WakePipe_[i], F_SETFD, FD_CLOEXEC);
+        fcntl(WakePipe_[i], F_SETFL, O_NONBLOCK);
+    }
+
+    // signals are handled by the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    Stop_ = false;
+    Children_ = children;
+    int status = pthread_create(&Thread_, NULL, run, this);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (status) {
+        Log(Error) << "Unable to start script executor thread: " << strerror(status) << LogEnd;
+        close(WakePipe_[0]);
+        close(WakePipe_[1]);
+        WakePipe_[0] = WakePipe_[1] = -1;
+        return false;
+    }
+    Started_ = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// @brief stops executor thread
+///
+/// Queued scripts are executed first and the thread waits for all of them
+/// to finish (hook daemon is told to exit by closing its socket). They
+/// are not completed, processCompleted() has to be called afterwards.
+void TSrvScriptExecutor::stop() {
+#ifdef LINUX
+    if (!Started_)
+        return;
+    pthread_mutex_lock(&Mutex_);
+    Stop_ = true;
+    pthread_cond_broadcast(&Cond_);
+    pthread_mutex_unlock(&Mutex_);
+    wake();
+    pthread_join(Thread_, NULL);
+    Started_ = false;
+    close(WakePipe_[0]);
+    close(WakePipe_[1]);
+    WakePipe_[0] = WakePipe_[1] = -1;
+#endif
+}
+
+/// @brief returns true if scripts are executed by executor thread
+bool TSrvScriptExecutor::isRunning() const {
+    return Started_;
+}
+
+/// @brief sets maximum number of scripts waiting to be executed
+///
+/// @param maxQueue maximum number of scripts
+void TSrvScriptExecutor::setMaxQueue(size_t maxQueue) {
+    MaxQueue_ = maxQueue;
+}
+
+/// @brief sets what to do with a script when the queue is full
+///
+/// @param overflow overflow policy
+void TSrvScriptExecutor::setOverflow(EOverflow overflow) {
+    Overflow_ = overflow;
+}
+
+/// @brief enables hook daemon mode
+///
+/// Must be called before start(). Instead of executing the script for
+/// every event, one long-lived instance of it receives all events.
+///
+/// @param batch maximum number of events sent at once (0 disables daemon mode)
+void TSrvScriptExecutor::setDaemon(size_t batch) {
+    Batch_ = batch;
+}
+
+/// @brief parses overflow policy name (drop, drop-oldest or wait)
+///
+/// @param txt policy name
+/// @param overflow [out] parsed policy
+///
+/// @return true if name is valid
+bool TSrvScriptExecutor::parseOverflow(const std::string& txt, EOverflow& overflow) {
+    if (txt == "drop")
+        overflow = OVERFLOW_DROP;
+    else if (txt == "drop-oldest")
+        overflow = OVERFLOW_DROP_OLDEST;
+    else if (txt == "wait")
+        overflow = OVERFLOW_WAIT;
+    else
+        return false;
+    return true;
+}
+
+/// @brief queues a script
+///
+/// Must be called with state lock held. If the executor thread is not
+/// running, script is executed (and completed) immediately. If there are
+/// too many scripts waiting already, overflow policy decides which script
+/// is dropped (or whether the caller waits).
+///
+/// @param job script to be executed (executor takes ownership of it)
+///
+/// @return true if script was queued (or executed)
+bool TSrvScriptExecutor::enqueue(TJob * job) {
+    job->Queued = now();
+
+    if (!Started_) {
+        Stats_.Queued++;
+#ifdef LINUX
+        if (launch(*job)) {
+            if (execute_wait(job->Pid, &job->Status, 1) < 0)
+                job->Status = LOWLEVEL_ERROR_UNSPEC;
+            if (job->PidFd >= 0)
+                close(job->PidFd);
+            job->Finished = now();
+        }
+#else
+        vector<const char*> env;
+        for (size_t i = 0; i < job->Env.size(); i++)
+            env.push_back(job->Env[i].c_str());
+        env.push_back(NULL);
+        const char * argv[] = { job->Script.c_str(), job->Action.c_str(), NULL };
+        job->Started = job->Queued;
+        job->Status = execute(job->Script.c_str(), argv, &env[0]);
+        job->Finished = now();
+#endif
+        complete(job);
+        return true;
+    }
+
+    TJob * dropped = NULL;
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+    if (Queue_.size() >= MaxQueue_) {
+        switch (Overflow_) {
+        case OVERFLOW_WAIT:
+            Stats_.Waited++;
+            while (Queue_.size() >= MaxQueue_ && !Stop_)
+                pthread_cond_wait(&Cond_, &Mutex_);
+            break;
+        case OVERFLOW_DROP_OLDEST:
+            dropped = Queue_.front();
+            Queue_.pop_front();
+            break;
+        case OVERFLOW_DROP:
+        default:
+            dropped = job;
+            break;
+        }
+    }
+    if (dropped != job) {
+        Stats_.Queued++;
+        Queue_.push_back(job);
+    }
+    pthread_mutex_unlock(&Mutex_);
+    wake();
+#endif
+
+    if (dropped) {
+        Stats_.Dropped++;
+        Log(Warning) << "Too many notify scripts waiting (" << MaxQueue_ << "), "
+                     << dropped->Action << " script dropped." << LogEnd;
+        delete dropped;
+    }
+    return dropped != job;
+}
+
+/// @brief completes scripts finished by the executor thread
+///
+/// Must be called with state lock held.
+///
+/// @return number of completed scripts
+unsigned int TSrvScriptExecutor::processCompleted() {
+    std::deque<TJob*> done;
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+    done.swap(Done_);
+    pthread_mutex_unlock(&Mutex_);
+#else
+    done.swap(Done_);
+#endif
+
+    for (size_t i = 0; i < done.size(); i++)
+        complete(done[i]);
+    return done.size();
+}
+
+/// @brief returns number of scripts that are not completed yet
+size_t TSrvScriptExecutor::countPending() {
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+    size_t cnt = Queue_.size() + Running_ + Done_.size();
+    pthread_mutex_unlock(&Mutex_);
+    return cnt;
+#else
+    return Queue_.size() + Done_.size();
+#endif
+}
+
+/// @brief returns statistics
+///
+/// Statistics are updated with state lock held only.
+TSrvScriptExecutor::TStats TSrvScriptExecutor::getStats() {
+    TStats stats = Stats_;
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+    stats.Batches = Batches_;
+    stats.Restarts = Restarts_;
+    pthread_mutex_unlock(&Mutex_);
+#endif
+    return stats;
+}
+
+/// @brief returns current time (in milliseconds)
+unsigned long long TSrvScriptExecutor::now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/// @brief prints result of a finished script and updates statistics
+///
+/// @param job finished script
+void TSrvScriptExecutor::complete(TJob * job) {
+    unsigned long long wait = job->Started - job->Queued;
+    unsigned long long run = job->Finished - job->Started;
+
+    Stats_.Executed++;
+    if (job->Status)
+        Stats_.Failed++;
+    Stats_.TotalWait += wait;
+    if (wait > Stats_.MaxWait)
+        Stats_.MaxWait = wait;
+    Stats_.TotalRun += run;
+    if (run > Stats_.MaxRun)
+        Stats_.MaxRun = run;
+
+    if (job->Status >= 0) {
+        Log(Debug) << "Script execution complete, return code=" << job->Status;
+    } else {
+        // negative return code, something went wrong
+        Log(Warning) << "Script execution failed, return code=" << job->Status;
+    }
+    Log(Cont) << " (" << job->Action << ", waited " << wait << "ms, ran " << run
+              << "ms)." << LogEnd;
+    delete job;
+}
+
+#ifdef LINUX
+/// @brief starts a script
+///
+/// Does not use logger (nor anything else protected by state lock).
+///
+/// @param job script to be started
+///
+/// @return true if script was started (false if it failed and is finished)
+bool TSrvScriptExecutor::launch(TJob& job) {
+    vector<const char*> env;
+    for (size_t i = 0; i < job.Env.size(); i++)
+        env.push_back(job.Env[i].c_str());
+    env.push_back(NULL);
+    const char * argv[] = { job.Script.c_str(), job.Action.c_str(), NULL };
+
+    job.Started = now();
+    job.Pid = execute_async(job.Script.c_str(), argv, &env[0]);
+    if (job.Pid < 0) {
+        job.Status = LOWLEVEL_ERROR_UNSPEC;
+        job.Finished = job.Started;
+        return false;
+    }
+
+    job.PidFd = -1;
+#ifdef SYS_pidfd_open
+    job.PidFd = syscall(SYS_pidfd_open, job.Pid, 0);
+#endif
+    return true;
+}
+
+void * TSrvScriptExecutor::run(void * executor) {
+    TSrvScriptExecutor * me = (TSrvScriptExecutor*)executor;
+    if (me->Batch_)
+        me->workDaemon();
+    else
+        me->work();
+    return NULL;
+}
+
+/// @brief wakes the executor thread up
+void TSrvScriptExecutor::wake() {
+    char c = 0;
+    if (write(WakePipe_[1], &c, 1) < 0) {
+        // pipe is full, so the thread will wake up anyway
+    }
+}
+
+/// @brief starts queued scripts and reaps finished ones until stopped
+void TSrvScriptExecutor::work() {
+    vector<TJob*> running;
+    while (true) {
+        vector<TJob*> done;
+
+        pthread_mutex_lock(&Mutex_);
+        while (!Queue_.empty() && running.size() < Children_) {
+            TJob * job = Queue_.front();
+            Queue_.pop_front();
+            Running_++;
+            pthread_cond_broadcast(&Cond_);
+            pthread_mutex_unlock(&Mutex_);
+
+            if (launch(*job))
+                running.push_back(job);
+            else
+                done.push_back(job);
+
+            pthread_mutex_lock(&Mutex_);
+        }
+        bool stop = Stop_ && Queue_.empty() && running.empty() && done.empty();
+        pthread_mutex_unlock(&Mutex_);
+        if (stop)
+            break;
+
+        // wait for a script to finish (or for a new one to be queued)
+        if (done.empty()) {
+            vector<struct pollfd> fds(1);
+            fds[0].fd = WakePipe_[0];
+            fds[0].events = POLLIN;
+            int timeout = -1;
+            for (size_t i = 0; i < running.size(); i++) {
+                if (running[i]->PidFd < 0) {
+                    timeout = SRVSCRIPTEXECUTOR_POLL_INTERVAL;
+                    continue;
+                }
+                struct pollfd fd;
+                fd.fd = running[i]->PidFd;
+                fd.events = POLLIN;
+                fd.revents = 0;
+                fds.push_back(fd);
+            }
+            poll(&fds[0], fds.size(), timeout);
+
+            char buf[64];
+            while (read(WakePipe_[0], buf, sizeof(buf)) > 0)
+                ;
+        }
+
+        vector<TJob*>::iterator it = running.begin();
+        while (it != running.end()) {
+            TJob * job = *it;
+            int ret = execute_wait(job->Pid, &job->Status, 0);
+            if (!ret) {
+                ++it;
+                continue;
+            }
+            if (ret < 0)
+                job->Status = LOWLEVEL_ERROR_UNSPEC;
+            job->Finished = now();
+            if (job->PidFd >= 0)
+                close(job->PidFd);
+            done.push_back(job);
+            it = running.erase(it);
+        }
+
+        if (!done.empty()) {
+            pthread_mutex_lock(&Mutex_);
+            Running_ -= done.size();
+            Done_.insert(Done_.end(), done.begin(), done.end());
+            pthread_mutex_unlock(&Mutex_);
+        }
+    }
+}
+
+/// @brief waits until socket is ready (or timeout passes)
+///
+/// @param fd socket
+/// @param events POLLIN or POLLOUT
+/// @param timeout timeout (in ms)
+///
+/// @return true if socket is ready (or closed)
+static bool waitForSocket(int fd, short events, long long timeout) {
+    if (timeout <= 0)
+        return false;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    int ret = poll(&pfd, 1, (int)timeout);
+    return ret > 0 || (ret < 0 && errno == EINTR);
+}
+
+/// @brief sends queued events to hook daemon until stopped
+///
+/// Events that were not acknowledged are sent once more (to a restarted
+/// daemon), then they are reported as failed.
+void TSrvScriptExecutor::workDaemon() {
+    vector<TJob*> batch;
+    while (true) {
+        pthread_mutex_lock(&Mutex_);
+        size_t taken = 0;
+        while (!Queue_.empty() && batch.size() < Batch_) {
+            batch.push_back(Queue_.front());
+            Queue_.pop_front();
+            taken++;
+        }
+        if (taken) {
+            Running_ += taken;
+            pthread_cond_broadcast(&Cond_);
+        }
+        bool stop = Stop_ && batch.empty();
+        pthread_mutex_unlock(&Mutex_);
+        if (stop)
+            break;
+
+        if (batch.empty()) {
+            struct pollfd fd;
+            fd.fd = WakePipe_[0];
+            fd.events = POLLIN;
+            fd.revents = 0;
+            poll(&fd, 1, -1);
+
+            char buf[64];
+            while (read(WakePipe_[0], buf, sizeof(buf)) > 0)
+                ;
+            continue;
+        }
+
+        size_t acked = sendToDaemon(batch);
+        vector<TJob*> done(batch.begin(), batch.begin() + acked);
+        vector<TJob*> retry;
+        for (size_t i = acked; i < batch.size(); i++) {
+            if (batch[i]->Attempts < 2) {
+                retry.push_back(batch[i]);
+                continue;
+            }
+            batch[i]->Status = LOWLEVEL_ERROR_UNSPEC;
+            batch[i]->Finished = now();
+            done.push_back(batch[i]);
+        }
+
+        pthread_mutex_lock(&Mutex_);
+        Batches_++;
+        Running_ -= done.size();
+        Done_.insert(Done_.end(), done.begin(), done.end());
+        pthread_mutex_unlock(&Mutex_);
+        batch.swap(retry);
+    }
+    stopDaemon(false);
+}
+
+/// @brief starts hook daemon
+///
+/// Daemon gets only PATH from the environment of the event.
+///
+/// @param job event that is about to be sent (used for script name and PATH)
+///
+/// @return true if daemon was started
+bool TSrvScriptExecutor::startDaemon(const TJob& job) {
+    vector<const char*> env;
+    for (size_t i = 0; i < job.Env.size(); i++) {
+        if (job.Env[i].compare(0, 5, "PATH=") == 0)
+            env.push_back(job.Env[i].c_str());
+    }
+    env.push_back(NULL);
+    const char * argv[] = { job.Script.c_str(), "daemon", NULL };
+
+    pthread_mutex_lock(&Mutex_);
+    Restarts_++;
+    pthread_mutex_unlock(&Mutex_);
+
+    DaemonPid_ = execute_daemon(job.Script.c_str(), argv, &env[0], &DaemonSock_);
+    if (DaemonPid_ < 0) {
+        DaemonPid_ = -1;
+        DaemonSock_ = -1;
+        return false;
+    }
+    return true;
+}
+
+/// @brief stops hook daemon
+///
+/// Daemon is expected to exit when its socket is closed. It is killed if
+/// it does not exit in time (or right away, if force is set).
+///
+/// @param force should the daemon be killed right away?
+void TSrvScriptExecutor::stopDaemon(bool force) {
+    if (DaemonPid_ < 0)
+        return;
+    close(DaemonSock_);
+    DaemonSock_ = -1;
+
+    int status;
+    unsigned long long deadline = now() + SRVSCRIPTEXECUTOR_DAEMON_TIMEOUT;
+    while (!force && !execute_wait(DaemonPid_, &status, 0)) {
+        if (now() >= deadline) {
+            force = true;
+            break;
+        }
+        usleep(SRVSCRIPTEXECUTOR_POLL_INTERVAL * 1000);
+    }
+    if (force) {
+        kill(DaemonPid_, SIGKILL);
+        execute_wait(DaemonPid_, &status, 1);
+    }
+    DaemonPid_ = -1;
+}
+
+/// @brief sends a batch of events to hook daemon and waits for acknowledgements
+///
+/// Daemon is started if it is not running. If it fails to acknowledge all
+/// events in time (or exits), it is killed.
+///
+/// @param batch events to be sent (their Status is set when acknowledged)
+///
+/// @return number of acknowledged events (from the beginning of the batch)
+size_t TSrvScriptExecutor::sendToDaemon(vector<TJob*>& batch) {
+    unsigned long long started = now();
+    for (size_t i = 0; i < batch.size(); i++) {
+        batch[i]->Attempts++;
+        batch[i]->Started = started;
+    }
+    if (DaemonPid_ < 0 && !startDaemon(*batch[0]))
+        return 0;
+
+    // length-prefixed records: action and environment, NUL terminated
+    string buf;
+    for (size_t i = 0; i < batch.size(); i++) {
+        string rec = batch[i]->Action;
+        rec.push_back('\0');
+        for (size_t j = 0; j < batch[i]->Env.size(); j++) {
+            rec += batch[i]->Env[j];
+            rec.push_back('\0');
+        }
+        uint32_t len = htonl(rec.size());
+        buf.append((const char*)&len, sizeof(len));
+        buf += rec;
+    }
+
+    unsigned long long deadline = started + SRVSCRIPTEXECUTOR_DAEMON_TIMEOUT;
+    size_t offset = 0;
+    while (offset < buf.size()) {
+        if (!waitForSocket(DaemonSock_, POLLOUT, (long long)deadline - (long long)now())) {
+            stopDaemon(true);
+            return 0;
+        }
+        ssize_t cnt = send(DaemonSock_, buf.data() + offset, buf.size() - offset,
+                           MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (cnt < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (cnt <= 0) {
+            stopDaemon(true);
+            return 0;
+        }
+        offset += cnt;
+    }
+
+    // one 32-bit return code for every record
+    size_t acked = 0;
+    vector<char> acks(batch.size() * sizeof(uint32_t));
+    offset = 0;
+    while (acked < batch.size()) {
+        if (!waitForSocket(DaemonSock_, POLLIN, (long long)deadline - (long long)now()))
+            break;
+        ssize_t cnt = recv(DaemonSock_, &acks[offset], acks.size() - offset, MSG_DONTWAIT);
+        if (cnt < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (cnt <= 0)
+            break;
+        offset += cnt;
+
+        unsigned long long finished = now();
+        while ((acked + 1) * sizeof(uint32_t) <= offset) {
+            uint32_t status;
+            memcpy(&status, &acks[acked * sizeof(uint32_t)], sizeof(status));
+            batch[acked]->Status = (int32_t)ntohl(status);
+            batch[acked]->Finished = finished;
+            acked++;
+        }
+    }
+
+    if (acked < batch.size())
+        stopDaemon(true);
+    return acked;
+}
+#endif
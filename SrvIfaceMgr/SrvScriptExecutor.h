@@ -0,0 +1,162 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TSrvScriptExecutor;
+#ifndef SRVSCRIPTEXECUTOR_H
+#define SRVSCRIPTEXECUTOR_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <stddef.h>
+#include "ScriptParams.h"
+
+#ifdef LINUX
+#include <pthread.h>
+#include <sys/types.h>
+#endif
+
+/// maximum number of scripts waiting to be executed
+#define SRVSCRIPTEXECUTOR_MAX_QUEUE 1024
+
+/// number of scripts executed at the same time (1 keeps them in order)
+#define SRVSCRIPTEXECUTOR_CHILDREN 1
+
+/// how long hook daemon may take to acknowledge a batch of events (in ms)
+#define SRVSCRIPTEXECUTOR_DAEMON_TIMEOUT 10000
+
+/// @brief Executes notify scripts in the background
+///
+/// Message processing only queues the script (with a copy of its
+/// parameters), so the reply is not delayed by the script. A separate
+/// thread starts up to N scripts at the same time and reaps them when
+/// they finish (waiting on their pidfds, or polling for them if pidfd is
+/// not supported). Finished scripts are completed by processCompleted(),
+/// called by the main loop (with state lock held): return codes are
+/// printed and statistics are updated.
+///
+/// The executor thread does not use managers, logger or smart pointers,
+/// so it does not need the state lock.
+///
+/// If the thread is not running (or not supported), scripts are executed
+/// synchronously.
+///
+/// In hook daemon mode (see setDaemon()) the script is started only once,
+/// with "daemon" as its parameter, and the thread streams events to it
+/// over a Unix stream socket connected to its standard input and output.
+/// Each event is sent as a record: 32-bit length (network byte order)
+/// followed by the action and then NAME=value environment variables, each
+/// of them terminated by a NUL byte. Up to N queued events are written at
+/// once. The daemon acknowledges every record, in order, with its 32-bit
+/// return code (network byte order). If it exits or does not acknowledge
+/// a batch in time, it is restarted and unacknowledged events are sent once
+/// more. See scripts/notify-scripts/server-notify-daemon.py for an example.
+class TSrvScriptExecutor
+{
+  public:
+    /// what to do with a script when the queue is full
+    enum EOverflow {
+        OVERFLOW_DROP,        ///< new script is dropped
+        OVERFLOW_DROP_OLDEST, ///< oldest queued script is dropped
+        OVERFLOW_WAIT         ///< caller waits until there's room in the queue
+    };
+
+    /// single script execution
+    class TJob {
+      public:
+        TJob(const std::string& script, const std::string& action,
+             const TNotifyScriptParams& params);
+
+        std::string Script;            ///< script to be executed
+        std::string Action;            ///< add, update, delete, expire...
+        std::vector<std::string> Env;  ///< environment variables (NAME=value)
+        int Status;                    ///< return code (negative on failure)
+        unsigned long long Queued;     ///< when it was queued (in ms)
+        unsigned long long Started;    ///< when it was started (in ms)
+        unsigned long long Finished;   ///< when it finished (in ms)
+        unsigned int Attempts;         ///< times it was sent to hook daemon
+#ifdef LINUX
+        pid_t Pid;                     ///< child process
+        int PidFd;                     ///< pidfd of the child (-1 if not available)
+#endif
+    };
+
+    struct TStats {
+        unsigned long Queued;      ///< scripts accepted
+        unsigned long Executed;    ///< scripts that finished
+        unsigned long Failed;      ///< scripts that returned non-zero (or failed to start)
+        unsigned long Dropped;     ///< scripts dropped (queue full)
+        unsigned long Waited;      ///< times caller waited for room in the queue
+        unsigned long long TotalWait;  ///< time spent in the queue (in ms)
+        unsigned long long MaxWait;
+        unsigned long long TotalRun;   ///< time spent running (in ms)
+        unsigned long long MaxRun;
+        unsigned long Batches;     ///< batches sent to hook daemon
+        unsigned long Restarts;    ///< times hook daemon was (re)started
+    };
+
+    TSrvScriptExecutor();
+    ~TSrvScriptExecutor();
+
+    bool start(unsigned int children);
+    void stop();
+    bool isRunning() const;
+
+    void setMaxQueue(size_t maxQueue);
+    void setOverflow(EOverflow overflow);
+    void setDaemon(size_t batch);
+    static bool parseOverflow(const std::string& txt, EOverflow& overflow);
+
+    bool enqueue(TJob * job);
+    unsigned int processCompleted();
+    size_t countPending();
+    TStats getStats();
+
+  private:
+    // not copyable
+    TSrvScriptExecutor(const TSrvScriptExecutor&);
+    TSrvScriptExecutor& operator=(const TSrvScriptExecutor&);
+
+    static unsigned long long now();
+    static bool launch(TJob& job);
+    void complete(TJob * job);
+
+    size_t MaxQueue_;
+    EOverflow Overflow_;
+    TStats Stats_;
+
+    std::deque<TJob*> Queue_;   ///< scripts waiting to be started
+    std::deque<TJob*> Done_;    ///< scripts waiting for processCompleted()
+    size_t Running_;            ///< scripts being executed right now
+    size_t Batch_;              ///< max events sent to hook daemon at once (0 = no daemon)
+    bool Started_;
+    bool Stop_;
+
+#ifdef LINUX
+    static void * run(void * executor);
+    void work();
+    void wake();
+    void workDaemon();
+    bool startDaemon(const TJob& job);
+    void stopDaemon(bool force);
+    size_t sendToDaemon(std::vector<TJob*>& batch);
+
+    unsigned int Children_;     ///< maximum number of scripts executed at once
+    pthread_t Thread_;
+    pthread_mutex_t Mutex_;     ///< protects queues and flags above
+    pthread_cond_t Cond_;       ///< signalled when a script is started (room in Queue_)
+    int WakePipe_[2];           ///< wakes the thread up when Queue_ or Stop_ change
+    pid_t DaemonPid_;           ///< hook daemon (-1 if not running)
+    int DaemonSock_;            ///< socket connected to hook daemon
+    unsigned long Batches_;     ///< TStats::Batches (updated by the thread)
+    unsigned long Restarts_;    ///< TStats::Restarts (updated by the thread)
+#endif
+};
+
+#endif
@@ -32,10 +32,13 @@
 
 #include "Logger.h"
 #include "SrvIfaceMgr.h"
+#include "SrvTxBuffers.h"
 #include "AddrClient.h"
 
 using namespace std;
 
+bool TSrvMsg::LazyOptions_ = true;
+
 /**
  * this constructor is used to build message as a reply to the received message
  * (i.e. it is used to contruct ADVERTISE or REPLY)
@@ -66,6 +69,9 @@ TSrvMsg::TSrvMsg(int iface, SPtr<TIPv6Addr> addr,
 {
     setDefaults();
 
+    // options are copied once and parsed on first access
+    OptData_.assign(buf, bufSize > 0 ? bufSize : 0);
+
     int pos=0;
     while (pos<bufSize)	{
         if (pos+4>bufSize) {
@@ -88,8 +94,6 @@ TSrvMsg::TSrvMsg(int iface, SPtr<TIPv6Addr> addr,
             return;
         }
 
-        SPtr<TOpt> ptr;
-
         if (!allowOptInMsg(MsgType,code)) {
             Log(Warning) << "Option " << code << " not allowed in message type="<< MsgType <<". Option ignored." << LogEnd;
             pos+=length;
@@ -101,111 +105,139 @@ TSrvMsg::TSrvMsg(int iface, SPtr<TIPv6Addr> addr,
             pos+=length;
             continue;
         }
-        ptr= 0;
-        switch (code) {
-        case OPTION_CLIENTID:
-            ptr = new TOptDUID(OPTION_CLIENTID, buf+pos, length, this);
-            break;
-        case OPTION_SERVERID:
-            ptr = new TOptDUID(OPTION_SERVERID, buf+pos, length, this);
-            break;
-        case OPTION_IA_NA:
-            ptr = new TSrvOptIA_NA(buf+pos,length,this);
-            break;
-        case OPTION_ORO:
-            ptr = new TOptOptionRequest(OPTION_ORO, buf+pos, length, this);
-            break;
-        case OPTION_PREFERENCE:
-            ptr = new TOptInteger(OPTION_PREFERENCE, 1, buf+pos, length, this);
-            break;
-        case OPTION_ELAPSED_TIME:
-            ptr = new TOptInteger(OPTION_ELAPSED_TIME, OPTION_ELAPSED_TIME_LEN,
-				  buf+pos, length, this);
-            break;
-        case OPTION_UNICAST:
-            ptr = new TOptAddr(OPTION_UNICAST, buf+pos, length, this);
-            break;
-        case OPTION_STATUS_CODE:
-            ptr = new TOptStatusCode(buf+pos,length,this);
-            break;
-        case OPTION_RAPID_COMMIT:
-            ptr = new TOptEmpty(code, buf+pos, length, this);
-            break;
-        case OPTION_DNS_SERVERS:
-        case OPTION_SNTP_SERVERS:
-        case OPTION_SIP_SERVER_A:
-        case OPTION_NIS_SERVERS:
-        case OPTION_NISP_SERVERS:
-            ptr = new TOptAddrLst(code, buf+pos, length, this);
-            break;
-        case OPTION_DOMAIN_LIST:
-        case OPTION_SIP_SERVER_D:
-        case OPTION_NIS_DOMAIN_NAME:
-        case OPTION_NISP_DOMAIN_NAME:
-            ptr = new TOptDomainLst(code, buf+pos, length, this);
-            break;
-        case OPTION_NEW_TZDB_TIMEZONE:
-            ptr = new TOptString(OPTION_NEW_TZDB_TIMEZONE, buf+pos, length, this);
-            break;
-        case OPTION_FQDN:
-            ptr = new TSrvOptFQDN(buf+pos, length, this);
-            break;
-        case OPTION_INFORMATION_REFRESH_TIME:
-            ptr = new TOptInteger(OPTION_INFORMATION_REFRESH_TIME,
-				  OPTION_INFORMATION_REFRESH_TIME_LEN,
-				  buf+pos, length, this);
-            break;
-        case OPTION_IA_TA:
-            ptr = new TSrvOptTA(buf+pos, length, this);
-            break;
-        case OPTION_IA_PD:
-            ptr = new TSrvOptIA_PD(buf+pos, length, this);
-            break;
-        case OPTION_LQ_QUERY:
-            ptr = new TSrvOptLQ(buf+pos, length, this);
-            break;
-            // remaining LQ options are not supported to be received by server
+        if (code == OPTION_AUTH) {
+            // parsed immediately, as it points to the received data
+            addOptionView(parseOption(code, buf+pos, length));
+        } else {
+            addOptionView(code, pos, length);
+        }
+        pos += length;
+    }
+
+    if (!LazyOptions_)
+        parseAllOptions();
+}
+
+/// @brief enables or disables lazy parsing of received options
+///
+/// When enabled (default), received options are only indexed when
+/// message is received. Option objects are created on first access.
+///
+/// @param lazy should the options be parsed on first access?
+void TSrvMsg::setLazyOptions(bool lazy) {
+    LazyOptions_ = lazy;
+}
 
-        case OPTION_AUTH:
-            ptr = new TOptAuthentication(buf+pos, length, this);
+/// @brief creates option object from received data
+///
+/// @param code option type
+/// @param buf option data
+/// @param length length of option data
+///
+/// @return parsed option (or 0 if it is not supported or invalid)
+SPtr<TOpt> TSrvMsg::parseOption(uint16_t code, char* buf, uint16_t length) {
+    SPtr<TOpt> ptr;
+    switch (code) {
+    case OPTION_CLIENTID:
+        ptr = new TOptDUID(OPTION_CLIENTID, buf, length, this);
+        break;
+    case OPTION_SERVERID:
+        ptr = new TOptDUID(OPTION_SERVERID, buf, length, this);
+        break;
+    case OPTION_IA_NA:
+        ptr = new TSrvOptIA_NA(buf,length,this);
+        break;
+    case OPTION_ORO:
+        ptr = new TOptOptionRequest(OPTION_ORO, buf, length, this);
+        break;
+    case OPTION_PREFERENCE:
+        ptr = new TOptInteger(OPTION_PREFERENCE, 1, buf, length, this);
+        break;
+    case OPTION_ELAPSED_TIME:
+        ptr = new TOptInteger(OPTION_ELAPSED_TIME, OPTION_ELAPSED_TIME_LEN,
+                              buf, length, this);
+        break;
+    case OPTION_UNICAST:
+        ptr = new TOptAddr(OPTION_UNICAST, buf, length, this);
+        break;
+    case OPTION_STATUS_CODE:
+        ptr = new TOptStatusCode(buf,length,this);
+        break;
+    case OPTION_RAPID_COMMIT:
+        ptr = new TOptEmpty(code, buf, length, this);
+        break;
+    case OPTION_DNS_SERVERS:
+    case OPTION_SNTP_SERVERS:
+    case OPTION_SIP_SERVER_A:
+    case OPTION_NIS_SERVERS:
+    case OPTION_NISP_SERVERS:
+        ptr = new TOptAddrLst(code, buf, length, this);
+        break;
+    case OPTION_DOMAIN_LIST:
+    case OPTION_SIP_SERVER_D:
+    case OPTION_NIS_DOMAIN_NAME:
+    case OPTION_NISP_DOMAIN_NAME:
+        ptr = new TOptDomainLst(code, buf, length, this);
+        break;
+    case OPTION_NEW_TZDB_TIMEZONE:
+        ptr = new TOptString(OPTION_NEW_TZDB_TIMEZONE, buf, length, this);
+        break;
+    case OPTION_FQDN:
+        ptr = new TSrvOptFQDN(buf, length, this);
+        break;
+    case OPTION_INFORMATION_REFRESH_TIME:
+        ptr = new TOptInteger(OPTION_INFORMATION_REFRESH_TIME,
+                              OPTION_INFORMATION_REFRESH_TIME_LEN,
+                              buf, length, this);
+        break;
+    case OPTION_IA_TA:
+        ptr = new TSrvOptTA(buf, length, this);
+        break;
+    case OPTION_IA_PD:
+        ptr = new TSrvOptIA_PD(buf, length, this);
+        break;
+    case OPTION_LQ_QUERY:
+        ptr = new TSrvOptLQ(buf, length, this);
+        break;
+        // remaining LQ options are not supported to be received by server
+
+    case OPTION_AUTH:
+        ptr = new TOptAuthentication(buf, length, this);
 #ifndef MOD_DISABLE_AUTH
-            if (SrvCfgMgr().getDigest() != DIGEST_NONE) {
+        if (SrvCfgMgr().getDigest() != DIGEST_NONE) {
 
-                SPtr<TOptDUID> optDUID = (SPtr<TOptDUID>)this->getOption(OPTION_CLIENTID);
-                if (optDUID) {
-                    SPtr<TAddrClient> client = SrvAddrMgr().getClient(optDUID->getDUID());
-                    if (client)
-                        client->setSPI(SPI_);
-                }
+            SPtr<TOptDUID> optDUID = (SPtr<TOptDUID>)this->getOption(OPTION_CLIENTID);
+            if (optDUID) {
+                SPtr<TAddrClient> client = SrvAddrMgr().getClient(optDUID->getDUID());
+                if (client)
+                    client->setSPI(SPI_);
             }
+        }
 #endif
-            break;
+        break;
 
-        case OPTION_VENDOR_OPTS:
-            ptr = new TOptVendorSpecInfo(code, buf+pos, length, this);
-            break;
-	case OPTION_RECONF_ACCEPT:
-	    ptr = new TOptEmpty(code, buf+pos, length, this);
-	    break;
-        case OPTION_USER_CLASS:
-	    ptr = new TOptUserClass(code, buf+pos, length, this);
-	    break;
-        case OPTION_VENDOR_CLASS:
-	    ptr = new TOptVendorClass(code, buf+pos, length, this);
-	    break;
-        case OPTION_RECONF_MSG:
-        case OPTION_RELAY_MSG:
-        default:
-            Log(Warning) << "Option type " << code << " not supported yet." << LogEnd;
-            break;
-        }
-        if ( (ptr) && (ptr->isValid()) )
-            Options.push_back( ptr );
-        else
-            Log(Warning) << "Option type " << code << " invalid. Option ignored." << LogEnd;
-        pos += length;
+    case OPTION_VENDOR_OPTS:
+        ptr = new TOptVendorSpecInfo(code, buf, length, this);
+        break;
+    case OPTION_RECONF_ACCEPT:
+        ptr = new TOptEmpty(code, buf, length, this);
+        break;
+    case OPTION_USER_CLASS:
+        ptr = new TOptUserClass(code, buf, length, this);
+        break;
+    case OPTION_VENDOR_CLASS:
+        ptr = new TOptVendorClass(code, buf, length, this);
+        break;
+    case OPTION_RECONF_MSG:
+    case OPTION_RELAY_MSG:
+    default:
+        Log(Warning) << "Option type " << code << " not supported yet." << LogEnd;
+        break;
     }
-
+    if ( (ptr) && (ptr->isValid()) )
+        return ptr;
+    Log(Warning) << "Option type " << code << " invalid. Option ignored." << LogEnd;
+    return 0;
 }
 
 void TSrvMsg::setDefaults() {
@@ -228,23 +260,40 @@ void TSrvMsg::processOptions(SPtr<TSrvMsg> clientMsg, bool quiet) {
 
     SPtr<TOpt> opt;
     SPtr<TIPv6Addr> clntAddr = PeerAddr_;
+    TOptList opts;
 
     // --- process this message ---
-    clientMsg->firstOption();
-    while ( opt = clientMsg->getOption()) {
-        switch (opt->getOptType()) {
-        case OPTION_IA_NA : {
-            processIA_NA((Ptr*)clientMsg, (Ptr*) opt);
-            break;
-        }
-        case OPTION_IA_TA: {
-            processIA_TA((Ptr*)clientMsg, (Ptr*) opt);
-            break;
-        }
-        case OPTION_IA_PD: {
-            processIA_PD((Ptr*)clientMsg, (Ptr*) opt);
+    // only options used below are parsed, the rest is handled by type
+    clientMsg->getOptions(OPTION_IA_NA, opts);
+    for (TOptList::iterator it = opts.begin(); it != opts.end(); ++it)
+        processIA_NA((Ptr*)clientMsg, (Ptr*) *it);
+
+    opts.clear();
+    clientMsg->getOptions(OPTION_IA_TA, opts);
+    for (TOptList::iterator it = opts.begin(); it != opts.end(); ++it)
+        processIA_TA((Ptr*)clientMsg, (Ptr*) *it);
+
+    opts.clear();
+    clientMsg->getOptions(OPTION_IA_PD, opts);
+    for (TOptList::iterator it = opts.begin(); it != opts.end(); ++it)
+        processIA_PD((Ptr*)clientMsg, (Ptr*) *it);
+
+    opts.clear();
+    clientMsg->getOptions(OPTION_VENDOR_OPTS, opts);
+    for (TOptList::iterator it = opts.begin(); it != opts.end(); ++it) {
+        SPtr<TOptVendorData> v = (Ptr*) *it;
+        appendVendorSpec(ClientDUID, Iface, v->getVendor(), ORO);
+    }
+
+    vector<uint16_t> types;
+    clientMsg->getOptionTypes(types);
+    for (vector<uint16_t>::const_iterator type = types.begin(); type != types.end(); ++type) {
+        switch (*type) {
+        case OPTION_IA_NA:
+        case OPTION_IA_TA:
+        case OPTION_IA_PD:
+        case OPTION_VENDOR_OPTS:
             break;
-        }
         case OPTION_AUTH : {
             ORO->addOption(OPTION_AUTH);
             break;
@@ -253,12 +302,6 @@ void TSrvMsg::processOptions(SPtr<TSrvMsg> clientMsg, bool quiet) {
             // skip processing for now (we need to process all IA_NA/IA_TA first)
             break;
         }
-        case OPTION_VENDOR_OPTS:
-        {
-            SPtr<TOptVendorData> v = (Ptr*) opt;
-            appendVendorSpec(ClientDUID, Iface, v->getVendor(), ORO);
-            break;
-        }
 
         case OPTION_PREFERENCE:
         case OPTION_UNICAST:
@@ -266,7 +309,7 @@ void TSrvMsg::processOptions(SPtr<TSrvMsg> clientMsg, bool quiet) {
         case OPTION_INTERFACE_ID:
         case OPTION_RECONF_MSG :
         case OPTION_STATUS_CODE : {
-            Log(Warning) << "Invalid option (" << opt->getOptType() << ") received. "
+            Log(Warning) << "Invalid option (" << *type << ") received. "
                          << "Client is not supposed to send it. Option ignored." << LogEnd;
             break;
         }
@@ -276,12 +319,12 @@ void TSrvMsg::processOptions(SPtr<TSrvMsg> clientMsg, bool quiet) {
             break;
         }
         default: {
-            handleDefaultOption(opt);
+            handleDefaultOption(*type);
             break;
         }
 
         } // end of switch
-    } // end of while
+    } // end of for
 
     // process FQDN afer all addresses are processed
     opt = clientMsg->getOption(OPTION_FQDN);
@@ -360,26 +403,20 @@ void TSrvMsg::addRelayInfo(SPtr<TIPv6Addr> linkAddr,
 
 void TSrvMsg::send(int dstPort /* = 0 */)
 {
-    char* buf = new char[getSize() < 2048? 2048:getSize()];
-    int offset = 0;
     int port;
 
-    SPtr<TOptGeneric> gen;
     SPtr<TIfaceIface> ptrIface;
-    SPtr<TIfaceIface> under;
     ptrIface = (Ptr*) SrvIfaceMgr().getIfaceByID(this->Iface);
     if (!ptrIface) {
         SPtr<TSrvCfgIface> cfgIface = SrvCfgMgr().getIfaceByID(this->Iface);
         if (!cfgIface) {
             Log(Error) << "Can't send message: interface with ifindex=" << this->Iface
                        << " not found." << LogEnd;
-            delete [] buf;
             return;
         }
         if (cfgIface->getRelayID()==-1) {
             Log(Error) << "Can't send message: interface " << cfgIface->getFullName()
                        << " is invalid relay." << LogEnd;
-            delete [] buf;
             return;
         }
         ptrIface = (Ptr*) SrvIfaceMgr().getIfaceByID(cfgIface->getRelayID());
@@ -387,7 +424,6 @@ void TSrvMsg::send(int dstPort /* = 0 */)
             Log(Error) << "Can't send message: interface " << cfgIface->getFullName()
                        << " has invalid physical interface defined (ifindex="
                        << cfgIface->getRelayID() << "." << LogEnd;
-            delete [] buf;
             return;
         }
     }
@@ -400,73 +436,50 @@ void TSrvMsg::send(int dstPort /* = 0 */)
     Log(Cont) << ", " << RelayInfo_.size() << " relay(s)." << LogEnd;
 
     port = DHCPCLIENT_PORT;
-    if (!RelayInfo_.empty()) {
-        port = DHCPSERVER_PORT;
-        if (RelayInfo_.size() > HOP_COUNT_LIMIT) {
-            Log(Error) << "Unable to send message. Got " << RelayInfo_.size()
-                       << " relay entries (" << HOP_COUNT_LIMIT
-                       << " is allowed maximum." << LogEnd;
-            delete [] buf;
-            return;
-        }
-
-        size_t len = getSize();
-        RelayInfo_.back().Len_ = len;
-
-        for (int i = RelayInfo_.size() - 1; i > 0; i--) {
-
-            SPtr<TOpt> interface_id = TOpt::getOption(RelayInfo_[i].EchoList_, OPTION_INTERFACE_ID);
-            // 38 = 34 bytes (relay header) + 4 bytes (relay-msg option header)
-            RelayInfo_[i-1].Len_ = RelayInfo_[i].Len_ + 38;
-            if (interface_id && (SrvCfgMgr().getInterfaceIDOrder()!=SRV_IFACE_ID_ORDER_NONE)) {
-                RelayInfo_[i-1].Len_ += interface_id->getSize();
-
-                for (TOptList::iterator it = RelayInfo_[i].EchoList_.begin();
-                     it != RelayInfo_[i].EchoList_.end(); ++it) {
-                    RelayInfo_[i-1].Len_ += (*it)->getSize();
-                }
-                //RelayInfo_[i].EchoList_.first();
-                //while (gen = RelayInfo_[i].EchoList_.get()) {
-                //    RelayInfo_[i-1].Len_ += gen->getSize();
-                //}
+    if (RelayInfo_.size() > HOP_COUNT_LIMIT) {
+        Log(Error) << "Unable to send message. Got " << RelayInfo_.size()
+                   << " relay entries (" << HOP_COUNT_LIMIT
+                   << " is allowed maximum." << LogEnd;
+        return;
+    }
 
-            }
+    // relay headers are written in front of the message, the options
+    // that follow relay-msg option (if any) after it
+    ESrvIfaceIdOrder order = SrvCfgMgr().getInterfaceIDOrder();
+    size_t hdrLen = 0, trailerLen = 0;
+    for (size_t i = 0; i < RelayInfo_.size(); i++) {
+        hdrLen += getRelayHdrSize(i, order);
+        trailerLen += getRelayTrailerSize(i, order);
+    }
+    size_t len = getSize();
 
-        }
+    TSrvTxBuffers::TBuffer txBuf(hdrLen + len + trailerLen);
+    char* buf = txBuf.get();
+    size_t offset = storeSelf(buf + hdrLen);
 
-#if 0
-        // calculate lengths of all relays
-        Len_[Relays_ - 1] = getSize();
-        for (int i = Relays_ - 1; i > 0; i--) {
-            Len_[i-1] = Len_[i] + 38; // 34 bytes (relay header) + 4 bytes (relay-msg option header)
-            if (InterfaceIDTbl_[i] && (SrvCfgMgr().getInterfaceIDOrder()!=SRV_IFACE_ID_ORDER_NONE)) {
-                Len_[i-1] += InterfaceIDTbl_[i]->getSize();
-
-                EchoListTbl_[i].first();
-                while (gen = EchoListTbl_[i].get()) {
-                    Len_[i-1] += gen->getSize();
-                }
+    if (!RelayInfo_.empty()) {
+        port = DHCPSERVER_PORT;
 
-            }
+        // encapsulate, starting with the innermost relay
+        for (int i = RelayInfo_.size() - 1; i >= 0; i--) {
+            size_t hdr = getRelayHdrSize(i, order);
+            hdrLen -= hdr;
+            RelayInfo_[i].Len_ = offset;
+            storeRelayHdr(buf + hdrLen, i, order);
+            offset += hdr;
+            offset += storeRelayTrailer(buf + hdrLen + offset, i, order);
         }
-#endif
-
-        // recursive storeSelf
-        offset += storeSelfRelay(buf, 0, SrvCfgMgr().getInterfaceIDOrder() );
 
-        Log(Debug) << "Sending " << this->getSize() << "(packet)+" << offset
+        Log(Debug) << "Sending " << len << "(packet)+" << offset - len
                    << "(relay headers) data on the "
                    << ptrIface->getFullName() << " interface." << LogEnd;
-    } else {
-        offset += this->storeSelf(buf+offset);
     }
 
     if (dstPort) {
         port = dstPort;
     }
 
-    SrvIfaceMgr().send(ptrIface->getID(), buf, offset, PeerAddr_, port);
-    delete [] buf;
+    SrvIfaceMgr().sendBuffer(ptrIface->getID(), txBuf, offset, PeerAddr_, port);
 }
 
 SPtr<TDUID> TSrvMsg::getClientDUID() {
@@ -743,46 +756,23 @@ void TSrvMsg::copyRelayInfo(SPtr<TSrvMsg> q) {
  *
  * @return - number of bytes used
  */
-int TSrvMsg::storeSelfRelay(char * buf, uint8_t relayDepth, ESrvIfaceIdOrder order)
+/// @brief returns options sent after relay-msg option
+///
+/// @param relayLevel relay (0 is the outermost one)
+/// @param order where interface-id should be placed
+/// @param opts options will be appended here
+void TSrvMsg::getRelayTrailer(uint8_t relayLevel, ESrvIfaceIdOrder order, TOptList& opts)
 {
-    int offset = 0;
-    if (relayDepth == RelayInfo_.size()) {
-        return storeSelf(buf);
-    }
-    buf[offset++] = forceMsgType_?forceMsgType_:RELAY_REPL_MSG;
-    buf[offset++] = RelayInfo_[relayDepth].Hop_;
-    RelayInfo_[relayDepth].LinkAddr_->storeSelf(buf+offset);
-    RelayInfo_[relayDepth].PeerAddr_->storeSelf(buf+offset+16);
-    offset += 32;
+    const TOptList& echoList = RelayInfo_[relayLevel].EchoList_;
 
-    SPtr<TOpt> interfaceid = TOpt::getOption(RelayInfo_[relayDepth].EchoList_, OPTION_INTERFACE_ID);
-
-    if (order == SRV_IFACE_ID_ORDER_BEFORE)
-    {
-        if (interfaceid) {
-            interfaceid->storeSelf(buf+offset);
-            offset += interfaceid->getSize();
-        }
-    }
-
-    writeUint16((buf+offset), OPTION_RELAY_MSG);
-    offset += sizeof(uint16_t);
-    writeUint16((buf+offset), RelayInfo_[relayDepth].Len_);
-    offset += sizeof(uint16_t);
-
-    offset += storeSelfRelay(buf+offset, relayDepth+1, order);
-
-    if (order == SRV_IFACE_ID_ORDER_AFTER)
-    {
-        if (interfaceid) {
-            interfaceid->storeSelf(buf+offset);
-            offset += interfaceid->getSize();
-        }
+    if (order == SRV_IFACE_ID_ORDER_AFTER) {
+        SPtr<TOpt> interfaceid = TOpt::getOption(echoList, OPTION_INTERFACE_ID);
+        if (interfaceid)
+            opts.push_back(interfaceid);
     }
 
     SPtr<TOpt> echo;
-    for (TOptList::const_iterator it = RelayInfo_[relayDepth].EchoList_.begin();
-         it != RelayInfo_[relayDepth].EchoList_.end(); ++it) {
+    for (TOptList::const_iterator it = echoList.begin(); it != echoList.end(); ++it) {
         if ((*it)->getOptType() == OPTION_ERO) {
             echo = *it;
         }
@@ -790,32 +780,98 @@ int TSrvMsg::storeSelfRelay(char * buf, uint8_t relayDepth, ESrvIfaceIdOrder ord
 
     if (echo) {
         SPtr<TOptOptionRequest> ero = (Ptr*) echo;
-
-        for (TOptList::const_iterator it = RelayInfo_[relayDepth].EchoList_.begin();
-             it != RelayInfo_[relayDepth].EchoList_.end(); ++it) {
-            if (ero->isOption((*it)->getOptType())) {
-                    Log(Debug) << "Echoing back option " << (*it)->getOptType() << ", length "
-                               << (*it)->getSize() << LogEnd;
-                    (*it)->storeSelf(buf+offset);
-                    offset += (*it)->getSize();
-            }
+        for (TOptList::const_iterator it = echoList.begin(); it != echoList.end(); ++it) {
+            if (ero->isOption((*it)->getOptType()))
+                opts.push_back(*it);
         }
     }
+}
 
-#if 0
-    SPtr<TOptGeneric> gen;
-    RelayInfo_[relayDepth].EchoList_.first();
-    while (gen = RelayInfo_[relayDepth].EchoList_.get()) {
-        Log(Debug) << "Echoing back option " << gen->getOptType() << ", length "
-                   << gen->getSize() << LogEnd;
-        gen->storeSelf(buf+offset);
-        offset += gen->getSize();
+/// @brief returns size of relay header (including relay-msg option header)
+///
+/// @param relayLevel relay (0 is the outermost one)
+/// @param order where interface-id should be placed
+///
+/// @return header size (in bytes)
+size_t TSrvMsg::getRelayHdrSize(uint8_t relayLevel, ESrvIfaceIdOrder order)
+{
+    // 34 bytes (relay header) + 4 bytes (relay-msg option header)
+    size_t len = 38;
+    if (order == SRV_IFACE_ID_ORDER_BEFORE) {
+        SPtr<TOpt> interfaceid = TOpt::getOption(RelayInfo_[relayLevel].EchoList_,
+                                                 OPTION_INTERFACE_ID);
+        if (interfaceid)
+            len += interfaceid->getSize();
     }
-#endif
+    return len;
+}
 
-    return offset;
+/// @brief returns size of options sent after relay-msg option
+///
+/// @param relayLevel relay (0 is the outermost one)
+/// @param order where interface-id should be placed
+///
+/// @return size (in bytes)
+size_t TSrvMsg::getRelayTrailerSize(uint8_t relayLevel, ESrvIfaceIdOrder order)
+{
+    TOptList opts;
+    getRelayTrailer(relayLevel, order, opts);
+    size_t len = 0;
+    for (TOptList::const_iterator it = opts.begin(); it != opts.end(); ++it)
+        len += (*it)->getSize();
+    return len;
 }
 
+/// @brief stores relay header (up to relay-msg option header)
+///
+/// Length of relay-msg option is taken from RelayInfo_[relayLevel].Len_.
+///
+/// @param buf buffer (getRelayHdrSize() bytes in front of relayed message)
+/// @param relayLevel relay (0 is the outermost one)
+/// @param order where interface-id should be placed
+void TSrvMsg::storeRelayHdr(char * buf, uint8_t relayLevel, ESrvIfaceIdOrder order)
+{
+    int offset = 0;
+    buf[offset++] = forceMsgType_?forceMsgType_:RELAY_REPL_MSG;
+    buf[offset++] = RelayInfo_[relayLevel].Hop_;
+    RelayInfo_[relayLevel].LinkAddr_->storeSelf(buf+offset);
+    RelayInfo_[relayLevel].PeerAddr_->storeSelf(buf+offset+16);
+    offset += 32;
+
+    if (order == SRV_IFACE_ID_ORDER_BEFORE) {
+        SPtr<TOpt> interfaceid = TOpt::getOption(RelayInfo_[relayLevel].EchoList_,
+                                                 OPTION_INTERFACE_ID);
+        if (interfaceid) {
+            interfaceid->storeSelf(buf+offset);
+            offset += interfaceid->getSize();
+        }
+    }
+
+    writeUint16((buf+offset), OPTION_RELAY_MSG);
+    offset += sizeof(uint16_t);
+    writeUint16((buf+offset), RelayInfo_[relayLevel].Len_);
+}
+
+/// @brief stores options sent after relay-msg option
+///
+/// @param buf buffer (just after relayed message)
+/// @param relayLevel relay (0 is the outermost one)
+/// @param order where interface-id should be placed
+///
+/// @return number of bytes stored
+size_t TSrvMsg::storeRelayTrailer(char * buf, uint8_t relayLevel, ESrvIfaceIdOrder order)
+{
+    TOptList opts;
+    getRelayTrailer(relayLevel, order, opts);
+    size_t offset = 0;
+    for (TOptList::const_iterator it = opts.begin(); it != opts.end(); ++it) {
+        Log(Debug) << "Echoing back option " << (*it)->getOptType() << ", length "
+                   << (*it)->getSize() << LogEnd;
+        (*it)->storeSelf(buf+offset);
+        offset += (*it)->getSize();
+    }
+    return offset;
+}
 
 void TSrvMsg::copyAAASPI(SPtr<TSrvMsg> q) {
 #ifndef MOD_DISABLE_AUTH
@@ -1196,8 +1252,15 @@ void TSrvMsg::appendStatusCode()
 }
 
 void TSrvMsg::handleDefaultOption(SPtr<TOpt> ptrOpt) {
-    int opt = ptrOpt->getOptType();
+    handleDefaultOption(ptrOpt->getOptType());
+}
 
+/// @brief handles option that is not processed by message handler
+///
+/// Only its type is needed, so received option does not have to be parsed.
+///
+/// @param opt option type
+void TSrvMsg::handleDefaultOption(int opt) {
     // RECONF_ACCEPT is the last standard option defined in RFC3315
     // All other options are considered extensions
     if (opt > OPTION_RECONF_ACCEPT && !ORO->isOption(opt) && !getOption(opt)) {
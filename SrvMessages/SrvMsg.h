@@ -104,11 +104,15 @@ public:
     void setPhysicalIface(int iface);
     int  getPhysicalIface() const;
 
+    static void setLazyOptions(bool lazy);
+
 
 protected:
     void setDefaults();
+    virtual SPtr<TOpt> parseOption(uint16_t code, char* buf, uint16_t length);
     SPtr<TOptOptionRequest> ORO;
     void handleDefaultOption(SPtr<TOpt> ptrOpt);
+    void handleDefaultOption(int opt);
     void getORO(SPtr<TMsg> clientMessage);
     SPtr<TDUID> ClientDUID;
 
@@ -130,7 +134,11 @@ protected:
     void delFQDN(SPtr<TSrvCfgIface> cfgIface, SPtr<TAddrIA> ptrIA, SPtr<TFQDN> fqdn);
 
 
-    int storeSelfRelay(char * buf, uint8_t relayLevel, ESrvIfaceIdOrder order);
+    void getRelayTrailer(uint8_t relayLevel, ESrvIfaceIdOrder order, TOptList& opts);
+    size_t getRelayHdrSize(uint8_t relayLevel, ESrvIfaceIdOrder order);
+    size_t getRelayTrailerSize(uint8_t relayLevel, ESrvIfaceIdOrder order);
+    void storeRelayHdr(char * buf, uint8_t relayLevel, ESrvIfaceIdOrder order);
+    size_t storeRelayTrailer(char * buf, uint8_t relayLevel, ESrvIfaceIdOrder order);
 
     unsigned long FirstTimeStamp_; // timestamp of first message transmission
     unsigned long MRT_;            // maximum retransmission timeout
@@ -144,6 +152,9 @@ protected:
 
     /// physical interface from/to which message was received/should be sent
     int physicalIface_;
+
+    /// should received options be parsed on first access?
+    static bool LazyOptions_;
 };
 
 typedef std::vector< SPtr<TSrvMsg> > SrvMsgList;
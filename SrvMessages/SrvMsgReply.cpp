@@ -538,27 +538,35 @@ TSrvMsgReply::TSrvMsgReply(SPtr<TSrvMsgRenew> renew)
     copyRemoteID((Ptr*)renew);
 
     unsigned long addrCount=0;
-    SPtr<TOpt> ptrOpt;
+    TOptList opts;
+
+    // only IAs are parsed, other options are handled by type
+    renew->getOptions(OPTION_IA_NA, opts);
+    for (TOptList::iterator opt = opts.begin(); opt != opts.end(); ++opt) {
+        SPtr<TSrvOptIA_NA> optIA_NA;
+        optIA_NA = new TSrvOptIA_NA((Ptr*)*opt,
+                                    renew->getRemoteAddr(), ClientDUID,
+                                    renew->getIface(), addrCount, RENEW_MSG, this);
+        Options.push_back((Ptr*)optIA_NA);
+    }
+
+    opts.clear();
+    renew->getOptions(OPTION_IA_PD, opts);
+    for (TOptList::iterator opt = opts.begin(); opt != opts.end(); ++opt) {
+        SPtr<TSrvOptIA_PD> optPD;
+        optPD = new TSrvOptIA_PD((Ptr*) renew, (Ptr*)*opt, this);
+        Options.push_back( (Ptr*) optPD);
+    }
 
-    renew->firstOption();
-    while (ptrOpt = renew->getOption() )
+    vector<uint16_t> types;
+    renew->getOptionTypes(types);
+    for (vector<uint16_t>::const_iterator type = types.begin(); type != types.end(); ++type)
     {
-        switch (ptrOpt->getOptType())
+        switch (*type)
         {
-        case OPTION_IA_NA: {
-            SPtr<TSrvOptIA_NA> optIA_NA;
-            optIA_NA = new TSrvOptIA_NA((Ptr*)ptrOpt,
-                                        renew->getRemoteAddr(), ClientDUID,
-                                        renew->getIface(), addrCount, RENEW_MSG, this);
-            Options.push_back((Ptr*)optIA_NA);
-            break;
-        }
-        case OPTION_IA_PD: {
-            SPtr<TSrvOptIA_PD> optPD;
-            optPD = new TSrvOptIA_PD((Ptr*) renew, (Ptr*)ptrOpt, this);
-            Options.push_back( (Ptr*) optPD);
+        case OPTION_IA_NA:
+        case OPTION_IA_PD:
             break;
-        }
         case OPTION_IA_TA:
             Log(Warning) << "TA option present. Temporary addreses cannot be renewed." << LogEnd;
             break;
@@ -571,10 +579,10 @@ TSrvMsgReply::TSrvMsgReply(SPtr<TSrvMsgRenew> renew)
         case OPTION_RAPID_COMMIT:
         case OPTION_UNICAST:
         case OPTION_STATUS_CODE:
-            Log(Warning) << "Invalid option "<<ptrOpt->getOptType()<<" received." << LogEnd;
+            Log(Warning) << "Invalid option "<< *type <<" received." << LogEnd;
             break;
         default:
-            handleDefaultOption(ptrOpt);
+            handleDefaultOption(*type);
             // do nothing with remaining options
             break;
         }
@@ -657,11 +665,12 @@ TSrvMsgReply::TSrvMsgReply(SPtr<TSrvMsgInfRequest> infRequest)
 
     Log(Debug) << "Received INF-REQUEST requesting " << showRequestedOptions(ORO) << "." << LogEnd;
 
-    infRequest->firstOption();
-    SPtr<TOpt> ptrOpt;
-    while (ptrOpt = infRequest->getOption() )
+    // options are not used here, so they don't have to be parsed
+    vector<uint16_t> types;
+    infRequest->getOptionTypes(types);
+    for (vector<uint16_t>::const_iterator type = types.begin(); type != types.end(); ++type)
     {
-        switch (ptrOpt->getOptType())
+        switch (*type)
         {
 
             case OPTION_RELAY_MSG   :
@@ -674,10 +683,10 @@ TSrvMsgReply::TSrvMsgReply(SPtr<TSrvMsgInfRequest> infRequest)
             case OPTION_RECONF_MSG  :
             case OPTION_IA_NA       :
             case OPTION_IA_TA       :
-                Log(Warning) << "Invalid option " << ptrOpt->getOptType() <<" received." << LogEnd;
+                Log(Warning) << "Invalid option " << *type <<" received." << LogEnd;
                 break;
             default:
-                handleDefaultOption(ptrOpt);
+                handleDefaultOption(*type);
             break;
         }
     }
@@ -0,0 +1,147 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include "Portable.h"
+#include "SrvTxBuffers.h"
+
+using namespace std;
+
+vector<vector<char>*> TSrvTxBuffers::Free_;
+unsigned long TSrvTxBuffers::Allocated_ = 0;
+unsigned long TSrvTxBuffers::Reused_ = 0;
+#ifdef LINUX
+pthread_mutex_t TSrvTxBuffers::Mutex_ = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/// @brief takes buffer from the pool
+///
+/// @param size required size (in bytes)
+TSrvTxBuffers::TBuffer::TBuffer(size_t size)
+    :Buf_(TSrvTxBuffers::take(size)) {
+}
+
+/// @brief returns buffer to the pool
+TSrvTxBuffers::TBuffer::~TBuffer() {
+    if (Buf_)
+        TSrvTxBuffers::give(Buf_);
+}
+
+/// @brief returns buffer memory
+///
+/// @return buffer (at least as large as requested)
+char * TSrvTxBuffers::TBuffer::get() {
+    return &(*Buf_)[0];
+}
+
+/// @brief hands the buffer over to the caller
+///
+/// Buffer is no longer returned to the pool when TBuffer is destroyed,
+/// the caller must return it with give() once it is not used.
+///
+/// @return buffer (get() must not be called afterwards)
+vector<char> * TSrvTxBuffers::TBuffer::detach() {
+    vector<char> * buf = Buf_;
+    Buf_ = 0;
+    return buf;
+}
+
+/// @brief allocates buffers in advance
+///
+/// Called before messages are sent, so no buffer is allocated when
+/// they are. One buffer is needed for every reply queued for batched
+/// transmission or still being sent.
+///
+/// @param count number of buffers that should be available
+void TSrvTxBuffers::preallocate(unsigned int count) {
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+#endif
+    if (count > SRVTXBUFFERS_MAX_FREE)
+        count = SRVTXBUFFERS_MAX_FREE;
+    while (Free_.size() < count) {
+        Free_.push_back(new vector<char>(SRVTXBUFFERS_SIZE));
+        Allocated_++;
+    }
+#ifdef LINUX
+    pthread_mutex_unlock(&Mutex_);
+#endif
+}
+
+/// @brief returns number of allocated buffers
+///
+/// @return buffers allocated so far (including the ones in use)
+unsigned long TSrvTxBuffers::getAllocated() {
+    return Allocated_;
+}
+
+/// @brief returns number of buffer reuses
+///
+/// @return number of times buffer was taken from the pool
+unsigned long TSrvTxBuffers::getReused() {
+    return Reused_;
+}
+
+/// @brief returns number of buffers waiting in the pool
+///
+/// @return number of unused buffers
+size_t TSrvTxBuffers::countFree() {
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+#endif
+    size_t cnt = Free_.size();
+#ifdef LINUX
+    pthread_mutex_unlock(&Mutex_);
+#endif
+    return cnt;
+}
+
+/// @brief takes buffer from the pool (or allocates a new one)
+///
+/// @param size required size (in bytes)
+///
+/// @return buffer
+vector<char> * TSrvTxBuffers::take(size_t size) {
+    vector<char> * buf = 0;
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+#endif
+    if (!Free_.empty()) {
+        buf = Free_.back();
+        Free_.pop_back();
+        Reused_++;
+    } else {
+        Allocated_++;
+    }
+#ifdef LINUX
+    pthread_mutex_unlock(&Mutex_);
+#endif
+
+    if (!buf)
+        buf = new vector<char>(SRVTXBUFFERS_SIZE);
+    if (buf->size() < size)
+        buf->resize(size);
+    return buf;
+}
+
+/// @brief returns buffer to the pool (or frees it, if pool is full)
+///
+/// @param buf buffer taken with take()
+void TSrvTxBuffers::give(vector<char> * buf) {
+#ifdef LINUX
+    pthread_mutex_lock(&Mutex_);
+#endif
+    if (Free_.size() < SRVTXBUFFERS_MAX_FREE) {
+        Free_.push_back(buf);
+        buf = 0;
+    }
+#ifdef LINUX
+    pthread_mutex_unlock(&Mutex_);
+#endif
+    delete buf;
+}
@@ -0,0 +1,72 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * authors: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+class TSrvTxBuffers;
+#ifndef SRVTXBUFFERS_H
+#define SRVTXBUFFERS_H
+
+#include <stddef.h>
+#include <vector>
+
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
+/// initial size of a transmit buffer (grows if a larger message is sent)
+#define SRVTXBUFFERS_SIZE 2048
+
+/// maximum number of unused buffers kept in the pool
+#define SRVTXBUFFERS_MAX_FREE 64
+
+/// @brief Pool of transmit buffers
+///
+/// Every sent message needs a buffer. Buffers are taken from the pool
+/// and returned there when the message is sent, so they are allocated
+/// only once. Replies queued for batched transmission keep their buffer
+/// until they are sent (see TBuffer::detach()). A buffer that was enlarged for a big message keeps its
+/// size.
+///
+/// The pool is protected by a mutex (Linux only, other systems use a
+/// single thread), so it may be used outside of the main thread.
+class TSrvTxBuffers
+{
+  public:
+    /// @brief buffer taken from the pool (returned when destroyed)
+    class TBuffer {
+      public:
+        TBuffer(size_t size);
+        ~TBuffer();
+        char * get();
+        std::vector<char> * detach();
+      private:
+        // not copyable
+        TBuffer(const TBuffer&);
+        TBuffer& operator=(const TBuffer&);
+
+        std::vector<char> * Buf_;
+    };
+
+    static void preallocate(unsigned int count);
+    static unsigned long getAllocated();
+    static unsigned long getReused();
+    static size_t countFree();
+    static void give(std::vector<char> * buf);
+
+  private:
+    static std::vector<char> * take(size_t size);
+
+    static std::vector<std::vector<char>*> Free_;
+    static unsigned long Allocated_; ///< buffers allocated so far
+    static unsigned long Reused_;    ///< buffers taken from the pool
+#ifdef LINUX
+    static pthread_mutex_t Mutex_;   ///< protects fields above
+#endif
+};
+
+#endif
@@ -331,6 +331,18 @@ bool TSrvOptIA_NA::assignAddr(SPtr<TIPv6Addr> addr, uint32_t pref, uint32_t vali
 
     pref = ptrClass->getPref(pref);
     valid = ptrClass->getValid(valid);
+
+    // configure this IA
+    T1_ = ptrClass->getT1(T1_);
+    T2_ = ptrClass->getT2(T2_);
+
+    // register this address as used by this client (other server process
+    // might have just leased it)
+    if (!SrvAddrMgr().addClntAddr(ClntDuid, ClntAddr, Iface, IAID_, T1_, T2_, addr, pref,
+                                  valid, quiet))
+        return false;
+    SrvCfgMgr().addClntAddr(this->Iface, addr);
+
     optAddr = new TSrvOptIAAddress(addr, pref, valid, this->Parent);
 
     /// @todo: remove get addr-params
@@ -346,14 +358,6 @@ bool TSrvOptIA_NA::assignAddr(SPtr<TIPv6Addr> addr, uint32_t pref, uint32_t vali
     Log(Info) << "Client " << ClntDuid->getPlain() << " got " << *addr
 	      << " (IAID=" << IAID_ << ", pref=" << pref << ",valid=" << valid << ")." << LogEnd;
 
-    // configure this IA
-    T1_ = ptrClass->getT1(T1_);
-    T2_ = ptrClass->getT2(T2_);
-
-    // register this address as used by this client
-    SrvAddrMgr().addClntAddr(ClntDuid, ClntAddr, Iface, IAID_, T1_, T2_, addr, pref, valid, quiet);
-    SrvCfgMgr().addClntAddr(this->Iface, addr);
-
     return true;
 }
 
@@ -467,6 +471,7 @@ bool TSrvOptIA_NA::renew(SPtr<TSrvOptIA_NA> queryOpt, bool complainIfMissing)
                                        this->Parent);
         SubOptions.append( (Ptr*)optAddr );
     }
+    SrvAddrMgr().leaseRenewed(ClntDuid, ptrIA, IATYPE_IA);
 
     // finally send greetings and happy OK status code
     SPtr<TOptStatusCode> ptrStatus;
@@ -610,10 +615,7 @@ SPtr<TIPv6Addr> TSrvOptIA_NA::getAddressHint(SPtr<TSrvMsg> clientReq, SPtr<TIPv6
     } else {
         Log(Debug) << "Requested address (" << *hint
                    << ") belongs to supported class, but is used." << LogEnd;
-        do {
-            addr = ptrClass->getRandomAddr();
-        } while (!SrvAddrMgr().addrIsFree(addr));
-        return addr;
+        return ptrClass->getFreeAddr();
     }
 
     return 0;
@@ -638,22 +640,16 @@ bool TSrvOptIA_NA::assignRandomAddr(SPtr<TSrvMsg> queryMsg, bool quiet) {
     if (pool->clntSupported(ClntDuid, ClntAddr, queryMsg) &&
         pool->getAssignedCount() < pool->getClassMaxLease() ) {
 
-        int safety = 0;
-
-        while (safety < SERVER_MAX_IA_RANDOM_TRIES) {
-            candidate = pool->getRandomAddr();
-
-            if (SrvAddrMgr().addrIsFree(candidate) && !SrvCfgMgr().addrReserved(candidate))
+        // free address may still be refused (e.g. leased by other server process)
+        for (int i = 0; i < SERVER_MAX_IA_RANDOM_TRIES; i++) {
+            candidate = pool->getFreeAddr();
+            if (!candidate)
                 break;
-
-            safety++;
-        }
-        if (safety < SERVER_MAX_IA_RANDOM_TRIES) {
-            return assignAddr(candidate, pool->getPref(), pool->getValid(), quiet);
-        } else {
-            Log(Error) << "Unable to randomly choose address after " << SERVER_MAX_IA_RANDOM_TRIES << " tries." << LogEnd;
-            return false;
+            if (assignAddr(candidate, pool->getPref(), pool->getValid(), quiet))
+                return true;
         }
+        Log(Error) << "Unable to find free address in class " << pool->getID() << "." << LogEnd;
+        return false;
     }
     return false;
 }
@@ -675,14 +671,25 @@ bool TSrvOptIA_NA::assignSequentialAddr(SPtr<TSrvMsg> clientMsg, bool quiet) {
             continue;
         if (pool->getAssignedCount() >= pool->getClassMaxLease())
             continue;
-        break;
 
-        SPtr<TIPv6Addr> candidate = pool->getFirstAddr();
-        for (candidate = pool->getFirstAddr(); candidate != pool->getLastAddr(); ++(*candidate)) {
-            if (!SrvAddrMgr().addrIsFree(candidate))
-                continue;
-            if (assignAddr(candidate, pool->getPref(), pool->getValid(), quiet))
+        // pools with bitmap know all their free addresses
+        if (pool->hasFreeMap()) {
+            SPtr<TIPv6Addr> candidate = pool->getFreeAddr();
+            if (candidate && assignAddr(candidate, pool->getPref(), pool->getValid(), quiet))
                 return true;
+            continue;
+        }
+
+        SPtr<TIPv6Addr> candidate = new TIPv6Addr(*pool->getFirstAddr());
+        SPtr<TIPv6Addr> last = pool->getLastAddr();
+        while (true) {
+            if (SrvAddrMgr().addrIsFree(candidate) && !SrvCfgMgr().addrReserved(candidate) &&
+                assignAddr(candidate, pool->getPref(), pool->getValid(), quiet))
+                return true;
+            if (*candidate == *last)
+                break;
+            candidate = new TIPv6Addr(*candidate);
+            ++(*candidate);
         }
     }
 
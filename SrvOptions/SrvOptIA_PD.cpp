@@ -166,13 +166,9 @@ bool TSrvOptIA_PD::assignPrefix(SPtr<TSrvMsg> clientMsg, SPtr<TIPv6Addr> hint, b
     prefixLst.clear();
     prefixLst = getFreePrefixes(clientMsg, hint);
     ostringstream buf;
+    int assigned = 0;
     prefixLst.first();
     while (prefix = prefixLst.get()) {
-        buf << prefix->getPlain() << "/" << this->PDLength << " ";
-        optPrefix = new TSrvOptIAPrefix(prefix, (char)this->PDLength, this->Prefered, this->Valid,
-                                        this->Parent);
-        SubOptions.append((Ptr*)optPrefix);
-
         // We do actual reservation here, even if it is SOLICIT. For SOLICIT, we will release
         // the prefix before sending ADVERTISE. We need to do this. Otherwise we could start
         // sending duplicate prefixes if client requested multiple IA_PDs.
@@ -184,18 +180,26 @@ bool TSrvOptIA_PD::assignPrefix(SPtr<TSrvMsg> clientMsg, SPtr<TIPv6Addr> hint, b
 
         // every prefix has to be remembered in AddrMgr, e.g. when there are 2 pools defined,
         // prefixLst contains entries from each pool, so 2 prefixes has to be remembered
-        SrvAddrMgr().addPrefix(this->ClntDuid, this->ClntAddr, cfgIface->getName(),
-                               Iface, IAID_, T1_, T2_, prefix, Prefered, Valid,
-                               this->PDLength, false);
+        // (unless other server process has just leased it)
+        if (!SrvAddrMgr().addPrefix(this->ClntDuid, this->ClntAddr, cfgIface->getName(),
+                                    Iface, IAID_, T1_, T2_, prefix, Prefered, Valid,
+                                    this->PDLength, false))
+            continue;
 
         // Increase prefix pool usage counter
         SrvCfgMgr().incrPrefixCount(Iface, prefix);
+
+        buf << prefix->getPlain() << "/" << this->PDLength << " ";
+        optPrefix = new TSrvOptIAPrefix(prefix, (char)this->PDLength, this->Prefered, this->Valid,
+                                        this->Parent);
+        SubOptions.append((Ptr*)optPrefix);
+        assigned++;
     }
     Log(Info) << "PD:" << (fake?"(would be)":"") << " assigned prefix(es):" << buf.str() << LogEnd;
 
-    if (prefixLst.count()) {
+    if (assigned) {
         stringstream tmp;
-        tmp << "Assigned " << prefixLst.count() << " prefix(es).";
+        tmp << "Assigned " << assigned << " prefix(es).";
         SubOptions.append( new TOptStatusCode(STATUSCODE_SUCCESS, tmp.str(), Parent) );
         return true;
     }
@@ -367,6 +371,7 @@ void TSrvOptIA_PD::renew(SPtr<TSrvOptIA_PD> queryOpt, SPtr<TSrvCfgIface> iface)
                                         prefix->getValid(), this->Parent);
         SubOptions.append( (Ptr*)optPrefix );
     }
+    SrvAddrMgr().leaseRenewed(ClntDuid, ptrIA, IATYPE_PD);
 
     // finally send greetings and happy OK status code
     SPtr<TOptStatusCode> ptrStatus;
@@ -590,7 +595,7 @@ List(TIPv6Addr) TSrvOptIA_PD::getFreePrefixes(SPtr<TSrvMsg> clientMsg, SPtr<TIPv
                 // Nope, not reserved.
 
                 // case 2: address belongs to supported class, and is free
-                if ( SrvAddrMgr().prefixIsFree(hint) ) {
+                if ( SrvAddrMgr().prefixIsFree(hint, ptrPD->getPD_Length()) ) {
                     Log(Debug) << "PD: Requested prefix (" << *hint << ") is free, great!" << LogEnd;
                     this->PDLength = ptrPD->getPD_Length();
                     this->Prefered = ptrPD->getPrefered(this->Prefered);
@@ -602,9 +607,13 @@ List(TIPv6Addr) TSrvOptIA_PD::getFreePrefixes(SPtr<TSrvMsg> clientMsg, SPtr<TIPv
                 } else {
 
                     // case 3: hint is used, but we can assign another prefix from the same pool
-                    do {
-                        prefix=ptrPD->getRandomPrefix();
-                    } while (!SrvAddrMgr().prefixIsFree(prefix));
+                    List(TIPv6Addr) freeLst = ptrPD->getFreeList();
+                    freeLst.first();
+                    if (!(prefix = freeLst.get())) {
+                        Log(Warning) << "PD: There are no free prefixes in pool " << ptrPD->getID()
+                                     << "." << LogEnd;
+                        return lst; // empty list
+                    }
                     lst.append(prefix);
 
                     this->PDLength = ptrPD->getPD_Length();
@@ -635,27 +644,17 @@ List(TIPv6Addr) TSrvOptIA_PD::getFreePrefixes(SPtr<TSrvMsg> clientMsg, SPtr<TIPv
         return lst;  // return empty list
     }
 
-    int attempts = SERVER_MAX_PD_RANDOM_TRIES;
-    while (attempts--) {
-        List(TIPv6Addr) lst;
-        lst = ptrPD->getRandomList();
-        lst.first();
-        bool allFree = true;
-        while (prefix = lst.get()) {
-            if (!SrvAddrMgr().prefixIsFree(prefix) || SrvCfgMgr().prefixReserved(prefix)) {
-                allFree = false;
-            }
-        }
-        if (allFree) {
-            this->PDLength = ptrPD->getPD_Length();
-            this->Prefered = ptrPD->getPrefered(this->Prefered);
-            this->Valid    = ptrPD->getValid(this->Valid);
-            T1_       = ptrPD->getT1(T1_);
-            T2_       = ptrPD->getT2(T2_);
-            return lst;
-        }
-    };
+    lst = ptrPD->getFreeList();
+    if (lst.count()) {
+        this->PDLength = ptrPD->getPD_Length();
+        this->Prefered = ptrPD->getPrefered(this->Prefered);
+        this->Valid    = ptrPD->getValid(this->Valid);
+        T1_       = ptrPD->getT1(T1_);
+        T2_       = ptrPD->getT2(T2_);
+        return lst;
+    }
 
-    // failed to find available prefixes after 100 attempts. Return empty list
-    return List(TIPv6Addr)();
+    // there are no free prefixes. Return empty list
+    Log(Warning) << "PD: There are no free prefixes in pool " << ptrPD->getID() << "." << LogEnd;
+    return lst;
 }
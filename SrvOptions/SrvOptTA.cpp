@@ -213,9 +213,13 @@ SPtr<TSrvOptIAAddress> TSrvOptTA::assignAddr(SPtr<TSrvMsg> clientMsg) {
 	addr = ta->getRandomAddr();
 	if (SrvAddrMgr().taAddrIsFree(addr)) {
 	    if ((this->OrgMessage == REQUEST_MSG)) {
+		// other server process might have just leased it
+		if (!SrvAddrMgr().addTAAddr(this->ClntDuid, this->ClntAddr, this->Iface,
+					    IAID_, addr, ta->getPref(), ta->getValid())) {
+		    safety++;
+		    continue;
+		}
 		Log(Debug) << "Temporary address " << addr->getPlain() << " granted." << LogEnd;
-		SrvAddrMgr().addTAAddr(this->ClntDuid, this->ClntAddr, this->Iface,
-				   IAID_, addr, ta->getPref(), ta->getValid());
 		SrvCfgMgr().addTAAddr(this->Iface);
 	    } else {
 		Log(Debug) << "Temporary address " << addr->getPlain() << " generated (not granted)." << LogEnd;
@@ -13,6 +13,7 @@
 #include <sstream>
 #include <map>
 #include <limits.h>
+#include <string.h>
 #include "SrvTransMgr.h"
 #include "SmartPtr.h"
 #include "SrvCfgIface.h"
@@ -43,9 +44,36 @@ using namespace std;
 
 TSrvTransMgr * TSrvTransMgr::Instance = 0;
 
+namespace {
+
+/// @brief counts pool allocations made while a message is processed
+///
+/// Must be created before any other object in the scope, so the
+/// objects are already released when it is destroyed.
+class TTransStats {
+public:
+    TTransStats(TMemPool::TStats& stats)
+        :Stats_(stats), Start_(TMemPool::getStats()) {
+    }
+    ~TTransStats() {
+        Stats_ = TMemPool::getStats(Start_);
+        Log(Debug) << "Memory: " << Stats_.Allocs << " object(s) allocated ("
+                   << Stats_.Reused << " reused), " << Stats_.Frees << " released, "
+                   << Stats_.Chunks << " new chunk(s), " << Stats_.Large
+                   << " large object(s)." << LogEnd;
+    }
+private:
+    TMemPool::TStats& Stats_;
+    TMemPool::TStats Start_;
+};
+
+}
+
 TSrvTransMgr::TSrvTransMgr(const std::string xmlFile, int port)
     : XmlFile(xmlFile), IsDone(false), port_(port)
 {
+    memset(&TransStats_, 0, sizeof(TransStats_));
+
     // TransMgr is certainly not done yet. We're just getting started
 
     // for each interface in CfgMgr, create socket (in IfaceMgr)
@@ -209,7 +237,7 @@ bool TSrvTransMgr::openSocket(SPtr<TSrvCfgIface> confIface, int port) {
 		  << iface->getFullName() << "." << LogEnd;
     }
 
-    if (unicast) {
+    if (unicast && !SrvIfaceMgr().isWildcard()) {
         /* unicast */
         Log(Notice) << "Creating unicast (" << *unicast << ") socket on "
 		    << confIface->getFullName() << " interface." << LogEnd;
@@ -227,6 +255,17 @@ bool TSrvTransMgr::openSocket(SPtr<TSrvCfgIface> confIface, int port) {
     }
 
     SPtr<TIPv6Addr> ipAddr(new TIPv6Addr(srvAddr));
+    if (SrvIfaceMgr().isWildcard()) {
+        // one socket bound to :: receives unicast traffic on all interfaces
+        Log(Notice) << "Joining " << ipAddr->getPlain() << " on " << confIface->getFullName()
+                    << " (" << iface->getFullName() << ") interface." << LogEnd;
+        if (!SrvIfaceMgr().addWildcardIface(iface, ipAddr, port)) {
+            Log(Crit) << "Proper socket creation failed." << LogEnd;
+            return false;
+        }
+        return true;
+    }
+
     Log(Notice) << "Creating multicast (" << ipAddr->getPlain() << ") socket on "
                 << confIface->getFullName() << " (" << iface->getFullName()
                 << ") interface." << LogEnd;
@@ -281,6 +320,17 @@ long TSrvTransMgr::getTimeout()
         min = ifaceRecheckPeriod;
     }
     addrTimeout = SrvAddrMgr().getValidTimeout();
+    if (SrvAddrMgr().getJournalTimeout() < addrTimeout) {
+        addrTimeout = SrvAddrMgr().getJournalTimeout();
+    }
+    // finished DNS Updates are completed in doDuties()
+    if (SrvIfaceMgr().getDnsUpdater().countPending() && min > 1) {
+        min = 1;
+    }
+    // and so are finished notify scripts
+    if (SrvIfaceMgr().getScriptExecutor().countPending() && min > 1) {
+        min = 1;
+    }
     if (min < addrTimeout) {
         return min;
     } else {
@@ -290,6 +340,8 @@ long TSrvTransMgr::getTimeout()
 
 void TSrvTransMgr::relayMsg(SPtr<TSrvMsg> msg)
 {
+    TTransStats stats(TransStats_);
+
     if (!msg->check()) {
         // proper warnings will be printed in the check() method, if necessary.
         // Log(Warning) << "Invalid message received." << LogEnd;
@@ -414,6 +466,9 @@ void TSrvTransMgr::relayMsg(SPtr<TSrvMsg> msg)
 
         // Call notify script
         SrvIfaceMgr().notifyScripts(SrvCfgMgr().getScriptName(), q, a);
+
+        // client's state could have been changed directly (e.g. FQDN)
+        SrvAddrMgr().clientChanged(msg->getClientDUID());
     }
 
     // save DB state regardless of action taken
@@ -421,6 +476,13 @@ void TSrvTransMgr::relayMsg(SPtr<TSrvMsg> msg)
     SrvCfgMgr().dump();
 }
 
+/// @brief returns pool allocation counters of the last processed message
+///
+/// @return counters (see TMemPool)
+const TMemPool::TStats& TSrvTransMgr::getTransStats() const {
+    return TransStats_;
+}
+
 void TSrvTransMgr::sendPacket(SPtr<TSrvMsg> msg) {
     if (!msg) {
         return;
@@ -492,6 +554,17 @@ void TSrvTransMgr::doDuties()
         removeExpired(addrLst, tempAddrLst, prefixLst);
     }
 
+    // store results of finished DNS Updates (or retry them)
+    SrvIfaceMgr().getDnsUpdater().processCompleted();
+
+    // report finished notify scripts
+    SrvIfaceMgr().getScriptExecutor().processCompleted();
+
+    // sync lease journal, if there are records waiting for too long
+    if (!SrvAddrMgr().getJournalTimeout()) {
+        SrvAddrMgr().dump();
+    }
+
     // Open socket on interface which becames ready during server run
     if (SrvCfgMgr().inactiveMode())
     {
@@ -623,7 +696,7 @@ void TSrvTransMgr::removeExpired(std::vector<TSrvAddrMgr::TExpiredInfo>& addrLst
 
 void TSrvTransMgr::shutdown()
 {
-    SrvAddrMgr().dump();
+    SrvAddrMgr().snapshot();
     IsDone = true;
 }
 
@@ -719,26 +792,12 @@ bool TSrvTransMgr::ClientInPool1(SPtr<TIPv6Addr> addr, int iface, bool PD) {
     
     if(PD) {
         // checking prefix delegation
-        ptrIface->firstPD();
-        SPtr<TSrvCfgPD> PDClass;
-        while (PDClass = ptrIface->getPD()) {
-            if (PDClass->prefixInPool(addr)){
-                return true;
-            }
-        }
-        return false;
+        return ptrIface->prefixInPdPool(addr);
     }
     else {
         // checking addresses
-    	ptrIface->firstAddrClass();
-    	SPtr<TSrvCfgAddrClass> addrClass;
-    	while (addrClass = ptrIface->getAddrClass()) {
-            if (addrClass->addrInPool(addr)){
-                return true;
-            }
-    	}
-    	return false;
-   }
+        return ptrIface->addrInPool(addr);
+    }
 }
 
 bool TSrvTransMgr::sendReconfigure(SPtr<TIPv6Addr> addr, int iface,
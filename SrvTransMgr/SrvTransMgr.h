@@ -21,6 +21,7 @@
 #include "SrvIfaceMgr.h"
 #include "SrvCfgIface.h"
 #include "SrvAddrMgr.h"
+#include "MemPool.h"
 
 #define SrvTransMgr() (TSrvTransMgr::instance())
 
@@ -35,6 +36,7 @@ class TSrvTransMgr
 
     long getTimeout();
     void relayMsg(SPtr<TSrvMsg> msg);
+    const TMemPool::TStats& getTransStats() const;
 
     /// @brief Checks whether message was sent to unicast when it was forbidden
     ///
@@ -94,6 +96,9 @@ class TSrvTransMgr
     static TSrvTransMgr * Instance;
 
     int port_;
+
+    /// pool allocations made while last message was processed
+    TMemPool::TStats TransStats_;
 };
 
 
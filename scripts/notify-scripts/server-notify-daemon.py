@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+
+# this is example hook daemon that can be used on a server side
+# (set DIBBLER_SCRIPT_DAEMON=N before starting dibbler-server)
+#
+# It is started once, with a single "daemon" parameter. Events are read
+# from standard input, each of them as a record: 32-bit length (network
+# byte order) followed by the operation (add, update, delete, expire) and
+# NAME=value variables, each of them NUL terminated. Every record must be
+# acknowledged (in order) with a 32-bit return code written to standard
+# output. Dibbler will just print it out. When standard input is closed,
+# daemon should exit.
+#
+# If it is called with any other parameter, it handles a single event
+# passed in the environment (as a regular notify script).
+
+import os
+import struct
+import sys
+
+LOGFILE = "/var/lib/dibbler/server-notify.log"
+
+
+def handle(log, operation, env):
+    if env.get("ADDR1"):
+        log.write("Address %s (operation %s) to client %s on interface %s/%s\n" %
+                  (env["ADDR1"], operation, env.get("REMOTE_ADDR"),
+                   env.get("IFACE"), env.get("IFINDEX")))
+    if env.get("PREFIX1"):
+        log.write("Prefix %s (operation %s) to client %s on interface %s/%s\n" %
+                  (env["PREFIX1"], operation, env.get("REMOTE_ADDR"),
+                   env.get("IFACE"), env.get("IFINDEX")))
+    # sample return code
+    return 0
+
+
+def daemon(log):
+    data = b""
+    while True:
+        chunk = os.read(0, 65536)
+        if not chunk:
+            break
+        data += chunk
+
+        # handle all complete records, then acknowledge them at once
+        acks = b""
+        while len(data) >= 4:
+            length = struct.unpack("!I", data[:4])[0]
+            if len(data) < 4 + length:
+                break
+            fields = data[4:4 + length].decode("utf-8", "replace").split("\0")[:-1]
+            data = data[4 + length:]
+            env = dict(field.split("=", 1) for field in fields[1:] if "=" in field)
+            acks += struct.pack("!i", handle(log, fields[0], env))
+        log.flush()
+        while acks:
+            acks = acks[os.write(1, acks):]
+
+
+def main():
+    with open(LOGFILE, "a") as log:
+        if len(sys.argv) > 1 and sys.argv[1] == "daemon":
+            daemon(log)
+            return 0
+        return handle(log, sys.argv[1] if len(sys.argv) > 1 else "", os.environ)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -18,6 +18,8 @@
 #include "HostRange.h"
 #include "assign_utils.h"
 #include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
 
 using namespace std;
 
@@ -390,4 +392,385 @@ TEST_F(ServerTest, SARR_outpool_reservation) {
 }
 
 
+// This test checks that leased addresses are tracked by addrIsFree(),
+// taAddrIsFree() and getClient(addr) as they are added and removed
+TEST_F(ServerTest, SrvAddrMgr_addrIsFree) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:123::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    SPtr<TIPv6Addr> addr = new TIPv6Addr("2001:db8:123::1", true);
+    SPtr<TIPv6Addr> other = new TIPv6Addr("2001:db8:123::2", true);
+    SPtr<TDUID> duid2 = new TDUID("00:01:00:0a:0b:0c:0d:0e:0f");
+    int ifindex = iface_->getID();
+
+    EXPECT_TRUE(addrmgr_->addrIsFree(addr));
+    EXPECT_FALSE(addrmgr_->getClient(addr));
+
+    EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, ifindex, 100, 101, 102,
+                                      addr, 103, 104, true));
+    EXPECT_FALSE(addrmgr_->addrIsFree(addr));
+    EXPECT_TRUE(addrmgr_->addrIsFree(other));
+    EXPECT_TRUE(addrmgr_->taAddrIsFree(addr));
+
+    SPtr<TAddrClient> client = addrmgr_->getClient(addr);
+    ASSERT_TRUE(client);
+    EXPECT_TRUE(*client->getDUID() == *clntDuid_);
+
+    // the same address held by a second client must not be freed by the first release
+    EXPECT_TRUE(addrmgr_->addClntAddr(duid2, clntAddr_, ifindex, 200, 101, 102,
+                                      addr, 103, 104, true));
+    EXPECT_TRUE(addrmgr_->delClntAddr(clntDuid_, 100, addr, true));
+    EXPECT_FALSE(addrmgr_->addrIsFree(addr));
+    client = addrmgr_->getClient(addr);
+    ASSERT_TRUE(client);
+    EXPECT_TRUE(*client->getDUID() == *duid2);
+
+    EXPECT_TRUE(addrmgr_->delClntAddr(duid2, 200, addr, true));
+    EXPECT_TRUE(addrmgr_->addrIsFree(addr));
+    EXPECT_FALSE(addrmgr_->getClient(addr));
+
+    // temporary addresses are tracked separately
+    EXPECT_TRUE(addrmgr_->addTAAddr(clntDuid_, clntAddr_, ifindex, 300, other, 103, 104));
+    EXPECT_FALSE(addrmgr_->taAddrIsFree(other));
+    EXPECT_TRUE(addrmgr_->addrIsFree(other));
+    EXPECT_TRUE(addrmgr_->delTAAddr(clntDuid_, 300, other, true));
+    EXPECT_TRUE(addrmgr_->taAddrIsFree(other));
+    EXPECT_EQ(0, addrmgr_->countClient());
+}
+
+// Checks that only expired leases are reported by doDuties()
+TEST_F(ServerTest, SrvAddrMgr_expiry) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:123::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    SPtr<TIPv6Addr> expired = new TIPv6Addr("2001:db8:123::1", true);
+    SPtr<TIPv6Addr> valid = new TIPv6Addr("2001:db8:123::2", true);
+    SPtr<TIPv6Addr> temp = new TIPv6Addr("2001:db8:123::3", true);
+    int ifindex = iface_->getID();
+
+    EXPECT_EQ(UINT_MAX, addrmgr_->getValidTimeout());
+
+    EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, ifindex, 100, 101, 102,
+                                      valid, 1000, 2000, true));
+    unsigned long timeout = addrmgr_->getValidTimeout();
+    EXPECT_LE(timeout, 2000u);
+    EXPECT_GE(timeout, 1999u);
+
+    EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, ifindex, 100, 101, 102,
+                                      expired, 0, 0, true));
+    EXPECT_TRUE(addrmgr_->addTAAddr(clntDuid_, clntAddr_, ifindex, 300, temp, 0, 0));
+    EXPECT_EQ(0u, addrmgr_->getValidTimeout());
+
+    std::vector<TSrvAddrMgr::TExpiredInfo> addrs, tas, prefixes;
+    addrmgr_->doDuties(addrs, tas, prefixes);
+    ASSERT_EQ(1u, addrs.size());
+    EXPECT_TRUE(*addrs[0].addr == *expired);
+    EXPECT_EQ(100u, addrs[0].ia->getIAID());
+    ASSERT_EQ(1u, tas.size());
+    EXPECT_TRUE(*tas[0].addr == *temp);
+    EXPECT_TRUE(prefixes.empty());
+
+    // expired leases are reported once
+    addrs.clear();
+    tas.clear();
+    addrmgr_->doDuties(addrs, tas, prefixes);
+    EXPECT_TRUE(addrs.empty());
+    EXPECT_TRUE(tas.empty());
+
+    // deleted lease is no longer tracked
+    EXPECT_TRUE(addrmgr_->delClntAddr(clntDuid_, 100, valid, true));
+    EXPECT_TRUE(addrmgr_->delClntAddr(clntDuid_, 100, expired, true));
+    EXPECT_TRUE(addrmgr_->delTAAddr(clntDuid_, 300, temp, true));
+    EXPECT_EQ(UINT_MAX, addrmgr_->getValidTimeout());
+}
+
+// Checks that leases changed after the snapshot are restored from the journal
+TEST_F(ServerTest, SrvAddrMgr_journal) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:123::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    SPtr<TIPv6Addr> addr1 = new TIPv6Addr("2001:db8:123::1", true);
+    SPtr<TIPv6Addr> addr2 = new TIPv6Addr("2001:db8:123::2", true);
+    SPtr<TIPv6Addr> addr3 = new TIPv6Addr("2001:db8:123::3", true);
+    SPtr<TDUID> duid2 = new TDUID("00:01:00:0a:0b:0c:0d:0e:10");
+    int ifindex = iface_->getID();
+
+    // first dump writes a snapshot
+    EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, ifindex, 100, 101, 102,
+                                      addr1, 1000, 2000, true));
+    EXPECT_TRUE(addrmgr_->addClntAddr(duid2, clntAddr_, ifindex, 200, 101, 102,
+                                      addr2, 1000, 2000, true));
+    addrmgr_->dump();
+
+    // following changes go to the journal only
+    EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, ifindex, 100, 101, 102,
+                                      addr3, 1000, 2000, true));
+    EXPECT_TRUE(addrmgr_->delClntAddr(duid2, 200, addr2, true));
+    addrmgr_->dump();
+
+    delete addrmgr_;
+    addrmgr_ = new NakedSrvAddrMgr("testdata/server-AddrMgr.xml", true); // load db
+
+    EXPECT_EQ(1, addrmgr_->countClient());
+    EXPECT_FALSE(addrmgr_->getClient(duid2));
+    SPtr<TAddrClient> client = addrmgr_->getClient(clntDuid_);
+    ASSERT_TRUE(client);
+    EXPECT_EQ(2u, addrmgr_->getLeaseCount(clntDuid_));
+    EXPECT_FALSE(addrmgr_->addrIsFree(addr1));
+    EXPECT_TRUE(addrmgr_->addrIsFree(addr2));
+    EXPECT_FALSE(addrmgr_->addrIsFree(addr3));
+}
+
+// Checks that client's own prefixes are kept when its journal record is
+// replayed and that truncated record does not remove client's leases
+TEST_F(ServerTest, SrvAddrMgr_journalReplay) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:123::/64 }\n"
+                 "  pd-class {\n"
+                 "    pd-pool 2001:db8:100::/48\n"
+                 "    pd-length 64\n"
+                 "  }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    SPtr<TIPv6Addr> addr = new TIPv6Addr("2001:db8:123::1", true);
+    SPtr<TIPv6Addr> prefix1 = new TIPv6Addr("2001:db8:100:1::", true);
+    SPtr<TIPv6Addr> prefix2 = new TIPv6Addr("2001:db8:100:2::", true);
+    int ifindex = iface_->getID();
+
+    EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, ifindex, 100, 101, 102,
+                                      addr, 1000, 2000, true));
+    EXPECT_TRUE(addrmgr_->addPrefix(clntDuid_, clntAddr_, iface_->getName(), ifindex, 5,
+                                    101, 102, prefix1, 1000, 2000, 64, true));
+    addrmgr_->dump();
+
+    // journal record contains both prefixes, prefix1 is also in the snapshot
+    EXPECT_TRUE(addrmgr_->addPrefix(clntDuid_, clntAddr_, iface_->getName(), ifindex, 5,
+                                    101, 102, prefix2, 1000, 2000, 64, true));
+    addrmgr_->dump();
+
+    // next record is cut in half (e.g. server crashed while writing it)
+    ostringstream record;
+    record << *addrmgr_->getClient(clntDuid_);
+    ofstream journal("testdata/server-AddrMgr.xml.journal", ios::app);
+    journal << record.str().substr(0, record.str().size() / 2);
+    journal.close();
+
+    delete addrmgr_;
+    addrmgr_ = new NakedSrvAddrMgr("testdata/server-AddrMgr.xml", true); // load db
+
+    SPtr<TAddrClient> client = addrmgr_->getClient(clntDuid_);
+    ASSERT_TRUE(client);
+    EXPECT_EQ(3u, addrmgr_->getLeaseCount(clntDuid_));
+    EXPECT_FALSE(addrmgr_->addrIsFree(addr));
+    SPtr<TAddrIA> pd = client->getPD(5);
+    ASSERT_TRUE(pd);
+    EXPECT_EQ(2, pd->countPrefix());
+    EXPECT_FALSE(addrmgr_->prefixIsFree(prefix1, 64));
+    EXPECT_FALSE(addrmgr_->prefixIsFree(prefix2, 64));
+}
+
+// Checks that least recently used cache entries are removed first and
+// that cache survives dump and read
+TEST_F(ServerTest, SrvAddrMgr_cache) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:123::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    SPtr<TIPv6Addr> addr1 = new TIPv6Addr("2001:db8:123::1", true);
+    SPtr<TIPv6Addr> addr2 = new TIPv6Addr("2001:db8:123::2", true);
+    SPtr<TIPv6Addr> addr3 = new TIPv6Addr("2001:db8:123::3", true);
+    SPtr<TIPv6Addr> prefix = new TIPv6Addr("2001:db8:1::", true);
+    SPtr<TDUID> duid2 = new TDUID("00:01:00:0a:0b:0c:0d:0e:10");
+    SPtr<TDUID> duid3 = new TDUID("00:01:00:0a:0b:0c:0d:0e:11");
+
+    addrmgr_->setCacheSize(0);
+    addrmgr_->setCacheSize(3 * (sizeof(TSrvAddrMgr::TSrvCacheEntry) + sizeof(TIPv6Addr)
+                                + sizeof(TDUID)));
+
+    addrmgr_->addCachedEntry(clntDuid_, addr1, IATYPE_IA);
+    addrmgr_->addCachedEntry(clntDuid_, prefix, IATYPE_PD);
+    addrmgr_->addCachedEntry(duid2, addr2, IATYPE_IA);
+    EXPECT_EQ(3u, addrmgr_->getCacheCount());
+
+    // address and prefix are cached separately
+    ASSERT_TRUE(addrmgr_->getCachedEntry(clntDuid_, IATYPE_IA));
+    EXPECT_TRUE(*addrmgr_->getCachedEntry(clntDuid_, IATYPE_IA) == *addr1);
+    ASSERT_TRUE(addrmgr_->getCachedEntry(clntDuid_, IATYPE_PD));
+    EXPECT_TRUE(*addrmgr_->getCachedEntry(clntDuid_, IATYPE_PD) == *prefix);
+    EXPECT_FALSE(addrmgr_->getCachedEntry(duid2, IATYPE_PD));
+
+    // duid2 is now the least recently used, so it's removed
+    addrmgr_->addCachedEntry(duid3, addr3, IATYPE_IA);
+    EXPECT_EQ(3u, addrmgr_->getCacheCount());
+    EXPECT_FALSE(addrmgr_->getCachedEntry(duid2, IATYPE_IA));
+    EXPECT_FALSE(addrmgr_->delCachedEntry(addr2, IATYPE_IA));
+
+    // the same address cached for another client replaces old entry
+    addrmgr_->addCachedEntry(duid2, addr3, IATYPE_IA);
+    EXPECT_EQ(3u, addrmgr_->getCacheCount());
+    EXPECT_FALSE(addrmgr_->getCachedEntry(duid3, IATYPE_IA));
+    ASSERT_TRUE(addrmgr_->getCachedEntry(duid2, IATYPE_IA));
+    EXPECT_TRUE(*addrmgr_->getCachedEntry(duid2, IATYPE_IA) == *addr3);
+
+    addrmgr_->cacheDump();
+    addrmgr_->cacheRead();
+    EXPECT_EQ(3u, addrmgr_->getCacheCount());
+    ASSERT_TRUE(addrmgr_->getCachedEntry(clntDuid_, IATYPE_IA));
+    EXPECT_TRUE(*addrmgr_->getCachedEntry(clntDuid_, IATYPE_IA) == *addr1);
+    ASSERT_TRUE(addrmgr_->getCachedEntry(clntDuid_, IATYPE_PD));
+    EXPECT_TRUE(*addrmgr_->getCachedEntry(clntDuid_, IATYPE_PD) == *prefix);
+
+    EXPECT_TRUE(addrmgr_->delCachedEntry(addr3, IATYPE_IA));
+    EXPECT_TRUE(addrmgr_->delCachedEntry(clntDuid_, IATYPE_PD));
+    EXPECT_FALSE(addrmgr_->delCachedEntry(clntDuid_, IATYPE_PD));
+    EXPECT_EQ(1u, addrmgr_->getCacheCount());
+
+    remove(SRVCACHE_BIN_FILE);
+}
+
+// Checks that free address is found even in almost exhausted pool
+TEST_F(ServerTest, SrvCfgAddrClass_getFreeAddr) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:123::1-2001:db8:123::100 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    cfgIface_->firstAddrClass();
+    SPtr<TSrvCfgAddrClass> pool = cfgIface_->getAddrClass();
+    ASSERT_TRUE(pool);
+    ASSERT_TRUE(pool->hasFreeMap());
+    int ifindex = iface_->getID();
+
+    // take every address, but one
+    SPtr<TIPv6Addr> last = new TIPv6Addr("2001:db8:123::77", true);
+    SPtr<TIPv6Addr> addr = new TIPv6Addr("2001:db8:123::1", true);
+    for (int i = 0; i < 256; i++) {
+        if (*addr != *last) {
+            EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, ifindex, 100, 101, 102,
+                                              addr, 1000, 2000, true));
+            cfgmgr_->addClntAddr(ifindex, addr);
+        }
+        addr = new TIPv6Addr(*addr);
+        ++(*addr);
+    }
+    EXPECT_EQ(255u, pool->getAssignedCount());
+
+    // the only free address is found every time
+    for (int i = 0; i < 10; i++) {
+        SPtr<TIPv6Addr> candidate = pool->getFreeAddr();
+        ASSERT_TRUE(candidate);
+        EXPECT_TRUE(*candidate == *last);
+    }
+
+    EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, ifindex, 100, 101, 102,
+                                      last, 1000, 2000, true));
+    cfgmgr_->addClntAddr(ifindex, last);
+    EXPECT_FALSE(pool->getFreeAddr());
+
+    // released address is available again
+    addr = new TIPv6Addr("2001:db8:123::100", true);
+    EXPECT_TRUE(addrmgr_->delClntAddr(clntDuid_, 100, addr, true));
+    cfgmgr_->delClntAddr(ifindex, addr);
+    SPtr<TIPv6Addr> candidate = pool->getFreeAddr();
+    ASSERT_TRUE(candidate);
+    EXPECT_TRUE(*candidate == *addr);
+}
+
+// Checks that address classes are found by address, even if their pools
+// overlap, and that CONFIRM accepts addresses from any of the pools.
+TEST_F(ServerTest, SrvCfgIface_getClassByAddr) {
+
+    string cfg = "iface REPLACE_ME {\n"
+        "  class { pool 2001:db8:1::10-2001:db8:1::1f }\n"
+        "  class { pool 2001:db8:1::/64 }\n"
+        "  class { pool 2001:db8:2::/64 }\n"
+        "  ta-class { pool 2001:db8:3::/64 }\n"
+        "  pd-class {\n"
+        "    pd-pool 2001:db8:100::/48\n"
+        "    pd-length 64\n"
+        "  }\n"
+        "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    cfgIface_->firstAddrClass();
+    SPtr<TSrvCfgAddrClass> small = cfgIface_->getAddrClass();
+    SPtr<TSrvCfgAddrClass> large = cfgIface_->getAddrClass();
+    SPtr<TSrvCfgAddrClass> other = cfgIface_->getAddrClass();
+    ASSERT_TRUE(small && large && other);
+    int ifindex = iface_->getID();
+
+    // class defined first takes precedence
+    SPtr<TIPv6Addr> addr = new TIPv6Addr("2001:db8:1::15", true);
+    EXPECT_TRUE(cfgmgr_->getClassByAddr(ifindex, addr) == small);
+    addr = new TIPv6Addr("2001:db8:1::20", true);
+    EXPECT_TRUE(cfgmgr_->getClassByAddr(ifindex, addr) == large);
+    EXPECT_EQ(ADDRSTATUS_YES, cfgIface_->confirmAddress(IATYPE_IA, addr));
+
+    addr = new TIPv6Addr("2001:db8:2::1", true);
+    EXPECT_TRUE(cfgmgr_->getClassByAddr(ifindex, addr) == other);
+    EXPECT_EQ(ADDRSTATUS_YES, cfgIface_->confirmAddress(IATYPE_IA, addr));
+
+    addr = new TIPv6Addr("2001:db8:4::1", true);
+    EXPECT_FALSE(cfgmgr_->getClassByAddr(ifindex, addr));
+    EXPECT_EQ(ADDRSTATUS_UNKNOWN, cfgIface_->confirmAddress(IATYPE_IA, addr));
+
+    addr = new TIPv6Addr("2001:db8:3::1", true);
+    EXPECT_TRUE(cfgIface_->getTAByAddr(addr));
+    EXPECT_EQ(ADDRSTATUS_YES, cfgIface_->confirmAddress(IATYPE_TA, addr));
+    EXPECT_EQ(ADDRSTATUS_UNKNOWN, cfgIface_->confirmAddress(IATYPE_IA, addr));
+
+    addr = new TIPv6Addr("2001:db8:100:5::", true);
+    EXPECT_TRUE(cfgmgr_->getClassByPrefix(ifindex, addr));
+    EXPECT_EQ(ADDRSTATUS_YES, cfgIface_->confirmAddress(IATYPE_PD, addr));
+    addr = new TIPv6Addr("2001:db8:101::", true);
+    EXPECT_FALSE(cfgmgr_->getClassByPrefix(ifindex, addr));
+}
+
+// Checks that objects released by one transaction are used by the next one
+TEST_F(ServerTest, SARR_memPool) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:123::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    for (int i = 0; i < 2; i++) {
+        SPtr<TSrvMsgSolicit> sol = createSolicit();
+        sol->addOption((Ptr*)clntId_);
+        sol->addOption((Ptr*)ia_);
+        ASSERT_TRUE(sendAndReceive((Ptr*)sol, i + 1));
+
+        const TMemPool::TStats& stats = transmgr_->getTransStats();
+        EXPECT_LT(0u, stats.Allocs);
+        EXPECT_LT(0u, stats.Frees);
+        if (i) {
+            // the second SOLICIT is served from released objects
+            EXPECT_LT(stats.Allocs / 2, stats.Reused);
+            EXPECT_EQ(0u, stats.Chunks);
+        }
+    }
+}
+
 }
@@ -472,4 +472,58 @@ TEST_F(ServerTest, SARR_prefix_hint_nonzero_host_part) {
                SERVER_DEFAULT_MIN_PREF, SERVER_DEFAULT_MIN_VALID);
 }
 
+// Checks that free prefix is found even in almost exhausted pool and that
+// reserved prefixes are never assigned dynamically
+TEST_F(ServerTest, SrvCfgPD_getFreeList) {
+
+    string cfg = "iface REPLACE_ME {\n"
+        "  pd-class {\n"
+        "    pd-pool 2001:db8:123::/60\n"
+        "    pd-length 64\n"
+        "  }\n"
+        "  client duid 00:01:00:00:00:00:00:00:00:01 { prefix 2001:db8:123:3::/64 }\n"
+        "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    cfgIface_->firstPD();
+    SPtr<TSrvCfgPD> cfgPD = cfgIface_->getPD();
+    ASSERT_TRUE(cfgPD);
+    int ifindex = iface_->getID();
+
+    // take every prefix, but the reserved one and 2001:db8:123:9::/64
+    SPtr<TIPv6Addr> last = new TIPv6Addr("2001:db8:123:9::", true);
+    SPtr<TIPv6Addr> reserved = new TIPv6Addr("2001:db8:123:3::", true);
+    char buf[64];
+    for (int i = 0; i < 16; i++) {
+        sprintf(buf, "2001:db8:123:%x::", i);
+        SPtr<TIPv6Addr> prefix = new TIPv6Addr(buf, true);
+        if (*prefix == *last || *prefix == *reserved)
+            continue;
+        EXPECT_TRUE(addrmgr_->addPrefix(clntDuid_, clntAddr_, "eth0", ifindex, 100, 101, 102,
+                                        prefix, 1000, 2000, 64, true));
+        cfgmgr_->incrPrefixCount(ifindex, prefix);
+    }
+
+    for (int i = 0; i < 10; i++) {
+        List(TIPv6Addr) lst = cfgPD->getFreeList();
+        ASSERT_EQ(1, lst.count());
+        lst.first();
+        EXPECT_TRUE(*lst.get() == *last);
+    }
+
+    EXPECT_TRUE(addrmgr_->addPrefix(clntDuid_, clntAddr_, "eth0", ifindex, 100, 101, 102,
+                                    last, 1000, 2000, 64, true));
+    cfgmgr_->incrPrefixCount(ifindex, last);
+    EXPECT_EQ(0, cfgPD->getFreeList().count());
+
+    // released prefix is available again
+    EXPECT_TRUE(addrmgr_->delPrefix(clntDuid_, 100, last, true));
+    cfgmgr_->decrPrefixCount(ifindex, last);
+    List(TIPv6Addr) lst = cfgPD->getFreeList();
+    ASSERT_EQ(1, lst.count());
+    lst.first();
+    EXPECT_TRUE(*lst.get() == *last);
+}
+
 }
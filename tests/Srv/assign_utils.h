@@ -55,6 +55,8 @@ namespace test {
         ~NakedSrvAddrMgr() {
             TSrvAddrMgr::Instance = NULL;
         }
+        using TSrvAddrMgr::cacheRead;
+        using TSrvAddrMgr::cacheDump;
     };
 
     class NakedSrvCfgMgr : public TSrvCfgMgr {
@@ -0,0 +1,220 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * author: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <unistd.h>
+#include <sys/time.h>
+#include "SrvDnsUpdater.h"
+#include "DNSUpdate.h"
+#include "assign_utils.h"
+#include <gtest/gtest.h>
+#include <vector>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+/// returns name in a zone of its own (so updates are not coalesced)
+string uniqueName() {
+    static int cnt = 0;
+    ostringstream name;
+    name << "foo.zone" << ++cnt << ".example.org";
+    return name.str();
+}
+
+/// update that does not talk to DNS server
+class FakeDNSUpdate : public DNSUpdate {
+public:
+    /// @param failures number of attempts that fail
+    /// @param delay duration of every attempt (in ms)
+    FakeDNSUpdate(unsigned int failures, unsigned int delay)
+        :DNSUpdate("::1", "", uniqueName(), "2001:db8:1::1", DNSUPDATE_AAAA,
+                   DNSUpdate::DNSUPDATE_UDP),
+         failures_(failures), delay_(delay) {
+    }
+
+    virtual void sendMsg(unsigned int /*timeout*/) {
+        usleep(delay_ * 1000);
+        if (failures_) {
+            failures_--;
+            throw PException("REFUSED");
+        }
+    }
+
+    unsigned int failures_;
+    unsigned int delay_;
+};
+
+/// finished jobs (name, success, attempts)
+struct TFinished {
+    string Name;
+    bool Success;
+    unsigned int Attempts;
+};
+vector<TFinished> finished;
+
+void recordJob(const TSrvDnsUpdater::TJob& job) {
+    TFinished f;
+    f.Name = job.Name;
+    f.Success = job.success();
+    f.Attempts = job.Attempts;
+    finished.push_back(f);
+}
+
+TSrvDnsUpdater::TJob * createJob(const string& name, FakeDNSUpdate * update) {
+    TSrvDnsUpdater::TJob * job = new TSrvDnsUpdater::TJob("2001:db8:1::1", name, true, 1);
+    job->addUpdate(update);
+    return job;
+}
+
+unsigned long long now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/// completes jobs until there are no more pending (or 5 seconds pass)
+void waitForJobs(TSrvDnsUpdater& updater) {
+    unsigned long long end = now() + 5000;
+    while (updater.countPending() && now() < end) {
+        updater.processCompleted();
+        usleep(5000);
+    }
+}
+
+}
+
+namespace test {
+
+TEST(DnsUpdaterTest, synchronous) {
+    TSrvDnsUpdater updater(recordJob);
+    finished.clear();
+
+    // thread is not running, so update is performed immediately
+    EXPECT_TRUE(updater.enqueue(createJob("a.example.org", new FakeDNSUpdate(0, 0))));
+    ASSERT_EQ(1u, finished.size());
+    EXPECT_TRUE(finished[0].Success);
+
+    // and is not retried
+    EXPECT_FALSE(updater.enqueue(createJob("b.example.org", new FakeDNSUpdate(1, 0))));
+    ASSERT_EQ(2u, finished.size());
+    EXPECT_FALSE(finished[1].Success);
+    EXPECT_EQ(1u, finished[1].Attempts);
+
+    TSrvDnsUpdater::TStats stats = updater.getStats();
+    EXPECT_EQ(2u, stats.Queued);
+    EXPECT_EQ(1u, stats.Succeeded);
+    EXPECT_EQ(1u, stats.Failed);
+    EXPECT_EQ(0u, stats.Retried);
+    EXPECT_EQ(0u, updater.countPending());
+}
+
+TEST(DnsUpdaterTest, background) {
+    TSrvDnsUpdater updater(recordJob);
+    finished.clear();
+    if (!updater.start()) {
+        cout << "DNS Update thread not supported, test skipped." << endl;
+        return;
+    }
+    EXPECT_TRUE(updater.isRunning());
+    updater.setRetries(2, 10);
+
+    // slow DNS server does not delay the caller
+    unsigned long long start = now();
+    EXPECT_TRUE(updater.enqueue(createJob("slow.example.org", new FakeDNSUpdate(0, 300))));
+    EXPECT_TRUE(updater.enqueue(createJob("retry.example.org", new FakeDNSUpdate(2, 0))));
+    EXPECT_TRUE(updater.enqueue(createJob("fail.example.org", new FakeDNSUpdate(5, 0))));
+    EXPECT_GT(200u, now() - start);
+    EXPECT_TRUE(finished.empty());
+    EXPECT_EQ(3u, updater.countPending());
+
+    waitForJobs(updater);
+    ASSERT_EQ(3u, finished.size());
+    for (size_t i = 0; i < finished.size(); i++) {
+        if (finished[i].Name == "slow.example.org") {
+            EXPECT_TRUE(finished[i].Success);
+            EXPECT_EQ(1u, finished[i].Attempts);
+        } else if (finished[i].Name == "retry.example.org") {
+            EXPECT_TRUE(finished[i].Success);
+            EXPECT_EQ(3u, finished[i].Attempts);
+        } else {
+            EXPECT_FALSE(finished[i].Success);
+            EXPECT_EQ(3u, finished[i].Attempts);
+        }
+    }
+
+    TSrvDnsUpdater::TStats stats = updater.getStats();
+    EXPECT_EQ(3u, stats.Queued);
+    EXPECT_EQ(2u, stats.Succeeded);
+    EXPECT_EQ(1u, stats.Failed);
+    EXPECT_EQ(4u, stats.Retried);
+    EXPECT_EQ(0u, stats.Dropped);
+
+    // queue is bounded
+    finished.clear();
+    updater.setMaxQueue(1);
+    EXPECT_TRUE(updater.enqueue(createJob("a.example.org", new FakeDNSUpdate(0, 100))));
+    EXPECT_FALSE(updater.enqueue(createJob("b.example.org", new FakeDNSUpdate(0, 0))));
+    ASSERT_EQ(1u, finished.size());
+    EXPECT_EQ("b.example.org", finished[0].Name);
+    EXPECT_FALSE(finished[0].Success);
+    EXPECT_EQ(1u, updater.getStats().Dropped);
+
+    // queued updates are sent before the thread stops
+    updater.stop();
+    EXPECT_FALSE(updater.isRunning());
+    updater.processCompleted();
+    ASSERT_EQ(2u, finished.size());
+    EXPECT_TRUE(finished[1].Success);
+}
+
+TEST_F(ServerTest, DnsUpdater_fqdnState) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:1::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    SPtr<TIPv6Addr> addr = new TIPv6Addr("2001:db8:1::1", true);
+    EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, iface_->getID(), 1, 100, 200,
+                                      addr, 300, 400, false));
+    SPtr<TAddrIA> ia = addrmgr_->getClient(clntDuid_)->getIA(1);
+    ASSERT_TRUE(ia);
+    EXPECT_EQ(FQDNSTATE_NONE, ia->getFQDNState());
+
+    TSrvDnsUpdater& updater = ifacemgr_->getDnsUpdater();
+    if (!updater.start()) {
+        cout << "DNS Update thread not supported, test skipped." << endl;
+        return;
+    }
+    updater.setRetries(0, 0);
+
+    // IA is updated when the update is finished
+    EXPECT_TRUE(ifacemgr_->setFQDNState(addr, FQDNSTATE_PENDING));
+    EXPECT_TRUE(updater.enqueue(createJob("foo.example.org", new FakeDNSUpdate(0, 0))));
+    EXPECT_EQ(FQDNSTATE_PENDING, ia->getFQDNState());
+    waitForJobs(updater);
+    EXPECT_EQ(FQDNSTATE_DONE, ia->getFQDNState());
+
+    EXPECT_TRUE(updater.enqueue(createJob("foo.example.org", new FakeDNSUpdate(1, 0))));
+    waitForJobs(updater);
+    EXPECT_EQ(FQDNSTATE_FAILED, ia->getFQDNState());
+
+    // records removed
+    TSrvDnsUpdater::TJob * job = createJob("foo.example.org", new FakeDNSUpdate(0, 0));
+    job->Add = false;
+    EXPECT_TRUE(updater.enqueue(job));
+    waitForJobs(updater);
+    EXPECT_EQ(FQDNSTATE_NONE, ia->getFQDNState());
+
+    updater.stop();
+}
+
+}
@@ -0,0 +1,198 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * author: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include "SrvMsgSolicit.h"
+#include "SrvMsgRenew.h"
+#include "OptDUID.h"
+#include "OptInteger.h"
+#include "MemPool.h"
+#include "assign_utils.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+/// SOLICIT that exposes its not yet parsed options
+class NakedSrvMsgSolicit: public TSrvMsgSolicit {
+public:
+    NakedSrvMsgSolicit(int iface, SPtr<TIPv6Addr> addr, char* buf, int bufSize)
+        :TSrvMsgSolicit(iface, addr, buf, bufSize) { }
+    unsigned int countParsed() {
+        unsigned int cnt = 0;
+        for (vector<TOptView>::const_iterator view = OptViews_.begin();
+             view != OptViews_.end(); ++view)
+            cnt += view->Parsed;
+        return cnt;
+    }
+    size_t countViews() { return OptViews_.size(); }
+};
+
+/// RENEW that exposes its not yet parsed options
+class NakedSrvMsgRenew: public TSrvMsgRenew {
+public:
+    NakedSrvMsgRenew(int iface, SPtr<TIPv6Addr> addr, char* buf, int bufSize)
+        :TSrvMsgRenew(iface, addr, buf, bufSize) { }
+    bool isParsed(uint16_t type) {
+        for (vector<TOptView>::const_iterator view = OptViews_.begin();
+             view != OptViews_.end(); ++view)
+            if (view->Type == type && view->Parsed)
+                return true;
+        return false;
+    }
+    size_t countViews() { return OptViews_.size(); }
+};
+
+/// RENEW with IA_NA and options that server does not need to answer it
+/// (server-id is appended later)
+char RENEW[] = { RENEW_MSG, 0x12, 0x34, 0x57,
+                 0, OPTION_CLIENTID, 0, 10, 0, 3, 0, 1, 1, 2, 3, 4, 5, 6,
+                 0, OPTION_ELAPSED_TIME, 0, 2, 0, 7,
+                 0, OPTION_ORO, 0, 2, 0, OPTION_DNS_SERVERS,
+                 0, OPTION_IA_NA, 0, 12, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0,
+                 0, OPTION_USER_CLASS, 0, 5, 0, 3, 'a', 'b', 'c',
+                 0, OPTION_USER_CLASS, 0, 5, 0, 3, 'd', 'e', 'f' };
+
+char SOLICIT[] = { SOLICIT_MSG, 0x12, 0x34, 0x56,
+                   0, OPTION_CLIENTID, 0, 10, 0, 3, 0, 1, 1, 2, 3, 4, 5, 6,
+                   0, OPTION_ELAPSED_TIME, 0, 2, 0, 7,
+                   0, OPTION_ELAPSED_TIME, 0, 1, 9, // truncated
+                   0, OPTION_ORO, 0, 4, 0, OPTION_DNS_SERVERS, 0, OPTION_DOMAIN_LIST,
+                   0, OPTION_IA_NA, 0, 12, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+}
+
+namespace test {
+
+TEST_F(ServerTest, LazyOptions_parse) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:1::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    // copy, so parsing can't depend on the received data
+    vector<char> buf(SOLICIT, SOLICIT + sizeof(SOLICIT));
+    NakedSrvMsgSolicit msg(iface_->getID(), clntAddr_, &buf[0], buf.size());
+    memset(&buf[0], 0xff, buf.size());
+
+    EXPECT_EQ(0x123456, msg.getTransID());
+    EXPECT_EQ(5u, msg.countViews());
+    EXPECT_EQ(0u, msg.countParsed());
+
+    // types are known without parsing
+    vector<uint16_t> types;
+    msg.getOptionTypes(types);
+    ASSERT_EQ(5u, types.size());
+    EXPECT_EQ(OPTION_CLIENTID, types[0]);
+    EXPECT_EQ(OPTION_IA_NA, types[4]);
+
+    // only requested option is parsed
+    SPtr<TOptInteger> elapsed = (Ptr*)msg.getOption(OPTION_ELAPSED_TIME);
+    ASSERT_TRUE(elapsed);
+    EXPECT_EQ(7u, elapsed->getValue());
+    EXPECT_EQ(1u, msg.countParsed());
+    EXPECT_TRUE(msg.getOption(OPTION_ELAPSED_TIME) == elapsed); // parsed only once
+    EXPECT_FALSE(msg.getOption(OPTION_SERVERID));
+    EXPECT_EQ(1u, msg.countParsed());
+
+    // check() needs client-id and server-id only
+    EXPECT_TRUE(msg.check());
+    EXPECT_EQ(2u, msg.countParsed());
+    SPtr<TOptDUID> clientId = (Ptr*)msg.getOption(OPTION_CLIENTID);
+    ASSERT_TRUE(clientId);
+    EXPECT_EQ("00:03:00:01:01:02:03:04:05:06", clientId->getDUID()->getPlain());
+
+    // invalid option is skipped
+    SPtr<TSrvOptIA_NA> ia = (Ptr*)msg.getOption(OPTION_IA_NA);
+    ASSERT_TRUE(ia);
+    EXPECT_EQ(2u, ia->getIAID());
+    TOptList elapsedLst;
+    msg.getOptions(OPTION_ELAPSED_TIME, elapsedLst);
+    EXPECT_EQ(1u, elapsedLst.size());
+    msg.getOptionTypes(types);
+    EXPECT_EQ(4u, types.size());
+
+    // iterating parses everything, in order of reception
+    EXPECT_EQ(4, msg.countOption());
+    EXPECT_EQ(0u, msg.countViews());
+    msg.firstOption();
+    EXPECT_TRUE(msg.getOption() == (Ptr*)clientId);
+    EXPECT_TRUE(msg.getOption() == (Ptr*)elapsed);
+    EXPECT_EQ(OPTION_ORO, msg.getOption()->getOptType());
+    EXPECT_TRUE(msg.getOption() == (Ptr*)ia);
+    EXPECT_FALSE(msg.getOption());
+
+    // stored message is the same as received one (without invalid option)
+    char out[sizeof(SOLICIT)];
+    ASSERT_EQ((int)sizeof(SOLICIT) - 5, msg.storeSelf(out));
+    EXPECT_EQ(0, memcmp(out, SOLICIT, 24));
+    EXPECT_EQ(0, memcmp(out + 24, SOLICIT + 29, sizeof(SOLICIT) - 29));
+
+    // the same without lazy parsing
+    TSrvMsg::setLazyOptions(false);
+    NakedSrvMsgSolicit eager(iface_->getID(), clntAddr_, SOLICIT, sizeof(SOLICIT));
+    TSrvMsg::setLazyOptions(true);
+    EXPECT_EQ(0u, eager.countViews());
+    EXPECT_EQ(4, eager.countOption());
+    ASSERT_EQ((int)sizeof(SOLICIT) - 5, eager.storeSelf(out));
+    EXPECT_EQ(0, memcmp(out + 24, SOLICIT + 29, sizeof(SOLICIT) - 29));
+}
+
+// Checks that RENEW is answered without parsing options it does not need
+// and counts objects allocated for it
+TEST_F(ServerTest, LazyOptions_renew) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:1::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    SPtr<TDUID> srvDuid = SrvCfgMgr().getDUID();
+    ASSERT_TRUE(srvDuid);
+    vector<char> buf(RENEW, RENEW + sizeof(RENEW));
+    buf.push_back(0);
+    buf.push_back(OPTION_SERVERID);
+    buf.push_back(0);
+    buf.push_back(srvDuid->getLen());
+    buf.insert(buf.end(), srvDuid->get(), srvDuid->get() + srvDuid->getLen());
+
+    TMemPool::TStats start = TMemPool::getStats();
+    SPtr<NakedSrvMsgRenew> renew = new NakedSrvMsgRenew(iface_->getID(), clntAddr_,
+                                                        &buf[0], buf.size());
+    ASSERT_TRUE(sendAndReceive((Ptr*)renew, 1));
+    TMemPool::TStats lazy = TMemPool::getStats(start);
+
+    // options were not parsed all at once
+    EXPECT_EQ(7u, renew->countViews());
+    EXPECT_TRUE(renew->isParsed(OPTION_CLIENTID));
+    EXPECT_TRUE(renew->isParsed(OPTION_SERVERID));
+    EXPECT_TRUE(renew->isParsed(OPTION_IA_NA));
+    EXPECT_FALSE(renew->isParsed(OPTION_USER_CLASS));
+
+    // the same RENEW (as another transaction), with all options parsed
+    buf[3]++;
+    TSrvMsg::setLazyOptions(false);
+    start = TMemPool::getStats();
+    SPtr<NakedSrvMsgRenew> eager = new NakedSrvMsgRenew(iface_->getID(), clntAddr_,
+                                                        &buf[0], buf.size());
+    ASSERT_TRUE(sendAndReceive((Ptr*)eager, 2));
+    TMemPool::TStats all = TMemPool::getStats(start);
+    TSrvMsg::setLazyOptions(true);
+    EXPECT_EQ(0u, eager->countViews());
+
+    // both user class options were skipped, each would take at least the
+    // option object and its reference counter
+    EXPECT_LE(lazy.Allocs + lazy.Large + 2 * 2, all.Allocs + all.Large);
+}
+
+}
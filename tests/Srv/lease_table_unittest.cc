@@ -0,0 +1,372 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * author: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "SrvLeaseTable.h"
+#include "assign_utils.h"
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+
+const char * TABLE_FILE = "lease-table-test.shm";
+
+TSrvLeaseTable::TLease createLease(const char * addr, const char * duid,
+                                   unsigned long iaid, int iface) {
+    TSrvLeaseTable::TLease lease;
+    lease.Type = IATYPE_IA;
+    lease.Addr = new TIPv6Addr(addr, true);
+    lease.PrefixLen = 128;
+    lease.Duid = new TDUID(duid);
+    lease.ClntAddr = new TIPv6Addr("fe80::abcd", true);
+    lease.Iface = iface;
+    lease.Ifname = "eth0";
+    lease.Iaid = iaid;
+    lease.T1 = 100;
+    lease.T2 = 200;
+    lease.Pref = 300;
+    lease.Valid = 400;
+    lease.Timestamp = (unsigned long)time(NULL);
+    lease.Owner = -1;
+    return lease;
+}
+
+}
+
+namespace test {
+
+TEST(LeaseTableTest, addFindDel) {
+    TSrvLeaseTable table;
+    unlink(TABLE_FILE);
+    if (!table.open(TABLE_FILE, 4)) {
+        cout << "Shared lease table not supported, test skipped." << endl;
+        return;
+    }
+
+    TSrvLeaseTable::TLease lease1 = createLease("2001:db8::1", "00:01:02", 1, 5);
+    TSrvLeaseTable::TLease lease2 = createLease("2001:db8::1", "00:01:03", 2, 5);
+    TSrvLeaseTable::TLease found;
+
+    EXPECT_TRUE(table.add(lease1));
+    EXPECT_TRUE(table.add(lease1)); // update
+    EXPECT_FALSE(table.add(lease2)); // leased to other client
+    ASSERT_TRUE(table.find(IATYPE_IA, lease1.Addr, 128, found));
+    EXPECT_TRUE(*found.Duid == *lease1.Duid);
+    EXPECT_EQ(1u, found.Iaid);
+    EXPECT_EQ("eth0", found.Ifname);
+    EXPECT_EQ(400u, found.Valid);
+    EXPECT_FALSE(table.find(IATYPE_TA, lease1.Addr, 128, found));
+    EXPECT_FALSE(table.find(IATYPE_PD, lease1.Addr, 64, found));
+
+    // more leases than fit in a single bucket
+    for (int i = 0; i < 40; i++) {
+        char addr[64];
+        sprintf(addr, "2001:db8::1:%x", i);
+        EXPECT_TRUE(table.add(createLease(addr, "00:01:02", 1, 5)));
+    }
+    EXPECT_EQ(41u, table.count());
+
+    vector<TSrvLeaseTable::TLease> leases;
+    table.getByDuid(lease1.Duid, leases);
+    EXPECT_EQ(41u, leases.size());
+    table.getByDuid(lease2.Duid, leases);
+    EXPECT_EQ(0u, leases.size());
+
+    EXPECT_FALSE(table.del(IATYPE_IA, lease1.Addr, 128, lease2.Duid));
+    EXPECT_TRUE(table.del(IATYPE_IA, lease1.Addr, 128, lease1.Duid));
+    EXPECT_FALSE(table.find(IATYPE_IA, lease1.Addr, 128, found));
+    EXPECT_EQ(40u, table.count());
+
+    // expired lease may be taken by other client
+    lease1.Timestamp -= 1000;
+    EXPECT_TRUE(table.add(lease1));
+    EXPECT_FALSE(table.find(IATYPE_IA, lease1.Addr, 128, found));
+    EXPECT_TRUE(table.add(lease2));
+    ASSERT_TRUE(table.find(IATYPE_IA, lease2.Addr, 128, found));
+    EXPECT_TRUE(*found.Duid == *lease2.Duid);
+
+    // leases are kept in the file
+    table.close();
+    ASSERT_TRUE(table.open(TABLE_FILE, 4));
+    EXPECT_EQ(41u, table.count());
+    table.close();
+    unlink(TABLE_FILE);
+}
+
+TEST(LeaseTableTest, fullBuckets) {
+    TSrvLeaseTable table;
+    unlink(TABLE_FILE);
+    if (!table.open(TABLE_FILE, 2)) {
+        cout << "Shared lease table not supported, test skipped." << endl;
+        return;
+    }
+
+    // leases overflow to the other bucket, until both of them are full
+    for (int i = 0; i < 2 * SRVLEASETABLE_BUCKET_SLOTS; i++) {
+        char addr[64];
+        sprintf(addr, "2001:db8::2:%x", i);
+        EXPECT_TRUE(table.add(createLease(addr, "00:01:02", 1, 5)));
+    }
+    EXPECT_EQ(2u * SRVLEASETABLE_BUCKET_SLOTS, table.count());
+
+    TSrvLeaseTable::TLease lease = createLease("2001:db8::3", "00:01:02", 1, 5);
+    TSrvLeaseTable::TLease found;
+    EXPECT_FALSE(table.add(lease));
+    EXPECT_FALSE(table.find(IATYPE_IA, lease.Addr, 128, found));
+
+    // every lease can still be found and removed
+    SPtr<TIPv6Addr> addr = new TIPv6Addr("2001:db8::2:1f", true);
+    ASSERT_TRUE(table.find(IATYPE_IA, addr, 128, found));
+    EXPECT_TRUE(table.del(IATYPE_IA, addr, 128, found.Duid));
+    EXPECT_TRUE(table.add(lease));
+    EXPECT_TRUE(table.find(IATYPE_IA, lease.Addr, 128, found));
+
+    table.close();
+    unlink(TABLE_FILE);
+}
+
+TEST(LeaseTableTest, getBuckets) {
+    EXPECT_EQ((unsigned int)SRVLEASETABLE_DEFAULT_BUCKETS, TSrvLeaseTable::getBuckets(0));
+    EXPECT_EQ((unsigned int)SRVLEASETABLE_DEFAULT_BUCKETS, TSrvLeaseTable::getBuckets(1000));
+    EXPECT_EQ(40001u, TSrvLeaseTable::getBuckets(320000));
+    EXPECT_EQ((unsigned int)SRVLEASETABLE_MAX_BUCKETS, TSrvLeaseTable::getBuckets(ULONG_MAX));
+}
+
+TEST(LeaseTableTest, processes) {
+    TSrvLeaseTable table;
+    unlink(TABLE_FILE);
+    if (!table.open(TABLE_FILE, 4)) {
+        cout << "Shared lease table not supported, test skipped." << endl;
+        return;
+    }
+    TSrvLeaseTable::TLease lease = createLease("2001:db8::1", "00:01:02", 1, 5);
+
+    int started[2], finish[2];
+    ASSERT_EQ(0, pipe(started));
+    ASSERT_EQ(0, pipe(finish));
+    pid_t pid = fork();
+    ASSERT_LE(0, pid);
+    if (!pid) {
+        // other server process: assigns a lease and waits
+        char c = table.attach(1) && table.add(lease) ? 1 : 0;
+        if (write(started[1], &c, 1) == 1)
+            c = read(finish[0], &c, 1);
+        _exit(0);
+    }
+
+    char c = 0;
+    ASSERT_EQ(1, read(started[0], &c, 1));
+    ASSERT_EQ(1, c);
+    ASSERT_TRUE(table.attach(0));
+    EXPECT_FALSE(table.attach(1));
+    EXPECT_EQ(0, table.getProcess());
+    EXPECT_TRUE(table.isAlive(1));
+    EXPECT_FALSE(table.isAlive(2));
+
+    // table is not opened (and its locks are not reset) while it is used
+    pid_t opener = fork();
+    ASSERT_LE(0, opener);
+    if (!opener) {
+        TSrvLeaseTable again;
+        _exit(again.open(TABLE_FILE, 4) ? 1 : 0);
+    }
+    int status = -1;
+    ASSERT_EQ(opener, waitpid(opener, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    vector<unsigned int> alive;
+    table.getAlive(alive);
+    ASSERT_EQ(2u, alive.size());
+    EXPECT_EQ(0u, alive[0]);
+    EXPECT_EQ(1u, alive[1]);
+
+    // lease belongs to running process
+    TSrvLeaseTable::TLease found;
+    ASSERT_TRUE(table.find(IATYPE_IA, lease.Addr, 128, found));
+    EXPECT_EQ(1, found.Owner);
+    EXPECT_FALSE(table.del(IATYPE_IA, lease.Addr, 128, lease.Duid));
+
+    // process terminates, but its lease is kept
+    ASSERT_EQ(1, write(finish[1], &c, 1));
+    waitpid(pid, NULL, 0);
+    EXPECT_FALSE(table.isAlive(1));
+    table.getAlive(alive);
+    EXPECT_EQ(1u, alive.size());
+    EXPECT_TRUE(table.find(IATYPE_IA, lease.Addr, 128, found));
+    EXPECT_TRUE(table.del(IATYPE_IA, lease.Addr, 128, lease.Duid));
+
+    // once all processes are gone, table may be opened again
+    table.close();
+    EXPECT_TRUE(table.open(TABLE_FILE, 4));
+
+    close(started[0]);
+    close(started[1]);
+    close(finish[0]);
+    close(finish[1]);
+    table.close();
+    unlink(TABLE_FILE);
+}
+
+TEST_F(ServerTest, LeaseTable_addrMgr) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:1::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    // two processes sharing the table
+    TSrvLeaseTable table, other;
+    unlink(TABLE_FILE);
+    if (!table.open(TABLE_FILE, 16) || !other.open(TABLE_FILE, 16)) {
+        cout << "Shared lease table not supported, test skipped." << endl;
+        return;
+    }
+    ASSERT_TRUE(table.attach(0));
+    ASSERT_TRUE(other.attach(1));
+    addrmgr_->setLeaseTable(&table);
+
+    SPtr<TIPv6Addr> addr1 = new TIPv6Addr("2001:db8:1::1", true);
+    SPtr<TIPv6Addr> addr2 = new TIPv6Addr("2001:db8:1::2", true);
+    SPtr<TDUID> duid2 = new TDUID("00:01:00:0a:0b:0c:0d:0f");
+
+    // lease assigned here is visible to the other process
+    EXPECT_TRUE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, iface_->getID(), 1, 100, 200,
+                                      addr1, 300, 400, false));
+    TSrvLeaseTable::TLease found;
+    ASSERT_TRUE(other.find(IATYPE_IA, addr1, 128, found));
+    EXPECT_TRUE(*found.Duid == *clntDuid_);
+    EXPECT_EQ(0, found.Owner);
+
+    // lease assigned by the other process is not assigned again
+    TSrvLeaseTable::TLease lease = createLease("2001:db8:1::2", "00:01:00:0a:0b:0c:0d:0f",
+                                               7, iface_->getID());
+    ASSERT_TRUE(other.add(lease));
+    EXPECT_FALSE(addrmgr_->addrIsFree(addr2));
+    EXPECT_FALSE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, iface_->getID(), 1, 100, 200,
+                                       addr2, 300, 400, false));
+
+    // client moves to this process
+    EXPECT_FALSE(addrmgr_->getClient(duid2));
+    EXPECT_TRUE(addrmgr_->importClient(duid2));
+    EXPECT_FALSE(addrmgr_->importClient(duid2));
+    SPtr<TAddrClient> client = addrmgr_->getClient(duid2);
+    ASSERT_TRUE(client);
+    SPtr<TAddrIA> ia = client->getIA(7);
+    ASSERT_TRUE(ia);
+    EXPECT_TRUE(ia->getAddr(addr2));
+    EXPECT_TRUE(addrmgr_->getClient(addr2));
+    ASSERT_TRUE(table.find(IATYPE_IA, addr2, 128, found));
+    EXPECT_EQ(0, found.Owner);
+
+    // released leases are removed from the table
+    EXPECT_TRUE(addrmgr_->delClntAddr(duid2, 7, addr2, false));
+    EXPECT_FALSE(table.find(IATYPE_IA, addr2, 128, found));
+    EXPECT_TRUE(addrmgr_->delClntAddr(clntDuid_, 1, addr1, false));
+    EXPECT_EQ(0u, table.count());
+
+    addrmgr_->setLeaseTable(0);
+    other.close();
+    table.close();
+    unlink(TABLE_FILE);
+}
+
+TEST_F(ServerTest, LeaseTable_full) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:1::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    TSrvLeaseTable table, other;
+    unlink(TABLE_FILE);
+    if (!table.open(TABLE_FILE, 1) || !other.open(TABLE_FILE, 1)) {
+        cout << "Shared lease table not supported, test skipped." << endl;
+        return;
+    }
+    ASSERT_TRUE(table.attach(0));
+    ASSERT_TRUE(other.attach(1));
+    addrmgr_->setLeaseTable(&table);
+
+    // the only bucket is filled by the other process
+    for (int i = 0; i < SRVLEASETABLE_BUCKET_SLOTS; i++) {
+        char addr[64];
+        sprintf(addr, "2001:db8:1::2:%x", i);
+        ASSERT_TRUE(other.add(createLease(addr, "00:01:00:0a:0b:0c:0d:0f", 7,
+                                          iface_->getID())));
+    }
+
+    // lease that other processes would not see is not granted
+    SPtr<TIPv6Addr> addr = new TIPv6Addr("2001:db8:1::1", true);
+    EXPECT_FALSE(addrmgr_->addClntAddr(clntDuid_, clntAddr_, iface_->getID(), 1, 100, 200,
+                                       addr, 300, 400, false));
+    EXPECT_FALSE(addrmgr_->getClient(clntDuid_));
+    EXPECT_TRUE(addrmgr_->addrIsFree(addr));
+
+    addrmgr_->setLeaseTable(0);
+    other.close();
+    table.close();
+    unlink(TABLE_FILE);
+}
+
+TEST_F(ServerTest, LeaseTable_freeAddr) {
+
+    string cfg = "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:1::1-2001:db8:1::2 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    TSrvLeaseTable table, other;
+    unlink(TABLE_FILE);
+    if (!table.open(TABLE_FILE, 16) || !other.open(TABLE_FILE, 16)) {
+        cout << "Shared lease table not supported, test skipped." << endl;
+        return;
+    }
+    ASSERT_TRUE(table.attach(0));
+    ASSERT_TRUE(other.attach(1));
+    addrmgr_->setLeaseTable(&table);
+
+    cfgIface_->firstAddrClass();
+    SPtr<TSrvCfgAddrClass> ac = cfgIface_->getAddrClass();
+    ASSERT_TRUE(ac);
+    ASSERT_TRUE(ac->hasFreeMap());
+
+    // both addresses are leased by the other process
+    TSrvLeaseTable::TLease lease1 = createLease("2001:db8:1::1", "00:01:00:0a:0b:0c:0d:0f",
+                                                7, iface_->getID());
+    TSrvLeaseTable::TLease lease2 = createLease("2001:db8:1::2", "00:01:00:0a:0b:0c:0d:0f",
+                                                7, iface_->getID());
+    ASSERT_TRUE(other.add(lease1));
+    ASSERT_TRUE(other.add(lease2));
+    EXPECT_FALSE(ac->getFreeAddr());
+
+    // once released there, they are offered again
+    EXPECT_TRUE(other.del(IATYPE_IA, lease2.Addr, 128, lease2.Duid));
+    SPtr<TIPv6Addr> addr = ac->getFreeAddr();
+    ASSERT_TRUE(addr);
+    EXPECT_TRUE(*addr == *lease2.Addr);
+    ASSERT_TRUE(other.add(lease2));
+    EXPECT_TRUE(other.del(IATYPE_IA, lease1.Addr, 128, lease1.Duid));
+    addr = ac->getFreeAddr();
+    ASSERT_TRUE(addr);
+    EXPECT_TRUE(*addr == *lease1.Addr);
+
+    addrmgr_->setLeaseTable(0);
+    other.close();
+    table.close();
+    unlink(TABLE_FILE);
+}
+
+}
@@ -10,6 +10,7 @@
 #include "SrvIfaceMgr.h"
 #include "SrvCfgMgr.h"
 #include "SrvTransMgr.h"
+#include "SrvTxBuffers.h"
 #include "assign_utils.h"
 #include <gtest/gtest.h>
 
@@ -430,5 +431,62 @@ TEST_F(ServerTest, relaySelectSubnet) {
     EXPECT_EQ(cfgIface->getName(), "relay2");
 }
 
+// Checks that relay headers of a message relayed twice are stored properly
+// and that transmit buffers are reused
+TEST_F(ServerTest, relayNestedSend) {
+
+    string cfg = "guess-mode\n"
+                 "iface REPLACE_ME {\n"
+                 "  class { pool 2001:db8:1::/64 }\n"
+                 "}\n"
+                 "\n"
+                 "iface relay1 {"
+                 "  relay REPLACE_ME\n"
+                 "  interface-id 1234\n"
+                 "  class { pool 2001:db8:123::/64 }\n"
+                 "}\n";
+
+    ASSERT_TRUE( createMgrs(cfg) );
+
+    setIface("relay1");
+    clntAddr_ = SPtr<TIPv6Addr>(new TIPv6Addr("ff05::1:3", true));
+    SPtr<TSrvMsg> sol = (Ptr*)createSolicit();
+    sol->addOption((Ptr*)clntId_); // include client-id
+    sol->addOption((Ptr*)ia_); // include IA_NA
+
+    sol->setMsgType(RELAY_FORW_MSG);
+
+    TOptList echoOpts;
+    echoOpts.push_back(new TSrvOptInterfaceID(1234, NULL));
+    addRelayInfo("2001:db8:123::1", "fe80::1", 1, echoOpts);
+    echoOpts.clear();
+    addRelayInfo("2001:db8:123::2", "fe80::abcd", 0, echoOpts);
+    setRelayInfo(sol);
+
+    unsigned long allocated = 0;
+    for (int i = 0; i < 2; i++) {
+        sol->send(10000 + DHCPSERVER_PORT);
+        if (!i)
+            allocated = TSrvTxBuffers::getAllocated();
+
+        SPtr<TSrvMsg> received = SrvIfaceMgr().select(1);
+        ASSERT_TRUE(received);
+
+        vector<TSrvMsg::RelayInfo> rcvRelay = received->RelayInfo_;
+        ASSERT_EQ(2u, rcvRelay.size());
+        EXPECT_EQ(string("2001:db8:123::1"), rcvRelay[0].LinkAddr_->getPlain());
+        EXPECT_EQ(string("fe80::1"), rcvRelay[0].PeerAddr_->getPlain());
+        EXPECT_EQ(1, rcvRelay[0].Hop_);
+        EXPECT_EQ(1u, rcvRelay[0].EchoList_.size());
+        EXPECT_EQ(string("2001:db8:123::2"), rcvRelay[1].LinkAddr_->getPlain());
+        EXPECT_EQ(string("fe80::abcd"), rcvRelay[1].PeerAddr_->getPlain());
+        EXPECT_EQ(0u, rcvRelay[1].EchoList_.size());
+        EXPECT_TRUE(received->getOption(OPTION_IA_NA));
+    }
+
+    // the second message used the same buffer
+    EXPECT_EQ(allocated, TSrvTxBuffers::getAllocated());
+    EXPECT_LT(0u, TSrvTxBuffers::countFree());
+}
 
 }
@@ -0,0 +1,347 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * author: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "SrvScriptExecutor.h"
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const char * SCRIPT = "script-executor-test.sh";
+const char * OUTPUT = "script-executor-test.out";
+const char * DAEMON = "script-executor-test.py";
+const char * MARKER = "script-executor-test.crashed";
+const char * PYTHON = "/usr/bin/python3";
+
+/// creates script that logs its action and NAME variable, sleeps for
+/// SLEEP seconds (if set) and returns RC (if set)
+void createScript() {
+    ofstream script(SCRIPT);
+    script << "#!/bin/sh" << endl
+           << "echo \"$1 $NAME\" >> " << OUTPUT << endl
+           << "if [ -n \"$SLEEP\" ]; then /bin/sleep $SLEEP; fi" << endl
+           << "exit ${RC:-0}" << endl;
+    script.close();
+    chmod(SCRIPT, 0755);
+    unlink(OUTPUT);
+}
+
+/// creates hook daemon that logs action and NAME of every event and
+/// acknowledges it with RC (if set). Event with NAME=crash makes it exit
+/// without acknowledgement the first time it is received.
+///
+/// @return false if python is not available
+bool createDaemon() {
+    if (access(PYTHON, X_OK))
+        return false;
+    ofstream script(DAEMON);
+    script << "#!" << PYTHON << endl
+           << "import os, struct, sys" << endl
+           << "data = b''" << endl
+           << "while True:" << endl
+           << "    chunk = os.read(0, 65536)" << endl
+           << "    if not chunk:" << endl
+           << "        break" << endl
+           << "    data += chunk" << endl
+           << "    while len(data) >= 4:" << endl
+           << "        length = struct.unpack('!I', data[:4])[0]" << endl
+           << "        if len(data) < 4 + length:" << endl
+           << "            break" << endl
+           << "        fields = data[4:4 + length].decode().split('\\0')[:-1]" << endl
+           << "        data = data[4 + length:]" << endl
+           << "        env = dict(f.split('=', 1) for f in fields[1:])" << endl
+           << "        if env.get('NAME') == 'crash' and not os.path.exists('" << MARKER << "'):" << endl
+           << "            open('" << MARKER << "', 'w').close()" << endl
+           << "            sys.exit(1)" << endl
+           << "        with open('" << OUTPUT << "', 'a') as out:" << endl
+           << "            out.write(fields[0] + ' ' + env.get('NAME', '') + '\\n')" << endl
+           << "        os.write(1, struct.pack('!i', int(env.get('RC', '0'))))" << endl;
+    script.close();
+    chmod(DAEMON, 0755);
+    unlink(OUTPUT);
+    unlink(MARKER);
+    return true;
+}
+
+/// returns lines written by the script
+vector<string> readOutput() {
+    vector<string> lines;
+    ifstream out(OUTPUT);
+    string line;
+    while (getline(out, line))
+        lines.push_back(line);
+    return lines;
+}
+
+TSrvScriptExecutor::TJob * createJob(const string& action, const string& name,
+                                     const char * sleep = NULL, const char * rc = NULL) {
+    TNotifyScriptParams params;
+    params.addParam("NAME", name);
+    if (sleep)
+        params.addParam("SLEEP", sleep);
+    if (rc)
+        params.addParam("RC", rc);
+    return new TSrvScriptExecutor::TJob(string("./") + SCRIPT, action, params);
+}
+
+TSrvScriptExecutor::TJob * createEvent(const string& action, const string& name,
+                                       const char * rc = NULL) {
+    TSrvScriptExecutor::TJob * job = createJob(action, name, NULL, rc);
+    job->Script = string("./") + DAEMON;
+    return job;
+}
+
+unsigned long long now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/// completes scripts until there are no more pending (or 5 seconds pass)
+void waitForScripts(TSrvScriptExecutor& executor) {
+    unsigned long long end = now() + 5000;
+    while (executor.countPending() && now() < end) {
+        executor.processCompleted();
+        usleep(5000);
+    }
+    executor.processCompleted();
+}
+
+}
+
+namespace test {
+
+TEST(ScriptExecutorTest, synchronous) {
+    createScript();
+    TSrvScriptExecutor executor;
+
+    // thread is not running, so script is executed immediately
+    EXPECT_TRUE(executor.enqueue(createJob("add", "foo")));
+    EXPECT_TRUE(executor.enqueue(createJob("expire", "bar", NULL, "3")));
+    EXPECT_EQ(0u, executor.countPending());
+
+    vector<string> lines = readOutput();
+    ASSERT_EQ(2u, lines.size());
+    EXPECT_EQ("add foo", lines[0]);
+    EXPECT_EQ("expire bar", lines[1]);
+
+    TSrvScriptExecutor::TStats stats = executor.getStats();
+    EXPECT_EQ(2u, stats.Queued);
+    EXPECT_EQ(2u, stats.Executed);
+    EXPECT_EQ(1u, stats.Failed);
+    EXPECT_EQ(0u, stats.Dropped);
+}
+
+TEST(ScriptExecutorTest, background) {
+    createScript();
+    TSrvScriptExecutor executor;
+    if (!executor.start(2)) {
+        cout << "Script executor thread not supported, test skipped." << endl;
+        return;
+    }
+    EXPECT_TRUE(executor.isRunning());
+
+    // slow scripts do not delay the caller
+    unsigned long long start = now();
+    for (int i = 0; i < 4; i++)
+        EXPECT_TRUE(executor.enqueue(createJob("add", "slow", "0.2")));
+    EXPECT_GT(100u, now() - start);
+    EXPECT_EQ(4u, executor.countPending());
+
+    // two of them are executed at the same time
+    waitForScripts(executor);
+    EXPECT_EQ(0u, executor.countPending());
+    EXPECT_GT(700u, now() - start);
+    EXPECT_EQ(4u, readOutput().size());
+
+    TSrvScriptExecutor::TStats stats = executor.getStats();
+    EXPECT_EQ(4u, stats.Queued);
+    EXPECT_EQ(4u, stats.Executed);
+    EXPECT_EQ(0u, stats.Failed);
+    EXPECT_LE(150u, stats.MaxRun);
+    EXPECT_LE(150u, stats.MaxWait);
+
+    // queued scripts are executed before the thread stops
+    EXPECT_TRUE(executor.enqueue(createJob("delete", "last", "0.1", "1")));
+    executor.stop();
+    EXPECT_FALSE(executor.isRunning());
+    executor.processCompleted();
+    EXPECT_EQ(5u, executor.getStats().Executed);
+    EXPECT_EQ(1u, executor.getStats().Failed);
+    EXPECT_EQ(5u, readOutput().size());
+}
+
+TEST(ScriptExecutorTest, order) {
+    createScript();
+    TSrvScriptExecutor executor;
+    if (!executor.start(1)) {
+        cout << "Script executor thread not supported, test skipped." << endl;
+        return;
+    }
+
+    // one script at a time keeps them in order
+    const char * actions[] = { "add", "update", "delete", "expire" };
+    for (int i = 0; i < 4; i++)
+        EXPECT_TRUE(executor.enqueue(createJob(actions[i], "foo")));
+    waitForScripts(executor);
+
+    vector<string> lines = readOutput();
+    ASSERT_EQ(4u, lines.size());
+    for (int i = 0; i < 4; i++)
+        EXPECT_EQ(string(actions[i]) + " foo", lines[i]);
+}
+
+TEST(ScriptExecutorTest, overflow) {
+    createScript();
+    TSrvScriptExecutor executor;
+    if (!executor.start(1)) {
+        cout << "Script executor thread not supported, test skipped." << endl;
+        return;
+    }
+    executor.setMaxQueue(1);
+
+    // first script is running, second one waits in the queue
+    EXPECT_TRUE(executor.enqueue(createJob("add", "a", "0.2")));
+    usleep(50000);
+    EXPECT_TRUE(executor.enqueue(createJob("add", "b", "0.2")));
+
+    // new script is dropped
+    EXPECT_FALSE(executor.enqueue(createJob("add", "c")));
+    EXPECT_EQ(1u, executor.getStats().Dropped);
+
+    // oldest queued script is dropped
+    executor.setOverflow(TSrvScriptExecutor::OVERFLOW_DROP_OLDEST);
+    EXPECT_TRUE(executor.enqueue(createJob("add", "d")));
+    EXPECT_EQ(2u, executor.getStats().Dropped);
+
+    // caller waits until first script finishes
+    executor.setOverflow(TSrvScriptExecutor::OVERFLOW_WAIT);
+    unsigned long long start = now();
+    EXPECT_TRUE(executor.enqueue(createJob("add", "e")));
+    EXPECT_LE(100u, now() - start);
+    EXPECT_EQ(1u, executor.getStats().Waited);
+
+    waitForScripts(executor);
+    vector<string> lines = readOutput();
+    ASSERT_EQ(3u, lines.size());
+    EXPECT_EQ("add a", lines[0]);
+    EXPECT_EQ("add d", lines[1]);
+    EXPECT_EQ("add e", lines[2]);
+
+    TSrvScriptExecutor::TStats stats = executor.getStats();
+    EXPECT_EQ(4u, stats.Queued);
+    EXPECT_EQ(3u, stats.Executed);
+    EXPECT_EQ(2u, stats.Dropped);
+}
+
+TEST(ScriptExecutorTest, parseOverflow) {
+    TSrvScriptExecutor::EOverflow overflow;
+    EXPECT_TRUE(TSrvScriptExecutor::parseOverflow("drop", overflow));
+    EXPECT_EQ(TSrvScriptExecutor::OVERFLOW_DROP, overflow);
+    EXPECT_TRUE(TSrvScriptExecutor::parseOverflow("drop-oldest", overflow));
+    EXPECT_EQ(TSrvScriptExecutor::OVERFLOW_DROP_OLDEST, overflow);
+    EXPECT_TRUE(TSrvScriptExecutor::parseOverflow("wait", overflow));
+    EXPECT_EQ(TSrvScriptExecutor::OVERFLOW_WAIT, overflow);
+    EXPECT_FALSE(TSrvScriptExecutor::parseOverflow("block", overflow));
+}
+
+TEST(ScriptExecutorTest, daemon) {
+    TSrvScriptExecutor executor;
+    executor.setDaemon(16);
+    if (!createDaemon() || !executor.start(1)) {
+        cout << "Hook daemon not supported, test skipped." << endl;
+        return;
+    }
+
+    // all events go to one process, in order
+    const char * actions[] = { "add", "update", "delete", "expire" };
+    for (int i = 0; i < 100; i++) {
+        ostringstream name;
+        name << "host" << i;
+        EXPECT_TRUE(executor.enqueue(createEvent(actions[i % 4], name.str(),
+                                                 i == 42 ? "2" : NULL)));
+    }
+    waitForScripts(executor);
+
+    vector<string> lines = readOutput();
+    ASSERT_EQ(100u, lines.size());
+    for (int i = 0; i < 100; i++) {
+        ostringstream line;
+        line << actions[i % 4] << " host" << i;
+        EXPECT_EQ(line.str(), lines[i]);
+    }
+
+    TSrvScriptExecutor::TStats stats = executor.getStats();
+    EXPECT_EQ(100u, stats.Executed);
+    EXPECT_EQ(1u, stats.Failed);
+    EXPECT_EQ(1u, stats.Restarts);
+    EXPECT_LE(7u, stats.Batches);
+
+    executor.stop();
+    EXPECT_EQ(1u, executor.getStats().Restarts);
+}
+
+TEST(ScriptExecutorTest, daemonRestart) {
+    TSrvScriptExecutor executor;
+    executor.setDaemon(16);
+    if (!createDaemon() || !executor.start(1)) {
+        cout << "Hook daemon not supported, test skipped." << endl;
+        return;
+    }
+
+    // daemon exits, unacknowledged events are sent to a new one
+    EXPECT_TRUE(executor.enqueue(createEvent("add", "a")));
+    EXPECT_TRUE(executor.enqueue(createEvent("add", "crash")));
+    EXPECT_TRUE(executor.enqueue(createEvent("add", "b")));
+    waitForScripts(executor);
+
+    vector<string> lines = readOutput();
+    ASSERT_EQ(3u, lines.size());
+    EXPECT_EQ("add a", lines[0]);
+    EXPECT_EQ("add crash", lines[1]);
+    EXPECT_EQ("add b", lines[2]);
+
+    TSrvScriptExecutor::TStats stats = executor.getStats();
+    EXPECT_EQ(3u, stats.Executed);
+    EXPECT_EQ(0u, stats.Failed);
+    EXPECT_EQ(2u, stats.Restarts);
+}
+
+TEST(ScriptExecutorTest, daemonFailure) {
+    TSrvScriptExecutor executor;
+    executor.setDaemon(16);
+    if (!executor.start(1)) {
+        cout << "Hook daemon not supported, test skipped." << endl;
+        return;
+    }
+
+    // daemon that exits right away, events are sent twice and fail
+    for (int i = 0; i < 3; i++) {
+        TSrvScriptExecutor::TJob * job = createJob("add", "foo");
+        job->Script = "/bin/false";
+        EXPECT_TRUE(executor.enqueue(job));
+    }
+    waitForScripts(executor);
+
+    TSrvScriptExecutor::TStats stats = executor.getStats();
+    EXPECT_EQ(3u, stats.Executed);
+    EXPECT_EQ(3u, stats.Failed);
+    EXPECT_LE(2u, stats.Restarts);
+}
+
+}
@@ -0,0 +1,118 @@
+/*
+ * Dibbler - a portable DHCPv6
+ *
+ * author: Tomasz Mrugalski <thomson@klub.com.pl>
+ *
+ * released under GNU GPL v2 only licence
+ *
+ */
+
+#include <unistd.h>
+#include <net/if.h>
+#include "SrvIfaceMgr.h"
+#include "SocketIPv6.h"
+#include "Portable.h"
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace {
+
+/// opens socket bound to ::1 on loopback interface
+SPtr<TIfaceSocket> openSocket(int port) {
+    char lo[] = "lo";
+    return new TIfaceSocket(lo, if_nametoindex(lo), port,
+                            new TIPv6Addr("::1", true), false, false);
+}
+
+}
+
+namespace test {
+
+TEST(SocketModeTest, parseSocketMode) {
+    bool wildcard = false;
+    EXPECT_TRUE(TSrvIfaceMgr::parseSocketMode("wildcard", wildcard));
+    EXPECT_TRUE(wildcard);
+    EXPECT_TRUE(TSrvIfaceMgr::parseSocketMode("per-interface", wildcard));
+    EXPECT_FALSE(wildcard);
+
+    // invalid name does not change the mode
+    wildcard = true;
+    EXPECT_FALSE(TSrvIfaceMgr::parseSocketMode("single", wildcard));
+    EXPECT_FALSE(TSrvIfaceMgr::parseSocketMode("", wildcard));
+    EXPECT_TRUE(wildcard);
+}
+
+// multicast received by all server processes is split between them
+TEST(SocketModeTest, getShard) {
+    // SOLICIT with client-id
+    char direct[] = { SOLICIT_MSG, 1, 2, 3,
+                      0, OPTION_CLIENTID, 0, 4, 0, 3, 0x12, 0x34 };
+    // the same, relayed
+    char relayed[34 + 4 + sizeof(direct)];
+    memset(relayed, 0, sizeof(relayed));
+    relayed[0] = RELAY_FORW_MSG;
+    relayed[34 + 1] = OPTION_RELAY_MSG;
+    relayed[34 + 3] = sizeof(direct);
+    memcpy(relayed + 38, direct, sizeof(direct));
+
+    char peer1[16] = { 0 };
+    char peer2[16] = { 1 };
+
+    for (unsigned int shards = 1; shards < 16; shards++) {
+        unsigned int shard = TSrvIfaceMgr::getShard(direct, sizeof(direct), peer1, shards);
+        EXPECT_GT(shards, shard);
+        // sender address does not matter, if there's client-id
+        EXPECT_EQ(shard, TSrvIfaceMgr::getShard(direct, sizeof(direct), peer2, shards));
+        EXPECT_EQ(shard, TSrvIfaceMgr::getShard(relayed, sizeof(relayed), peer2, shards));
+    }
+
+    // no client-id (or truncated message), sender address is used
+    unsigned int shards = 0, differ = 0;
+    for (shards = 2; shards < 16; shards++) {
+        EXPECT_EQ(TSrvIfaceMgr::getShard(direct, 4, peer1, shards),
+                  TSrvIfaceMgr::getShard(relayed, 40, peer1, shards));
+        if (TSrvIfaceMgr::getShard(direct, 4, peer1, shards) !=
+            TSrvIfaceMgr::getShard(direct, 4, peer2, shards))
+            differ++;
+    }
+    EXPECT_LT(0u, differ);
+}
+
+TEST(SocketModeTest, reusePort) {
+    int port = 20000 + getpid() % 10000;
+
+#ifdef LINUX
+    bool supported = sock_reuseport_supported();
+#else
+    bool supported = false;
+#endif
+    EXPECT_EQ(supported, TIfaceSocket::setReusePort(true));
+    EXPECT_EQ(supported, TIfaceSocket::getReusePort());
+    if (!supported) {
+        // sockets are not shared, so a single server process is used
+        cout << "SO_REUSEPORT not supported, sharing sockets not tested." << endl;
+        EXPECT_TRUE(TIfaceSocket::setReusePort(false));
+        return;
+    }
+
+    // several processes may be bound to the same port
+    {
+        SPtr<TIfaceSocket> first = openSocket(port);
+        SPtr<TIfaceSocket> second = openSocket(port);
+        EXPECT_EQ(STATE_CONFIGURED, first->getStatus());
+        EXPECT_EQ(STATE_CONFIGURED, second->getStatus());
+    }
+
+    // but not without SO_REUSEPORT
+    EXPECT_TRUE(TIfaceSocket::setReusePort(false));
+    EXPECT_FALSE(TIfaceSocket::getReusePort());
+    {
+        SPtr<TIfaceSocket> first = openSocket(port);
+        SPtr<TIfaceSocket> second = openSocket(port);
+        EXPECT_EQ(STATE_CONFIGURED, first->getStatus());
+        EXPECT_EQ(STATE_FAILED, second->getStatus());
+    }
+}
+
+}